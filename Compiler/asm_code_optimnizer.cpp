@@ -1,37 +1,11 @@
 #include "asm_code_optimnizer.h"
+#include "asm_code_verifier.h"
 #include <vector>
 #include <memory>
 #include <algorithm>
-
-vector<int(*)(asm_cmd_list_ptr, int)> optimizers;
-
-shared_ptr<asm_operator_t> cast_to_op(asm_cmd_ptr cmd) {
-	return dynamic_pointer_cast<asm_operator_t>(cmd);
-}
-
-var_ptr cast_to_var(asm_oprnd_ptr op) {
-	return dynamic_pointer_cast<asm_const_oprnd_t>(op)->get_var();
-}
-
-shared_ptr<asm_reg_oprnd_t> cast_to_reg(asm_oprnd_ptr op) {
-	return dynamic_pointer_cast<asm_reg_oprnd_t>(op);
-}
-
-shared_ptr<asm_deref_reg_oprnd_t> cast_to_reg_deref(asm_oprnd_ptr op) {
-	return dynamic_pointer_cast<asm_deref_reg_oprnd_t>(op);
-}
-
-shared_ptr<asm_const_oprnd_t> new_const_oprnd(var_ptr var) {
-	return shared_ptr<asm_const_oprnd_t>(new asm_const_oprnd_t(var));
-}
-
-bool reg_used_in_oprnd(asm_oprnd_ptr op, asm_oprnd_ptr reg) {
-	return op ? op->like(reg) : false;
-}
-
-bool reg_used_in_oprnd(asm_oprnd_ptr op, ASM_REGISTER reg) {
-	return op ? op->like(reg) : false;
-}
+#include <chrono>
+#include <iomanip>
+#include <mutex>
 
 enum REG_USAGE {
 	RU_USED,
@@ -39,42 +13,37 @@ enum REG_USAGE {
 	RU_UNUSED
 };
 
-REG_USAGE check_reg_use(asm_cmd_ptr cmd, ASM_REGISTER reg) {
+REG_USAGE check_reg_use(const asm_cmd_t& cmd, ASM_REGISTER reg) {
 	if (cmd == ACT_LABEL)
-		RU_UNUSED;
+		return RU_UNUSED;
 	if (cmd == AO_CALL)
-		RU_UNUSED;
+		return RU_UNUSED;
 
 	if (cmd == AO_MOV &&
-		cast_to_op(cmd)->get_left()->like(reg) &&
-		cast_to_op(cmd)->get_left() != AOT_DEREF)
+		cmd.left.like(reg) &&
+		cmd.left != AOT_DEREF)
 		return RU_FREED;
 	if (cmd == AO_LEA &&
-		cast_to_op(cmd)->get_left()->like(reg))
+		cmd.left.like(reg))
 		return RU_FREED;
 	if (cmd == AO_XOR &&
-		cast_to_op(cmd)->get_left()->like(reg) &&
-		cast_to_op(cmd)->get_right()->like(reg))
+		cmd.left.like(reg) &&
+		cmd.right.like(reg))
 		return RU_FREED;
 	if (cmd == AO_POP &&
-		cast_to_op(cmd)->get_left()->like(reg))
+		cmd.left.like(reg))
 		return RU_FREED;
 
-	if (cmd == AO_RET && reg == AR_EAX)
-		return RU_USED;
-
-	if (reg_used_in_oprnd(cast_to_op(cmd)->get_left(), reg) ||
-		reg_used_in_oprnd(cast_to_op(cmd)->get_right(), reg))
-		return RU_USED;
+	return RU_USED;
 }
 
-bool unused_reg(asm_cmd_list_ptr cmd_list, int i, asm_oprnd_ptr reg) {
-	for (; i < cmd_list->_size(); i++) {
+bool unused_reg(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i, const asm_oprnd_t& reg) {
+	for (; i != cmd_list->_end(); ++i) {
 		if (cmd_list[i] == ACT_LABEL)
 			continue;
 		if (cmd_list[i] == AO_CALL)
 			return true;
-		REG_USAGE reg_usage = check_reg_use(cmd_list[i], cast_to_reg(reg)->get_reg());
+		REG_USAGE reg_usage = check_reg_use(cmd_list[i], reg.reg);
 		if (reg_usage == RU_UNUSED)
 			continue;
 		return reg_usage == RU_FREED;
@@ -82,18 +51,16 @@ bool unused_reg(asm_cmd_list_ptr cmd_list, int i, asm_oprnd_ptr reg) {
 	return true;
 }
 
-void erase_reg_from_set(set<ASM_REGISTER>& regs, asm_oprnd_ptr op) {
-	if (!op)
-		return;
+void erase_reg_from_set(set<ASM_REGISTER>& regs, const asm_oprnd_t& op) {
 	if (op == AOT_REG)
-		regs.erase(cast_to_reg(op)->get_reg());
+		regs.erase(op.reg);
 	else if (op == AOT_DEREF) {
-		regs.erase(cast_to_reg_deref(op)->get_reg());
-		regs.erase(cast_to_reg_deref(op)->get_offset_reg());
+		regs.erase(op.reg);
+		regs.erase(op.offset_reg);
 	}
 }
 
-ASM_REGISTER find_unused_reg_until_pop(asm_cmd_list_ptr cmd_list, int i) {
+ASM_REGISTER find_unused_reg_until_pop(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
 	set<ASM_REGISTER> regs;
 	regs.insert(AR_EAX);
 	regs.insert(AR_EBX);
@@ -101,7 +68,7 @@ ASM_REGISTER find_unused_reg_until_pop(asm_cmd_list_ptr cmd_list, int i) {
 	regs.insert(AR_EDX);
 	//regs.insert(AR_ESI);
 	//regs.insert(AR_EDI);
-	for (; i < cmd_list->_size(); i++) {
+	for (; i != cmd_list->_end(); ++i) {
 		if (cmd_list[i] == ACT_LABEL)
 			continue;
 		if (cmd_list[i] == AO_CALL)
@@ -112,21 +79,19 @@ ASM_REGISTER find_unused_reg_until_pop(asm_cmd_list_ptr cmd_list, int i) {
 	return regs.empty() ? AR_NONE : *regs.begin();
 }
 
-void replace_reg_in_operand(asm_oprnd_ptr op, ASM_REGISTER from, ASM_REGISTER to) {
-	if (!op)
-		return;
-	if (op == AOT_REG && cast_to_reg(op)->get_reg() == from)
-		cast_to_reg(op)->set_reg(to);
+void replace_reg_in_operand(asm_oprnd_t& op, ASM_REGISTER from, ASM_REGISTER to) {
+	if (op == AOT_REG && op.reg == from)
+		op.reg = to;
 	else if (op == AOT_DEREF) {
-		if (cast_to_reg_deref(op)->get_reg() == from)
-			cast_to_reg_deref(op)->set_reg(to);
-		if (cast_to_reg_deref(op)->get_offset_reg() == from)
-			cast_to_reg_deref(op)->set_offset_reg(to);
+		if (op.reg == from)
+			op.reg = to;
+		if (op.offset_reg == from)
+			op.offset_reg = to;
 	}
 }
 
-void replace_register(asm_cmd_list_ptr cmd_list, int i, ASM_REGISTER from, ASM_REGISTER to) {
-	for (; i < cmd_list->_size(); i++) {
+void replace_register(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i, ASM_REGISTER from, ASM_REGISTER to) {
+	for (; i != cmd_list->_end(); ++i) {
 		if (cmd_list[i] == ACT_LABEL)
 			continue;
 		if (cmd_list[i] == AO_CALL)
@@ -138,8 +103,8 @@ void replace_register(asm_cmd_list_ptr cmd_list, int i, ASM_REGISTER from, ASM_R
 	}
 }
 
-void replace_reg_to_operand(asm_cmd_list_ptr cmd_list, int i, ASM_REGISTER from, asm_oprnd_ptr to) {
-	for (; i < cmd_list->_size(); i++) {
+void replace_reg_to_operand(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i, ASM_REGISTER from, const asm_oprnd_t& to) {
+	for (; i != cmd_list->_end(); ++i) {
 		if (cmd_list[i] == ACT_LABEL)
 			continue;
 		if (cmd_list[i] == AO_CALL)
@@ -147,89 +112,123 @@ void replace_reg_to_operand(asm_cmd_list_ptr cmd_list, int i, ASM_REGISTER from,
 		if (check_reg_use(cmd_list[i], from) == RU_FREED)
 			return;
 
-		if (cmd_list->get_op(i)->get_left() && 
-			cmd_list->get_op(i)->get_left() == AOT_REG &&
-			cmd_list->get_op(i)->get_left()->like(from))
+		if (cmd_list->get_op(i)->get_left() == AOT_REG &&
+			cmd_list->get_op(i)->get_left().like(from))
 				cmd_list->get_op(i)->set_left(to);
 		
-		if (cmd_list->get_op(i)->get_right() &&
-			cmd_list->get_op(i)->get_right() == AOT_REG &&
-			cmd_list->get_op(i)->get_right()->like(from))
+		if (cmd_list->get_op(i)->get_right() == AOT_REG &&
+			cmd_list->get_op(i)->get_right().like(from))
 				cmd_list->get_op(i)->set_right(to);
 	}
 }
 
-void combine_reg_derefs(asm_oprnd_ptr src, asm_oprnd_ptr add, ASM_REGISTER reg) {
+void combine_reg_derefs(asm_oprnd_t& src, const asm_oprnd_t& add, ASM_REGISTER reg) {
 	if (src != AOT_DEREF || add != AOT_DEREF)
 		return;
-	auto src_d = cast_to_reg_deref(src);
-	auto add_d = cast_to_reg_deref(add);
-	src_d->add_offset(add_d->get_offset());
-	if (src_d->get_reg() == reg)
-		src_d->set_reg(add_d->get_reg());
-	if (src_d->get_offset_reg() == reg)
-		src_d->set_offset_reg(add_d->get_offset_reg());
+	if (src.reg != reg && src.offset_reg != reg)
+		return;
+	src.offset += add.offset;
+	if (src.reg == reg)
+		src.reg = add.reg;
+	if (src.offset_reg == reg)
+		src.offset_reg = add.offset_reg;
 }
 
-void combine_all_reg_derefs(asm_cmd_list_ptr cmd_list, int i, ASM_REGISTER reg, asm_oprnd_ptr deref) {
-	for (; i < cmd_list->_size(); i++) {
-		if (cmd_list[i] == ACT_LABEL)
-			continue;
-		if (cmd_list[i] == AO_CALL)
-			return;
-
-		if (cmd_list[i] == AO_MOV &&
-			cmd_list->get_op(i)->get_left() == AOT_REG &&
-			cmd_list->get_op(i)->get_left()->like(reg) &&
-			cmd_list->get_op(i)->get_right() == AOT_DEREF &&
-			(cast_to_reg_deref(cmd_list->get_op(i)->get_right())->get_reg() == reg ||
-			cast_to_reg_deref(cmd_list->get_op(i)->get_right())->get_offset_reg() == reg))
-		{
-			combine_reg_derefs(cmd_list->get_op(i)->get_right(), deref, reg);
-			return;
+REG_USAGE check_reg_access(const asm_cmd_t& cmd, ASM_REGISTER reg) {
+	if (cmd == ACT_STR)
+		return RU_USED;
+	if (cmd == ACT_LABEL)
+		return RU_UNUSED;
+	if (cmd == AO_CALL)
+		return reg == AR_EAX || reg == AR_ECX || reg == AR_EDX ? RU_FREED : RU_UNUSED;
+	if (cmd == AO_RET)
+		return reg == AR_EAX ? RU_USED : RU_FREED;
+	if (cmd == AO_SAHF || cmd == AO_DIV || cmd == AO_IMUL && cmd.right == AOT_NONE)
+		if (reg == AR_EAX || reg == AR_EDX)
+			return RU_USED;
+
+	asm_oprnd_t reg_oprnd = asm_oprnd_t::make_reg(reg);
+	if (cmd.left == AOT_DEREF && cmd.left.like(reg_oprnd) ||
+		cmd.right.like(reg_oprnd))
+		return RU_USED;
+	if (!cmd.left.like(reg))
+		return RU_UNUSED;
+	if ((cmd == AO_MOV || cmd == AO_LEA || cmd == AO_POP ||
+		cmd == AO_XOR && cmd.right == cmd.left) &&
+		cmd.left == reg)
+		return RU_FREED;
+	return RU_USED;
+}
+
+bool dead_reg(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i, ASM_REGISTER reg) {
+	reg = asm_gen_t::parent_of(reg);
+	map<int, asm_cmd_iter_t> labels;
+	for (asm_cmd_iter_t j = cmd_list->_begin(); j != cmd_list->_end(); ++j)
+		if (cmd_list[j] == ACT_LABEL)
+			labels[j->left.label] = j;
+	set<int> visited;
+	vector<asm_cmd_iter_t> paths;
+	paths.push_back(i);
+	while (!paths.empty()) {
+		asm_cmd_iter_t j = paths.back();
+		paths.pop_back();
+		for (; j != cmd_list->_end() && visited.insert(j.get_node()).second; ++j) {
+			REG_USAGE reg_usage = check_reg_access(*j, reg);
+			if (reg_usage == RU_USED)
+				return false;
+			if (reg_usage == RU_FREED)
+				break;
+			if (j->left == AOT_LABEL) {
+				if (!labels.count(j->left.label))
+					return false;
+				paths.push_back(labels[j->left.label]);
+				if (cmd_list[j] == AO_JMP)
+					break;
+			}
 		}
-
-		if (check_reg_use(cmd_list[i], reg) == RU_FREED)
-			return;
-
-		if (cmd_list->get_op(i)->get_left() &&
-			cmd_list->get_op(i)->get_left() == AOT_DEREF &&
-			(cast_to_reg_deref(cmd_list->get_op(i)->get_left())->get_reg() == reg ||
-			cast_to_reg_deref(cmd_list->get_op(i)->get_left())->get_offset_reg() == reg))
-				combine_reg_derefs(cmd_list->get_op(i)->get_left(), deref, reg);
-
-		if (cmd_list->get_op(i)->get_right() &&
-			cmd_list->get_op(i)->get_right() == AOT_DEREF &&
-			(cast_to_reg_deref(cmd_list->get_op(i)->get_right())->get_reg() == reg ||
-			cast_to_reg_deref(cmd_list->get_op(i)->get_right())->get_offset_reg() == reg))
-				combine_reg_derefs(cmd_list->get_op(i)->get_right(), deref, reg);
+		if (j == cmd_list->_end() && reg == AR_EAX)
+			return false;
 	}
+	return true;
 }
 
-bool used_only_as_deref_base(asm_cmd_list_ptr cmd_list, int i, ASM_REGISTER reg) {
-	for (; i < cmd_list->_size(); i++) {
+bool unused_flags(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	for (; i != cmd_list->_end(); ++i) {
 		if (cmd_list[i] == ACT_LABEL)
 			continue;
-		if (cmd_list[i] == AO_CALL)
-			return true;
-		if (cmd_list[i] == AO_RET && reg == AR_EAX)
-			return false;
-		if (check_reg_use(cmd_list[i], reg) == RU_FREED)
-			return true;
-		if (cmd_list->get_op(i)->get_left() &&
-			cmd_list->get_op(i)->get_left() != AOT_DEREF &&
-			cmd_list->get_op(i)->get_left()->like(reg))
-			return false;
-		if (cmd_list->get_op(i)->get_right() &&
-			cmd_list->get_op(i)->get_right() != AOT_DEREF &&
-			cmd_list->get_op(i)->get_right()->like(reg))
-			return false;
+		return
+			cmd_list[i] == AO_CALL ||
+			cmd_list[i] == AO_ADD ||
+			cmd_list[i] == AO_SUB ||
+			cmd_list[i] == AO_CMP ||
+			cmd_list[i] == AO_TEST ||
+			cmd_list[i] == AO_XOR ||
+			cmd_list[i] == AO_AND ||
+			cmd_list[i] == AO_OR ||
+			cmd_list[i] == AO_NEG;
 	}
 	return true;
 }
 
-int o1(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 2)
+int checked_rewrite(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i, int n, const vector<asm_cmd_t>& rewrite, ASM_REGISTER dead_reg) {
+	vector<asm_cmd_t> window;
+	asm_cmd_iter_t end = i;
+	for (; n > 0; n--, ++end)
+		window.push_back(*end);
+	if (!asm_equivalent(window, rewrite, dead_reg, unused_flags(cmd_list, end)))
+		return 0;
+	for each (auto& cmd in rewrite) {
+		i->set_op(cmd.op);
+		i->set_left(cmd.left);
+		i->set_right(cmd.right);
+		++i;
+	}
+	cmd_list->_erase(i, end);
+	return window.size() - rewrite.size();
+}
+
+int o1(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 2))
 		return 0;
 	if (cmd_list[i] == AO_MOV &&
 		cmd_list[i + 1] == AO_PUSH &&
@@ -243,8 +242,8 @@ int o1(asm_cmd_list_ptr cmd_list, int i) {
 	return 0;
 }
 
-int o2(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 3)
+int o2(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 3))
 		return 0;
 	if (cmd_list[i] == AO_PUSH &&
 		(cmd_list[i + 1] != AO_PUSH && cmd_list[i + 1] != AO_POP) &&
@@ -259,12 +258,12 @@ int o2(asm_cmd_list_ptr cmd_list, int i) {
 	return 0;
 }
 
-int o3(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 1)
+int o3(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 1))
 		return 0;
 	if ((cmd_list[i] == AO_ADD || cmd_list[i] == AO_SUB) &&
-		cmd_list->get_op(i)->get_right() == AOT_VAR &&
-		cast_to_var(cmd_list->get_op(i)->get_right())->is_null())
+		cmd_list->get_op(i)->get_right() == AOT_IMM &&
+		cmd_list->get_op(i)->get_right().imm == 0)
 	{
 		cmd_list->_erase(i);
 		return 1;
@@ -272,8 +271,8 @@ int o3(asm_cmd_list_ptr cmd_list, int i) {
 	return 0;
 }
 
-int o4(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 3)
+int o4(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 3))
 		return 0;
 	if (cmd_list[i] == AO_MOV &&
 		cmd_list[i+1] == AO_MOV &&
@@ -289,20 +288,20 @@ int o4(asm_cmd_list_ptr cmd_list, int i) {
 	return 0;
 }
 
-int o5(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 3)
+int o5(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 3))
 		return 0;
 	if (cmd_list[i] == AO_MOV &&
 		cmd_list[i + 1] == AO_XOR &&
 		cmd_list[i + 2] == AO_MOV &&
 		cmd_list->get_op(i)->get_left() == AOT_REG &&
-		cmd_list->get_op(i)->get_right() == AOT_VAR &&
+		cmd_list->get_op(i)->get_right() == AOT_IMM &&
 		cmd_list->get_op(i + 1)->get_left() == cmd_list->get_op(i + 1)->get_right() &&
-		cmd_list->get_op(i)->get_left()->like(cmd_list->get_op(i + 2)->get_right()) && 
-		cmd_list->get_op(i+1)->get_left()->like(cmd_list->get_op(i + 2)->get_left()))
+		cmd_list->get_op(i)->get_left().like(cmd_list->get_op(i + 2)->get_right()) && 
+		cmd_list->get_op(i+1)->get_left().like(cmd_list->get_op(i + 2)->get_left()))
 	{
 		cmd_list->get_op(i)->set_left(cmd_list->get_op(i+1)->get_left());
-		cmd_list->get_op(i)->set_right(new_const_oprnd(var_cast<int>(cast_to_var(cmd_list->get_op(i)->get_right())) % new_var<int>(256)));
+		cmd_list->get_op(i)->set_right(asm_oprnd_t::make_imm(cmd_list->get_op(i)->get_right().imm % 256));
 		cmd_list->_erase(i+1);
 		cmd_list->_erase(i+1);
 		return 2;
@@ -310,14 +309,14 @@ int o5(asm_cmd_list_ptr cmd_list, int i) {
 	return 0;
 }
 
-int o6(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 2)
+int o6(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 2))
 		return 0;
 	if (cmd_list[i] == AO_MOV &&
 		(cmd_list[i + 1] == AO_MOV || cmd_list[i + 1] == AO_ADD || cmd_list[i + 1] == AO_SUB) &&
 		cmd_list->get_op(i)->get_left() == AOT_REG &&
-		cmd_list->get_op(i)->get_right() == AOT_VAR &&
-		cmd_list->get_op(i)->get_left()->like(cmd_list->get_op(i + 1)->get_right()) &&
+		(cmd_list->get_op(i)->get_right() == AOT_IMM || cmd_list->get_op(i)->get_right() == AOT_VAR) &&
+		cmd_list->get_op(i)->get_left().like(cmd_list->get_op(i + 1)->get_right()) &&
 		unused_reg(cmd_list, i + 2, cmd_list->get_op(i)->get_left()))
 	{
 		cmd_list->get_op(i+1)->set_right(cmd_list->get_op(i)->get_right());
@@ -327,8 +326,8 @@ int o6(asm_cmd_list_ptr cmd_list, int i) {
 	return 0;
 }
 
-int o7(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 6)
+int o7(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 6))
 		return 0;
 	if (cmd_list[i] == AO_CMP &&
 		cmd_list[i + 2] == AO_XOR &&
@@ -361,7 +360,7 @@ int o7(asm_cmd_list_ptr cmd_list, int i) {
 				AO_JAE);
 		}
 		cmd_list->get_op(i + 1)->set_left(cmd_list->get_op(i + 5)->get_left());
-		cmd_list->get_op(i + 1)->set_right(nullptr);
+		cmd_list->get_op(i + 1)->set_right(asm_oprnd_t());
 		cmd_list->_erase(i + 2);
 		cmd_list->_erase(i + 2);
 		cmd_list->_erase(i + 2);
@@ -371,8 +370,8 @@ int o7(asm_cmd_list_ptr cmd_list, int i) {
 	return 0;
 }
 
-int o8(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 2)
+int o8(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 2))
 		return 0;
 	if (cmd_list[i] == AO_LEA &&
 		cmd_list[i + 1] == AO_MOV &&
@@ -386,18 +385,18 @@ int o8(asm_cmd_list_ptr cmd_list, int i) {
 	return 0;
 }
 
-int o9(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 3)
+int o9(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 3))
 		return 0;
 	if (cmd_list[i] == AO_MOV &&
 		cmd_list[i + 1] == AO_XOR &&
 		cmd_list[i + 2] == AO_MOV &&
-		cmd_list->get_op(i)->get_left()->like(cmd_list->get_op(i + 2)->get_right()) &&
-		cmd_list->get_op(i + 1)->get_left()->like(cmd_list->get_op(i + 2)->get_left()) &&
+		cmd_list->get_op(i)->get_left().like(cmd_list->get_op(i + 2)->get_right()) &&
+		cmd_list->get_op(i + 1)->get_left().like(cmd_list->get_op(i + 2)->get_left()) &&
 		cmd_list->get_op(i)->get_right() == AOT_DEREF &&
-		!cmd_list->get_op(i)->get_right()->like(cmd_list->get_op(i + 1)->get_left()))
+		!cmd_list->get_op(i)->get_right().like(cmd_list->get_op(i + 1)->get_left()))
 	{
-		cast_to_reg_deref(cmd_list->get_op(i)->get_right())->set_op_size(cast_to_reg(cmd_list->get_op(i + 2)->get_left())->get_size());
+		cmd_list->get_op(i)->get_right().set_op_size(cmd_list->get_op(i + 2)->get_left().get_size());
 		cmd_list->get_op(i + 2)->set_right(cmd_list->get_op(i)->get_right());
 		cmd_list->_erase(i);
 		return 1;
@@ -405,20 +404,20 @@ int o9(asm_cmd_list_ptr cmd_list, int i) {
 	return 0;
 }
 
-int o10(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 2)
+int o10(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 2))
 		return 0;
 	if (cmd_list[i] == AO_LEA) {
-		int j;
+		asm_cmd_iter_t j;
 		bool erased = false;
-		for (j = i + 1; j < cmd_list->_size() &&
+		for (j = i + 1; j != cmd_list->_end() &&
 			(cmd_list[j] == AO_MOV || cmd_list[j] == AO_PUSH) &&
-			cmd_list->get_op(j)->get_left()->like(cmd_list->get_op(i)->get_left()) &&
+			cmd_list->get_op(j)->get_left().like(cmd_list->get_op(i)->get_left()) &&
 			cmd_list->get_op(j)->get_left() == AOT_DEREF &&
-			cmd_list->get_op(j)->get_right() != AOT_DEREF; j++) 
+			cmd_list->get_op(j)->get_right() != AOT_DEREF; ++j) 
 		{
-			cast_to_reg_deref(cmd_list->get_op(j)->get_left())->add_offset(cast_to_reg_deref(cmd_list->get_op(i)->get_right())->get_offset());
-			cast_to_reg_deref(cmd_list->get_op(j)->get_left())->set_reg(cast_to_reg_deref(cmd_list->get_op(i)->get_right())->get_reg());
+			cmd_list->get_op(j)->get_left().offset += cmd_list->get_op(i)->get_right().offset;
+			cmd_list->get_op(j)->get_left().reg = cmd_list->get_op(i)->get_right().reg;
 			erased = true;
 		}
 		if (erased)
@@ -428,8 +427,8 @@ int o10(asm_cmd_list_ptr cmd_list, int i) {
 	return 0;
 }
 
-int o11(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 1)
+int o11(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 1))
 		return 0;
 	if (cmd_list[i] == AO_XOR &&
 		cmd_list->get_op(i + 1)->get_left() == cmd_list->get_op(i + 1)->get_right() &&
@@ -441,30 +440,27 @@ int o11(asm_cmd_list_ptr cmd_list, int i) {
 	return 0;
 }
 
-int o12(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 2)
+int o12(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 2))
 		return 0;
 	if (cmd_list[i] == AO_MOV &&
 		cmd_list[i + 1] == AO_MOV &&
+		cmd_list->get_op(i)->get_left() == AOT_REG &&
 		cmd_list->get_op(i)->get_right() == AOT_DEREF &&
 		cmd_list->get_op(i + 1)->get_left() == AOT_REG &&
-		cmd_list->get_op(i)->get_left()->like(cmd_list->get_op(i + 1)->get_right()) &&
-		!cmd_list->get_op(i)->get_right()->like(cmd_list->get_op(i)->get_left()) &&
-		unused_reg(cmd_list, i + 2, cmd_list->get_op(i)->get_left())) 
+		cmd_list->get_op(i)->get_left().like(cmd_list->get_op(i + 1)->get_right()) &&
+		dead_reg(cmd_list, i + 2, cmd_list->get_op(i)->get_left().reg)) 
 	{
-		asm_oprnd_ptr moved_to_reg = cmd_list->get_op(i)->get_left();
-		cast_to_reg_deref(cmd_list->get_op(i)->get_right())->set_op_size(cast_to_reg(cmd_list->get_op(i + 1)->get_left())->get_size());
-		cmd_list->get_op(i + 1)->set_right(cmd_list->get_op(i)->get_right());
-		cmd_list->get_op(i)->set_op(AO_XOR);
-		cmd_list->get_op(i)->set_left(moved_to_reg);
-		cmd_list->get_op(i)->set_right(moved_to_reg);
-		return 0;
+		asm_cmd_t load = *cmd_list->get_op(i + 1);
+		load.set_right(cmd_list->get_op(i)->get_right());
+		load.get_right().set_op_size(load.get_left().get_size());
+		return checked_rewrite(cmd_list, i, 2, { load }, cmd_list->get_op(i)->get_left().reg);
 	}
 	return 0;
 }
 
-int o13(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 2)
+int o13(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 2))
 		return 0;
 	if (cmd_list[i] == AO_MOV &&
 		cmd_list[i + 1] == AO_MOV &&
@@ -473,144 +469,477 @@ int o13(asm_cmd_list_ptr cmd_list, int i) {
 		cmd_list->get_op(i)->get_right() == AOT_REG &&
 		cmd_list->get_op(i)->get_left() != AR_EBP &&
 		cmd_list->get_op(i)->get_right() == AR_ESP &&
-		cast_to_reg_deref(cmd_list->get_op(i + 1)->get_left())->like(cmd_list->get_op(i)->get_left()) &&
+		cmd_list->get_op(i + 1)->get_left().like(cmd_list->get_op(i)->get_left()) &&
 		unused_reg(cmd_list, i + 2, cmd_list->get_op(i)->get_right())) 
 	{
-		cast_to_reg_deref(cmd_list->get_op(i + 1)->get_left())->set_reg(cast_to_reg(cmd_list->get_op(i)->get_right())->get_reg());
+		cmd_list->get_op(i + 1)->get_left().reg = cmd_list->get_op(i)->get_right().reg;
 		cmd_list->_erase(i);
 		return 1;
 	}
 	return 0;
 }
 
-int o14(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 2)
+int o14(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 2))
 		return 0;
 	if (cmd_list[i + 0] == AO_ADD &&
 		cmd_list[i + 1] == AO_MOV &&
 		cmd_list->get_op(i)->get_left() == AOT_REG &&
 		cmd_list->get_op(i)->get_right() == AOT_REG &&
 		cmd_list->get_op(i + 1)->get_left() == AOT_DEREF &&
-		cmd_list->get_op(i)->get_left() == cast_to_reg_deref(cmd_list->get_op(i + 1)->get_left())->get_reg() &&
-		unused_reg(cmd_list, i + 2, cmd_list->get_op(i)->get_left()))
+		cmd_list->get_op(i + 1)->get_left().offset_reg == AR_NONE &&
+		cmd_list->get_op(i)->get_left() == cmd_list->get_op(i + 1)->get_left().reg &&
+		dead_reg(cmd_list, i + 2, cmd_list->get_op(i)->get_left().reg))
 	{
-		cast_to_reg_deref(cmd_list->get_op(i + 1)->get_left())->set_reg(cast_to_reg(cmd_list->get_op(i)->get_right())->get_reg());
-		cmd_list->_erase(i);
-		return 1;
+		asm_cmd_t store = *cmd_list->get_op(i + 1);
+		store.get_left().offset_reg = cmd_list->get_op(i)->get_right().reg;
+		return checked_rewrite(cmd_list, i, 2, { store }, cmd_list->get_op(i)->get_left().reg);
 	}
 	return 0;
 }
 
-int o15(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 2)
+int o15(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 2))
 		return 0;
 	int var_val;
 	if (cmd_list[i] == AO_IMUL &&
 		cmd_list[i + 1] == AO_MOV &&
 		cmd_list->get_op(i)->get_left() == AOT_REG &&
-		cmd_list->get_op(i)->get_right() == AOT_VAR &&
+		cmd_list->get_op(i)->get_right() == AOT_IMM &&
 		cmd_list->get_op(i + 1)->get_left() == AOT_DEREF &&
-		((var_val = var_pointer_cast<int>(cast_to_var(cmd_list->get_op(i)->get_right()))->get_val()) == 1 ||
+		((var_val = cmd_list->get_op(i)->get_right().imm) == 1 ||
 		(var_val == 2) || (var_val == 4) || (var_val == 8)) &&
-		cmd_list->get_op(i)->get_left() == cast_to_reg_deref(cmd_list->get_op(i + 1)->get_left())->get_reg() &&
+		cmd_list->get_op(i)->get_left() == cmd_list->get_op(i + 1)->get_left().reg &&
 		unused_reg(cmd_list, i + 2, cmd_list->get_op(i)->get_left())) 
 	{
-		ASM_REGISTER base_reg = cast_to_reg_deref(cmd_list->get_op(i + 1)->get_left())->get_reg();
-		cast_to_reg_deref(cmd_list->get_op(i + 1)->get_left())->set_reg(cast_to_reg_deref(cmd_list->get_op(i + 1)->get_left())->get_offset_reg());
-		cast_to_reg_deref(cmd_list->get_op(i + 1)->get_left())->set_offset_reg(base_reg);
-		cast_to_reg_deref(cmd_list->get_op(i + 1)->get_left())->set_scale(var_val);
+		ASM_REGISTER base_reg = cmd_list->get_op(i + 1)->get_left().reg;
+		cmd_list->get_op(i + 1)->get_left().reg = cmd_list->get_op(i + 1)->get_left().offset_reg;
+		cmd_list->get_op(i + 1)->get_left().offset_reg = base_reg;
+		cmd_list->get_op(i + 1)->get_left().scale = var_val;
 		cmd_list->_erase(i);
 		return 1;
 	}
 	return 0;
 }
 
-int o16(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 2)
+int o16(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 2))
 		return 0;
 	int var_val;
 	if (cmd_list[i] == AO_LEA &&
 		cmd_list[i + 1] == AO_LEA &&
-		cast_to_reg(cmd_list->get_op(i+1)->get_left())->get_reg() == cast_to_reg_deref(cmd_list->get_op(i + 1)->get_right())->get_reg())
+		cmd_list->get_op(i+1)->get_left().reg == cmd_list->get_op(i + 1)->get_right().reg)
 	{
-		cast_to_reg_deref(cmd_list->get_op(i)->get_right())->add_offset(cast_to_reg_deref(cmd_list->get_op(i + 1)->get_right())->get_offset());
+		cmd_list->get_op(i)->get_right().offset += cmd_list->get_op(i + 1)->get_right().offset;
 		cmd_list->_erase(i + 1);
 		return 1;
 	}
 	return 0;
 }
 
-int o17(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 3)
+int o17(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 2))
 		return 0;
-	if (cmd_list[i] != AO_XOR &&
-		cmd_list[i + 1] == AO_MOV &&
-		cmd_list[i + 2] == AO_MOV &&
+	if (cmd_list[i] == AO_MOV &&
+		(cmd_list[i + 1] == AO_ADD || cmd_list[i + 1] == AO_SUB || cmd_list[i + 1] == AO_IMUL ||
+		cmd_list[i + 1] == AO_AND || cmd_list[i + 1] == AO_OR || cmd_list[i + 1] == AO_XOR ||
+		cmd_list[i + 1] == AO_CMP) &&
+		cmd_list->get_op(i)->get_left() == AOT_REG &&
 		cmd_list->get_op(i)->get_right() == AOT_DEREF &&
 		cmd_list->get_op(i + 1)->get_left() == AOT_REG &&
-		cmd_list->get_op(i)->get_left()->like(cmd_list->get_op(i + 1)->get_right()) &&
-		!cmd_list->get_op(i)->get_right()->like(cmd_list->get_op(i)->get_left()) &&
-		unused_reg(cmd_list, i + 2, cmd_list->get_op(i)->get_left()))
+		cmd_list->get_op(i)->get_left().like(cmd_list->get_op(i + 1)->get_right()) &&
+		dead_reg(cmd_list, i + 2, cmd_list->get_op(i)->get_left().reg))
 	{
-		asm_oprnd_ptr moved_to_reg = cmd_list->get_op(i)->get_left();
-		cast_to_reg_deref(cmd_list->get_op(i)->get_right())->set_op_size(cast_to_reg(cmd_list->get_op(i + 1)->get_left())->get_size());
-		cmd_list->get_op(i + 1)->set_right(cmd_list->get_op(i)->get_right());
-		cmd_list->get_op(i)->set_op(AO_XOR);
-		cmd_list->get_op(i)->set_left(moved_to_reg);
-		cmd_list->get_op(i)->set_right(moved_to_reg);
-		return 0;
+		asm_cmd_t op = *cmd_list->get_op(i + 1);
+		op.set_right(cmd_list->get_op(i)->get_right());
+		op.get_right().set_op_size(op.get_left().get_size());
+		return checked_rewrite(cmd_list, i, 2, { op }, cmd_list->get_op(i)->get_left().reg);
 	}
 	return 0;
 }
 
-int o18(asm_cmd_list_ptr cmd_list, int i) {
-	if (cmd_list->_size() - i < 1)
+int o18(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!cmd_list->_has(i, 2))
 		return 0;
-	if (cmd_list[i] == AO_LEA &&
-		used_only_as_deref_base(cmd_list, i + 1, cast_to_reg(cmd_list->get_op(i)->get_left())->get_reg())) 
-	{
-		combine_all_reg_derefs(cmd_list, i + 1, cast_to_reg(cmd_list->get_op(i)->get_left())->get_reg(), cmd_list->get_op(i)->get_right());
-		cmd_list->_erase(i);
-		return 1;
+	if (cmd_list[i] != AO_LEA ||
+		cmd_list->get_op(i)->get_left() != AOT_REG)
+		return 0;
+	ASM_REGISTER reg = cmd_list->get_op(i)->get_left().reg;
+	asm_oprnd_t deref = cmd_list->get_op(i)->get_right();
+	vector<asm_cmd_t> rewrite;
+	asm_cmd_iter_t j = i + 1;
+	int n = 1;
+	for (; j != cmd_list->_end() && cmd_list[j] == ACT_OPERATOR; ++j, n++) {
+		if (cmd_list[j] == AO_CALL || cmd_list[j] == AO_RET || cmd_list->get_op(j)->get_left() == AOT_LABEL)
+			break;
+		asm_cmd_t cmd = *j;
+		combine_reg_derefs(cmd.get_right(), deref, reg);
+		if (check_reg_use(*j, reg) == RU_FREED) {
+			rewrite.push_back(cmd);
+			return checked_rewrite(cmd_list, i, n + 1, rewrite, AR_NONE);
+		}
+		combine_reg_derefs(cmd.get_left(), deref, reg);
+		rewrite.push_back(cmd);
 	}
-	return 0;
+	if (!dead_reg(cmd_list, j, reg))
+		return 0;
+	return checked_rewrite(cmd_list, i, n, rewrite, reg);
+}
+
+bool is_mem_slot(const asm_oprnd_t& op) {
+	return op == AOT_IDENT ||
+		op == AOT_DEREF && op.reg == AR_EBP && op.offset_reg == AR_NONE;
+}
+
+bool is_local_slot(const asm_oprnd_t& op) {
+	return is_mem_slot(op) && op == AOT_DEREF && op.offset < 0;
+}
+
+bool slots_overlap(const asm_oprnd_t& a, const asm_oprnd_t& b) {
+	if (a.type != b.type)
+		return false;
+	if (a == AOT_IDENT)
+		return a.sym == b.sym;
+	return a.offset < b.offset + b.get_size() && b.offset < a.offset + a.get_size();
+}
+
+bool slot_covers(const asm_oprnd_t& a, const asm_oprnd_t& b) {
+	if (a.type != b.type)
+		return false;
+	if (a == AOT_IDENT)
+		return a.sym == b.sym;
+	return a.offset <= b.offset && b.offset + b.get_size() <= a.offset + a.get_size();
+}
+
+bool write_only_left(const asm_cmd_t& cmd) {
+	return
+		cmd == AO_MOV || cmd == AO_POP || cmd == AO_LEA ||
+		cmd == AO_FST || cmd == AO_FSTP || cmd == AO_FIST || cmd == AO_FISTP ||
+		cmd == AO_SETE || cmd == AO_SETNE || cmd == AO_SETL || cmd == AO_SETLE || cmd == AO_SETG ||
+		cmd == AO_SETGE || cmd == AO_SETB || cmd == AO_SETBE || cmd == AO_SETA || cmd == AO_SETAE;
+}
+
+bool writes_left(const asm_cmd_t& cmd) {
+	if (cmd == AO_PUSH || cmd == AO_CMP || cmd == AO_TEST)
+		return false;
+	if (cmd == AO_FILD || cmd == AO_FLD || cmd == AO_FADD || cmd == AO_FSUB || cmd == AO_FSUBR ||
+		cmd == AO_FDIV || cmd == AO_FDIVR || cmd == AO_FMUL || cmd == AO_FCOMIP)
+		return false;
+	return cmd.left == AOT_REG || cmd.left == AOT_DEREF || cmd.left == AOT_IDENT;
+}
+
+bool writes_reg(const asm_cmd_t& cmd, ASM_REGISTER reg) {
+	if (cmd == ACT_STR || cmd == AO_CALL)
+		return true;
+	if ((cmd == AO_DIV || cmd == AO_IMUL && cmd.right == AOT_NONE) && (reg == AR_EAX || reg == AR_EDX))
+		return true;
+	if (cmd == AO_XCHG && cmd.right.like(reg))
+		return true;
+	return writes_left(cmd) && cmd.left.like(reg);
+}
+
+bool frame_escapes(asm_cmd_list_ptr cmd_list) {
+	asm_oprnd_t ebp = asm_oprnd_t::make_reg(AR_EBP);
+	for (asm_cmd_iter_t i = cmd_list->_begin(); i != cmd_list->_end(); ++i) {
+		if (cmd_list[i] == ACT_STR)
+			return true;
+		if (cmd_list[i] == ACT_LABEL || cmd_list[i] == AO_PUSH || cmd_list[i] == AO_POP)
+			continue;
+		if (cmd_list[i] == AO_MOV && (i->left == AR_EBP || i->left == AR_ESP))
+			continue;
+		if (cmd_list[i] == AO_LEA && i->right.like(ebp))
+			return true;
+		if (i->left == AR_EBP || i->right == AR_EBP)
+			return true;
+	}
+	return false;
+}
+
+bool dead_slot(asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i, const asm_oprnd_t& slot, bool escaped) {
+	map<int, asm_cmd_iter_t> labels;
+	for (asm_cmd_iter_t j = cmd_list->_begin(); j != cmd_list->_end(); ++j)
+		if (cmd_list[j] == ACT_LABEL)
+			labels[j->left.label] = j;
+	set<int> visited;
+	vector<asm_cmd_iter_t> paths;
+	paths.push_back(i);
+	while (!paths.empty()) {
+		asm_cmd_iter_t j = paths.back();
+		paths.pop_back();
+		for (; j != cmd_list->_end() && visited.insert(j.get_node()).second; ++j) {
+			if (cmd_list[j] == ACT_LABEL)
+				continue;
+			if (cmd_list[j] == ACT_STR)
+				return false;
+			// A struct is returned by its address in eax, so once the frame escapes the caller may still read it
+			if (cmd_list[j] == AO_RET) {
+				if (escaped)
+					return false;
+				break;
+			}
+			if (cmd_list[j] == AO_CALL) {
+				if (escaped)
+					return false;
+				continue;
+			}
+			if (cmd_list[j] != AO_POP && writes_reg(*j, AR_EBP))
+				return false;
+
+			asm_oprnd_t ops[] = { j->left, j->right };
+			for (int k = 0; k < 2; k++) {
+				if (ops[k] != AOT_DEREF || !k && write_only_left(*j) || cmd_list[j] == AO_LEA)
+					continue;
+				if (!is_mem_slot(ops[k]) && (escaped || ops[k].like(asm_oprnd_t::make_reg(AR_EBP))))
+					return false;
+				if (is_mem_slot(ops[k]) && slots_overlap(ops[k], slot))
+					return false;
+			}
+
+			if (write_only_left(*j) && is_mem_slot(j->left) && slot_covers(j->left, slot))
+				break;
+			if (j->left == AOT_LABEL) {
+				if (!labels.count(j->left.label))
+					return false;
+				paths.push_back(labels[j->left.label]);
+				if (cmd_list[j] == AO_JMP)
+					break;
+			}
+		}
+	}
+	return true;
+}
+
+bool forward_mem_slots(asm_cmd_list_ptr cmd_list) {
+	bool changed = false;
+	bool escaped = frame_escapes(cmd_list);
+	set<int> targets;
+	for (asm_cmd_iter_t i = cmd_list->_begin(); i != cmd_list->_end(); ++i)
+		if (cmd_list[i] == ACT_OPERATOR && i->left == AOT_LABEL)
+			targets.insert(i->left.label);
+
+	vector<pair<asm_oprnd_t, ASM_REGISTER>> held;
+	asm_cmd_iter_t i = cmd_list->_begin();
+	while (i != cmd_list->_end()) {
+		asm_cmd_iter_t next = i + 1;
+		if (cmd_list[i] == ACT_LABEL) {
+			if (targets.count(i->left.label))
+				held.clear();
+			i = next;
+			continue;
+		}
+		if (cmd_list[i] == ACT_STR || cmd_list[i] == AO_CALL || cmd_list[i] == AO_JMP || cmd_list[i] == AO_RET) {
+			held.clear();
+			i = next;
+			continue;
+		}
+
+		asm_oprnd_t& read = cmd_list[i] == AO_PUSH ? i->left : i->right;
+		bool reg_operand_allowed =
+			cmd_list[i] == AO_PUSH ||
+			i->left == AOT_REG && i->left.get_size() == 4 && (
+			cmd_list[i] == AO_MOV || cmd_list[i] == AO_ADD || cmd_list[i] == AO_SUB ||
+			cmd_list[i] == AO_IMUL || cmd_list[i] == AO_AND || cmd_list[i] == AO_OR ||
+			cmd_list[i] == AO_XOR || cmd_list[i] == AO_CMP || cmd_list[i] == AO_TEST);
+		bool erased = false;
+		if (reg_operand_allowed && is_mem_slot(read) && (read == AOT_IDENT || read.get_size() == 4))
+			for each (auto& h in held)
+				if (h.first == read) {
+					if (cmd_list[i] == AO_MOV && i->left == h.second) {
+						cmd_list->_erase(i);
+						erased = true;
+					} else
+						read = asm_oprnd_t::make_reg(h.second);
+					changed = true;
+					break;
+				}
+		if (erased) {
+			i = next;
+			continue;
+		}
+
+		if (writes_left(*i) && (i->left == AOT_DEREF || i->left == AOT_IDENT) || cmd_list[i] == AO_XCHG) {
+			if (!is_mem_slot(i->left) || cmd_list[i] == AO_XCHG) {
+				for (int k = held.size() - 1; k >= 0; k--)
+					if (escaped || held[k].first == AOT_IDENT)
+						held.erase(held.begin() + k);
+			} else
+				for (int k = held.size() - 1; k >= 0; k--)
+					if (slots_overlap(held[k].first, i->left))
+						held.erase(held.begin() + k);
+		}
+		for (int k = held.size() - 1; k >= 0; k--)
+			if (writes_reg(*i, held[k].second))
+				held.erase(held.begin() + k);
+		if (writes_reg(*i, AR_EBP))
+			for (int k = held.size() - 1; k >= 0; k--)
+				if (held[k].first == AOT_DEREF)
+					held.erase(held.begin() + k);
+
+		if (cmd_list[i] == AO_MOV) {
+			asm_oprnd_t slot = is_mem_slot(i->left) ? i->left : i->right;
+			asm_oprnd_t reg = is_mem_slot(i->left) ? i->right : i->left;
+			ASM_REGISTER parent = asm_gen_t::parent_of(reg.reg);
+			if (is_mem_slot(slot) && reg == AOT_REG && reg == parent &&
+				parent != AR_EBP && parent != AR_ESP && (slot == AOT_IDENT || slot.get_size() == 4))
+			{
+				bool known = false;
+				for each (auto& h in held)
+					known = known || h.first == slot;
+				if (!known)
+					held.push_back(make_pair(slot, parent));
+			}
+		}
+		i = next;
+	}
+	return changed;
+}
+
+bool eliminate_dead_stores(asm_cmd_list_ptr cmd_list) {
+	bool changed = false;
+	bool escaped = frame_escapes(cmd_list);
+	asm_cmd_iter_t i = cmd_list->_begin();
+	while (i != cmd_list->_end()) {
+		asm_cmd_iter_t next = i + 1;
+		if (cmd_list[i] == AO_MOV && is_local_slot(i->left) && dead_slot(cmd_list, next, i->left, escaped)) {
+			cmd_list->_erase(i);
+			changed = true;
+		}
+		i = next;
+	}
+	return changed;
+}
+
+static asm_pass_t make_rule(string name, OPT_LEVEL level, int(*rule)(asm_cmd_list_ptr, asm_cmd_iter_t)) {
+	asm_pass_t res = { name, level, rule, nullptr, true, 0, 0 };
+	return res;
+}
+
+static asm_pass_t make_pass(string name, OPT_LEVEL level, bool(*pass)(asm_cmd_list_ptr)) {
+	asm_pass_t res = { name, level, nullptr, pass, true, 0, 0 };
+	return res;
+}
+
+asm_optimizer_t::asm_optimizer_t(OPT_LEVEL level) : time_passes(false) {
+	rules.push_back(make_rule("o1", OL_1, o1));
+	rules.push_back(make_rule("o2", OL_1, o2));
+	rules.push_back(make_rule("o3", OL_1, o3));
+	rules.push_back(make_rule("o4", OL_1, o4));
+	rules.push_back(make_rule("o5", OL_1, o5));
+	rules.push_back(make_rule("o6", OL_1, o6));
+	rules.push_back(make_rule("o7", OL_1, o7));
+	rules.push_back(make_rule("o8", OL_1, o8));
+	rules.push_back(make_rule("o9", OL_1, o9));
+	rules.push_back(make_rule("o10", OL_1, o10));
+	rules.push_back(make_rule("o11", OL_1, o11));
+	rules.push_back(make_rule("o12", OL_2, o12));
+	rules.push_back(make_rule("o13", OL_1, o13));
+	rules.push_back(make_rule("o14", OL_2, o14));
+	rules.push_back(make_rule("o15", OL_1, o15));
+	rules.push_back(make_rule("o16", OL_1, o16));
+	rules.push_back(make_rule("o17", OL_2, o17));
+	rules.push_back(make_rule("o18", OL_2, o18));
+	passes.push_back(make_pass("forward-slots", OL_2, forward_mem_slots));
+	passes.push_back(make_pass("dead-stores", OL_2, eliminate_dead_stores));
+	set_opt_level(level);
+}
+
+void asm_optimizer_t::set_opt_level(OPT_LEVEL level) {
+	OPT_LEVEL effective = level == OL_S ? OL_2 : level;
+	for each (auto& o in rules)
+		o.enabled = o.level <= effective;
+	for each (auto& p in passes)
+		p.enabled = p.level <= effective;
+}
+
+bool asm_optimizer_t::set_pass_enabled(string name, bool enabled) {
+	bool found = false;
+	for each (auto& o in rules)
+		if (o.name == name || name == "peephole") {
+			o.enabled = enabled;
+			found = true;
+		}
+	for each (auto& p in passes)
+		if (p.name == name) {
+			p.enabled = enabled;
+			found = true;
+		}
+	return found;
+}
+
+void asm_optimizer_t::set_time_passes(bool time_passes_) {
+	time_passes = time_passes_;
+}
+
+void asm_optimizer_t::print_pass_times(ostream& os) {
+	double total = 0;
+	os << left << setw(16) << "pass" << setw(10) << "hits" << "time (ms)" << endl;
+	for (int i = 0; i < rules.size() + passes.size(); i++) {
+		asm_pass_t& p = i < rules.size() ? rules[i] : passes[i - rules.size()];
+		if (!p.enabled)
+			continue;
+		os << setw(16) << p.name << setw(10) << p.hits << fixed << setprecision(3) << p.time * 1000 << endl;
+		total += p.time;
+	}
+	os << setw(26) << "total" << fixed << setprecision(3) << total * 1000 << endl;
+}
+
+int asm_optimizer_t::_run_rule(const asm_pass_t& o, asm_pass_t& stat, asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i) {
+	if (!time_passes)
+		return o.rule(cmd_list, i);
+	auto start = chrono::steady_clock::now();
+	int d = o.rule(cmd_list, i);
+	stat.time += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	stat.hits += d != 0;
+	return d;
+}
+
+bool asm_optimizer_t::_run_pass(const asm_pass_t& p, asm_pass_t& stat, asm_cmd_list_ptr cmd_list) {
+	if (!time_passes)
+		return p.pass(cmd_list);
+	auto start = chrono::steady_clock::now();
+	bool changed = p.pass(cmd_list);
+	stat.time += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	stat.hits += changed;
+	return changed;
 }
 
-void init_asm_code_optimizer() {
-	optimizers.push_back(o1);
-	optimizers.push_back(o2);
-	optimizers.push_back(o3);
-	optimizers.push_back(o4);
-	optimizers.push_back(o5);
-	optimizers.push_back(o6);
-	optimizers.push_back(o7);
-	optimizers.push_back(o8);
-	optimizers.push_back(o9);
-	optimizers.push_back(o10);
-	optimizers.push_back(o11);
-	//optimizers.push_back(o12);
-	optimizers.push_back(o13);
-	//optimizers.push_back(o14);
-	optimizers.push_back(o15);
-	optimizers.push_back(o16);
-	//optimizers.push_back(o17);
-	//optimizers.push_back(o18);
-}
-
-void asm_optimize_code(asm_cmd_list_ptr cmd_list) {
+static void merge_pass_times(vector<asm_pass_t>& passes, const vector<asm_pass_t>& stats) {
+	for (int i = 0; i < passes.size(); i++) {
+		passes[i].hits += stats[i].hits;
+		passes[i].time += stats[i].time;
+	}
+}
+
+void asm_optimizer_t::optimize(asm_cmd_list_ptr cmd_list) {
+	vector<asm_pass_t> rule_stats(rules.size());
+	vector<asm_pass_t> pass_stats(passes.size());
 	bool changed = true;
 	while (changed) {
 		changed = false;
-		for (int i = 0; i < cmd_list->_size(); i++) {
-			for each (auto o in optimizers) {
-				if (i < 0)
+		for (asm_cmd_iter_t i = cmd_list->_begin(); i != cmd_list->_end(); ++i) {
+			for (int k = 0; k < rules.size(); k++) {
+				const asm_pass_t& o = rules[k];
+				if (i == cmd_list->_end())
 					break;
-				int d = o(cmd_list, i);
+				if (!o.enabled)
+					continue;
+				asm_cmd_iter_t prev = i - 1;
+				int d = _run_rule(o, rule_stats[k], cmd_list, i);
 				changed = changed || d;
-				i -= d;
+				if (d)
+					i = (prev == cmd_list->_end() ? cmd_list->_begin() : prev + 1) - d;
 			}
-			if (i < 0)
+			if (i == cmd_list->_end())
 				break;
 		}
+		for (int k = 0; k < passes.size(); k++)
+			if (!changed && passes[k].enabled)
+				changed = _run_pass(passes[k], pass_stats[k], cmd_list);
+	}
+	cmd_list->_compact();
+	if (time_passes) {
+		lock_guard<mutex> lock(stats_mutex);
+		merge_pass_times(rules, rule_stats);
+		merge_pass_times(passes, pass_stats);
 	}
 }
@@ -1,6 +1,39 @@
 #pragma once
 #include "asm_generator.h"
+#include <string>
+#include <ostream>
+#include <vector>
+#include <mutex>
 
-void init_asm_code_optimizer();
+enum OPT_LEVEL {
+	OL_0,
+	OL_1,
+	OL_2,
+	OL_S
+};
 
-void asm_optimize_code(asm_cmd_list_ptr cmd_list);
\ No newline at end of file
+struct asm_pass_t {
+	string name;
+	OPT_LEVEL level;
+	int (*rule)(asm_cmd_list_ptr, asm_cmd_iter_t);
+	bool (*pass)(asm_cmd_list_ptr);
+	bool enabled;
+	int hits;
+	double time;
+};
+
+class asm_optimizer_t {
+	vector<asm_pass_t> rules;
+	vector<asm_pass_t> passes;
+	bool time_passes;
+	mutex stats_mutex;
+	int _run_rule(const asm_pass_t& o, asm_pass_t& stat, asm_cmd_list_ptr cmd_list, asm_cmd_iter_t i);
+	bool _run_pass(const asm_pass_t& p, asm_pass_t& stat, asm_cmd_list_ptr cmd_list);
+public:
+	asm_optimizer_t(OPT_LEVEL level = OL_2);
+	void set_opt_level(OPT_LEVEL level);
+	bool set_pass_enabled(string name, bool enabled);
+	void set_time_passes(bool time_passes_);
+	void print_pass_times(ostream& os);
+	void optimize(asm_cmd_list_ptr cmd_list);
+};
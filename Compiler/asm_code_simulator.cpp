@@ -0,0 +1,993 @@
+#include "asm_code_simulator.h"
+#include "exceptions.h"
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#define SIM_DATA_BASE 0x10000u
+#define SIM_MEMORY_SIZE (16u << 20)
+#define SIM_STACK_SIZE (1u << 20)
+#define SIM_CODE_BASE 0x80000000u
+#define SIM_EXIT_ADDRESS 0xFFFFFFF0u
+#define SIM_LOAD_COST 3
+#define SIM_STORE_COST 1
+#define SIM_TAKEN_BRANCH_COST 1
+#define SIM_EXTERN_COST 100
+
+extern map<ASM_OPERATOR, string> asm_op_to_str;
+
+static int op_cost(ASM_OPERATOR op) {
+	switch (op) {
+		case AO_IMUL: return 3;
+		case AO_DIV: return 26;
+		case AO_CALL:
+		case AO_RET: return 2;
+		case AO_FILD:
+		case AO_FIST:
+		case AO_FISTP:
+		case AO_FADD:
+		case AO_FSUB:
+		case AO_FSUBR: return 3;
+		case AO_FMUL: return 5;
+		case AO_FDIV:
+		case AO_FDIVR: return 20;
+		case AO_FCOMPP:
+		case AO_FCOMIP:
+		case AO_FSTSW: return 2;
+		case AO_NOP: return 0;
+	}
+	return 1;
+}
+
+static const map<string, SIM_EXTERN>& externs() {
+	static const map<string, SIM_EXTERN> res = {
+		{ "crt_printf", SE_PRINTF },
+		{ "crt_scanf", SE_SCANF },
+		{ "crt_malloc", SE_MALLOC },
+		{ "crt_free", SE_FREE },
+		{ "crt__exit", SE_EXIT },
+	};
+	return res;
+}
+
+static uint32_t size_mask(int size) {
+	return size == 4 ? 0xFFFFFFFFu : (1u << size * 8) - 1;
+}
+
+static uint32_t sign_bit(int size) {
+	return 1u << (size * 8 - 1);
+}
+
+static int32_t sign_extend(uint32_t val, int size) {
+	return size == 4 ? (int32_t)val : (int32_t)((val ^ sign_bit(size)) & size_mask(size)) - (int32_t)sign_bit(size);
+}
+
+template <typename T>
+static string format_arg(const string& spec, T val) {
+	int len = snprintf(nullptr, 0, spec.c_str(), val);
+	if (len <= 0)
+		return "";
+	vector<char> buf(len + 1);
+	snprintf(buf.data(), buf.size(), spec.c_str(), val);
+	return string(buf.data(), len);
+}
+
+asm_machine_t::asm_machine_t(asm_gen_ptr gen) :
+	memory(SIM_MEMORY_SIZE), data_end(SIM_DATA_BASE), zf(false), sf(false), cf(false), of(false), pf(false),
+	fpu_top(0), fpu_status(0), halted(false), exit_code(0), max_steps(100000000), in(nullptr), out(nullptr), stats()
+{
+	if (asm_gen_t::get_target() != AT_X86)
+		throw SimulationError("Only x86 code can be simulated");
+	memset(regs, 0, sizeof(regs));
+	memset(fpu, 0, sizeof(fpu));
+	memset(fpu_used, 0, sizeof(fpu_used));
+	globals["_double"] = make_pair(_alloc_data(8, 8), 8);
+	globals["_int"] = make_pair(_alloc_data(4, 4), 4);
+	for each (auto var in gen->global_vars) {
+		int size = asm_gen_t::size_of(var->type);
+		globals[var->name] = make_pair(_alloc_data(size * max(1, var->dup), size), size);
+	}
+	int pos = 0;
+	for each (auto func in gen->functions) {
+		funcs[func->name] = pos;
+		for (asm_cmd_iter_t it = func->cmd_list->_begin(); it != func->cmd_list->_end(); ++it)
+			pos += *it == ACT_OPERATOR;
+		pos++;
+	}
+	asm_sim_cmd_t ret = {};
+	ret.op = AO_RET;
+	for (int i = 0; i < gen->functions.size(); i++) {
+		func_names.push_back(gen->functions[i]->name);
+		_add_list(gen->functions[i]->cmd_list, i);
+		ret.func = i;
+		code.push_back(ret);
+	}
+	func_names.push_back("start");
+	entry = code.size();
+	for each (auto var in gen->global_vars)
+		if (var->init_commands)
+			_add_list(var->init_commands, func_names.size() - 1);
+	_add_list(gen->main_cmd_list, func_names.size() - 1);
+	asm_sim_cmd_t halt = {};
+	halt.func = func_names.size() - 1;
+	halt.op = AO_PUSH;
+	halt.left.type = SOT_IMM;
+	code.push_back(halt);
+	halt.op = AO_CALL;
+	halt.left.type = SOT_EXTERN;
+	halt.left.offset = SE_EXIT;
+	code.push_back(halt);
+	heap_end = data_end;
+	stats.op_counts.resize(AO_NOP + 1);
+	stats.func_counts.resize(func_names.size());
+}
+
+uint32_t asm_machine_t::_alloc_data(int size, int align) {
+	data_end = (data_end + align - 1) / align * align;
+	uint32_t res = data_end;
+	data_end += max(size, 1);
+	if (data_end > memory.size() - SIM_STACK_SIZE)
+		throw SimulationError("Data segment does not fit in simulated memory");
+	return res;
+}
+
+uint32_t asm_machine_t::_literal(const string& data, int align) {
+	auto it = literals.find(data);
+	if (it != literals.end() && it->second % align == 0)
+		return it->second;
+	uint32_t addr = _alloc_data(data.size(), align);
+	memcpy(&memory[addr], data.data(), data.size());
+	return literals[data] = addr;
+}
+
+void asm_machine_t::_add_list(asm_cmd_list_ptr list, int func) {
+	map<int, int> labels;
+	int pos = code.size();
+	for (asm_cmd_iter_t it = list->_begin(); it != list->_end(); ++it)
+		if (*it == ACT_LABEL)
+			labels[it->left.label] = pos;
+		else if (*it == ACT_OPERATOR)
+			pos++;
+	for (asm_cmd_iter_t it = list->_begin(); it != list->_end(); ++it) {
+		if (!(*it == ACT_OPERATOR))
+			continue;
+		asm_sim_cmd_t cmd;
+		cmd.op = it->op;
+		cmd.left = _decode(list.get(), it->left, labels);
+		cmd.right = _decode(list.get(), it->right, labels);
+		cmd.cost = op_cost(it->op);
+		cmd.func = func;
+		cmd.list = list.get();
+		cmd.cmd = *it;
+		code.push_back(cmd);
+	}
+}
+
+asm_sim_oprnd_t asm_machine_t::_decode(asm_cmd_list_t* list, const asm_oprnd_t& op, const map<int, int>& labels) {
+	asm_sim_oprnd_t res = { SOT_NONE, AR_NONE, AR_NONE, 0, 0, 0, 0 };
+	string name = op == AOT_IDENT || op == AOT_ADDR ? list->idents[op.sym] : "";
+	switch (op.type) {
+		case AOT_REG:
+			res.type = SOT_REG;
+			res.reg = op.reg;
+			res.size = res.decl_size = asm_gen_t::size_of(op.reg);
+			break;
+		case AOT_IMM:
+			res.type = SOT_IMM;
+			res.offset = op.imm;
+			break;
+		case AOT_LABEL:
+			if (!labels.count(op.label))
+				throw SimulationError("Undefined label LABEL_" + to_string(op.label));
+			res.type = SOT_CODE;
+			res.offset = labels.at(op.label);
+			break;
+		case AOT_DEREF:
+			res.type = SOT_MEM;
+			res.reg = op.reg;
+			res.offset_reg = op.offset_reg;
+			res.scale = op.scale ? op.scale : 1;
+			res.offset = op.offset;
+			res.size = res.decl_size = asm_gen_t::size_of(op.mtype);
+			break;
+		case AOT_ADDR:
+			res.type = SOT_IMM;
+			if (globals.count(name))
+				res.offset = globals[name].first;
+			else if (funcs.count(name))
+				res.offset = SIM_CODE_BASE + funcs[name];
+			else
+				throw SimulationError("Undefined symbol " + name);
+			break;
+		case AOT_IDENT:
+			if (globals.count(name)) {
+				res.type = SOT_MEM;
+				res.offset = globals[name].first;
+				res.decl_size = globals[name].second;
+			} else if (funcs.count(name)) {
+				res.type = SOT_CODE;
+				res.offset = funcs[name];
+			} else if (externs().count(name)) {
+				res.type = SOT_EXTERN;
+				res.offset = externs().at(name);
+			} else
+				throw SimulationError("Undefined symbol " + name);
+			break;
+		case AOT_VAR: {
+			var_ptr var = list->vars[op.sym];
+			if (auto v = dynamic_pointer_cast<var_t<int>>(var)) {
+				res.type = SOT_IMM;
+				res.offset = v->get_val();
+			} else if (auto v = dynamic_pointer_cast<var_t<char>>(var)) {
+				res.type = SOT_IMM;
+				res.offset = v->get_val();
+			} else if (auto v = dynamic_pointer_cast<var_t<double>>(var)) {
+				res.type = SOT_MEM;
+				res.offset = _literal(string((char*)&v->get_val(), sizeof(double)), 8);
+				res.size = res.decl_size = 8;
+			} else if (auto v = dynamic_pointer_cast<var_t<string>>(var)) {
+				res.type = SOT_IMM;
+				res.offset = _literal(v->get_val() + '\0', 1);
+			} else
+				throw SimulationError("Unsupported constant operand");
+			break;
+		}
+	}
+	return res;
+}
+
+void asm_machine_t::set_max_steps(long long steps) {
+	max_steps = steps;
+}
+
+void asm_machine_t::set_input(istream& is) {
+	in = &is;
+}
+
+uint8_t* asm_machine_t::_mem(uint32_t addr, int size) {
+	if (addr < SIM_DATA_BASE || addr > memory.size() - size) {
+		ostringstream os;
+		os << "Access violation at address 0x" << hex << setw(8) << setfill('0') << addr;
+		throw SimulationError(os.str());
+	}
+	return &memory[addr];
+}
+
+uint32_t asm_machine_t::_peek(uint32_t addr) {
+	uint32_t res;
+	memcpy(&res, _mem(addr, 4), 4);
+	return res;
+}
+
+double asm_machine_t::_peek_fp(uint32_t addr) {
+	double res;
+	memcpy(&res, _mem(addr, 8), 8);
+	return res;
+}
+
+string asm_machine_t::_string(uint32_t addr) {
+	string res;
+	for (char c; (c = *_mem(addr, 1)) != 0; addr++)
+		res += c;
+	return res;
+}
+
+uint32_t asm_machine_t::_load(uint32_t addr, int size) {
+	uint32_t res = 0;
+	memcpy(&res, _mem(addr, size), size);
+	stats.loads++;
+	stats.load_bytes += size;
+	return res;
+}
+
+void asm_machine_t::_store(uint32_t addr, int size, uint32_t val) {
+	memcpy(_mem(addr, size), &val, size);
+	stats.stores++;
+	stats.store_bytes += size;
+}
+
+double asm_machine_t::_load_fp(uint32_t addr, int size) {
+	stats.loads++;
+	stats.load_bytes += size;
+	if (size == 4) {
+		float res;
+		memcpy(&res, _mem(addr, 4), 4);
+		return res;
+	}
+	double res;
+	memcpy(&res, _mem(addr, 8), 8);
+	return res;
+}
+
+void asm_machine_t::_store_fp(uint32_t addr, int size, double val) {
+	stats.stores++;
+	stats.store_bytes += size;
+	if (size == 4) {
+		float res = (float)val;
+		memcpy(_mem(addr, 4), &res, 4);
+	} else
+		memcpy(_mem(addr, 8), &val, 8);
+}
+
+uint32_t asm_machine_t::_addr(const asm_sim_oprnd_t& op) {
+	if (op.type != SOT_MEM)
+		throw SimulationError("Memory operand expected");
+	uint32_t res = op.offset;
+	if (op.reg != AR_NONE)
+		res += regs[asm_gen_t::parent_of(op.reg)];
+	if (op.offset_reg != AR_NONE)
+		res += regs[asm_gen_t::parent_of(op.offset_reg)] * op.scale;
+	return res;
+}
+
+uint32_t asm_machine_t::_read(const asm_sim_oprnd_t& op, int size) {
+	switch (op.type) {
+		case SOT_REG:
+			return regs[asm_gen_t::parent_of(op.reg)] & size_mask(op.size);
+		case SOT_IMM:
+			return (uint32_t)op.offset & size_mask(size);
+		case SOT_MEM:
+			return _load(_addr(op), size);
+		case SOT_CODE:
+			return SIM_CODE_BASE + op.offset;
+	}
+	throw SimulationError("Invalid source operand");
+}
+
+void asm_machine_t::_write(const asm_sim_oprnd_t& op, int size, uint32_t val) {
+	if (op.type == SOT_MEM) {
+		_store(_addr(op), size, val);
+		return;
+	}
+	if (op.type != SOT_REG)
+		throw SimulationError("Invalid destination operand");
+	uint32_t& reg = regs[asm_gen_t::parent_of(op.reg)];
+	uint32_t mask = size_mask(op.size);
+	reg = reg & ~mask | val & mask;
+}
+
+int asm_machine_t::_op_size(const asm_sim_cmd_t& cmd) {
+	if (cmd.left.size)
+		return cmd.left.size;
+	if (cmd.right.size)
+		return cmd.right.size;
+	if (cmd.left.decl_size)
+		return cmd.left.decl_size;
+	if (cmd.right.decl_size)
+		return cmd.right.decl_size;
+	return 4;
+}
+
+void asm_machine_t::_push(uint32_t val) {
+	uint32_t& esp = regs[AR_ESP];
+	if (esp - 4 < memory.size() - SIM_STACK_SIZE)
+		throw SimulationError("Stack overflow");
+	esp -= 4;
+	_store(esp, 4, val);
+	stats.stack_bytes = max(stats.stack_bytes, (uint32_t)memory.size() - esp);
+}
+
+uint32_t asm_machine_t::_pop() {
+	uint32_t res = _load(regs[AR_ESP], 4);
+	regs[AR_ESP] += 4;
+	return res;
+}
+
+double asm_machine_t::_st(int i) {
+	int reg = fpu_top + i & 7;
+	if (!fpu_used[reg]) {
+		stats.fpu_faults++;
+		return numeric_limits<double>::quiet_NaN();
+	}
+	return fpu[reg];
+}
+
+void asm_machine_t::_set_st(int i, double val) {
+	int reg = fpu_top + i & 7;
+	fpu[reg] = val;
+	fpu_used[reg] = true;
+}
+
+void asm_machine_t::_fpu_push(double val) {
+	fpu_top = fpu_top - 1 & 7;
+	if (fpu_used[fpu_top]) {
+		stats.fpu_faults++;
+		val = numeric_limits<double>::quiet_NaN();
+	}
+	_set_st(0, val);
+}
+
+double asm_machine_t::_fpu_pop() {
+	double res = _st(0);
+	fpu_used[fpu_top] = false;
+	fpu_top = fpu_top + 1 & 7;
+	return res;
+}
+
+void asm_machine_t::_set_flags(uint32_t res, int size) {
+	res &= size_mask(size);
+	zf = res == 0;
+	sf = (res & sign_bit(size)) != 0;
+	uint8_t low = res;
+	low ^= low >> 4;
+	low ^= low >> 2;
+	low ^= low >> 1;
+	pf = !(low & 1);
+}
+
+bool asm_machine_t::_condition(ASM_OPERATOR op) {
+	switch (op) {
+		case AO_JZ:
+		case AO_JE:
+		case AO_SETE: return zf;
+		case AO_JNZ:
+		case AO_JNE:
+		case AO_SETNE: return !zf;
+		case AO_JL:
+		case AO_SETL: return sf != of;
+		case AO_JLE:
+		case AO_SETLE: return zf || sf != of;
+		case AO_JG:
+		case AO_SETG: return !zf && sf == of;
+		case AO_JGE:
+		case AO_SETGE: return sf == of;
+		case AO_JB:
+		case AO_SETB: return cf;
+		case AO_JBE:
+		case AO_SETBE: return cf || zf;
+		case AO_JA:
+		case AO_SETA: return !cf && !zf;
+		case AO_JAE:
+		case AO_SETAE: return !cf;
+	}
+	return true;
+}
+
+void asm_machine_t::_jump(const asm_sim_oprnd_t& target) {
+	if (target.type == SOT_CODE) {
+		ip = target.offset;
+		return;
+	}
+	uint32_t addr = _read(target, 4);
+	if (addr < SIM_CODE_BASE || addr - SIM_CODE_BASE >= code.size())
+		throw SimulationError("Jump to an invalid address");
+	ip = addr - SIM_CODE_BASE;
+}
+
+void asm_machine_t::_fpu_compare(double left, double right) {
+	bool unordered = left != left || right != right;
+	zf = unordered || left == right;
+	pf = unordered;
+	cf = unordered || left < right;
+	of = sf = false;
+}
+
+string asm_machine_t::_format(uint32_t fmt, uint32_t args) {
+	string res;
+	for (char c; (c = *_mem(fmt, 1)) != 0; fmt++) {
+		if (c != '%') {
+			res += c;
+			continue;
+		}
+		string spec = "%";
+		for (c = *_mem(++fmt, 1); c && strchr("-+ #0123456789.*lhL", c); c = *_mem(++fmt, 1))
+			if (c == '*') {
+				spec += to_string((int32_t)_peek(args));
+				args += 4;
+			} else if (!strchr("lhL", c))
+				spec += c;
+		if (!c)
+			break;
+		spec += c;
+		switch (c) {
+			case 'd':
+			case 'i':
+			case 'c':
+				res += format_arg(spec, (int32_t)_peek(args));
+				args += 4;
+				break;
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X':
+				res += format_arg(spec, _peek(args));
+				args += 4;
+				break;
+			case 'p':
+				res += format_arg("%08X", _peek(args));
+				args += 4;
+				break;
+			case 's':
+				res += format_arg(spec, _string(_peek(args)).c_str());
+				args += 4;
+				break;
+			case 'f':
+			case 'F':
+			case 'e':
+			case 'E':
+			case 'g':
+			case 'G':
+				res += format_arg(spec, _peek_fp(args));
+				args += 8;
+				break;
+			case '%':
+				res += '%';
+				break;
+			default:
+				res += spec;
+		}
+	}
+	return res;
+}
+
+int asm_machine_t::_scan(uint32_t fmt, uint32_t args) {
+	if (!in)
+		return -1;
+	int count = 0;
+	for (char c; (c = *_mem(fmt, 1)) != 0; fmt++) {
+		if (isspace((unsigned char)c)) {
+			*in >> ws;
+			continue;
+		}
+		if (c != '%') {
+			if (in->peek() != c)
+				break;
+			in->get();
+			continue;
+		}
+		bool is_long = false;
+		for (c = *_mem(++fmt, 1); c && strchr("lhL0123456789", c); c = *_mem(++fmt, 1))
+			is_long |= c == 'l' || c == 'L';
+		if (c == '%') {
+			if (in->get() != '%')
+				break;
+			continue;
+		}
+		uint32_t dst = _peek(args);
+		bool ok = true;
+		switch (c) {
+			case 'd':
+			case 'i':
+			case 'u':
+			case 'x': {
+				long long val;
+				ok = !!(*in >> (c == 'x' ? hex : dec) >> val);
+				*in >> dec;
+				if (ok)
+					_store(dst, 4, (uint32_t)val);
+				break;
+			}
+			case 'c': {
+				char val;
+				ok = !!in->get(val);
+				if (ok)
+					_store(dst, 1, (uint8_t)val);
+				break;
+			}
+			case 's': {
+				string val;
+				ok = !!(*in >> val);
+				if (ok) {
+					val += '\0';
+					memcpy(_mem(dst, val.size()), val.data(), val.size());
+				}
+				break;
+			}
+			case 'f':
+			case 'e':
+			case 'g': {
+				double val;
+				ok = !!(*in >> val);
+				if (ok)
+					_store_fp(dst, is_long ? 8 : 4, val);
+				break;
+			}
+			default:
+				ok = false;
+		}
+		if (!ok)
+			return count || !in->eof() ? count : -1;
+		args += 4;
+		count++;
+	}
+	return count;
+}
+
+void asm_machine_t::_call_extern(SIM_EXTERN func) {
+	uint32_t esp = regs[AR_ESP];
+	stats.extern_calls++;
+	stats.cycles += SIM_EXTERN_COST;
+	switch (func) {
+		case SE_PRINTF: {
+			string res = _format(_peek(esp), esp + 4);
+			*out << res;
+			regs[AR_EAX] = res.size();
+			break;
+		}
+		case SE_SCANF:
+			regs[AR_EAX] = _scan(_peek(esp), esp + 4);
+			break;
+		case SE_MALLOC: {
+			uint32_t size = _peek(esp);
+			uint32_t addr = (heap_end + 7) / 8 * 8;
+			if (size > memory.size() - SIM_STACK_SIZE - addr)
+				regs[AR_EAX] = 0;
+			else {
+				heap_end = addr + max(size, 1u);
+				stats.heap_bytes += size;
+				regs[AR_EAX] = addr;
+			}
+			break;
+		}
+		case SE_FREE:
+			break;
+		case SE_EXIT:
+			halted = true;
+			exit_code = _peek(esp);
+			break;
+	}
+}
+
+void asm_machine_t::_exec_fpu(const asm_sim_cmd_t& cmd) {
+	double left, right;
+	int size = cmd.left.size ? cmd.left.size : cmd.left.decl_size;
+	switch (cmd.op) {
+		case AO_FWAIT:
+			break;
+		case AO_FLD1:
+			_fpu_push(1);
+			break;
+		case AO_FLD:
+			_fpu_push(cmd.left.type == SOT_REG ? _st(cmd.left.reg - AR_ST_0) : _load_fp(_addr(cmd.left), size));
+			break;
+		case AO_FILD:
+			if (size == 8)
+				_fpu_push((double)(int64_t)((uint64_t)_load(_addr(cmd.left) + 4, 4) << 32 | _load(_addr(cmd.left), 4)));
+			else
+				_fpu_push(sign_extend(_load(_addr(cmd.left), size), size));
+			break;
+		case AO_FST:
+		case AO_FSTP:
+			if (cmd.left.type == SOT_REG)
+				_set_st(cmd.left.reg - AR_ST_0, _st(0));
+			else
+				_store_fp(_addr(cmd.left), size, _st(0));
+			if (cmd.op == AO_FSTP)
+				_fpu_pop();
+			break;
+		case AO_FIST:
+		case AO_FISTP: {
+			double val = nearbyint(_st(0));
+			int64_t limit = (int64_t)1 << (size * 8 - 1);
+			int64_t res = val >= -limit && val < limit ? (int64_t)val : -limit;
+			if (size == 8) {
+				_store(_addr(cmd.left), 4, (uint32_t)res);
+				_store(_addr(cmd.left) + 4, 4, (uint32_t)((uint64_t)res >> 32));
+			} else
+				_store(_addr(cmd.left), size, (uint32_t)res);
+			if (cmd.op == AO_FISTP)
+				_fpu_pop();
+			break;
+		}
+		case AO_FCHS:
+			_set_st(0, -_st(0));
+			break;
+		case AO_FDECSTP:
+			fpu_top = fpu_top - 1 & 7;
+			break;
+		case AO_FCOMPP:
+			left = _st(0);
+			right = _st(1);
+			fpu_status = left != left || right != right ? 0x4500 : left < right ? 0x0100 : left == right ? 0x4000 : 0;
+			_fpu_pop();
+			_fpu_pop();
+			break;
+		case AO_FCOMIP:
+			_fpu_compare(_st(cmd.left.type == SOT_REG ? cmd.left.reg - AR_ST_0 : 0), _st(cmd.right.type == SOT_REG ? cmd.right.reg - AR_ST_0 : 1));
+			_fpu_pop();
+			break;
+		case AO_FSTSW:
+			_write(cmd.left, 2, fpu_status & ~0x3800 | fpu_top << 11);
+			break;
+		case AO_SAHF: {
+			uint32_t ah = regs[AR_EAX] >> 8;
+			sf = (ah & 0x80) != 0;
+			zf = (ah & 0x40) != 0;
+			pf = (ah & 0x04) != 0;
+			cf = (ah & 0x01) != 0;
+			break;
+		}
+		default: {
+			int dst = 0;
+			bool pop = false;
+			if (cmd.left.type == SOT_NONE) {
+				dst = 1;
+				right = _st(0);
+				pop = true;
+			} else if (cmd.left.type == SOT_MEM)
+				right = _load_fp(_addr(cmd.left), size);
+			else if (cmd.right.type == SOT_NONE)
+				right = _st(cmd.left.reg - AR_ST_0);
+			else {
+				dst = cmd.left.reg - AR_ST_0;
+				right = _st(cmd.right.reg - AR_ST_0);
+			}
+			left = _st(dst);
+			double res;
+			switch (cmd.op) {
+				case AO_FADD: res = left + right; break;
+				case AO_FSUB: res = left - right; break;
+				case AO_FSUBR: res = right - left; break;
+				case AO_FMUL: res = left * right; break;
+				case AO_FDIV: res = left / right; break;
+				case AO_FDIVR: res = right / left; break;
+				default: throw SimulationError("Unsupported instruction");
+			}
+			_set_st(dst, res);
+			if (pop)
+				_fpu_pop();
+		}
+	}
+}
+
+void asm_machine_t::_exec(const asm_sim_cmd_t& cmd) {
+	int size = _op_size(cmd);
+	uint32_t left, right, res;
+	switch (cmd.op) {
+		case AO_NOP:
+			return;
+		case AO_MOV:
+			_write(cmd.left, size, _read(cmd.right, size));
+			return;
+		case AO_LEA:
+			_write(cmd.left, cmd.left.size, _addr(cmd.right));
+			return;
+		case AO_XCHG:
+			left = _read(cmd.left, size);
+			right = _read(cmd.right, size);
+			_write(cmd.left, size, right);
+			_write(cmd.right, size, left);
+			return;
+		case AO_PUSH:
+			if (cmd.left.size == 8)
+				throw SimulationError("Unsupported operand size");
+			_push(_read(cmd.left, 4));
+			return;
+		case AO_POP:
+			_write(cmd.left, 4, _pop());
+			return;
+		case AO_ADD:
+		case AO_SUB:
+		case AO_CMP:
+			left = _read(cmd.left, size) & size_mask(size);
+			right = _read(cmd.right, size) & size_mask(size);
+			res = cmd.op == AO_ADD ? left + right : left - right;
+			_set_flags(res, size);
+			if (cmd.op == AO_ADD) {
+				cf = (uint64_t)left + right > size_mask(size);
+				of = ((left ^ res) & (right ^ res) & sign_bit(size)) != 0;
+			} else {
+				cf = left < right;
+				of = ((left ^ right) & (left ^ res) & sign_bit(size)) != 0;
+			}
+			if (cmd.op != AO_CMP)
+				_write(cmd.left, size, res);
+			return;
+		case AO_AND:
+		case AO_OR:
+		case AO_XOR:
+		case AO_TEST:
+			left = _read(cmd.left, size);
+			right = _read(cmd.right, size);
+			res = cmd.op == AO_OR ? left | right : cmd.op == AO_XOR ? left ^ right : left & right;
+			_set_flags(res, size);
+			cf = of = false;
+			if (cmd.op != AO_TEST)
+				_write(cmd.left, size, res);
+			return;
+		case AO_INC:
+		case AO_DEC:
+			left = _read(cmd.left, size);
+			res = cmd.op == AO_INC ? left + 1 : left - 1;
+			_set_flags(res, size);
+			of = (res & size_mask(size)) == (cmd.op == AO_INC ? sign_bit(size) : sign_bit(size) - 1);
+			_write(cmd.left, size, res);
+			return;
+		case AO_NEG:
+			left = _read(cmd.left, size);
+			res = 0 - left;
+			_set_flags(res, size);
+			cf = left != 0;
+			of = left == sign_bit(size);
+			_write(cmd.left, size, res);
+			return;
+		case AO_NOT:
+			_write(cmd.left, size, ~_read(cmd.left, size));
+			return;
+		case AO_IMUL: {
+			if (cmd.right.type == SOT_NONE) {
+				int64_t prod = (int64_t)sign_extend(regs[AR_EAX], 4) * sign_extend(_read(cmd.left, 4), 4);
+				regs[AR_EAX] = (uint32_t)prod;
+				regs[AR_EDX] = (uint32_t)((uint64_t)prod >> 32);
+				cf = of = prod != (int32_t)prod;
+				return;
+			}
+			int64_t prod = (int64_t)sign_extend(_read(cmd.left, size), size) * sign_extend(_read(cmd.right, size), size);
+			_set_flags((uint32_t)prod, size);
+			cf = of = prod != sign_extend((uint32_t)prod, size);
+			_write(cmd.left, size, (uint32_t)prod);
+			return;
+		}
+		case AO_DIV: {
+			uint64_t divisor = _read(cmd.left, size);
+			if (!divisor)
+				throw SimulationError("Integer division by zero");
+			int bits = size * 8;
+			uint64_t dividend = size == 1 ? regs[AR_EAX] & 0xFFFF :
+				((uint64_t)(regs[AR_EDX] & size_mask(size)) << bits) | regs[AR_EAX] & size_mask(size);
+			uint64_t quot = dividend / divisor;
+			if (quot > size_mask(size))
+				throw SimulationError("Integer overflow in division");
+			uint32_t rem = (uint32_t)(dividend % divisor);
+			if (size == 1)
+				regs[AR_EAX] = regs[AR_EAX] & ~0xFFFFu | rem << 8 | (uint32_t)quot;
+			else {
+				regs[AR_EAX] = regs[AR_EAX] & ~size_mask(size) | (uint32_t)quot;
+				regs[AR_EDX] = regs[AR_EDX] & ~size_mask(size) | rem;
+			}
+			return;
+		}
+		case AO_SHL:
+		case AO_SHR: {
+			left = _read(cmd.left, size);
+			int count = _read(cmd.right, 1) & 31;
+			if (!count)
+				return;
+			int bits = size * 8;
+			if (cmd.op == AO_SHL) {
+				res = count < 32 ? left << count : 0;
+				cf = count <= bits && (left >> (bits - count) & 1);
+				of = ((res & sign_bit(size)) != 0) != cf;
+			} else {
+				res = left >> count;
+				cf = (left >> (count - 1) & 1) != 0;
+				of = (left & sign_bit(size)) != 0;
+			}
+			_set_flags(res, size);
+			_write(cmd.left, size, res);
+			return;
+		}
+		case AO_SETE:
+		case AO_SETNE:
+		case AO_SETL:
+		case AO_SETLE:
+		case AO_SETG:
+		case AO_SETGE:
+		case AO_SETB:
+		case AO_SETBE:
+		case AO_SETA:
+		case AO_SETAE:
+			_write(cmd.left, 1, _condition(cmd.op));
+			return;
+		case AO_JMP:
+			_jump(cmd.left);
+			return;
+		case AO_JZ:
+		case AO_JNZ:
+		case AO_JE:
+		case AO_JNE:
+		case AO_JL:
+		case AO_JLE:
+		case AO_JG:
+		case AO_JGE:
+		case AO_JB:
+		case AO_JBE:
+		case AO_JA:
+		case AO_JAE:
+			stats.branches++;
+			if (_condition(cmd.op)) {
+				stats.taken_branches++;
+				stats.cycles += SIM_TAKEN_BRANCH_COST;
+				_jump(cmd.left);
+			}
+			return;
+		case AO_CALL:
+			stats.calls++;
+			if (cmd.left.type == SOT_EXTERN) {
+				_call_extern((SIM_EXTERN)cmd.left.offset);
+				return;
+			}
+			_push(SIM_CODE_BASE + ip);
+			_jump(cmd.left);
+			return;
+		case AO_RET: {
+			uint32_t addr = _pop();
+			if (cmd.left.type != SOT_NONE)
+				regs[AR_ESP] += _read(cmd.left, 4);
+			if (addr == SIM_EXIT_ADDRESS) {
+				halted = true;
+				exit_code = regs[AR_EAX];
+				return;
+			}
+			asm_sim_oprnd_t target = { SOT_IMM, AR_NONE, AR_NONE, 0, (int32_t)addr, 4, 4 };
+			_jump(target);
+			return;
+		}
+	}
+	_exec_fpu(cmd);
+}
+
+int asm_machine_t::run(ostream& os) {
+	out = &os;
+	regs[AR_ESP] = memory.size();
+	_push(SIM_EXIT_ADDRESS);
+	stats.loads = stats.stores = stats.load_bytes = stats.store_bytes = 0;
+	ip = entry;
+	while (!halted) {
+		if (stats.instructions >= max_steps)
+			throw SimulationError("Step limit of " + to_string(max_steps) + " instructions exceeded");
+		const asm_sim_cmd_t& cmd = code[ip++];
+		long long loads = stats.loads;
+		long long stores = stats.stores;
+		long long cycles = stats.cycles;
+		try {
+			_exec(cmd);
+		} catch (SimulationError& e) {
+			ostringstream es;
+			es << e << " in " << func_names[cmd.func] << ": ";
+			if (cmd.list)
+				cmd.list->print_cmd(es, cmd.cmd);
+			else
+				es << asm_op_to_str.at(cmd.op);
+			throw SimulationError(es.str());
+		}
+		stats.cycles += cmd.cost + (stats.loads - loads) * SIM_LOAD_COST + (stats.stores - stores) * SIM_STORE_COST;
+		stats.instructions++;
+		stats.op_counts[cmd.op]++;
+		stats.func_counts[cmd.func].first++;
+		stats.func_counts[cmd.func].second += stats.cycles - cycles;
+	}
+	return exit_code;
+}
+
+const asm_sim_stats_t& asm_machine_t::get_stats() {
+	return stats;
+}
+
+void asm_machine_t::print_stats(ostream& os) {
+	os << std::left << setw(24) << "exit code" << std::right << setw(14) << exit_code << endl;
+	pair<const char*, long long> rows[] = {
+		{ "instructions", stats.instructions },
+		{ "estimated cycles", stats.cycles },
+		{ "memory loads", stats.loads },
+		{ "memory stores", stats.stores },
+		{ "bytes loaded", stats.load_bytes },
+		{ "bytes stored", stats.store_bytes },
+		{ "branches", stats.branches },
+		{ "taken branches", stats.taken_branches },
+		{ "calls", stats.calls },
+		{ "extern calls", stats.extern_calls },
+		{ "heap bytes", stats.heap_bytes },
+		{ "stack bytes", stats.stack_bytes },
+		{ "fpu stack faults", stats.fpu_faults },
+	};
+	for each (auto& row in rows)
+		os << std::left << setw(24) << row.first << std::right << setw(14) << row.second << endl;
+	vector<pair<long long, ASM_OPERATOR>> ops;
+	for (int i = 0; i < stats.op_counts.size(); i++)
+		if (stats.op_counts[i])
+			ops.push_back(make_pair(stats.op_counts[i], (ASM_OPERATOR)i));
+	sort(ops.rbegin(), ops.rend());
+	os << endl << std::left << setw(24) << "instruction" << std::right << setw(14) << "count" << endl;
+	for each (auto& op in ops)
+		os << std::left << setw(24) << asm_op_to_str.at(op.second) << std::right << setw(14) << op.first << endl;
+	os << endl << std::left << setw(24) << "function" << std::right << setw(14) << "instructions" << setw(14) << "cycles" << endl;
+	for (int i = 0; i < func_names.size(); i++)
+		if (stats.func_counts[i].first)
+			os << std::left << setw(24) << func_names[i] << std::right << setw(14) << stats.func_counts[i].first << setw(14) << stats.func_counts[i].second << endl;
+}
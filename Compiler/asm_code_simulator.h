@@ -0,0 +1,129 @@
+#pragma once
+#include "asm_generator.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <stdint.h>
+
+using namespace std;
+
+enum SIM_OPERAND_TYPE {
+	SOT_NONE,
+	SOT_REG,
+	SOT_IMM,
+	SOT_MEM,
+	SOT_CODE,
+	SOT_EXTERN
+};
+
+enum SIM_EXTERN {
+	SE_PRINTF,
+	SE_SCANF,
+	SE_MALLOC,
+	SE_FREE,
+	SE_EXIT
+};
+
+struct asm_sim_oprnd_t {
+	SIM_OPERAND_TYPE type;
+	ASM_REGISTER reg;
+	ASM_REGISTER offset_reg;
+	int scale;
+	int32_t offset;
+	int size;
+	int decl_size;
+};
+
+struct asm_sim_cmd_t {
+	ASM_OPERATOR op;
+	asm_sim_oprnd_t left;
+	asm_sim_oprnd_t right;
+	int cost;
+	int func;
+	asm_cmd_list_t* list;
+	asm_cmd_t cmd;
+};
+
+struct asm_sim_stats_t {
+	long long instructions;
+	long long cycles;
+	long long loads;
+	long long stores;
+	long long load_bytes;
+	long long store_bytes;
+	long long branches;
+	long long taken_branches;
+	long long calls;
+	long long extern_calls;
+	long long heap_bytes;
+	long long fpu_faults;
+	uint32_t stack_bytes;
+	vector<long long> op_counts;
+	vector<pair<long long, long long>> func_counts;
+};
+
+class asm_machine_t {
+	vector<asm_sim_cmd_t> code;
+	vector<string> func_names;
+	map<string, int> funcs;
+	map<string, pair<uint32_t, int>> globals;
+	map<string, uint32_t> literals;
+	vector<uint8_t> memory;
+	uint32_t data_end;
+	uint32_t heap_end;
+	uint32_t regs[AR_ST_7 + 1];
+	bool zf, sf, cf, of, pf;
+	double fpu[8];
+	bool fpu_used[8];
+	int fpu_top;
+	int fpu_status;
+	int entry;
+	int ip;
+	bool halted;
+	int exit_code;
+	long long max_steps;
+	istream* in;
+	ostream* out;
+	asm_sim_stats_t stats;
+
+	uint32_t _alloc_data(int size, int align);
+	uint32_t _literal(const string& data, int align);
+	void _add_list(asm_cmd_list_ptr list, int func);
+	asm_sim_oprnd_t _decode(asm_cmd_list_t* list, const asm_oprnd_t& op, const map<int, int>& labels);
+	uint8_t* _mem(uint32_t addr, int size);
+	uint32_t _peek(uint32_t addr);
+	double _peek_fp(uint32_t addr);
+	string _string(uint32_t addr);
+	uint32_t _load(uint32_t addr, int size);
+	void _store(uint32_t addr, int size, uint32_t val);
+	double _load_fp(uint32_t addr, int size);
+	void _store_fp(uint32_t addr, int size, double val);
+	uint32_t _addr(const asm_sim_oprnd_t& op);
+	uint32_t _read(const asm_sim_oprnd_t& op, int size);
+	void _write(const asm_sim_oprnd_t& op, int size, uint32_t val);
+	int _op_size(const asm_sim_cmd_t& cmd);
+	void _push(uint32_t val);
+	uint32_t _pop();
+	double _st(int i);
+	void _set_st(int i, double val);
+	void _fpu_push(double val);
+	double _fpu_pop();
+	void _set_flags(uint32_t res, int size);
+	bool _condition(ASM_OPERATOR op);
+	void _jump(const asm_sim_oprnd_t& target);
+	void _fpu_compare(double left, double right);
+	void _call_extern(SIM_EXTERN func);
+	string _format(uint32_t fmt, uint32_t args);
+	int _scan(uint32_t fmt, uint32_t args);
+	void _exec_fpu(const asm_sim_cmd_t& cmd);
+	void _exec(const asm_sim_cmd_t& cmd);
+public:
+	asm_machine_t(asm_gen_ptr gen);
+	void set_max_steps(long long steps);
+	void set_input(istream& is);
+	int run(ostream& os);
+	const asm_sim_stats_t& get_stats();
+	void print_stats(ostream& os);
+};
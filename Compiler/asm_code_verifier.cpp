@@ -0,0 +1,416 @@
+#include "asm_code_verifier.h"
+
+static string reg_atom(ASM_REGISTER reg) {
+	return "reg" + to_string(reg);
+}
+
+static string sym_atom(const asm_oprnd_t& op) {
+	return (op == AOT_VAR ? "var" : "sym") + to_string(op.sym);
+}
+
+static int wrap(long long val) {
+	return (int)(unsigned)val;
+}
+
+//------------------------------ASM_SYM_VAL-------------------------------------------
+
+asm_sym_val_t::asm_sym_val_t(int imm) : imm(imm) {}
+
+asm_sym_val_t::asm_sym_val_t(string atom) : imm(0) {
+	atoms[atom] = 1;
+}
+
+asm_sym_val_t asm_sym_val_t::operator+(const asm_sym_val_t& val) const {
+	asm_sym_val_t res = *this;
+	for each (auto& atom in val.atoms) {
+		int k = wrap((long long)res.atoms[atom.first] + atom.second);
+		if (k)
+			res.atoms[atom.first] = k;
+		else
+			res.atoms.erase(atom.first);
+	}
+	res.imm = wrap((long long)imm + val.imm);
+	return res;
+}
+
+asm_sym_val_t asm_sym_val_t::operator-(const asm_sym_val_t& val) const {
+	return *this + val * -1;
+}
+
+asm_sym_val_t asm_sym_val_t::operator*(int k) const {
+	asm_sym_val_t res(wrap((long long)imm * k));
+	for each (auto& atom in atoms) {
+		int c = wrap((long long)atom.second * k);
+		if (c)
+			res.atoms[atom.first] = c;
+	}
+	return res;
+}
+
+bool asm_sym_val_t::operator==(const asm_sym_val_t& val) const {
+	return imm == val.imm && atoms == val.atoms;
+}
+
+bool asm_sym_val_t::operator!=(const asm_sym_val_t& val) const {
+	return !operator==(val);
+}
+
+bool asm_sym_val_t::is_imm() const {
+	return atoms.empty();
+}
+
+bool asm_sym_val_t::is_atom() const {
+	return atoms.size() == 1 && atoms.begin()->second == 1 && !imm;
+}
+
+string asm_sym_val_t::str() const {
+	string res;
+	for each (auto& atom in atoms)
+		res += to_string(atom.second) + '*' + atom.first + '+';
+	return res + to_string(imm);
+}
+
+//------------------------------ASM_SYM_MACHINE-------------------------------------------
+
+asm_sym_machine_t::asm_sym_machine_t() : flags(string("flags")), fpu(string("fpu")) {
+	ASM_REGISTER gp_regs[] = { AR_EAX, AR_EBX, AR_ECX, AR_EDX, AR_ESI, AR_EDI, AR_EBP, AR_ESP };
+	for each (auto reg in gp_regs)
+		regs[reg] = asm_sym_val_t(reg_atom(reg));
+}
+
+asm_sym_val_t asm_sym_machine_t::_opaque(string name, const asm_sym_val_t& left, const asm_sym_val_t& right) {
+	return asm_sym_val_t(name + '(' + left.str() + ',' + right.str() + ')');
+}
+
+asm_sym_val_t asm_sym_machine_t::_trunc(const asm_sym_val_t& val, int size) {
+	if (size >= 4)
+		return val;
+	if (val.is_imm())
+		return asm_sym_val_t(val.imm & ((1 << size * 8) - 1));
+	if (val.is_atom()) {
+		string atom = val.atoms.begin()->first;
+		if (loads.count(atom) && loads[atom].size >= size) {
+			asm_sym_load_t load = loads[atom];
+			return _load_atom(load.addr, size, load.version);
+		}
+		if (merges.count(atom) && merges[atom].size >= size)
+			return _trunc(merges[atom].val, size);
+	}
+	return _opaque("trunc" + to_string(size), val, asm_sym_val_t());
+}
+
+asm_sym_val_t asm_sym_machine_t::_merge(const asm_sym_val_t& old, const asm_sym_val_t& val, int size) {
+	asm_sym_val_t part = _trunc(val, size);
+	asm_sym_val_t base = old;
+	if (old.is_atom() && merges.count(old.atoms.begin()->first) && merges[old.atoms.begin()->first].size <= size)
+		base = merges[old.atoms.begin()->first].old;
+	if (_trunc(base, size) == part)
+		return base;
+	asm_sym_val_t res = _opaque("merge" + to_string(size), base, part);
+	asm_sym_merge_t merge = { base, part, size };
+	merges[res.atoms.begin()->first] = merge;
+	return res;
+}
+
+asm_sym_val_t asm_sym_machine_t::_load_atom(const asm_sym_val_t& addr, int size, int version) {
+	string name = "load" + to_string(size) + '@' + to_string(version) + '[' + addr.str() + ']';
+	asm_sym_load_t load = { addr, size, version };
+	loads[name] = load;
+	return asm_sym_val_t(name);
+}
+
+asm_sym_val_t asm_sym_machine_t::_load(const asm_sym_val_t& addr, int size) {
+	for (int i = stores.size() - 1; i >= 0; i--) {
+		asm_sym_val_t diff = addr - stores[i].addr;
+		if (diff.is_imm()) {
+			if (!diff.imm && size <= stores[i].size)
+				return _trunc(stores[i].val, size);
+			if (diff.imm + size <= 0 || diff.imm >= stores[i].size)
+				continue;
+		} else if (_disjoint(addr, stores[i].addr))
+			continue;
+		return _load_atom(addr, size, i + 1);
+	}
+	return _load_atom(addr, size, 0);
+}
+
+void asm_sym_machine_t::_store(const asm_sym_val_t& addr, int size, const asm_sym_val_t& val) {
+	asm_sym_store_t store = { addr, size, _trunc(val, size) };
+	stores.push_back(store);
+}
+
+static int addr_region(const asm_sym_val_t& addr) {
+	if (addr.atoms.size() != 1 || addr.atoms.begin()->second != 1)
+		return 0;
+	string base = addr.atoms.begin()->first;
+	if (base == reg_atom(AR_EBP) || base == reg_atom(AR_ESP))
+		return 1;
+	if (base.compare(0, 3, "sym") == 0)
+		return 2;
+	return 0;
+}
+
+bool asm_sym_machine_t::_disjoint(const asm_sym_val_t& addr1, const asm_sym_val_t& addr2) {
+	int region1 = addr_region(addr1);
+	int region2 = addr_region(addr2);
+	return region1 && region2 && region1 != region2;
+}
+
+bool asm_sym_machine_t::_addr(const asm_oprnd_t& op, asm_sym_val_t& res) {
+	if (op == AOT_IDENT) {
+		res = asm_sym_val_t(sym_atom(op));
+		return true;
+	}
+	if (op != AOT_DEREF || !regs.count(op.reg))
+		return false;
+	res = regs[op.reg] + op.offset;
+	if (op.offset_reg != AR_NONE) {
+		if (!regs.count(op.offset_reg))
+			return false;
+		res = res + regs[op.offset_reg] * (op.scale ? op.scale : 1);
+	}
+	return true;
+}
+
+bool asm_sym_machine_t::_read(const asm_oprnd_t& op, int size, asm_sym_val_t& res) {
+	asm_sym_val_t addr;
+	switch (op.type) {
+		case AOT_REG:
+			if (!regs.count(asm_gen_t::parent_of(op.reg)))
+				return false;
+			res = _trunc(regs[asm_gen_t::parent_of(op.reg)], asm_gen_t::size_of(op.reg));
+			return true;
+		case AOT_IMM:
+			res = _trunc(asm_sym_val_t(op.imm), size);
+			return true;
+		case AOT_VAR:
+			res = _trunc(asm_sym_val_t(sym_atom(op)), size);
+			return true;
+		case AOT_ADDR:
+			res = asm_sym_val_t(sym_atom(op));
+			return true;
+		case AOT_IDENT:
+		case AOT_DEREF:
+			if (!_addr(op, addr))
+				return false;
+			res = _load(addr, op == AOT_DEREF ? asm_gen_t::size_of(op.mtype) : size);
+			return true;
+		default:
+			return false;
+	}
+}
+
+bool asm_sym_machine_t::_write(const asm_oprnd_t& op, int size, const asm_sym_val_t& val) {
+	asm_sym_val_t addr;
+	if (op == AOT_REG) {
+		ASM_REGISTER reg = asm_gen_t::parent_of(op.reg);
+		if (!regs.count(reg))
+			return false;
+		regs[reg] = op == reg ? val : _merge(regs[reg], val, asm_gen_t::size_of(op.reg));
+		return true;
+	}
+	if (op != AOT_IDENT && op != AOT_DEREF || !_addr(op, addr))
+		return false;
+	_store(addr, op == AOT_DEREF ? asm_gen_t::size_of(op.mtype) : size, val);
+	return true;
+}
+
+bool asm_sym_machine_t::_read_fpu(const asm_oprnd_t& op, asm_sym_val_t& res) {
+	switch (op.type) {
+		case AOT_NONE:
+			res = asm_sym_val_t();
+			return true;
+		case AOT_REG:
+			res = asm_sym_val_t("st" + to_string(op.reg));
+			return !regs.count(asm_gen_t::parent_of(op.reg));
+		case AOT_VAR:
+			res = asm_sym_val_t(sym_atom(op));
+			return true;
+		case AOT_DEREF:
+			return _read(op, asm_gen_t::size_of(op.mtype), res);
+		default:
+			return false;
+	}
+}
+
+int asm_sym_machine_t::_op_size(const asm_cmd_t& cmd) {
+	if (cmd.left == AOT_REG || cmd.left == AOT_DEREF)
+		return cmd.left.get_size();
+	if (cmd.right == AOT_REG || cmd.right == AOT_DEREF)
+		return cmd.right.get_size();
+	return 4;
+}
+
+bool asm_sym_machine_t::_exec_fpu(const asm_cmd_t& cmd) {
+	string name = "fpu" + to_string(cmd.op);
+	asm_sym_val_t left, right;
+	switch (cmd.op) {
+		case AO_FWAIT:
+			return true;
+		case AO_SAHF:
+			flags = _opaque(name, regs[AR_EAX], flags);
+			return true;
+		case AO_FSTSW:
+			return cmd.left == AOT_REG && _write(cmd.left, cmd.left.get_size(), _opaque(name, fpu, asm_sym_val_t()));
+		case AO_FST:
+		case AO_FSTP:
+		case AO_FIST:
+		case AO_FISTP:
+			if (cmd.left != AOT_DEREF)
+				break;
+			if (!_addr(cmd.left, left))
+				return false;
+			_store(left, asm_gen_t::size_of(cmd.left.mtype), _opaque(name, fpu, asm_sym_val_t()));
+			fpu = _opaque(name, fpu, asm_sym_val_t());
+			return true;
+	}
+	if (!_read_fpu(cmd.left, left) || !_read_fpu(cmd.right, right))
+		return false;
+	if (cmd == AO_FCOMIP)
+		flags = _opaque(name, fpu, flags);
+	fpu = _opaque(name, fpu, _opaque("", left, right));
+	return true;
+}
+
+bool asm_sym_machine_t::exec(const asm_cmd_t& cmd) {
+	if (!(cmd == ACT_OPERATOR))
+		return false;
+	switch (cmd.op) {
+		case AO_FILD:
+		case AO_FLD:
+		case AO_FST:
+		case AO_FSTP:
+		case AO_FIST:
+		case AO_FISTP:
+		case AO_FWAIT:
+		case AO_FADD:
+		case AO_FSUB:
+		case AO_FSUBR:
+		case AO_FDIV:
+		case AO_FDIVR:
+		case AO_FMUL:
+		case AO_FDECSTP:
+		case AO_FCHS:
+		case AO_FLD1:
+		case AO_FCOMPP:
+		case AO_FCOMIP:
+		case AO_FSTSW:
+		case AO_SAHF:
+			return _exec_fpu(cmd);
+	}
+	int size = _op_size(cmd);
+	if (size > 4)
+		return false;
+	string name = "op" + to_string(cmd.op) + '.' + to_string(size);
+	asm_sym_val_t left, right, res;
+	switch (cmd.op) {
+		case AO_NOP:
+			return true;
+		case AO_MOV:
+			return _read(cmd.right, size, right) && _write(cmd.left, size, right);
+		case AO_LEA:
+			return cmd.right == AOT_DEREF && _addr(cmd.right, res) && _write(cmd.left, size, res);
+		case AO_XCHG:
+			return _read(cmd.left, size, left) && _read(cmd.right, size, right) &&
+				_write(cmd.left, size, right) && _write(cmd.right, size, left);
+		case AO_PUSH:
+			if (size != 4 || !_read(cmd.left, size, left))
+				return false;
+			regs[AR_ESP] = regs[AR_ESP] - 4;
+			_store(regs[AR_ESP], 4, left);
+			return true;
+		case AO_POP:
+			if (size != 4 || cmd.left.like(asm_oprnd_t::make_reg(AR_ESP)))
+				return false;
+			left = _load(regs[AR_ESP], 4);
+			regs[AR_ESP] = regs[AR_ESP] + 4;
+			return _write(cmd.left, size, left);
+		case AO_ADD:
+		case AO_SUB:
+		case AO_IMUL:
+		case AO_XOR:
+		case AO_AND:
+		case AO_OR:
+		case AO_SHL:
+		case AO_SHR:
+		case AO_CMP:
+		case AO_TEST:
+			if (cmd.right == AOT_NONE || !_read(cmd.left, size, left) ||
+				!_read(cmd.right, cmd.right == AOT_REG ? cmd.right.get_size() : size, right))
+				return false;
+			switch (cmd.op) {
+				case AO_ADD: res = left + right; break;
+				case AO_SUB: res = left - right; break;
+				case AO_IMUL:
+					res = right.is_imm() ? left * right.imm : left.is_imm() ? right * left.imm : _opaque(name, left, right);
+					break;
+				case AO_XOR: res = left == right ? asm_sym_val_t(0) : _opaque(name, left, right); break;
+				case AO_AND:
+				case AO_OR: res = left == right ? left : _opaque(name, left, right); break;
+				case AO_SHL: res = right.is_imm() ? left * (int)(1u << (right.imm & 31)) : _opaque(name, left, right); break;
+				default: res = _opaque(name, left, right); break;
+			}
+			flags = cmd == AO_SHL || cmd == AO_SHR ?
+				_opaque("flags" + name, _opaque(name, left, right), flags) :
+				_opaque("flags" + name, left, right);
+			return cmd == AO_CMP || cmd == AO_TEST || _write(cmd.left, size, res);
+		case AO_NEG:
+		case AO_NOT:
+		case AO_INC:
+		case AO_DEC:
+			if (cmd.right != AOT_NONE || !_read(cmd.left, size, left))
+				return false;
+			if (cmd != AO_NOT)
+				flags = _opaque("flags" + name, left, flags);
+			res =
+				cmd == AO_NEG ? left * -1 :
+				cmd == AO_NOT ? asm_sym_val_t(-1) - left :
+				cmd == AO_INC ? left + 1 :
+				left - 1;
+			return _write(cmd.left, size, res);
+		case AO_SETE:
+		case AO_SETNE:
+		case AO_SETL:
+		case AO_SETLE:
+		case AO_SETG:
+		case AO_SETGE:
+		case AO_SETB:
+		case AO_SETBE:
+		case AO_SETA:
+		case AO_SETAE:
+			return size == 1 && _write(cmd.left, size, _opaque(name, flags, asm_sym_val_t()));
+		default:
+			return false;
+	}
+}
+
+bool asm_sym_machine_t::same_as(const asm_sym_machine_t& m, ASM_REGISTER dead_reg, bool dead_flags) const {
+	for each (auto& reg in regs)
+		if (reg.first != asm_gen_t::parent_of(dead_reg) && reg.second != m.regs.at(reg.first))
+			return false;
+	if (!dead_flags && flags != m.flags)
+		return false;
+	if (fpu != m.fpu)
+		return false;
+	if (stores.size() != m.stores.size())
+		return false;
+	for (int i = 0; i < stores.size(); i++)
+		if (stores[i].addr != m.stores[i].addr ||
+			stores[i].size != m.stores[i].size ||
+			stores[i].val != m.stores[i].val)
+			return false;
+	return true;
+}
+
+//------------------------------ASM_EQUIVALENCE-------------------------------------------
+
+bool asm_equivalent(const vector<asm_cmd_t>& before, const vector<asm_cmd_t>& after, ASM_REGISTER dead_reg, bool dead_flags) {
+	asm_sym_machine_t before_machine, after_machine;
+	for each (auto& cmd in before)
+		if (!before_machine.exec(cmd))
+			return false;
+	for each (auto& cmd in after)
+		if (!after_machine.exec(cmd))
+			return false;
+	return before_machine.same_as(after_machine, dead_reg, dead_flags);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "asm_generator.h"
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class asm_sym_val_t {
+public:
+	map<string, int> atoms;
+	int imm;
+	asm_sym_val_t(int imm = 0);
+	asm_sym_val_t(string atom);
+	asm_sym_val_t operator+(const asm_sym_val_t& val) const;
+	asm_sym_val_t operator-(const asm_sym_val_t& val) const;
+	asm_sym_val_t operator*(int k) const;
+	bool operator==(const asm_sym_val_t& val) const;
+	bool operator!=(const asm_sym_val_t& val) const;
+	bool is_imm() const;
+	bool is_atom() const;
+	string str() const;
+};
+
+struct asm_sym_store_t {
+	asm_sym_val_t addr;
+	int size;
+	asm_sym_val_t val;
+};
+
+struct asm_sym_load_t {
+	asm_sym_val_t addr;
+	int size;
+	int version;
+};
+
+struct asm_sym_merge_t {
+	asm_sym_val_t old;
+	asm_sym_val_t val;
+	int size;
+};
+
+class asm_sym_machine_t {
+	map<ASM_REGISTER, asm_sym_val_t> regs;
+	asm_sym_val_t flags;
+	asm_sym_val_t fpu;
+	vector<asm_sym_store_t> stores;
+	map<string, asm_sym_load_t> loads;
+	map<string, asm_sym_merge_t> merges;
+	asm_sym_val_t _opaque(string name, const asm_sym_val_t& left, const asm_sym_val_t& right);
+	asm_sym_val_t _trunc(const asm_sym_val_t& val, int size);
+	asm_sym_val_t _merge(const asm_sym_val_t& old, const asm_sym_val_t& val, int size);
+	asm_sym_val_t _load_atom(const asm_sym_val_t& addr, int size, int version);
+	asm_sym_val_t _load(const asm_sym_val_t& addr, int size);
+	void _store(const asm_sym_val_t& addr, int size, const asm_sym_val_t& val);
+	bool _disjoint(const asm_sym_val_t& addr1, const asm_sym_val_t& addr2);
+	bool _addr(const asm_oprnd_t& op, asm_sym_val_t& res);
+	bool _read(const asm_oprnd_t& op, int size, asm_sym_val_t& res);
+	bool _write(const asm_oprnd_t& op, int size, const asm_sym_val_t& val);
+	bool _read_fpu(const asm_oprnd_t& op, asm_sym_val_t& res);
+	int _op_size(const asm_cmd_t& cmd);
+	bool _exec_fpu(const asm_cmd_t& cmd);
+public:
+	asm_sym_machine_t();
+	bool exec(const asm_cmd_t& cmd);
+	bool same_as(const asm_sym_machine_t& m, ASM_REGISTER dead_reg, bool dead_flags) const;
+};
+
+bool asm_equivalent(const vector<asm_cmd_t>& before, const vector<asm_cmd_t>& after, ASM_REGISTER dead_reg, bool dead_flags);
@@ -0,0 +1,397 @@
+#include "asm_encoder.h"
+#include "exceptions.h"
+#include <cstring>
+#include <cctype>
+
+#define SHORT_JMP_SIZE 2
+#define NEAR_JMP_SIZE 5
+#define NEAR_JCC_SIZE 6
+
+extern map<ASM_REGISTER, string> asm_reg_to_str;
+extern map<ASM_OPERATOR, string> asm_op_to_str;
+
+static int reg_code(ASM_REGISTER reg) {
+	if (reg >= AR_XMM0 && reg <= AR_XMM7)
+		return reg - AR_XMM0;
+	if (reg >= AR_XMM8 && reg <= AR_XMM15)
+		return reg - AR_XMM8 + 8;
+	switch (asm_gen_t::parent_of(reg)) {
+		case AR_EAX: return 0;
+		case AR_ECX: return 1;
+		case AR_EDX: return 2;
+		case AR_EBX: return 3;
+		case AR_ESP: return 4;
+		case AR_EBP: return 5;
+		case AR_ESI: return 6;
+		case AR_EDI: return 7;
+		case AR_R8: return 8;
+		case AR_R9: return 9;
+		case AR_R10: return 10;
+		case AR_R11: return 11;
+		case AR_R12: return 12;
+		case AR_R13: return 13;
+		case AR_R14: return 14;
+		case AR_R15: return 15;
+	}
+	throw EncodeError("Can't encode register " + asm_reg_to_str.at(reg));
+}
+
+static int cond_code(ASM_OPERATOR op) {
+	switch (op) {
+		case AO_JB: case AO_SETB: return 0x2;
+		case AO_JAE: case AO_SETAE: return 0x3;
+		case AO_JZ: case AO_JE: case AO_SETE: return 0x4;
+		case AO_JNZ: case AO_JNE: case AO_SETNE: return 0x5;
+		case AO_JBE: case AO_SETBE: return 0x6;
+		case AO_JA: case AO_SETA: return 0x7;
+		case AO_JL: case AO_SETL: return 0xC;
+		case AO_JGE: case AO_SETGE: return 0xD;
+		case AO_JLE: case AO_SETLE: return 0xE;
+		case AO_JG: case AO_SETG: return 0xF;
+	}
+	return -1;
+}
+
+static bool is_imm8(int64_t val) {
+	return val >= -128 && val <= 127;
+}
+
+static uint8_t byte_op(int size, uint8_t opcode) {
+	return size == 1 ? opcode : opcode + 1;
+}
+
+static int sse_opcode(ASM_OPERATOR op) {
+	switch (op) {
+		case AO_MOVSD: return 0x10;
+		case AO_CVTSI2SD: return 0x2A;
+		case AO_CVTSD2SI: return 0x2D;
+		case AO_COMISD: return 0x2F;
+		case AO_ADDSD: return 0x58;
+		case AO_MULSD: return 0x59;
+		case AO_SUBSD: return 0x5C;
+		case AO_DIVSD: return 0x5E;
+	}
+	return -1;
+}
+
+asm_encoder_t::asm_encoder_t(asm_x64_gen_t& gen) : gen(gen), list(nullptr) {}
+
+// Only the program's own functions, data and literals and the C runtime may be referenced,
+// anything else would become an undefined symbol of the object file
+string asm_encoder_t::_symbol(const asm_oprnd_t& op) {
+	string name = list->idents[op.sym];
+	if (!symbols.count(name) && !gen.is_extern(name))
+		throw EncodeError("Undefined symbol " + name);
+	return name;
+}
+
+void asm_encoder_t::_imm(asm_insn_t& insn, int64_t val, int size) {
+	for (int i = 0; i < size; i++)
+		insn.bytes.push_back((uint8_t)(val >> i * 8));
+}
+
+void asm_encoder_t::_rm(asm_insn_t& insn, initializer_list<uint8_t> opcode, int size, int reg, const asm_oprnd_t& rm, int imm_size, uint8_t prefix, bool default64) {
+	uint8_t rex = size == 8 && !default64 ? 0x48 : 0x40;
+	if (reg & 8)
+		rex |= 0x4;
+	if (rm == AOT_REG && reg_code(rm.reg) & 8 || rm == AOT_DEREF && reg_code(rm.reg) & 8)
+		rex |= 0x1;
+	if (rm == AOT_DEREF && rm.offset_reg != AR_NONE && reg_code(rm.offset_reg) & 8)
+		rex |= 0x2;
+	if (size == 2)
+		insn.bytes.push_back(0x66);
+	if (prefix)
+		insn.bytes.push_back(prefix);
+	if (rex != 0x40)
+		insn.bytes.push_back(rex);
+	insn.bytes.insert(insn.bytes.end(), opcode);
+	reg &= 7;
+	switch (rm.type) {
+		case AOT_REG:
+			insn.bytes.push_back(0xC0 | reg << 3 | reg_code(rm.reg) & 7);
+			break;
+		case AOT_IDENT:
+		case AOT_ADDR: {
+			insn.bytes.push_back(reg << 3 | 5);
+			elf_reloc_t reloc = { insn.bytes.size(), _symbol(rm), ERT_PC32, -4 - imm_size };
+			insn.relocs.push_back(reloc);
+			_imm(insn, 0, 4);
+			break;
+		}
+		case AOT_DEREF: {
+			int base = reg_code(rm.reg) & 7;
+			bool sib = base == 4 || rm.offset_reg != AR_NONE;
+			int mod = !rm.offset && base != 5 ? 0 : is_imm8(rm.offset) ? 1 : 2;
+			insn.bytes.push_back(mod << 6 | reg << 3 | (sib ? 4 : base));
+			if (sib) {
+				int scale = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+				int index = rm.offset_reg != AR_NONE ? reg_code(rm.offset_reg) & 7 : 4;
+				insn.bytes.push_back(scale << 6 | index << 3 | base);
+			}
+			if (mod)
+				_imm(insn, rm.offset, mod == 1 ? 1 : 4);
+			break;
+		}
+		default:
+			throw EncodeError("Invalid memory operand");
+	}
+}
+
+void asm_encoder_t::_reg_op(asm_insn_t& insn, uint8_t opcode, int size, ASM_REGISTER reg) {
+	int code = reg_code(reg);
+	if (size == 2)
+		insn.bytes.push_back(0x66);
+	if (size == 8 || code & 8)
+		insn.bytes.push_back(0x40 | (size == 8 ? 0x8 : 0) | (code & 8 ? 0x1 : 0));
+	insn.bytes.push_back(opcode + (code & 7));
+}
+
+void asm_encoder_t::_alu(asm_insn_t& insn, int ext, const asm_cmd_t& cmd) {
+	int size = cmd.left.get_size();
+	if (cmd.right == AOT_IMM) {
+		int imm_size = size == 1 || is_imm8(cmd.right.imm) ? 1 : min(size, 4);
+		_rm(insn, { (uint8_t)(size == 1 ? 0x80 : imm_size == 1 ? 0x83 : 0x81) }, size, ext, cmd.left, imm_size);
+		_imm(insn, cmd.right.imm, imm_size);
+	} else if (cmd.right == AOT_REG)
+		_rm(insn, { byte_op(size, ext << 3) }, size, reg_code(cmd.right.reg), cmd.left);
+	else
+		_rm(insn, { byte_op(size, ext << 3 | 2) }, size, reg_code(cmd.left.reg), cmd.right);
+}
+
+// Scalar double instructions, movsd is the only one with a memory destination
+void asm_encoder_t::_sse(asm_insn_t& insn, const asm_cmd_t& cmd) {
+	const asm_oprnd_t& left = cmd.left;
+	const asm_oprnd_t& right = cmd.right;
+	int opcode = sse_opcode(cmd.op);
+	if (opcode < 0)
+		return;
+	if (cmd == AO_MOVSD && left != AOT_REG)
+		_rm(insn, { 0x0F, 0x11 }, 4, reg_code(right.reg), left, 0, 0xF2);
+	else if (cmd == AO_CVTSI2SD)
+		_rm(insn, { 0x0F, (uint8_t)opcode }, right.get_size(), reg_code(left.reg), right, 0, 0xF2);
+	else
+		_rm(insn, { 0x0F, (uint8_t)opcode }, cmd == AO_CVTSD2SI ? left.get_size() : 4, reg_code(left.reg), right, 0, cmd == AO_COMISD ? 0x66 : 0xF2);
+}
+
+asm_insn_t asm_encoder_t::_encode(const asm_cmd_t& cmd) {
+	asm_insn_t insn;
+	insn.label = -1;
+	insn.cond = -1;
+	insn.near = false;
+	const asm_oprnd_t& left = cmd.left;
+	const asm_oprnd_t& right = cmd.right;
+	int size = left.get_size();
+	switch (cmd.op) {
+		case AO_ADD: _alu(insn, 0, cmd); break;
+		case AO_OR: _alu(insn, 1, cmd); break;
+		case AO_AND: _alu(insn, 4, cmd); break;
+		case AO_SUB: _alu(insn, 5, cmd); break;
+		case AO_XOR: _alu(insn, 6, cmd); break;
+		case AO_CMP: _alu(insn, 7, cmd); break;
+		case AO_TEST:
+			if (right == AOT_IMM) {
+				_rm(insn, { byte_op(size, 0xF6) }, size, 0, left, min(size, 4));
+				_imm(insn, right.imm, min(size, 4));
+			} else if (right == AOT_REG)
+				_rm(insn, { byte_op(size, 0x84) }, size, reg_code(right.reg), left);
+			else
+				_rm(insn, { byte_op(size, 0x84) }, size, reg_code(left.reg), right);
+			break;
+		case AO_MOV:
+			if (right == AOT_IMM && left == AOT_REG && size < 8) {
+				_reg_op(insn, size == 1 ? 0xB0 : 0xB8, size, left.reg);
+				_imm(insn, right.imm, size);
+			} else if (right == AOT_IMM) {
+				_rm(insn, { byte_op(size, 0xC6) }, size, 0, left, min(size, 4));
+				_imm(insn, right.imm, min(size, 4));
+			} else if (right == AOT_REG)
+				_rm(insn, { byte_op(right.get_size(), 0x88) }, right.get_size(), reg_code(right.reg), left);
+			else
+				_rm(insn, { byte_op(size, 0x8A) }, size, reg_code(left.reg), right);
+			break;
+		case AO_XCHG:
+			if (right == AOT_REG)
+				_rm(insn, { byte_op(right.get_size(), 0x86) }, right.get_size(), reg_code(right.reg), left);
+			else
+				_rm(insn, { byte_op(size, 0x86) }, size, reg_code(left.reg), right);
+			break;
+		case AO_LEA:
+			_rm(insn, { 0x8D }, size, reg_code(left.reg), right);
+			break;
+		case AO_MOVSXD:
+			if (right.get_size() == 4)
+				_rm(insn, { 0x63 }, size, reg_code(left.reg), right);
+			else
+				_rm(insn, { 0x0F, (uint8_t)(right.get_size() == 1 ? 0xBE : 0xBF) }, size, reg_code(left.reg), right);
+			break;
+		case AO_INC: _rm(insn, { byte_op(size, 0xFE) }, size, 0, left); break;
+		case AO_DEC: _rm(insn, { byte_op(size, 0xFE) }, size, 1, left); break;
+		case AO_NOT: _rm(insn, { byte_op(size, 0xF6) }, size, 2, left); break;
+		case AO_NEG: _rm(insn, { byte_op(size, 0xF6) }, size, 3, left); break;
+		case AO_DIV: _rm(insn, { byte_op(size, 0xF6) }, size, 6, left); break;
+		case AO_IMUL:
+			if (right == AOT_NONE)
+				_rm(insn, { byte_op(size, 0xF6) }, size, 5, left);
+			else if (right == AOT_IMM) {
+				int imm_size = is_imm8(right.imm) ? 1 : min(size, 4);
+				_rm(insn, { (uint8_t)(imm_size == 1 ? 0x6B : 0x69) }, size, reg_code(left.reg), left, imm_size);
+				_imm(insn, right.imm, imm_size);
+			} else
+				_rm(insn, { 0x0F, 0xAF }, size, reg_code(left.reg), right);
+			break;
+		case AO_SHL:
+		case AO_SHR: {
+			int ext = cmd == AO_SHL ? 4 : 5;
+			if (right == AOT_REG)
+				_rm(insn, { byte_op(size, 0xD2) }, size, ext, left);
+			else if (right.imm == 1)
+				_rm(insn, { byte_op(size, 0xD0) }, size, ext, left);
+			else {
+				_rm(insn, { byte_op(size, 0xC0) }, size, ext, left, 1);
+				_imm(insn, right.imm, 1);
+			}
+			break;
+		}
+		case AO_PUSH:
+			if (left == AOT_REG)
+				_reg_op(insn, 0x50, 0, left.reg);
+			else if (left == AOT_IMM) {
+				insn.bytes.push_back(is_imm8(left.imm) ? 0x6A : 0x68);
+				_imm(insn, left.imm, is_imm8(left.imm) ? 1 : 4);
+			} else
+				_rm(insn, { 0xFF }, 8, 6, left, 0, 0, true);
+			break;
+		case AO_POP:
+			if (left == AOT_REG)
+				_reg_op(insn, 0x58, 0, left.reg);
+			else
+				_rm(insn, { 0x8F }, 8, 0, left, 0, 0, true);
+			break;
+		case AO_CALL:
+			if (left == AOT_IDENT || left == AOT_ADDR) {
+				string name = _symbol(left);
+				insn.bytes.push_back(0xE8);
+				elf_reloc_t reloc = { insn.bytes.size(), name, gen.is_extern(name) ? ERT_PLT32 : ERT_PC32, -4 };
+				insn.relocs.push_back(reloc);
+				_imm(insn, 0, 4);
+			} else
+				_rm(insn, { 0xFF }, 8, 2, left, 0, 0, true);
+			break;
+		case AO_RET:
+			if (left == AOT_IMM) {
+				insn.bytes.push_back(0xC2);
+				_imm(insn, left.imm, 2);
+			} else
+				insn.bytes.push_back(0xC3);
+			break;
+		case AO_NOP: insn.bytes.push_back(0x90); break;
+		case AO_SAHF: insn.bytes.push_back(0x9E); break;
+		case AO_SETE: case AO_SETNE: case AO_SETL: case AO_SETLE: case AO_SETG:
+		case AO_SETGE: case AO_SETB: case AO_SETBE: case AO_SETA: case AO_SETAE:
+			_rm(insn, { 0x0F, (uint8_t)(0x90 | cond_code(cmd.op)) }, 1, 0, left);
+			break;
+		case AO_JMP:
+		case AO_JZ: case AO_JNZ: case AO_JE: case AO_JNE: case AO_JL: case AO_JLE:
+		case AO_JG: case AO_JGE: case AO_JB: case AO_JBE: case AO_JA: case AO_JAE:
+			if (left != AOT_LABEL)
+				throw EncodeError("Can't encode indirect " + asm_op_to_str.at(cmd.op));
+			insn.label = left.label;
+			insn.cond = cond_code(cmd.op);
+			break;
+		default:
+			_sse(insn, cmd);
+	}
+	if (insn.bytes.empty() && insn.label < 0)
+		throw EncodeError("Can't encode " + asm_op_to_str.at(cmd.op));
+	return insn;
+}
+
+void asm_encoder_t::_encode_function(const asm_x64_func_t& func) {
+	list = func.cmd_list.get();
+	vector<asm_insn_t> insns;
+	map<int, int> labels;
+	for (asm_cmd_iter_t it = list->_begin(); it != list->_end(); ++it) {
+		if (*it == ACT_LABEL)
+			labels[it->left.label] = insns.size();
+		else if (*it == ACT_STR)
+			throw EncodeError("Can't encode raw assembly text");
+		else
+			insns.push_back(_encode(*it));
+	}
+	for each (auto& insn in insns)
+		if (insn.label >= 0 && !labels.count(insn.label))
+			throw EncodeError("Undefined label LABEL_" + to_string(insn.label));
+
+	// Jumps start short and only ever grow, so the layout converges
+	vector<int> offsets(insns.size() + 1);
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (int i = 0; i < insns.size(); i++)
+			offsets[i + 1] = offsets[i] + (insns[i].label < 0 ? insns[i].bytes.size() :
+				!insns[i].near ? SHORT_JMP_SIZE : insns[i].cond < 0 ? NEAR_JMP_SIZE : NEAR_JCC_SIZE);
+		for (int i = 0; i < insns.size(); i++)
+			if (insns[i].label >= 0 && !insns[i].near && !is_imm8(offsets[labels[insns[i].label]] - offsets[i + 1])) {
+				insns[i].near = true;
+				changed = true;
+			}
+	}
+
+	vector<uint8_t> code;
+	vector<elf_reloc_t> relocs;
+	for (int i = 0; i < insns.size(); i++) {
+		asm_insn_t& insn = insns[i];
+		if (insn.label >= 0) {
+			int rel = offsets[labels[insn.label]] - offsets[i + 1];
+			if (!insn.near)
+				insn.bytes = { (uint8_t)(insn.cond < 0 ? 0xEB : 0x70 | insn.cond) };
+			else if (insn.cond < 0)
+				insn.bytes = { 0xE9 };
+			else
+				insn.bytes = { 0x0F, (uint8_t)(0x80 | insn.cond) };
+			_imm(insn, rel, insn.near ? 4 : 1);
+		}
+		for each (auto reloc in insn.relocs) {
+			reloc.offset += code.size();
+			relocs.push_back(reloc);
+		}
+		code.insert(code.end(), insn.bytes.begin(), insn.bytes.end());
+	}
+
+	uint64_t offset = elf.append(ES_TEXT, code);
+	elf.add_symbol(func.name, ES_TEXT, offset, code.size(), func.name == "main", true);
+	for each (auto& reloc in relocs)
+		elf.add_reloc(ES_TEXT, offset + reloc.offset, reloc.symbol, reloc.type, reloc.addend);
+}
+
+elf_writer_t& asm_encoder_t::encode() {
+	for each (auto& func in gen.get_functions())
+		symbols.insert(func.name);
+	for each (auto& var in gen.get_data())
+		symbols.insert(var.name);
+	for each (auto& literal in gen.get_literals())
+		symbols.insert(literal.name);
+	for each (auto& func in gen.get_functions())
+		_encode_function(func);
+	for each (auto& var in gen.get_data())
+		elf.add_symbol(var.name, ES_BSS, elf.reserve(ES_BSS, var.size, var.align), var.size);
+	for each (auto& literal in gen.get_literals()) {
+		vector<uint8_t> bytes;
+		int align = 1;
+		if (auto fp = dynamic_pointer_cast<var_t<double>>(literal.value)) {
+			double val = fp->get_val();
+			bytes.resize(sizeof(val));
+			memcpy(&bytes[0], &val, sizeof(val));
+			align = sizeof(val);
+		} else {
+			string str = unescape(static_pointer_cast<var_t<string>>(literal.value)->get_val());
+			bytes.assign(str.begin(), str.end());
+			bytes.push_back(0);
+		}
+		elf.add_symbol(literal.name, ES_RODATA, elf.append(ES_RODATA, bytes, align), bytes.size());
+	}
+	return elf;
+}
+
+void asm_encoder_t::write_object(ostream& os) {
+	encode().write(os);
+}
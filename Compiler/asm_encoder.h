@@ -0,0 +1,35 @@
+#pragma once
+#include "asm_x64.h"
+#include "elf_writer.h"
+#include <initializer_list>
+#include <set>
+
+using namespace std;
+
+struct asm_insn_t {
+	vector<uint8_t> bytes;
+	vector<elf_reloc_t> relocs;
+	int label;
+	int cond;
+	bool near;
+};
+
+class asm_encoder_t {
+	asm_x64_gen_t& gen;
+	asm_cmd_list_t* list;
+	elf_writer_t elf;
+	set<string> symbols;
+
+	string _symbol(const asm_oprnd_t& op);
+	void _rm(asm_insn_t& insn, initializer_list<uint8_t> opcode, int size, int reg, const asm_oprnd_t& rm, int imm_size = 0, uint8_t prefix = 0, bool default64 = false);
+	void _imm(asm_insn_t& insn, int64_t val, int size);
+	void _reg_op(asm_insn_t& insn, uint8_t opcode, int size, ASM_REGISTER reg);
+	void _alu(asm_insn_t& insn, int ext, const asm_cmd_t& cmd);
+	void _sse(asm_insn_t& insn, const asm_cmd_t& cmd);
+	asm_insn_t _encode(const asm_cmd_t& cmd);
+	void _encode_function(const asm_x64_func_t& func);
+public:
+	asm_encoder_t(asm_x64_gen_t& gen);
+	elf_writer_t& encode();
+	void write_object(ostream& os);
+};
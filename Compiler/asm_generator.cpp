@@ -1,5 +1,7 @@
 #include "asm_generator.h"
 #include "asm_code_optimnizer.h"
+#include <sstream>
+#include <cstring>
 #include <assert.h>
 #include <map>
 
@@ -15,6 +17,20 @@ map<ASM_MEM_TYPE, string> asm_mt_to_str;
 map<ASM_MEM_TYPE, int> size_of_mtype;
 map<int, ASM_MEM_TYPE> mem_type_by_size;
 map<ASM_OPERAND_PREFIX, string> asm_aop_to_str;
+vector<string> asm_reg_names;
+vector<string> asm_op_names;
+vector<string> asm_mt_names;
+static thread_local ASM_TARGET asm_target = AT_X86;
+
+template<typename K>
+static void fill_names(vector<string>& names, const map<K, string>& src) {
+	names.clear();
+	for each (auto& it in src) {
+		if (it.first >= (int)names.size())
+			names.resize(it.first + 1);
+		names[it.first] = it.second;
+	}
+}
 
 static string lower_case(char cstr[]) {
 	string res(cstr);
@@ -49,178 +65,110 @@ void asm_generator_init() {
 #include "asm_mem_type.h"
 #undef register_mem_type
 
-	init_asm_code_optimizer();
-}
-
-//------------------------------ASM_REGISTER_OPERAND-------------------------------------------
-
-asm_reg_oprnd_t::asm_reg_oprnd_t(ASM_REGISTER reg) : reg(reg) {}
-asm_reg_oprnd_t::asm_reg_oprnd_t(ASM_REGISTER reg, int reg_size) : reg(asm_gen_t::reg_by_size(reg, reg_size)) {}
-
-asm_reg_oprnd_t::asm_reg_oprnd_t(ASM_REGISTER reg, ASM_MEM_TYPE reg_size) : reg(asm_gen_t::reg_by_mtype(reg, reg_size)) {}
-
-bool asm_reg_oprnd_t::operator==(ASM_OPERAND_TYPE op) {
-	return op == AOT_REG;
-}
-
-bool asm_reg_oprnd_t::operator==(ASM_REGISTER reg_) {
-	return reg == reg_;
-}
-
-bool asm_reg_oprnd_t::operator==(asm_oprnd_ptr op) {
-	return op == AOT_REG ? static_pointer_cast<asm_reg_oprnd_t>(op)->reg == reg : false;
-}
-
-bool asm_reg_oprnd_t::like(ASM_REGISTER reg_) {
-	return parent_of_map.at(reg) == parent_of_map.at(reg_);
-}
-
-bool asm_reg_oprnd_t::like(asm_oprnd_ptr op) {
-	return op == AOT_REG ? like(static_pointer_cast<asm_reg_oprnd_t>(op)->reg) : false;
-}
-
-int asm_reg_oprnd_t::get_size() {
-	return asm_gen_t::size_of(reg);
-}
-
-ASM_REGISTER asm_reg_oprnd_t::get_reg() {
-	return reg;
-}
-
-void asm_reg_oprnd_t::set_reg(ASM_REGISTER reg_) {
-	reg = reg_;
-}
-
-void asm_reg_oprnd_t::print(ostream& os) {
-	os << asm_reg_to_str.at(reg);
+	fill_names(asm_reg_names, asm_reg_to_str);
+	fill_names(asm_op_names, asm_op_to_str);
+	fill_names(asm_mt_names, asm_mt_to_str);
 }
 
-//------------------------------ASM_IDENT_OPERAND-------------------------------------------
-
-asm_ident_operand_t::asm_ident_operand_t(string name) : name(name) {}
+//------------------------------ASM_OPERAND-------------------------------------------
 
-bool asm_ident_operand_t::operator==(ASM_OPERAND_TYPE op) {
-	return op == AOT_IDENT;
+asm_oprnd_t asm_oprnd_t::make_reg(ASM_REGISTER reg, int reg_size) {
+	asm_oprnd_t res = {};
+	res.type = AOT_REG;
+	res.reg = asm_gen_t::reg_by_size(reg, reg_size);
+	return res;
 }
 
-void asm_ident_operand_t::print(ostream& os) {
-	os << name;
+asm_oprnd_t asm_oprnd_t::make_reg(ASM_REGISTER reg, ASM_MEM_TYPE reg_size) {
+	return make_reg(reg, asm_gen_t::size_of(reg_size));
 }
 
-//------------------------------ASM_CONSTANT_OPERAND-------------------------------------------
-
-asm_const_oprnd_t::asm_const_oprnd_t(var_ptr var) : var(var) {}
-
-var_ptr asm_const_oprnd_t::get_var() {
-	return var;
-}
-
-void asm_const_oprnd_t::print(ostream& os) {
-	var->asm_print(os);
+asm_oprnd_t asm_oprnd_t::make_deref(ASM_MEM_TYPE mtype, ASM_REGISTER reg, int offset, ASM_REGISTER offset_reg, int scale) {
+	assert(reg);
+	asm_oprnd_t res = {};
+	res.type = AOT_DEREF;
+	res.mtype = mtype;
+	res.reg = reg;
+	res.offset_reg = offset_reg;
+	res.offset = offset;
+	res.scale = scale;
+	return res;
 }
 
-bool asm_const_oprnd_t::operator==(ASM_OPERAND_TYPE op) {
-	return op == AOT_VAR;
+asm_oprnd_t asm_oprnd_t::make_imm(int imm) {
+	asm_oprnd_t res = {};
+	res.type = AOT_IMM;
+	res.imm = imm;
+	return res;
 }
 
-//------------------------------ASM_ADRESS_OPERAND-------------------------------------------
-
-asm_addr_ident_oprnd_t::asm_addr_ident_oprnd_t(string name) : name(name) {}
-
-void asm_addr_ident_oprnd_t::print(ostream& os) {
-	os << "OFFSET " << name;
+asm_oprnd_t asm_oprnd_t::make_label(asm_label_t label) {
+	asm_oprnd_t res = {};
+	res.type = AOT_LABEL;
+	res.label = label.id;
+	return res;
 }
 
-asm_addr_reg_oprnd_t::asm_addr_reg_oprnd_t(ASM_REGISTER reg, int offset) : reg(reg), offset(offset) {}
-
-void asm_addr_reg_oprnd_t::print(ostream& os) {
-	os << asm_reg_to_str.at(reg) << " + " << offset;
+asm_oprnd_t asm_oprnd_t::make_sym(ASM_OPERAND_TYPE type, int sym) {
+	asm_oprnd_t res = {};
+	res.type = type;
+	res.sym = sym;
+	return res;
 }
 
-//------------------------------ASM_DEREFERENCE_OPERAND-------------------------------------------
-
-asm_deref_oprnd_t::asm_deref_oprnd_t(int offset, int scale) : offset(offset), scale(scale) {}
-
-void asm_deref_oprnd_t::set_offset(int offset_) {
-	offset = offset_;
+bool asm_oprnd_t::operator==(ASM_OPERAND_TYPE type_) const {
+	return type == type_;
 }
 
-void asm_deref_oprnd_t::add_offset(int offset_) {
-	offset += offset_;
+bool asm_oprnd_t::operator!=(ASM_OPERAND_TYPE type_) const {
+	return type != type_;
 }
 
-void asm_deref_oprnd_t::set_scale(int scale_) {
-	scale = scale_;
+bool asm_oprnd_t::operator==(ASM_REGISTER reg_) const {
+	return type == AOT_REG && reg == reg_;
 }
 
-int asm_deref_oprnd_t::get_scale() {
-	return scale;
+bool asm_oprnd_t::operator!=(ASM_REGISTER reg_) const {
+	return !operator==(reg_);
 }
 
-int asm_deref_oprnd_t::get_offset() {
-	return offset;
+bool asm_oprnd_t::operator==(const asm_oprnd_t& op) const {
+	if (type != op.type)
+		return false;
+	switch (type) {
+		case AOT_NONE: return true;
+		case AOT_REG: return reg == op.reg;
+		case AOT_IMM: return imm == op.imm;
+		case AOT_LABEL: return label == op.label;
+		case AOT_DEREF: return mtype == op.mtype && reg == op.reg && offset_reg == op.offset_reg && scale == op.scale && offset == op.offset;
+		default: return sym == op.sym;
+	}
 }
 
-bool asm_deref_oprnd_t::operator==(ASM_OPERAND_TYPE op) {
-	return op == AOT_DEREF;
+bool asm_oprnd_t::operator!=(const asm_oprnd_t& op) const {
+	return !operator==(op);
 }
 
-asm_deref_reg_oprnd_t::asm_deref_reg_oprnd_t(ASM_MEM_TYPE mtype, ASM_REGISTER reg, int offset, ASM_REGISTER offset_reg, int scale) : 
-	asm_deref_oprnd_t(offset, scale), mtype(mtype), reg(reg), offset_reg(offset_reg) {
-	assert(reg);
+bool asm_oprnd_t::like(ASM_REGISTER reg_) const {
+	return type == AOT_REG && asm_gen_t::parent_of(reg) == asm_gen_t::parent_of(reg_);
 }
 
-ASM_REGISTER asm_deref_reg_oprnd_t::get_offset_reg() {
-	return offset_reg;
+bool asm_oprnd_t::like(const asm_oprnd_t& op) const {
+	if (type == AOT_REG)
+		return op.like(reg);
+	if (type == AOT_DEREF)
+		return op.like(reg) || op.like(offset_reg);
+	return false;
 }
 
-ASM_REGISTER asm_deref_reg_oprnd_t::get_reg() {
-	return reg;
+int asm_oprnd_t::get_size() const {
+	return type == AOT_REG ? asm_gen_t::size_of(reg) : asm_gen_t::size_of(mtype);
 }
 
-void asm_deref_reg_oprnd_t::set_op_size(int size) {
+void asm_oprnd_t::set_op_size(int size) {
 	mtype = asm_gen_t::mtype_by_size(size);
 }
 
-void asm_deref_reg_oprnd_t::set_op_size(ASM_MEM_TYPE mtype_) {
-	mtype = mtype_;
-}
-
-void asm_deref_reg_oprnd_t::set_reg(ASM_REGISTER reg_) {
-	reg = reg_;
-}
-
-void asm_deref_reg_oprnd_t::set_offset_reg(ASM_REGISTER reg_) {
-	offset_reg = reg_;
-}
-
-int asm_deref_reg_oprnd_t::get_op_size() {
-	return asm_gen_t::size_of(mtype);
-}
-
-bool asm_deref_reg_oprnd_t::like(asm_oprnd_ptr op) {
-	return op->like(reg) || op->like(offset_reg);
-}
-
-bool asm_deref_reg_oprnd_t::like_reg(asm_oprnd_ptr op) {
-	return op == reg;
-}
-
-bool asm_deref_reg_oprnd_t::like_offset_reg(asm_oprnd_ptr op) {
-	return op == offset_reg;
-}
-
-void asm_deref_reg_oprnd_t::print(ostream& os) {
-	os << asm_mt_to_str.at(mtype) << " PTR [" << asm_reg_to_str.at(reg);
-	if (offset_reg != AR_NONE)
-		os << " + " << asm_reg_to_str.at(offset_reg);
-	if (scale)
-		os << " * " << scale;
-	if (offset)
-		os << " + " << offset;
-	os << ']';
-}
-
 //------------------------------ASM_GLOBAL_VAR-------------------------------------------
 
 asm_global_var_t::asm_global_var_t(string name, ASM_MEM_TYPE type, asm_cmd_list_ptr init_commands, int dup) : 
@@ -229,129 +177,134 @@ asm_global_var_t::asm_global_var_t(string name, ASM_MEM_TYPE type, asm_cmd_list_
 asm_global_var_t::asm_global_var_t(string name, ASM_MEM_TYPE type, int dup) :
 	name(name), type(type), dup(dup) {}
 
-void asm_global_var_t::print_alloc(ostream& os) {
-	os << name << ' ' << asm_mt_to_str.at(type);
+void asm_global_var_t::print_alloc(out_buffer_t& os) {
+	os << name << ' ' << asm_mt_names[type];
 	if (dup)
 		os << ' ' << dup << " dup (0)";
 	else
 		os << " 0";
-	os << endl;
+	os << '\n';
 }
 
-void asm_global_var_t::print_init(ostream& os) {
+void asm_global_var_t::print_init(out_buffer_t& os) {
 	init_commands->print(os);
 }
 
-//------------------------------ASM_FUNCTION-------------------------------------------
+//------------------------------ASM-------------------------------------------
 
-asm_function_t::asm_function_t(string name, asm_cmd_list_ptr cmd_list) : name(name), cmd_list(cmd_list) {}
-
-void asm_function_t::optimize() {
-	asm_optimize_code(cmd_list);
+void asm_t::print(ostream& os) {
+	out_buffer_t buf(os);
+	print(buf);
 }
 
-void asm_function_t::print(ostream& os) {
-	os << name << " PROC" << endl;
+//------------------------------ASM_FUNCTION-------------------------------------------
+
+asm_function_t::asm_function_t(string name, asm_cmd_list_ptr cmd_list, string signature) : name(name), signature(signature), cmd_list(cmd_list) {}
+
+void asm_function_t::print(out_buffer_t& os) {
+	os << name << " PROC\n";
 	cmd_list->print(os);
-	os << "ret" << endl;
-	os << name << " ENDP" << endl;
+	os << "ret\n";
+	os << name << " ENDP\n";
 }
 
 //------------------------------ASM_COMMANDS-------------------------------------------
 
-//------------------------------ASM_LABEL-------------------------------------------
-
-asm_label_oprnd_t::asm_label_oprnd_t() {
-	id = global_id++;
+asm_oprnd_t& asm_cmd_t::get_left() {
+	return left;
 }
 
-bool asm_label_oprnd_t::operator==(ASM_OPERAND_TYPE op) {
-	return op == AOT_LABEL;
+asm_oprnd_t& asm_cmd_t::get_right() {
+	return right;
 }
 
-int asm_label_oprnd_t::global_id = 0;
+void asm_cmd_t::set_left(const asm_oprnd_t& op) {
+	left = op;
+}
 
-void asm_label_oprnd_t::print(ostream& os) {
-	os << "LABEL_" << id;
+void asm_cmd_t::set_right(const asm_oprnd_t& op) {
+	right = op;
 }
 
-//------------------------------ASM_STR_COMMAND-------------------------------------------
+void asm_cmd_t::set_op(ASM_OPERATOR op_) {
+	op = op_;
+}
 
-asm_str_cmd_t::asm_str_cmd_t(string str) : str(str) {}
+bool asm_cmd_t::operator==(ASM_OPERATOR op_) const {
+	return type == ACT_OPERATOR && op == op_;
+}
 
-void asm_str_cmd_t::print(ostream& os) {
-	os << str;
+bool asm_cmd_t::operator!=(ASM_OPERATOR op_) const {
+	return !operator==(op_);
 }
 
-//------------------------------ASM_OPERATOR-------------------------------------------
+bool asm_cmd_t::operator==(ASM_COMMAND_TYPE ct) const {
+	return type == ct;
+}
 
-asm_operator_t::asm_operator_t(ASM_OPERATOR op, asm_oprnd_ptr left_operand, asm_oprnd_ptr right_operand) : 
-	op(op), left_operand(left_operand), right_operand(right_operand) {}
+//------------------------------ASM_COMMAND_ITERATOR-------------------------------------------
 
-asm_operator_t::asm_operator_t(ASM_OPERATOR op, asm_oprnd_ptr left_operand) : op(op), left_operand(left_operand) {}
+asm_cmd_iter_t::asm_cmd_iter_t() : list(nullptr), node(-1) {}
 
-asm_operator_t::asm_operator_t(ASM_OPERATOR op) : op(op) {}
+asm_cmd_iter_t::asm_cmd_iter_t(asm_cmd_list_t* list, int node) : list(list), node(node) {}
 
-asm_oprnd_ptr asm_operator_t::get_left() {
-	return left_operand;
+asm_cmd_t& asm_cmd_iter_t::operator*() const {
+	return list->commands.at(node);
 }
 
-asm_oprnd_ptr asm_operator_t::get_right() {
-	return right_operand;
+asm_cmd_t* asm_cmd_iter_t::operator->() const {
+	return &operator*();
 }
 
-void asm_operator_t::set_left(asm_oprnd_ptr op) {
-	left_operand = op;
+asm_cmd_iter_t& asm_cmd_iter_t::operator++() {
+	if (node != -1)
+		node = list->commands[node].next;
+	return *this;
 }
 
-void asm_operator_t::set_right(asm_oprnd_ptr op) {
-	right_operand = op;
+asm_cmd_iter_t& asm_cmd_iter_t::operator--() {
+	node = node == -1 ? list->tail : list->commands[node].prev;
+	return *this;
 }
 
-void asm_operator_t::set_op(ASM_OPERATOR op_) {
-	op = op_;
+asm_cmd_iter_t asm_cmd_iter_t::operator+(int n) const {
+	asm_cmd_iter_t res = *this;
+	for (; n > 0 && res.node != -1; n--)
+		++res;
+	return res;
 }
 
-bool asm_operator_t::operator==(ASM_OPERATOR op_) {
-	return op == op_;
+asm_cmd_iter_t asm_cmd_iter_t::operator-(int n) const {
+	asm_cmd_iter_t res = *this;
+	for (; n > 0; n--)
+		if ((--res).node == -1)
+			break;
+	return res;
 }
 
-bool asm_operator_t::operator==(ASM_COMMAND_TYPE ct) {
-	return ct == ACT_OPERATOR;
+bool asm_cmd_iter_t::operator==(const asm_cmd_iter_t& it) const {
+	return node == it.node;
 }
 
-void asm_operator_t::print(ostream& os) {
-	os << asm_op_to_str.at(op);
-	if (left_operand) {
-		os << ' ';
-		left_operand->print(os);
-	}
-	if (right_operand) {
-		os << ", ";
-		right_operand->print(os);
-	}
+bool asm_cmd_iter_t::operator!=(const asm_cmd_iter_t& it) const {
+	return node != it.node;
 }
 
-//------------------------------ASM_LABEL_OPERATOR-------------------------------------------
-
-asm_label_oprtr_t::asm_label_oprtr_t(asm_label_ptr label) : label(label) {}
-
-void asm_label_oprtr_t::print(ostream& os) {
-	label->print(os);
-	os << ':';
-}
-
-bool asm_label_oprtr_t::operator==(ASM_COMMAND_TYPE ct) {
-	return ct == ACT_LABEL;
+int asm_cmd_iter_t::get_node() const {
+	return node;
 }
 
 //------------------------------ASM_COMANNDS_LIST-------------------------------------------
 
+asm_cmd_list_t::asm_cmd_list_t() : head(-1), tail(-1), free_head(-1), count(0), insert_pos(-1), labels_count(0) {}
+
 #define register_asm_op(op_name, op_incode_name)\
 	void asm_cmd_list_t::op_incode_name() \
 	{_add_op(AO_##op_name);}\
-	void asm_cmd_list_t::op_incode_name(asm_oprnd_ptr operand)\
+	void asm_cmd_list_t::op_incode_name(asm_oprnd_t operand)\
 	{_add_op(AO_##op_name, operand);}\
+	void asm_cmd_list_t::op_incode_name(asm_label_t label)\
+	{_add_op(AO_##op_name, asm_oprnd_t::make_label(label));}\
 	void asm_cmd_list_t::op_incode_name(ASM_REGISTER operand, int operand_size)\
 	{_add_op(AO_##op_name, operand, operand_size);}\
 	void asm_cmd_list_t::op_incode_name(var_ptr operand)\
@@ -410,28 +363,53 @@ bool asm_label_oprtr_t::operator==(ASM_COMMAND_TYPE ct) {
 #include "asm_op.h"
 #undef register_op
 
-void asm_cmd_list_t::_add_op(ASM_OPERATOR op, asm_oprnd_ptr operand) {
-	commands.push_back(asm_cmd_ptr(new asm_operator_t(op, operand)));
+asm_oprnd_t asm_cmd_list_t::_ident(string name, ASM_OPERAND_TYPE type) {
+	auto it = ident_ids.find(name);
+	if (it == ident_ids.end()) {
+		it = ident_ids.insert(make_pair(name, (int)idents.size())).first;
+		idents.push_back(name);
+	}
+	return asm_oprnd_t::make_sym(type, it->second);
+}
+
+asm_oprnd_t asm_cmd_list_t::_const(var_ptr var) {
+	if (typeid(*var.get()) == typeid(var_t<int>) || typeid(*var.get()) == typeid(var_t<char>))
+		return asm_oprnd_t::make_imm(var_pointer_cast<int>(var)->get_val());
+	vars.push_back(var);
+	return asm_oprnd_t::make_sym(AOT_VAR, vars.size() - 1);
+}
+
+void asm_cmd_list_t::_push_cmd(ASM_COMMAND_TYPE type, ASM_OPERATOR op, asm_oprnd_t left, asm_oprnd_t right) {
+	asm_cmd_t cmd = {};
+	cmd.type = type;
+	cmd.op = op;
+	cmd.left = left;
+	cmd.right = right;
+	_insert(asm_cmd_iter_t(this, insert_pos), cmd);
+}
+
+void asm_cmd_list_t::_add_op(ASM_OPERATOR op, asm_oprnd_t operand) {
+	_push_cmd(ACT_OPERATOR, op, operand, asm_oprnd_t());
 }
 
 void asm_cmd_list_t::_add_op(ASM_OPERATOR op, ASM_REGISTER operand, int operand_size) {
-	_add_op(op, asm_oprnd_ptr(new asm_reg_oprnd_t(operand, operand_size)));
+	_add_op(op, asm_oprnd_t::make_reg(operand, operand_size));
 }
 
 void asm_cmd_list_t::_add_op(ASM_OPERATOR op, var_ptr operand) {
-	_add_op(op, asm_oprnd_ptr(new asm_const_oprnd_t(operand)));
+	_add_op(op, _const(operand));
 }
 
 void asm_cmd_list_t::_add_op(ASM_OPERATOR op, string operand) {
-	_add_op(op, asm_oprnd_ptr(new asm_ident_operand_t(operand)));
+	_add_op(op, _ident(operand));
 }
 
 void asm_cmd_list_t::_add_op_addr(ASM_OPERATOR op, string operand) {
-	_add_op(op, asm_oprnd_ptr(new asm_addr_ident_oprnd_t(operand)));
+	_add_op(op, _ident(operand, AOT_ADDR));
 }
 
 void asm_cmd_list_t::_add_op_deref(ASM_OPERATOR op, ASM_REGISTER operand, ASM_MEM_TYPE mtype, int offset, ASM_REGISTER offset_reg, int scale) {
-	_add_op(op, asm_oprnd_ptr(new asm_deref_reg_oprnd_t(mtype, operand, offset, offset_reg, scale)));
+	_add_op(op, asm_oprnd_t::make_deref(mtype, operand, offset, offset_reg, scale));
 }
 
 void asm_cmd_list_t::_add_op_deref(ASM_OPERATOR op, ASM_REGISTER operand, int operand_size, int offset, ASM_REGISTER offset_reg, int scale) {
@@ -439,43 +417,43 @@ void asm_cmd_list_t::_add_op_deref(ASM_OPERATOR op, ASM_REGISTER operand, int op
 }
 
 void asm_cmd_list_t::_add_op(ASM_OPERATOR op) {
-	commands.push_back(asm_cmd_ptr(new asm_operator_t(op)));
+	_push_cmd(ACT_OPERATOR, op, asm_oprnd_t(), asm_oprnd_t());
 }
 
-void asm_cmd_list_t::_add_op(ASM_OPERATOR op, asm_oprnd_ptr left, asm_oprnd_ptr right) {
-	commands.push_back(asm_cmd_ptr(new asm_operator_t(op, left, right)));
+void asm_cmd_list_t::_add_op(ASM_OPERATOR op, asm_oprnd_t left, asm_oprnd_t right) {
+	_push_cmd(ACT_OPERATOR, op, left, right);
 }
 
 void asm_cmd_list_t::_add_op(ASM_OPERATOR op, ASM_REGISTER left, ASM_REGISTER right, int operand_size) {
-	_add_op(op, asm_oprnd_ptr(new asm_reg_oprnd_t(left, operand_size)), asm_oprnd_ptr(new asm_reg_oprnd_t(right, operand_size)));
+	_add_op(op, asm_oprnd_t::make_reg(left, operand_size), asm_oprnd_t::make_reg(right, operand_size));
 }
 
 void asm_cmd_list_t::_add_op(ASM_OPERATOR op, ASM_REGISTER left, var_ptr right, int operand_size) {
-	_add_op(op, asm_oprnd_ptr(new asm_reg_oprnd_t(left, operand_size)), asm_oprnd_ptr(new asm_const_oprnd_t(right)));
+	_add_op(op, asm_oprnd_t::make_reg(left, operand_size), _const(right));
 }
 
 void asm_cmd_list_t::_add_op(ASM_OPERATOR op, ASM_REGISTER left, string right, int operand_size) {
-	_add_op(op, asm_oprnd_ptr(new asm_reg_oprnd_t(left, operand_size)), asm_oprnd_ptr(new asm_ident_operand_t(right)));
+	_add_op(op, asm_oprnd_t::make_reg(left, operand_size), _ident(right));
 }
 
 void asm_cmd_list_t::_add_op_raddr(ASM_OPERATOR op, ASM_REGISTER left, string right) {
-	_add_op(op, asm_oprnd_ptr(new asm_reg_oprnd_t(left)), asm_oprnd_ptr(new asm_addr_ident_oprnd_t(right)));
+	_add_op(op, asm_oprnd_t::make_reg(left), _ident(right, AOT_ADDR));
 }
 
 void asm_cmd_list_t::_add_op_raddr(ASM_OPERATOR op, string left, string right) {
-	_add_op(op, asm_oprnd_ptr(new asm_ident_operand_t(left)), asm_oprnd_ptr(new asm_addr_ident_oprnd_t(right)));
+	_add_op(op, _ident(left), _ident(right, AOT_ADDR));
 }
 
 void asm_cmd_list_t::_add_op(ASM_OPERATOR op, string left, ASM_REGISTER right, int operand_size) {
-	_add_op(op, asm_oprnd_ptr(new asm_ident_operand_t(left)), asm_oprnd_ptr(new asm_reg_oprnd_t(right, operand_size)));
+	_add_op(op, _ident(left), asm_oprnd_t::make_reg(right, operand_size));
 }
 
 void asm_cmd_list_t::_add_op(ASM_OPERATOR op, string left, var_ptr right) {
-	_add_op(op, asm_oprnd_ptr(new asm_ident_operand_t(left)), asm_oprnd_ptr(new asm_const_oprnd_t(right)));
+	_add_op(op, _ident(left), _const(right));
 }
 
 void asm_cmd_list_t::_add_op_lderef(ASM_OPERATOR op, ASM_REGISTER left, ASM_REGISTER right, ASM_MEM_TYPE mtype, int offset, ASM_REGISTER offset_reg, int scale) {
-	_add_op(op, asm_oprnd_ptr(new asm_deref_reg_oprnd_t(mtype, left, offset, offset_reg, scale)), asm_oprnd_ptr(new asm_reg_oprnd_t(right, mtype)));
+	_add_op(op, asm_oprnd_t::make_deref(mtype, left, offset, offset_reg, scale), asm_oprnd_t::make_reg(right, mtype));
 }
 
 void asm_cmd_list_t::_add_op_lderef(ASM_OPERATOR op, ASM_REGISTER left, ASM_REGISTER right, int operand_size, int offset, ASM_REGISTER offset_reg, int scale) {
@@ -483,7 +461,7 @@ void asm_cmd_list_t::_add_op_lderef(ASM_OPERATOR op, ASM_REGISTER left, ASM_REGI
 }
 
 void asm_cmd_list_t::_add_op_lderef_ls(ASM_OPERATOR op, ASM_REGISTER left, ASM_REGISTER right, ASM_MEM_TYPE mtype, int offset, ASM_REGISTER offset_reg, int scale) {
-	_add_op(op, asm_oprnd_ptr(new asm_deref_reg_oprnd_t(mtype, left, offset, offset_reg, scale)), asm_oprnd_ptr(new asm_reg_oprnd_t(right)));
+	_add_op(op, asm_oprnd_t::make_deref(mtype, left, offset, offset_reg, scale), asm_oprnd_t::make_reg(right));
 }
 
 void asm_cmd_list_t::_add_op_lderef_ls(ASM_OPERATOR op, ASM_REGISTER left, ASM_REGISTER right, int operand_size, int offset, ASM_REGISTER offset_reg, int scale) {
@@ -491,7 +469,7 @@ void asm_cmd_list_t::_add_op_lderef_ls(ASM_OPERATOR op, ASM_REGISTER left, ASM_R
 }
 
 void asm_cmd_list_t::_add_op_lderef(ASM_OPERATOR op, ASM_REGISTER left, var_ptr right, ASM_MEM_TYPE mtype, int offset, ASM_REGISTER offset_reg, int scale) {
-	_add_op(op, asm_oprnd_ptr(new asm_deref_reg_oprnd_t(mtype, left, offset, offset_reg, scale)), asm_oprnd_ptr(new asm_const_oprnd_t(right)));
+	_add_op(op, asm_oprnd_t::make_deref(mtype, left, offset, offset_reg, scale), _const(right));
 }
 
 void asm_cmd_list_t::_add_op_lderef(ASM_OPERATOR op, ASM_REGISTER left, var_ptr right, int operand_size, int offset, ASM_REGISTER offset_reg, int scale) {
@@ -499,7 +477,7 @@ void asm_cmd_list_t::_add_op_lderef(ASM_OPERATOR op, ASM_REGISTER left, var_ptr
 }
 
 void asm_cmd_list_t::_add_op_lderef(ASM_OPERATOR op, ASM_REGISTER left, string right, ASM_MEM_TYPE mtype, int offset, ASM_REGISTER offset_reg, int scale) {
-	_add_op(op, asm_oprnd_ptr(new asm_deref_reg_oprnd_t(mtype, left, offset, offset_reg, scale)), asm_oprnd_ptr(new asm_ident_operand_t(right)));
+	_add_op(op, asm_oprnd_t::make_deref(mtype, left, offset, offset_reg, scale), _ident(right));
 }
 
 void asm_cmd_list_t::_add_op_lderef(ASM_OPERATOR op, ASM_REGISTER left, string right, int operand_size, int offset, ASM_REGISTER offset_reg, int scale) {
@@ -507,7 +485,7 @@ void asm_cmd_list_t::_add_op_lderef(ASM_OPERATOR op, ASM_REGISTER left, string r
 }
 
 void asm_cmd_list_t::_add_op_rderef(ASM_OPERATOR op, ASM_REGISTER left, ASM_REGISTER right, ASM_MEM_TYPE mtype, int offset, ASM_REGISTER offset_reg, int scale) {
-	_add_op(op, asm_oprnd_ptr(new asm_reg_oprnd_t(left, mtype)), asm_oprnd_ptr(new asm_deref_reg_oprnd_t(mtype, right, offset, offset_reg, scale)));
+	_add_op(op, asm_oprnd_t::make_reg(left, mtype), asm_oprnd_t::make_deref(mtype, right, offset, offset_reg, scale));
 }
 
 void asm_cmd_list_t::_add_op_rderef(ASM_OPERATOR op, ASM_REGISTER left, ASM_REGISTER right, int operand_size, int offset, ASM_REGISTER offset_reg, int scale) {
@@ -515,7 +493,7 @@ void asm_cmd_list_t::_add_op_rderef(ASM_OPERATOR op, ASM_REGISTER left, ASM_REGI
 }
 
 void asm_cmd_list_t::_add_op_rderef(ASM_OPERATOR op, string left, ASM_REGISTER right, ASM_MEM_TYPE mtype, int offset, ASM_REGISTER offset_reg, int scale) {
-	_add_op(op, asm_oprnd_ptr(new asm_ident_operand_t(left)), asm_oprnd_ptr(new asm_deref_reg_oprnd_t(mtype, right, offset, offset_reg, scale)));
+	_add_op(op, _ident(left), asm_oprnd_t::make_deref(mtype, right, offset, offset_reg, scale));
 }
 
 void asm_cmd_list_t::_add_op_rderef(ASM_OPERATOR op, string left, ASM_REGISTER right, int operand_size, int offset, ASM_REGISTER offset_reg, int scale) {
@@ -539,9 +517,10 @@ void asm_cmd_list_t::_copy_to_mem(ASM_REGISTER src_reg, ASM_REGISTER dest_reg, i
 }
 
 void asm_cmd_list_t::_copy_to_stack(ASM_REGISTER src_reg, int size, int src_offset) {
-	size = asm_gen_t::alignment(size) - asm_gen_t::size_of(AMT_DWORD);
-	for (int i = size; i >= 0; i -= asm_gen_t::size_of(AMT_DWORD))
-		push_deref(src_reg, AMT_DWORD, i + src_offset);
+	int slot = asm_gen_t::ptr_size();
+	size = asm_gen_t::stack_alignment(size) - slot;
+	for (int i = size; i >= 0; i -= slot)
+		push_deref(src_reg, asm_gen_t::mtype_by_size(slot), i + src_offset);
 }
 
 void asm_cmd_list_t::_alloc_in_stack(int size) {
@@ -570,77 +549,339 @@ void asm_cmd_list_t::_cast_char_to_int(ASM_REGISTER src_reg, ASM_REGISTER dst_re
 	mov(dst_reg, src_reg, asm_gen_t::size_of(AMT_BYTE));
 }
 
-asm_label_ptr asm_cmd_list_t::_new_label() {
-	return asm_label_ptr(new asm_label_oprnd_t);
+asm_label_t asm_cmd_list_t::_new_label() {
+	asm_label_t res = { labels_count++ };
+	return res;
 }
 
-asm_label_ptr asm_cmd_list_t::_insert_new_label() {
-	asm_label_ptr res = _new_label();
+asm_label_t asm_cmd_list_t::_insert_new_label() {
+	asm_label_t res = _new_label();
 	_insert_label(res);
 	return res;
 }
 
-void asm_cmd_list_t::_insert_label(asm_label_ptr label) {
-	commands.push_back(asm_cmd_ptr(new asm_label_oprtr_t(label)));
+void asm_cmd_list_t::_insert_label(asm_label_t label) {
+	_push_cmd(ACT_LABEL, AO_NOP, asm_oprnd_t::make_label(label), asm_oprnd_t());
+}
+
+int asm_cmd_list_t::_labels_count() {
+	return labels_count;
+}
+
+void asm_cmd_list_t::_shift_labels(int base) {
+	for (asm_cmd_iter_t it = _begin(); it != _end(); ++it) {
+		if (it->left == AOT_LABEL)
+			it->left.label += base;
+		if (it->right == AOT_LABEL)
+			it->right.label += base;
+	}
 }
 
 int asm_cmd_list_t::_size() {
-	return commands.size();
+	return count;
+}
+
+asm_cmd_iter_t asm_cmd_list_t::_begin() {
+	return asm_cmd_iter_t(this, head);
+}
+
+asm_cmd_iter_t asm_cmd_list_t::_end() {
+	return asm_cmd_iter_t(this, -1);
 }
 
-asm_cmd_ptr asm_cmd_list_t::operator[](int i) {
-	return commands.at(i);
+bool asm_cmd_list_t::_has(asm_cmd_iter_t it, int n) {
+	for (; n > 0; n--, ++it)
+		if (it == _end())
+			return false;
+	return true;
 }
 
-shared_ptr<asm_operator_t> asm_cmd_list_t::get_op(int i) {
-	return static_pointer_cast<asm_operator_t>(operator[](i));
+asm_cmd_t& asm_cmd_list_t::operator[](asm_cmd_iter_t it) {
+	return *it;
 }
 
-void asm_cmd_list_t::_erase(int i) {
-	commands.erase(commands.begin() + i);
+asm_cmd_t* asm_cmd_list_t::get_op(asm_cmd_iter_t it) {
+	return &*it;
 }
 
-void asm_cmd_list_t::_erase(int from, int to) {
-	commands.erase(commands.begin() + from, commands.begin() + to);
+asm_cmd_iter_t asm_cmd_list_t::_insert(asm_cmd_iter_t pos, const asm_cmd_t& cmd) {
+	int node = free_head;
+	if (node != -1) {
+		free_head = commands[node].next;
+		commands[node] = cmd;
+	} else {
+		node = commands.size();
+		commands.push_back(cmd);
+	}
+	int next = pos.get_node();
+	int prev = next == -1 ? tail : commands[next].prev;
+	commands[node].prev = prev;
+	commands[node].next = next;
+	if (prev == -1)
+		head = node;
+	else
+		commands[prev].next = node;
+	if (next == -1)
+		tail = node;
+	else
+		commands[next].prev = node;
+	count++;
+	return asm_cmd_iter_t(this, node);
+}
+
+void asm_cmd_list_t::_set_insert_pos(asm_cmd_iter_t pos) {
+	insert_pos = pos.get_node();
+}
+
+void asm_cmd_list_t::_erase(asm_cmd_iter_t it) {
+	int node = it.get_node();
+	assert(node != -1);
+	int prev = commands[node].prev;
+	int next = commands[node].next;
+	if (prev == -1)
+		head = next;
+	else
+		commands[prev].next = next;
+	if (next == -1)
+		tail = prev;
+	else
+		commands[next].prev = prev;
+	if (insert_pos == node)
+		insert_pos = next;
+	commands[node].next = free_head;
+	free_head = node;
+	count--;
+}
+
+void asm_cmd_list_t::_erase(asm_cmd_iter_t from, asm_cmd_iter_t to) {
+	while (from != to) {
+		asm_cmd_iter_t next = from + 1;
+		_erase(from);
+		from = next;
+	}
+}
+
+void asm_cmd_list_t::_compact() {
+	vector<asm_cmd_t> res;
+	res.reserve(count);
+	for (int node = head; node != -1; node = commands[node].next) {
+		res.push_back(commands[node]);
+		res.back().prev = res.size() - 2;
+		res.back().next = res.size();
+	}
+	if (!res.empty())
+		res.back().next = -1;
+	commands.swap(res);
+	head = commands.empty() ? -1 : 0;
+	tail = commands.size() - 1;
+	free_head = -1;
+	insert_pos = -1;
 }
 
 void asm_cmd_list_t::_push_str(string str) {
-	commands.push_back(asm_cmd_ptr(new asm_str_cmd_t(str)));
+	_push_cmd(ACT_STR, AO_NOP, _ident(str), asm_oprnd_t());
+}
+
+static void serialize_oprnd(ostream& os, const asm_oprnd_t& op) {
+	os << ' ' << op.type << ' ' << op.mtype << ' ' << op.reg << ' ' << op.offset_reg << ' ' << op.scale << ' ' << op.offset << ' ' << op.imm;
+}
+
+static void serialize_str(ostream& os, const string& str) {
+	os << str.size() << ' ' << str;
+}
+
+static bool deserialize_str(istream& is, size_t limit, string& str) {
+	size_t len;
+	if (!(is >> len) || is.get() != ' ' || len > limit)
+		return false;
+	str.assign(len, 0);
+	return !len || is.read(&str[0], len);
+}
+
+// Everything read from a cache file is checked against the enums and tables before use, the file may be damaged
+bool asm_cmd_list_t::_deserialize_oprnd(istream& is, asm_oprnd_t& op) {
+	int type, mtype, reg, offset_reg;
+	op = asm_oprnd_t();
+	if (!(is >> type >> mtype >> reg >> offset_reg >> op.scale >> op.offset >> op.imm))
+		return false;
+	if (type < AOT_NONE || type > AOT_LABEL || mtype < 0 || mtype >= (int)asm_mt_names.size() ||
+		reg < 0 || reg >= (int)asm_reg_names.size() || offset_reg < 0 || offset_reg >= (int)asm_reg_names.size() ||
+		op.scale != 0 && op.scale != 1 && op.scale != 2 && op.scale != 4 && op.scale != 8)
+		return false;
+	op.type = (ASM_OPERAND_TYPE)type;
+	op.mtype = (ASM_MEM_TYPE)mtype;
+	op.reg = (ASM_REGISTER)reg;
+	op.offset_reg = (ASM_REGISTER)offset_reg;
+	switch (op.type) {
+		case AOT_IDENT:
+		case AOT_ADDR: return op.sym >= 0 && op.sym < (int)idents.size();
+		case AOT_VAR: return op.sym >= 0 && op.sym < (int)vars.size();
+		case AOT_LABEL: return op.label >= 0 && op.label < labels_count;
+	}
+	return true;
+}
+
+// Constants keep their type: doubles are stored bit for bit and strings with their length,
+// so a list read back prints and encodes exactly like the one that was stored.
+// An empty result means the list holds a constant that can't be stored
+string asm_cmd_list_t::serialize() const {
+	ostringstream os;
+	os << labels_count << ' ' << idents.size() << ' ' << vars.size() << ' ' << count << '\n';
+	for each (auto& ident in idents)
+		serialize_str(os, ident);
+	for each (auto& var in vars) {
+		if (auto d = dynamic_cast<var_t<double>*>(var.get())) {
+			unsigned long long bits;
+			memcpy(&bits, &d->get_val(), sizeof(bits));
+			os << " d " << bits;
+		} else if (auto str = dynamic_cast<var_t<string>*>(var.get())) {
+			os << " s ";
+			serialize_str(os, str->get_val());
+		} else if (auto i = dynamic_cast<var_t<int>*>(var.get()))
+			os << " i " << i->get_val();
+		else
+			return "";
+	}
+	for (int node = head; node != -1; node = commands[node].next) {
+		const asm_cmd_t& cmd = commands[node];
+		os << '\n' << cmd.type << ' ' << cmd.op;
+		serialize_oprnd(os, cmd.left);
+		serialize_oprnd(os, cmd.right);
+	}
+	return os.str();
+}
+
+bool asm_cmd_list_t::deserialize(const string& data) {
+	istringstream is(data);
+	int idents_count, vars_count, size;
+	if (!(is >> labels_count >> idents_count >> vars_count >> size) || labels_count < 0 ||
+		idents_count < 0 || idents_count > data.size() || vars_count < 0 || vars_count > data.size() || size < 0 || size > data.size())
+		return false;
+	for (int i = 0; i < idents_count; i++) {
+		string ident;
+		if (!deserialize_str(is, data.size(), ident) || ident_ids.count(ident))
+			return false;
+		_ident(ident);
+	}
+	for (int i = 0; i < vars_count; i++) {
+		char kind;
+		if (!(is >> kind))
+			return false;
+		if (kind == 'd') {
+			unsigned long long bits;
+			double val;
+			if (!(is >> bits))
+				return false;
+			memcpy(&val, &bits, sizeof(val));
+			vars.push_back(new_var<double>(val));
+		} else if (kind == 's') {
+			string val;
+			if (!deserialize_str(is, data.size(), val))
+				return false;
+			vars.push_back(new_var<string>(val));
+		} else if (kind == 'i') {
+			int val;
+			if (!(is >> val))
+				return false;
+			vars.push_back(new_var<int>(val));
+		} else
+			return false;
+	}
+	for (int i = 0; i < size; i++) {
+		int type, op;
+		asm_oprnd_t left, right;
+		if (!(is >> type >> op) || type < ACT_LABEL || type > ACT_STR || op < 0 || op >= (int)asm_op_names.size() ||
+			!_deserialize_oprnd(is, left) || !_deserialize_oprnd(is, right))
+			return false;
+		if (type == ACT_STR && left != AOT_IDENT || type == ACT_LABEL && left != AOT_LABEL)
+			return false;
+		_push_cmd((ASM_COMMAND_TYPE)type, (ASM_OPERATOR)op, left, right);
+	}
+	return true;
+}
+
+void asm_cmd_list_t::print_oprnd(out_buffer_t& os, const asm_oprnd_t& op) {
+	switch (op.type) {
+		case AOT_REG: os << asm_reg_names[op.reg]; break;
+		case AOT_IDENT: os << idents[op.sym]; break;
+		case AOT_VAR: vars[op.sym]->asm_print(os); break;
+		case AOT_IMM: os << op.imm; break;
+		case AOT_ADDR: os << "OFFSET " << idents[op.sym]; break;
+		case AOT_LABEL: os << "LABEL_" << op.label; break;
+		case AOT_DEREF:
+			os << asm_mt_names[op.mtype] << " PTR [" << asm_reg_names[op.reg];
+			if (op.offset_reg != AR_NONE)
+				os << " + " << asm_reg_names[op.offset_reg];
+			if (op.scale)
+				os << " * " << op.scale;
+			if (op.offset)
+				os << " + " << op.offset;
+			os << ']';
+			break;
+	}
 }
 
-void asm_cmd_list_t::print(ostream& os) {
-	for each (auto cmd in commands) {
-		cmd->print(os);
-		os << endl;
+void asm_cmd_list_t::print_cmd(out_buffer_t& os, const asm_cmd_t& cmd) {
+	switch (cmd.type) {
+		case ACT_LABEL:
+			print_oprnd(os, cmd.left);
+			os << ':';
+			break;
+		case ACT_STR:
+			os << idents[cmd.left.sym];
+			break;
+		case ACT_OPERATOR:
+			os << asm_op_names[cmd.op];
+			if (cmd.left != AOT_NONE) {
+				os << ' ';
+				print_oprnd(os, cmd.left);
+			}
+			if (cmd.right != AOT_NONE) {
+				os << ", ";
+				print_oprnd(os, cmd.right);
+			}
+			break;
+	}
+}
+
+void asm_cmd_list_t::print_cmd(ostream& os, const asm_cmd_t& cmd) {
+	out_buffer_t buf(os);
+	print_cmd(buf, cmd);
+}
+
+void asm_cmd_list_t::print(out_buffer_t& os) {
+	for (asm_cmd_iter_t it = _begin(); it != _end(); ++it) {
+		print_cmd(os, *it);
+		os << '\n';
 	}
 }
 
 //------------------------------ASM_GENERATOR-------------------------------------------
 
-void asm_gen_t::print_header(ostream& os) {
+void asm_gen_t::print_header(out_buffer_t& os) {
 	os <<
-		".686" << endl <<
-		".model flat, C" << endl <<
-		"option casemap : none" << endl <<
-		"include \\masm32\\include\\msvcrt.inc" << endl <<
-		"includelib \\masm32\\lib\\msvcrt.lib" << endl <<
-		"R8 macro value:req" << endl <<
-		"LOCAL lbl" << endl << 
-		".data" << endl <<
-		"lbl REAL8 value" << endl <<
-		".code" << endl <<
-		"EXITM <lbl>" << endl <<
-		"endm" << endl <<
-		"STR_LITERAL macro value : req" << endl <<
-		"LOCAL lbl" << endl <<
-		".data" << endl <<
-		"lbl BYTE value, 0" << endl <<
-		".code" << endl <<
-		"EXITM <lbl>" << endl <<
-		"endm" << endl <<
-		".DATA" << endl <<
-		DOUBLE_BUFF_NAME << " QWORD 0" << endl <<
-		INT_BUFF_NAME << " DWORD 0" << endl;
+		".686\n"
+		".model flat, C\n"
+		"option casemap : none\n"
+		"include \\masm32\\include\\msvcrt.inc\n"
+		"includelib \\masm32\\lib\\msvcrt.lib\n"
+		"R8 macro value:req\n"
+		"LOCAL lbl\n"
+		".data\n"
+		"lbl REAL8 value\n"
+		".code\n"
+		"EXITM <lbl>\n"
+		"endm\n"
+		"STR_LITERAL macro value : req\n"
+		"LOCAL lbl\n"
+		".data\n"
+		"lbl BYTE value, 0\n"
+		".code\n"
+		"EXITM <lbl>\n"
+		"endm\n"
+		".DATA\n" <<
+		DOUBLE_BUFF_NAME << " QWORD 0\n" <<
+		INT_BUFF_NAME << " DWORD 0\n";
 }
 
 void asm_gen_t::add_global_var(string name, ASM_MEM_TYPE mem_type, int dup) {
@@ -651,35 +892,47 @@ void asm_gen_t::add_global_var(string name, ASM_MEM_TYPE mem_type, asm_cmd_list_
 	global_vars.push_back(shared_ptr<asm_global_var_t>(new asm_global_var_t(name, mem_type, init_cmd_list, dup)));
 }
 
-void asm_gen_t::add_function(string name, asm_cmd_list_ptr cmd_list) {
-	functions.push_back(shared_ptr<asm_function_t>(new asm_function_t(name, cmd_list)));
+void asm_gen_t::add_function(string name, asm_cmd_list_ptr cmd_list, string signature) {
+	functions.push_back(shared_ptr<asm_function_t>(new asm_function_t(name, cmd_list, signature)));
 }
 
 void asm_gen_t::set_main_cmd_list(asm_cmd_list_ptr cmd_list) {
 	main_cmd_list = cmd_list;
 }
 
-void asm_gen_t::optimize() {
-	asm_optimize_code(main_cmd_list);
-	for each (auto var in functions)
-		var->optimize();
-}
-
-void asm_gen_t::print(ostream& os) {
+void asm_gen_t::print(out_buffer_t& os) {
 	print_header(os);
 
 	for each (auto var in global_vars)
 		var->print_alloc(os);
 
-	os << ".CODE" << endl;
+	os << ".CODE\n";
 	for each (auto func in functions)
 		func->print(os);
-	os << "start:" << endl;
+	os << "start:\n";
 	for each (auto var in global_vars)
 		var->print_init(os);
 	main_cmd_list->print(os);
-	os << "invoke crt__exit, 0" << endl;
-	os << "end start" << endl;
+	os << "invoke crt__exit, 0\n";
+	os << "end start\n";
+}
+
+void asm_gen_t::set_target(ASM_TARGET target) {
+	asm_target = target;
+}
+
+ASM_TARGET asm_gen_t::get_target() {
+	return asm_target;
+}
+
+int asm_gen_t::ptr_size() {
+	return asm_target == AT_X64 ? size_of(AMT_QWORD) : size_of(AMT_DWORD);
+}
+
+int asm_gen_t::stack_alignment(int size) {
+	if (asm_target == AT_X86)
+		return alignment(size);
+	return size + (ptr_size() - size % ptr_size()) % ptr_size();
 }
 
 int asm_gen_t::alignment(int size) {
@@ -721,66 +974,6 @@ ASM_REGISTER asm_gen_t::parent_of(ASM_REGISTER reg) {
 	return parent_of_map.at(reg);
 }
 
-bool asm_cmd_t::operator==(ASM_OPERATOR) {
-	return false;
-}
-
-bool asm_cmd_t::operator==(ASM_COMMAND_TYPE) {
-	return false;
-}
-
-bool asm_cmd_ptr::operator==(ASM_OPERATOR op) {
-	return get()->operator==(op);
-}
-
-bool asm_cmd_ptr::operator!=(ASM_OPERATOR op) {
-	return !(*this == op);
-}
-
-bool asm_cmd_ptr::operator==(ASM_COMMAND_TYPE ct) {
-	return get()->operator==(ct);
-}
-
-asm_cmd_ptr asm_cmd_list_ptr::operator[](int i) {
-	return get()->operator[](i);
-}
-
-bool asm_operand_t::operator==(ASM_OPERAND_TYPE) {
-	return false;
-}
-
-bool asm_operand_t::operator==(ASM_REGISTER) {
-	return false;
-}
-
-bool asm_operand_t::operator==(asm_oprnd_ptr op) {
-	return false;
-}
-
-bool asm_operand_t::like(asm_oprnd_ptr op) {
-	return false;
-}
-
-bool asm_operand_t::like(ASM_REGISTER reg) {
-	return false;
-}
-
-bool asm_oprnd_ptr::operator==(ASM_OPERAND_TYPE op) {
-	return get() ? get()->operator==(op) : false;
-}
-
-bool asm_oprnd_ptr::operator!=(ASM_OPERAND_TYPE op) {
-	return !operator==(op);
-}
-
-bool asm_oprnd_ptr::operator==(ASM_REGISTER reg_) {
-	return get() ? get()->operator==(reg_) : false;
-}
-
-bool asm_oprnd_ptr::operator!=(ASM_REGISTER reg_) {
-	return !operator==(reg_);
-}
-
-bool asm_oprnd_ptr::operator==(asm_oprnd_ptr op) {
-	return get() ? get()->operator==(op) : false;
+asm_cmd_t& asm_cmd_list_ptr::operator[](asm_cmd_iter_t it) {
+	return get()->operator[](it);
 }
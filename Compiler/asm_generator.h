@@ -5,6 +5,7 @@
 #include "var.h"
 #include <memory>
 #include <vector>
+#include <map>
 #include <iostream>
 #include <algorithm>
 
@@ -40,9 +41,11 @@ enum ASM_OPERAND_PREFIX {
 };
 
 enum ASM_OPERAND_TYPE {
+	AOT_NONE,
 	AOT_REG,
 	AOT_IDENT,
 	AOT_VAR,
+	AOT_IMM,
 	AOT_DEREF,
 	AOT_ADDR,
 	AOT_LABEL
@@ -50,186 +53,100 @@ enum ASM_OPERAND_TYPE {
 
 enum ASM_COMMAND_TYPE {
 	ACT_LABEL,
-	ACT_OPERATOR
+	ACT_OPERATOR,
+	ACT_STR
 };
 
-class asm_oprnd_ptr : public shared_ptr<asm_operand_t> {
-public:
-	using shared_ptr<asm_operand_t>::shared_ptr;
-	bool operator==(ASM_OPERAND_TYPE);
-	bool operator!=(ASM_OPERAND_TYPE);
-	bool operator==(ASM_REGISTER);
-	bool operator!=(ASM_REGISTER);
-	bool operator==(asm_oprnd_ptr);
+enum ASM_TARGET {
+	AT_X86,
+	AT_X64
 };
 
-class asm_cmd_ptr : public shared_ptr<asm_cmd_t> {
+class asm_cmd_iter_t {
+	asm_cmd_list_t* list;
+	int node;
 public:
-	using shared_ptr<asm_cmd_t>::shared_ptr;
-	bool operator==(ASM_OPERATOR);
-	bool operator!=(ASM_OPERATOR);
-	bool operator==(ASM_COMMAND_TYPE);
+	asm_cmd_iter_t();
+	asm_cmd_iter_t(asm_cmd_list_t* list, int node);
+	asm_cmd_t& operator*() const;
+	asm_cmd_t* operator->() const;
+	asm_cmd_iter_t& operator++();
+	asm_cmd_iter_t& operator--();
+	asm_cmd_iter_t operator+(int n) const;
+	asm_cmd_iter_t operator-(int n) const;
+	bool operator==(const asm_cmd_iter_t& it) const;
+	bool operator!=(const asm_cmd_iter_t& it) const;
+	int get_node() const;
 };
 
 class asm_cmd_list_ptr : public shared_ptr<asm_cmd_list_t> {
 public:
 	using shared_ptr<asm_cmd_list_t>::shared_ptr;
-	asm_cmd_ptr operator[](int i);
+	asm_cmd_t& operator[](asm_cmd_iter_t it);
 };
 
 class asm_t {
 public:
-	virtual void print(ostream& os) {};
-};
-
-class asm_cmd_t : public asm_t {
-public:
-	virtual bool operator==(ASM_OPERATOR);
-	virtual bool operator==(ASM_COMMAND_TYPE);
-};
-
-class asm_str_cmd_t : public asm_cmd_t {
-	string str;
-public:
-	asm_str_cmd_t(string str);
-	void print(ostream& os) override;
-};
-
-class asm_operator_t : public asm_cmd_t {
-	ASM_OPERATOR op;
-	asm_oprnd_ptr left_operand;
-	asm_oprnd_ptr right_operand;
-public:
-	asm_operator_t(ASM_OPERATOR op, asm_oprnd_ptr left_operand, asm_oprnd_ptr right_operand);
-	asm_operator_t(ASM_OPERATOR op, asm_oprnd_ptr left_operand);
-	asm_operator_t(ASM_OPERATOR op);
-	asm_oprnd_ptr get_left();
-	asm_oprnd_ptr get_right();
-	void set_left(asm_oprnd_ptr);
-	void set_right(asm_oprnd_ptr);
-	void set_op(ASM_OPERATOR);
-	bool operator==(ASM_OPERATOR) override;
-	bool operator==(ASM_COMMAND_TYPE) override;
-	void print(ostream& os) override;
-};
-
-class asm_label_oprtr_t : public asm_cmd_t {
-	asm_label_ptr label;
-public:
-	asm_label_oprtr_t(asm_label_ptr label);
-	bool operator==(ASM_COMMAND_TYPE) override;
-	void print(ostream& os) override;
-};
-
-class asm_operand_t : public asm_t {
-public:
-	virtual bool operator==(ASM_OPERAND_TYPE);
-	virtual bool operator==(ASM_REGISTER);
-	virtual bool operator==(asm_oprnd_ptr);
-	virtual bool like(asm_oprnd_ptr op);
-	virtual bool like(ASM_REGISTER);
-};
-
-class asm_label_oprnd_t : public asm_operand_t {
-	int id;
-	static int global_id;
-public:
-	asm_label_oprnd_t();
-	bool operator==(ASM_OPERAND_TYPE op);
-	void print(ostream& os) override;
-};
-
-class asm_reg_oprnd_t : public asm_operand_t {
-	ASM_REGISTER reg;
-public:
-	asm_reg_oprnd_t(ASM_REGISTER reg);
-	asm_reg_oprnd_t(ASM_REGISTER reg, int reg_size);
-	asm_reg_oprnd_t(ASM_REGISTER reg, ASM_MEM_TYPE reg_size);
-	bool operator==(ASM_OPERAND_TYPE op); 
-	bool operator==(ASM_REGISTER reg);
-	bool operator==(asm_oprnd_ptr op);
-	bool like(ASM_REGISTER reg_) override;
-	bool like(asm_oprnd_ptr op) override;
-	int get_size();
-	ASM_REGISTER get_reg();
-	void set_reg(ASM_REGISTER reg_);
-	void print(ostream& os) override;
-};
-
-class asm_ident_operand_t : public asm_operand_t {
-	string name;
-public:
-	asm_ident_operand_t(string name);
-	bool operator==(ASM_OPERAND_TYPE op);
-	void print(ostream& os) override;
-};
-
-class asm_addr_oprnd_t : public asm_operand_t {
-
-};
-
-class asm_addr_ident_oprnd_t : public asm_addr_oprnd_t {
-protected:
-	string name;
-public:
-	asm_addr_ident_oprnd_t(string name);
-	void print(ostream& os);
-};
-
-class asm_addr_reg_oprnd_t : public asm_addr_oprnd_t {
-protected:
-	ASM_REGISTER reg;
-	int offset;
-public:
-	asm_addr_reg_oprnd_t(ASM_REGISTER reg, int offset);
 	void print(ostream& os);
+	virtual void print(out_buffer_t& os) {};
 };
 
-class asm_deref_oprnd_t : public asm_operand_t {
-protected:
-	int offset;
-	int scale;
-public:
-	asm_deref_oprnd_t(int offset, int scale);
-	void set_offset(int offset);
-	void add_offset(int offset);
-	void set_scale(int scale);
-	int get_scale();
-	int get_offset();
-	bool operator==(ASM_OPERAND_TYPE op);
+struct asm_label_t {
+	int id;
 };
 
-class asm_deref_reg_oprnd_t : public asm_deref_oprnd_t {
-protected:
+struct asm_oprnd_t {
+	ASM_OPERAND_TYPE type;
 	ASM_MEM_TYPE mtype;
 	ASM_REGISTER reg;
 	ASM_REGISTER offset_reg;
-public:
-	asm_deref_reg_oprnd_t(ASM_MEM_TYPE mtype, ASM_REGISTER reg, int offset = 0, ASM_REGISTER offset_reg = AR_NONE, int scale = 0);
-	ASM_REGISTER get_offset_reg();
-	ASM_REGISTER get_reg();
+	int scale;
+	int offset;
+	union {
+		int imm;
+		int label;
+		int sym;
+	};
+
+	static asm_oprnd_t make_reg(ASM_REGISTER reg, int reg_size = 0);
+	static asm_oprnd_t make_reg(ASM_REGISTER reg, ASM_MEM_TYPE reg_size);
+	static asm_oprnd_t make_deref(ASM_MEM_TYPE mtype, ASM_REGISTER reg, int offset = 0, ASM_REGISTER offset_reg = AR_NONE, int scale = 0);
+	static asm_oprnd_t make_imm(int imm);
+	static asm_oprnd_t make_label(asm_label_t label);
+	static asm_oprnd_t make_sym(ASM_OPERAND_TYPE type, int sym);
+	bool operator==(ASM_OPERAND_TYPE) const;
+	bool operator!=(ASM_OPERAND_TYPE) const;
+	bool operator==(ASM_REGISTER) const;
+	bool operator!=(ASM_REGISTER) const;
+	bool operator==(const asm_oprnd_t&) const;
+	bool operator!=(const asm_oprnd_t&) const;
+	bool like(ASM_REGISTER) const;
+	bool like(const asm_oprnd_t&) const;
+	int get_size() const;
 	void set_op_size(int size);
-	void set_op_size(ASM_MEM_TYPE mtype);
-	void set_op_size(asm_oprnd_ptr);
-	void set_reg(ASM_REGISTER reg);
-	void set_offset_reg(ASM_REGISTER reg);
-	int get_op_size();
-	bool like(asm_oprnd_ptr) override;
-	bool like_reg(asm_oprnd_ptr);
-	bool like_offset_reg(asm_oprnd_ptr);
-	void print(ostream& os);
 };
 
-class asm_const_oprnd_t : public asm_operand_t {
-	var_ptr var;
-public:
-	asm_const_oprnd_t(var_ptr var);
-	var_ptr get_var();
-	bool operator==(ASM_OPERAND_TYPE op);
-	void print(ostream& os) override;
+struct asm_cmd_t {
+	ASM_COMMAND_TYPE type;
+	ASM_OPERATOR op;
+	asm_oprnd_t left;
+	asm_oprnd_t right;
+	int prev;
+	int next;
+
+	asm_oprnd_t& get_left();
+	asm_oprnd_t& get_right();
+	void set_left(const asm_oprnd_t& op);
+	void set_right(const asm_oprnd_t& op);
+	void set_op(ASM_OPERATOR op);
+	bool operator==(ASM_OPERATOR) const;
+	bool operator!=(ASM_OPERATOR) const;
+	bool operator==(ASM_COMMAND_TYPE) const;
 };
 
 class asm_global_var_t {
+	friend class asm_machine_t;
+	friend class asm_x64_gen_t;
 	string name;
 	ASM_MEM_TYPE type;
 	vector<var_ptr> init_list;
@@ -239,26 +156,48 @@ public:
 	asm_global_var_t(string name, ASM_MEM_TYPE type, vector<var_ptr> init_list, int dup = 0);
 	asm_global_var_t(string name, ASM_MEM_TYPE type, asm_cmd_list_ptr init_commands, int dup = 0);
 	asm_global_var_t(string name, ASM_MEM_TYPE type, int dup = 0);
-	void print_alloc(ostream& os);
-	void print_init(ostream& os);
+	void print_alloc(out_buffer_t& os);
+	void print_init(out_buffer_t& os);
 };
 
 class asm_function_t : public asm_t {
+	friend class asm_machine_t;
+	friend class asm_x64_gen_t;
 	string name;
+	string signature;
 	asm_cmd_list_ptr cmd_list;
 public:
-	asm_function_t(string name, asm_cmd_list_ptr cmd_list);
-	void optimize();
-	void print(ostream& os) override;
+	asm_function_t(string name, asm_cmd_list_ptr cmd_list, string signature);
+	using asm_t::print;
+	void print(out_buffer_t& os) override;
 };
 
 class asm_cmd_list_t : public asm_t {
+	friend class asm_cmd_iter_t;
+	friend class asm_machine_t;
+	friend class asm_x64_gen_t;
+	friend class asm_encoder_t;
 protected:
-	vector<asm_cmd_ptr> commands;
+	vector<asm_cmd_t> commands;
+	int head;
+	int tail;
+	int free_head;
+	int count;
+	int insert_pos;
+	int labels_count;
+	vector<string> idents;
+	map<string, int> ident_ids;
+	vector<var_ptr> vars;
+	asm_oprnd_t _ident(string name, ASM_OPERAND_TYPE type = AOT_IDENT);
+	asm_oprnd_t _const(var_ptr var);
+	void _push_cmd(ASM_COMMAND_TYPE type, ASM_OPERATOR op, asm_oprnd_t left, asm_oprnd_t right);
+	bool _deserialize_oprnd(istream& is, asm_oprnd_t& op);
 public:
+	asm_cmd_list_t();
 #define register_asm_op(op_name, op_incode_name)\
 	void op_incode_name();\
-	void op_incode_name(asm_oprnd_ptr operand);\
+	void op_incode_name(asm_oprnd_t operand);\
+	void op_incode_name(asm_label_t label);\
 	void op_incode_name(ASM_REGISTER operand, int operand_size = 0);\
 	void op_incode_name(var_ptr operand);\
 	void op_incode_name(string operand);\
@@ -293,7 +232,7 @@ public:
 #undef register_asm_op
 
 	void _add_op(ASM_OPERATOR op);
-	void _add_op(ASM_OPERATOR op, asm_oprnd_ptr operand);
+	void _add_op(ASM_OPERATOR op, asm_oprnd_t operand);
 	void _add_op(ASM_OPERATOR op, ASM_REGISTER operand, int operand_size = 0);
 	void _add_op(ASM_OPERATOR op, var_ptr operand);
 	void _add_op(ASM_OPERATOR op, string operand);
@@ -301,7 +240,7 @@ public:
 	void _add_op_deref(ASM_OPERATOR op, ASM_REGISTER operand, ASM_MEM_TYPE mtype, int offset = 0, ASM_REGISTER offset_reg = AR_NONE, int scale = 0);
 	void _add_op_deref(ASM_OPERATOR op, ASM_REGISTER operand, int operand_size, int offset = 0, ASM_REGISTER offset_reg = AR_NONE, int scale = 0);
 
-	void _add_op(ASM_OPERATOR op, asm_oprnd_ptr left, asm_oprnd_ptr right);
+	void _add_op(ASM_OPERATOR op, asm_oprnd_t left, asm_oprnd_t right);
 	void _add_op(ASM_OPERATOR op, ASM_REGISTER left, ASM_REGISTER right, int operand_size = 0);
 	void _add_op(ASM_OPERATOR op, ASM_REGISTER left, var_ptr right, int operand_size = 0);
 	void _add_op(ASM_OPERATOR op, ASM_REGISTER left, string right, int operand_size = 0);
@@ -334,23 +273,39 @@ public:
 	void _cast_double_to_int(ASM_REGISTER dst_reg, bool keep_val);
 	void _cast_char_to_int(ASM_REGISTER src_reg, ASM_REGISTER dst_reg);
 
-	asm_label_ptr _new_label();
-	asm_label_ptr _insert_new_label();
-	void _insert_label(asm_label_ptr label);
+	asm_label_t _new_label();
+	asm_label_t _insert_new_label();
+	void _insert_label(asm_label_t label);
+	int _labels_count();
+	void _shift_labels(int base);
 
 	int _size();
-	asm_cmd_ptr operator[](int i);
-	shared_ptr<asm_operator_t> get_op(int i);
-
-	void _erase(int i);
-	void _erase(int from, int to);
+	asm_cmd_iter_t _begin();
+	asm_cmd_iter_t _end();
+	bool _has(asm_cmd_iter_t it, int n);
+	asm_cmd_t& operator[](asm_cmd_iter_t it);
+	asm_cmd_t* get_op(asm_cmd_iter_t it);
+
+	asm_cmd_iter_t _insert(asm_cmd_iter_t pos, const asm_cmd_t& cmd);
+	void _set_insert_pos(asm_cmd_iter_t pos);
+	void _erase(asm_cmd_iter_t it);
+	void _erase(asm_cmd_iter_t from, asm_cmd_iter_t to);
+	void _compact();
 
 	void _push_str(string str);
-	void print(ostream& os) override;
+	string serialize() const;
+	bool deserialize(const string& data);
+	void print_oprnd(out_buffer_t& os, const asm_oprnd_t& op);
+	void print_cmd(out_buffer_t& os, const asm_cmd_t& cmd);
+	void print_cmd(ostream& os, const asm_cmd_t& cmd);
+	using asm_t::print;
+	void print(out_buffer_t& os) override;
 };
 
 class asm_gen_t : public asm_t {
-	void print_header(ostream& os);
+	friend class asm_machine_t;
+	friend class asm_x64_gen_t;
+	void print_header(out_buffer_t& os);
 	vector <shared_ptr<asm_global_var_t>> global_vars;
 	vector <shared_ptr<asm_function_t>> functions;
 	asm_cmd_list_ptr main_cmd_list;
@@ -358,10 +313,14 @@ public:
 	void add_global_var(shared_ptr<asm_global_var_t> var);
 	void add_global_var(string name, ASM_MEM_TYPE mem_type, int dup = 0);
 	void add_global_var(string name, ASM_MEM_TYPE mem_type, asm_cmd_list_ptr init_cmd_list, int dup = 0);
-	void add_function(string name, asm_cmd_list_ptr cmd_list);
+	void add_function(string name, asm_cmd_list_ptr cmd_list, string signature);
 	void set_main_cmd_list(asm_cmd_list_ptr cmd_list);
-	void optimize();
-	void print(ostream& os);
+	using asm_t::print;
+	void print(out_buffer_t& os) override;
+	static void set_target(ASM_TARGET target);
+	static ASM_TARGET get_target();
+	static int ptr_size();
+	static int stack_alignment(int size);
 	static int alignment(int size);
 	static int align_size(int size);
 	static ASM_REGISTER reg_by_size(ASM_REGISTER reg, int size);
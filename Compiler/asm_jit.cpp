@@ -0,0 +1,132 @@
+#include "asm_jit.h"
+#include "asm_x64.h"
+#include "asm_encoder.h"
+#include "exceptions.h"
+#include <set>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#if !defined(_WIN32) && (defined(__x86_64__) || defined(_M_X64))
+#define JIT_HOST
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define STUB_SIZE 16
+
+static const ELF_SECTION data_sections[] = { ES_RODATA, ES_DATA, ES_BSS };
+
+static const map<string, void*> host_funcs = {
+#define reg_res_func(name, func_name, asm_name, ...) { #func_name, (void*)&func_name },
+#include "register_reserved_function.h"
+#undef reg_res_func
+};
+
+static size_t align_up(size_t size, size_t align) {
+	return (size + align - 1) / align * align;
+}
+
+asm_jit_t::asm_jit_t() : image(nullptr), image_size(0), code_size(0) {}
+
+asm_jit_t::~asm_jit_t() {
+#ifdef JIT_HOST
+	if (image)
+		munmap(image, image_size);
+#endif
+}
+
+uint8_t* asm_jit_t::_symbol(const string& name) {
+	auto it = symbols.find(name);
+	if (it == symbols.end())
+		throw JitError("Undefined symbol " + name);
+	return it->second;
+}
+
+void asm_jit_t::_relocate(uint8_t* base, const elf_section_t& section) {
+	for each (auto& reloc in section.relocs) {
+		uint8_t* place = base + reloc.offset;
+		int64_t val = (intptr_t)_symbol(reloc.symbol) + reloc.addend;
+		if (reloc.type == ERT_64) {
+			memcpy(place, &val, sizeof(val));
+			continue;
+		}
+		int64_t rel = val - (intptr_t)place;
+		int32_t rel32 = (int32_t)rel;
+		if (rel32 != rel)
+			throw JitError("Relocation to " + reloc.symbol + " is out of range");
+		memcpy(place, &rel32, sizeof(rel32));
+	}
+}
+
+void asm_jit_t::load(asm_gen_ptr gen) {
+#ifndef JIT_HOST
+	throw JitError("Native execution needs an x86-64 System V host");
+#else
+	if (asm_gen_t::get_target() != AT_X64)
+		throw JitError("Only x86-64 code can be run natively");
+	asm_x64_gen_t x64_gen(gen);
+	asm_encoder_t encoder(x64_gen);
+	elf_writer_t& obj = encoder.encode();
+
+	set<string> defined;
+	for each (auto& sym in obj.get_symbols())
+		defined.insert(sym.name);
+	vector<string> externs;
+	for (int i = 0; i < ES_COUNT; i++)
+		for each (auto& reloc in obj.get_section((ELF_SECTION)i).relocs)
+			if (!defined.count(reloc.symbol) && find(externs.begin(), externs.end(), reloc.symbol) == externs.end())
+				externs.push_back(reloc.symbol);
+
+	// Code and extern stubs share the executable pages, data sections follow on their own pages
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t offsets[ES_COUNT];
+	size_t stubs = align_up(obj.get_section(ES_TEXT).size, STUB_SIZE);
+	offsets[ES_TEXT] = 0;
+	code_size = align_up(stubs + externs.size() * STUB_SIZE, page);
+	size_t size = code_size;
+	for each (ELF_SECTION i in data_sections) {
+		size = align_up(size, obj.get_section(i).align);
+		offsets[i] = size;
+		size += obj.get_section(i).size;
+	}
+	image_size = align_up(max<size_t>(size, 1), page);
+	void* mem = mmap(nullptr, image_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		image_size = 0;
+		throw JitError("Can't allocate memory for native code");
+	}
+	image = (uint8_t*)mem;
+
+	for (int i = 0; i < ES_COUNT; i++) {
+		const elf_section_t& section = obj.get_section((ELF_SECTION)i);
+		if (!section.data.empty())
+			memcpy(image + offsets[i], &section.data[0], section.data.size());
+	}
+	for each (auto& sym in obj.get_symbols())
+		symbols[sym.name] = image + offsets[sym.section] + sym.value;
+	for (int i = 0; i < externs.size(); i++) {
+		auto it = host_funcs.find(externs[i]);
+		if (it == host_funcs.end())
+			throw JitError("Undefined symbol " + externs[i]);
+		uint8_t* stub = image + stubs + i * STUB_SIZE;
+		static const uint8_t jmp_rip[] = { 0xFF, 0x25, 0, 0, 0, 0 };
+		memcpy(stub, jmp_rip, sizeof(jmp_rip));
+		memcpy(stub + sizeof(jmp_rip), &it->second, sizeof(it->second));
+		symbols[externs[i]] = stub;
+	}
+	for (int i = 0; i < ES_COUNT; i++)
+		_relocate(image + offsets[i], obj.get_section((ELF_SECTION)i));
+	if (mprotect(image, code_size, PROT_READ | PROT_EXEC) != 0)
+		throw JitError("Can't make native code executable");
+#endif
+}
+
+int asm_jit_t::run() {
+	if (!image)
+		throw JitError("No native code is loaded");
+	int (*entry)() = (int (*)())_symbol("main");
+	int res = entry();
+	fflush(stdout);
+	return res;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "asm_generator.h"
+#include "elf_writer.h"
+#include <map>
+#include <string>
+#include <stdint.h>
+
+using namespace std;
+
+class asm_jit_t {
+	uint8_t* image;
+	size_t image_size;
+	size_t code_size;
+	map<string, uint8_t*> symbols;
+
+	uint8_t* _symbol(const string& name);
+	void _relocate(uint8_t* base, const elf_section_t& section);
+public:
+	asm_jit_t();
+	~asm_jit_t();
+	void load(asm_gen_ptr gen);
+	int run();
+};
@@ -62,4 +62,14 @@ register_asm_op(JGE, jge)
 register_asm_op(JB, jb)
 register_asm_op(JBE, jbe)
 register_asm_op(JA, ja)
-register_asm_op(JAE, jae)
\ No newline at end of file
+register_asm_op(JAE, jae)
+register_asm_op(NOP, nop)
+register_asm_op(MOVSD, movsd)
+register_asm_op(MOVSXD, movsxd)
+register_asm_op(ADDSD, addsd)
+register_asm_op(SUBSD, subsd)
+register_asm_op(MULSD, mulsd)
+register_asm_op(DIVSD, divsd)
+register_asm_op(COMISD, comisd)
+register_asm_op(CVTSI2SD, cvtsi2sd)
+register_asm_op(CVTSD2SI, cvtsd2si)
\ No newline at end of file
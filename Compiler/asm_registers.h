@@ -33,4 +33,63 @@ register_register(st(3), ST_3, ST_3, 8)
 register_register(st(4), ST_4, ST_4, 8)
 register_register(st(5), ST_5, ST_5, 8)
 register_register(st(6), ST_6, ST_6, 8)
-register_register(st(7), ST_7, ST_7, 8)
\ No newline at end of file
+register_register(st(7), ST_7, ST_7, 8)
+
+register_register(rax, RAX, EAX, 8)
+register_register(rbx, RBX, EBX, 8)
+register_register(rcx, RCX, ECX, 8)
+register_register(rdx, RDX, EDX, 8)
+register_register(rsi, RSI, ESI, 8)
+register_register(rdi, RDI, EDI, 8)
+register_register(rbp, RBP, EBP, 8)
+register_register(rsp, RSP, ESP, 8)
+
+register_register(r8, R8, R8, 8)
+register_register(r8d, R8D, R8, 4)
+
+register_register(r9, R9, R9, 8)
+register_register(r9d, R9D, R9, 4)
+
+register_register(r10, R10, R10, 8)
+register_register(r10d, R10D, R10, 4)
+
+register_register(r11, R11, R11, 8)
+register_register(r11d, R11D, R11, 4)
+
+register_register(xmm0, XMM0, XMM0, 8)
+register_register(xmm1, XMM1, XMM1, 8)
+register_register(xmm2, XMM2, XMM2, 8)
+register_register(xmm3, XMM3, XMM3, 8)
+register_register(xmm4, XMM4, XMM4, 8)
+register_register(xmm5, XMM5, XMM5, 8)
+register_register(xmm6, XMM6, XMM6, 8)
+register_register(xmm7, XMM7, XMM7, 8)
+
+register_register(r12, R12, R12, 8)
+register_register(r12d, R12D, R12, 4)
+register_register(r12w, R12W, R12, 2)
+register_register(r12b, R12B, R12, 1)
+
+register_register(r13, R13, R13, 8)
+register_register(r13d, R13D, R13, 4)
+register_register(r13w, R13W, R13, 2)
+register_register(r13b, R13B, R13, 1)
+
+register_register(r14, R14, R14, 8)
+register_register(r14d, R14D, R14, 4)
+register_register(r14w, R14W, R14, 2)
+register_register(r14b, R14B, R14, 1)
+
+register_register(r15, R15, R15, 8)
+register_register(r15d, R15D, R15, 4)
+register_register(r15w, R15W, R15, 2)
+register_register(r15b, R15B, R15, 1)
+
+register_register(xmm8, XMM8, XMM8, 8)
+register_register(xmm9, XMM9, XMM9, 8)
+register_register(xmm10, XMM10, XMM10, 8)
+register_register(xmm11, XMM11, XMM11, 8)
+register_register(xmm12, XMM12, XMM12, 8)
+register_register(xmm13, XMM13, XMM13, 8)
+register_register(xmm14, XMM14, XMM14, 8)
+register_register(xmm15, XMM15, XMM15, 8)
\ No newline at end of file
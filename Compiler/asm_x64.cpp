@@ -0,0 +1,721 @@
+#include "asm_x64.h"
+#include "exceptions.h"
+#include <sstream>
+#include <cstring>
+#include <stdint.h>
+
+#define SCRATCH_REG AR_R11
+#define FP_SCRATCH_REG AR_XMM15
+#define FP_STACK_SIZE 7
+#define EXTERN_PREFIX string("crt_")
+
+extern vector<string> asm_reg_names;
+extern vector<string> asm_op_names;
+extern vector<string> asm_mt_names;
+
+static const ASM_REGISTER int_arg_regs[] = { AR_RDI, AR_RSI, AR_RDX, AR_RCX, AR_R8, AR_R9 };
+static const ASM_REGISTER fp_arg_regs[] = { AR_XMM0, AR_XMM1, AR_XMM2, AR_XMM3, AR_XMM4, AR_XMM5, AR_XMM6, AR_XMM7 };
+static const ASM_REGISTER saved_regs[] = { AR_R12, AR_R13, AR_R14, AR_R15 };
+
+static bool is_gp32(const asm_oprnd_t& op) {
+	return op == AOT_REG && asm_gen_t::size_of(op.reg) == asm_gen_t::size_of(AMT_DWORD) && asm_gen_t::parent_of(op.reg) == op.reg;
+}
+
+static bool is_mem(const asm_oprnd_t& op) {
+	return op == AOT_DEREF || op == AOT_IDENT;
+}
+
+static bool is_frame_reg(const asm_oprnd_t& op) {
+	return op == AOT_REG && (asm_gen_t::parent_of(op.reg) == AR_ESP || asm_gen_t::parent_of(op.reg) == AR_EBP);
+}
+
+static asm_oprnd_t wide(const asm_oprnd_t& op) {
+	return is_gp32(op) ? asm_oprnd_t::make_reg(op.reg, AMT_QWORD) : op;
+}
+
+static bool is_xmm(ASM_REGISTER reg) {
+	return reg >= AR_XMM0 && reg <= AR_XMM7 || reg >= AR_XMM8 && reg <= AR_XMM15;
+}
+
+static int st_index(const asm_oprnd_t& op, int def) {
+	return op == AOT_REG ? op.reg - AR_ST_0 : def;
+}
+
+static ASM_OPERATOR sse_op(ASM_OPERATOR op) {
+	switch (op) {
+		case AO_FADD: return AO_ADDSD;
+		case AO_FSUB: case AO_FSUBR: return AO_SUBSD;
+		case AO_FMUL: return AO_MULSD;
+	}
+	return AO_DIVSD;
+}
+
+// Register of every argument slot of a signature in the System V order, AR_NONE for the slots passed on the stack
+static vector<ASM_REGISTER> arg_regs(const string& sig) {
+	vector<ASM_REGISTER> res;
+	int int_args = 0, fp_args = 0;
+	for (int i = 1; i < sig.size(); i++) {
+		if (sig[i] == 'd')
+			res.push_back(fp_args < sizeof(fp_arg_regs) / sizeof(fp_arg_regs[0]) ? fp_arg_regs[fp_args++] : AR_NONE);
+		else if (sig[i] != 'm')
+			res.push_back(int_args < sizeof(int_arg_regs) / sizeof(int_arg_regs[0]) ? int_arg_regs[int_args++] : AR_NONE);
+		else
+			res.push_back(AR_NONE);
+	}
+	return res;
+}
+
+asm_x64_gen_t::asm_x64_gen_t(asm_gen_ptr gen) {
+	asm_x64_data_t int_buff = { "_int", asm_gen_t::size_of(AMT_DWORD), asm_gen_t::size_of(AMT_DWORD) };
+	asm_x64_data_t double_buff = { "_double", asm_gen_t::size_of(AMT_QWORD), asm_gen_t::size_of(AMT_QWORD) };
+	data.push_back(double_buff);
+	data.push_back(int_buff);
+	symbols["_double"] = AMT_QWORD;
+	symbols["_int"] = AMT_DWORD;
+	for each (auto var in gen->global_vars) {
+		int size = asm_gen_t::size_of(var->type);
+		asm_x64_data_t global = { var->name, size * max(1, var->dup), size };
+		data.push_back(global);
+		symbols[var->name] = var->type;
+	}
+
+	for each (auto func in gen->functions)
+		code_symbols.insert(func->name);
+	for each (auto func in gen->functions) {
+		asm_x64_func_t res = { func->name, asm_cmd_list_ptr(new asm_cmd_list_t) };
+		_lower_function(func->signature, func->cmd_list, res.cmd_list.get());
+		functions.push_back(res);
+	}
+
+	asm_x64_func_t start = { "main", asm_cmd_list_ptr(new asm_cmd_list_t) };
+	asm_cmd_list_t* list = start.cmd_list.get();
+	_begin_function("i", false);
+	_emit(list, AO_PUSH, asm_oprnd_t::make_reg(AR_RBX));
+	_emit(list, AO_PUSH, asm_oprnd_t::make_reg(AR_RBP));
+	for each (auto var in gen->global_vars)
+		if (var->init_commands)
+			_lower(var->init_commands, list);
+	_emit(list, AO_CALL, list->_ident("_main"));
+	_emit(list, AO_POP, asm_oprnd_t::make_reg(AR_RBP));
+	_emit(list, AO_POP, asm_oprnd_t::make_reg(AR_RBX));
+	_emit(list, AO_XOR, asm_oprnd_t::make_reg(AR_EAX), asm_oprnd_t::make_reg(AR_EAX));
+	_emit(list, AO_RET);
+	functions.push_back(start);
+
+	asm_x64_func_t main = { "_main", asm_cmd_list_ptr(new asm_cmd_list_t) };
+	_lower_function("i", gen->main_cmd_list, main.cmd_list.get());
+	functions.push_back(main);
+}
+
+const vector<asm_x64_func_t>& asm_x64_gen_t::get_functions() {
+	return functions;
+}
+
+const vector<asm_x64_data_t>& asm_x64_gen_t::get_data() {
+	return data;
+}
+
+const vector<asm_x64_literal_t>& asm_x64_gen_t::get_literals() {
+	return literals;
+}
+
+bool asm_x64_gen_t::is_extern(const string& name) {
+	return externs.count(name) > 0;
+}
+
+asm_oprnd_t asm_x64_gen_t::_literal(asm_cmd_list_t* dst, var_ptr var) {
+	auto fp = dynamic_pointer_cast<var_t<double>>(var);
+	string key;
+	if (fp) {
+		double val = fp->get_val();
+		uint64_t bits;
+		memcpy(&bits, &val, sizeof(bits));
+		key = "d" + to_string(bits);
+	} else
+		key = "s" + static_pointer_cast<var_t<string>>(var)->get_val();
+	auto it = literal_names.find(key);
+	if (it == literal_names.end()) {
+		asm_x64_literal_t literal = { ".LC" + to_string(literals.size()), var };
+		literals.push_back(literal);
+		symbols[literal.name] = AMT_QWORD;
+		it = literal_names.insert(make_pair(key, literal.name)).first;
+	}
+	asm_oprnd_t res = dst->_ident(it->second, fp ? AOT_IDENT : AOT_ADDR);
+	res.mtype = AMT_QWORD;
+	return res;
+}
+
+asm_oprnd_t asm_x64_gen_t::_oprnd(asm_cmd_list_t* src, asm_cmd_list_t* dst, const asm_oprnd_t& op) {
+	asm_oprnd_t res = op;
+	switch (op.type) {
+		case AOT_DEREF:
+			res.reg = asm_gen_t::reg_by_mtype(op.reg, AMT_QWORD);
+			if (op.offset_reg != AR_NONE)
+				res.offset_reg = asm_gen_t::reg_by_mtype(op.offset_reg, AMT_QWORD);
+			break;
+		case AOT_IDENT:
+		case AOT_ADDR: {
+			string name = src->idents[op.sym];
+			if (!symbols.count(name) && !code_symbols.count(name))
+				throw TargetError("Unknown symbol " + name + " in x86-64 code");
+			res = dst->_ident(name, op.type);
+			res.mtype = symbols.count(name) ? symbols[name] : AMT_DWORD;
+			break;
+		}
+		case AOT_VAR:
+			res = _literal(dst, src->vars[op.sym]);
+			break;
+	}
+	return res;
+}
+
+void asm_x64_gen_t::_emit(asm_cmd_list_t* dst, ASM_OPERATOR op, asm_oprnd_t left, asm_oprnd_t right) {
+	dst->_push_cmd(ACT_OPERATOR, op, left, right);
+}
+
+void asm_x64_gen_t::_emit_sext(asm_cmd_list_t* dst, ASM_OPERATOR op, asm_oprnd_t left, asm_oprnd_t right) {
+	_emit(dst, op, left, right);
+	_emit(dst, AO_MOVSXD, wide(left), left);
+}
+
+// The x87 stack of the IR lives in xmm8 and up, st(0) is the highest register in use
+asm_oprnd_t asm_x64_gen_t::_st(int i) {
+	if (i >= fp_depth)
+		throw TargetError("Floating point stack underflow in x86-64 code");
+	return asm_oprnd_t::make_reg((ASM_REGISTER)(AR_XMM8 + fp_depth - 1 - i));
+}
+
+asm_oprnd_t asm_x64_gen_t::_fp_push() {
+	if (fp_depth == FP_STACK_SIZE)
+		throw TargetError("Floating point expression is too deep for x86-64 code");
+	fp_depth++;
+	return _st(0);
+}
+
+void asm_x64_gen_t::_fp_pop() {
+	if (!fp_depth)
+		throw TargetError("Floating point stack underflow in x86-64 code");
+	fp_depth--;
+}
+
+// Every xmm register is caller-saved, values on the floating point stack wait out calls
+// in slots the function reserves above its arguments
+asm_oprnd_t asm_x64_gen_t::_spill_slot(int i) {
+	int slot = asm_gen_t::size_of(AMT_QWORD);
+	return asm_oprnd_t::make_deref(AMT_QWORD, AR_RBP, slot + args_size + i * slot);
+}
+
+void asm_x64_gen_t::_spill(asm_cmd_list_t* dst) {
+	if (!fp_depth)
+		return;
+	if (!has_frame)
+		throw TargetError("Calls inside floating point expressions need a function frame in x86-64 code");
+	spill_slots = max(spill_slots, fp_depth);
+	for (int i = 0; i < fp_depth; i++)
+		_emit(dst, AO_MOVSD, _spill_slot(i), asm_oprnd_t::make_reg((ASM_REGISTER)(AR_XMM8 + i)));
+}
+
+void asm_x64_gen_t::_reload(asm_cmd_list_t* dst) {
+	for (int i = 0; i < fp_depth; i++)
+		_emit(dst, AO_MOVSD, asm_oprnd_t::make_reg((ASM_REGISTER)(AR_XMM8 + i)), _spill_slot(i));
+}
+
+void asm_x64_gen_t::_call_extern(asm_cmd_list_t* dst, string name) {
+	size_t sig_pos = name.find('@');
+	string sig = name.substr(sig_pos + 1);
+	name = name.substr(EXTERN_PREFIX.size(), sig_pos - EXTERN_PREFIX.size());
+	externs.insert(name);
+
+	_spill(dst);
+	asm_oprnd_t scratch = asm_oprnd_t::make_reg(SCRATCH_REG);
+	asm_oprnd_t rsp = asm_oprnd_t::make_reg(AR_RSP);
+	_emit(dst, AO_MOV, scratch, rsp);
+	_emit(dst, AO_AND, rsp, asm_oprnd_t::make_imm(-16));
+	_emit(dst, AO_SUB, rsp, asm_oprnd_t::make_imm(asm_gen_t::size_of(AMT_QWORD)));
+	_emit(dst, AO_PUSH, scratch);
+
+	vector<ASM_REGISTER> regs = arg_regs(sig);
+	int fp_args = 0;
+	vector<int> stack_args;
+	for (int i = 0; i < regs.size(); i++) {
+		asm_oprnd_t slot = asm_oprnd_t::make_deref(AMT_QWORD, SCRATCH_REG, i * asm_gen_t::size_of(AMT_QWORD));
+		if (regs[i] == AR_NONE)
+			stack_args.push_back(i);
+		else if (is_xmm(regs[i])) {
+			_emit(dst, AO_MOVSD, asm_oprnd_t::make_reg(regs[i]), slot);
+			fp_args++;
+		} else
+			_emit(dst, AO_MOV, asm_oprnd_t::make_reg(regs[i]), slot);
+	}
+	int stack_size = (stack_args.size() + stack_args.size() % 2) * asm_gen_t::size_of(AMT_QWORD);
+	if (stack_args.size() % 2)
+		_emit(dst, AO_SUB, rsp, asm_oprnd_t::make_imm(asm_gen_t::size_of(AMT_QWORD)));
+	for (int i = stack_args.size() - 1; i >= 0; i--)
+		_emit(dst, AO_PUSH, asm_oprnd_t::make_deref(AMT_QWORD, SCRATCH_REG, stack_args[i] * asm_gen_t::size_of(AMT_QWORD)));
+
+	_emit(dst, AO_MOV, asm_oprnd_t::make_reg(AR_EAX), asm_oprnd_t::make_imm(fp_args));
+	_emit(dst, AO_CALL, dst->_ident(name));
+	if (stack_size)
+		_emit(dst, AO_ADD, rsp, asm_oprnd_t::make_imm(stack_size));
+	_emit(dst, AO_POP, rsp);
+	_reload(dst);
+	if (sig[0] == 'i')
+		_emit(dst, AO_MOVSXD, asm_oprnd_t::make_reg(AR_RAX), asm_oprnd_t::make_reg(AR_EAX));
+	else if (sig[0] == 'd')
+		_emit(dst, AO_MOVSD, _fp_push(), asm_oprnd_t::make_reg(AR_XMM0));
+}
+
+// The IR pushes the arguments of a call, register arguments are taken off the stack again
+// and the stack ones moved up next to the return address as System V expects them
+void asm_x64_gen_t::_call_internal(asm_cmd_list_t* dst, string name) {
+	size_t sig_pos = name.find('@');
+	string sig = name.substr(sig_pos + 1);
+	name = name.substr(0, sig_pos);
+	if (!code_symbols.count(name))
+		throw TargetError("Unknown symbol " + name + " in x86-64 code");
+
+	_spill(dst);
+	int slot = asm_gen_t::size_of(AMT_QWORD);
+	vector<ASM_REGISTER> regs = arg_regs(sig);
+	vector<int> stack_args;
+	for (int i = 0; i < regs.size(); i++) {
+		asm_oprnd_t arg = asm_oprnd_t::make_deref(AMT_QWORD, AR_RSP, i * slot);
+		if (regs[i] == AR_NONE)
+			stack_args.push_back(i);
+		else
+			_emit(dst, is_xmm(regs[i]) ? AO_MOVSD : AO_MOV, asm_oprnd_t::make_reg(regs[i]), arg);
+	}
+	int released = (regs.size() - stack_args.size()) * slot;
+	asm_oprnd_t scratch = asm_oprnd_t::make_reg(SCRATCH_REG);
+	for (int i = stack_args.size() - 1; i >= 0; i--)
+		if (stack_args[i] * slot != released + i * slot) {
+			_emit(dst, AO_MOV, scratch, asm_oprnd_t::make_deref(AMT_QWORD, AR_RSP, stack_args[i] * slot));
+			_emit(dst, AO_MOV, asm_oprnd_t::make_deref(AMT_QWORD, AR_RSP, released + i * slot), scratch);
+		}
+	if (released)
+		_emit(dst, AO_ADD, asm_oprnd_t::make_reg(AR_RSP), asm_oprnd_t::make_imm(released));
+	_emit(dst, AO_CALL, dst->_ident(name));
+	_reload(dst);
+	if (sig[0] == 'd')
+		_emit(dst, AO_MOVSD, _fp_push(), asm_oprnd_t::make_reg(AR_XMM0));
+	released_stack = released;
+}
+
+void asm_x64_gen_t::_ret(asm_cmd_list_t* dst) {
+	if (signature[0] == 'd' && fp_depth)
+		_emit(dst, AO_MOVSD, asm_oprnd_t::make_reg(AR_XMM0), _st(0));
+	_emit(dst, AO_RET);
+	reachable = false;
+}
+
+// x87 instructions become scalar SSE ones on the registers of the floating point stack
+bool asm_x64_gen_t::_lower_fp(asm_cmd_list_t* dst, const asm_cmd_t& cmd, const asm_oprnd_t& left, const asm_oprnd_t& right) {
+	asm_oprnd_t fp_scratch = asm_oprnd_t::make_reg(FP_SCRATCH_REG);
+	switch (cmd.op) {
+		case AO_FLD: {
+			asm_oprnd_t src = left == AOT_REG ? _st(st_index(left, 0)) : left;
+			_emit(dst, AO_MOVSD, _fp_push(), src);
+			break;
+		}
+		case AO_FLD1:
+			_emit(dst, AO_MOVSD, _fp_push(), _literal(dst, new_var<double>(1.0)));
+			break;
+		case AO_FILD:
+			_emit(dst, AO_CVTSI2SD, _fp_push(), left);
+			break;
+		case AO_FST:
+		case AO_FSTP:
+			_emit(dst, AO_MOVSD, left == AOT_REG ? _st(st_index(left, 0)) : left, _st(0));
+			if (cmd == AO_FSTP)
+				_fp_pop();
+			break;
+		case AO_FIST:
+		case AO_FISTP: {
+			// Like fist with the default control word cvtsd2si rounds to nearest
+			asm_oprnd_t res = asm_oprnd_t::make_reg(SCRATCH_REG, left.get_size());
+			_emit(dst, AO_CVTSD2SI, res, _st(0));
+			_emit(dst, AO_MOV, left, res);
+			if (cmd == AO_FISTP)
+				_fp_pop();
+			break;
+		}
+		case AO_FCHS:
+			_emit(dst, AO_MULSD, _st(0), _literal(dst, new_var<double>(-1.0)));
+			break;
+		case AO_FCOMIP:
+			_emit(dst, AO_COMISD, _st(st_index(left, 0)), _st(st_index(right, 1)));
+			_fp_pop();
+			break;
+		// The IR only uses fdecstp to drop a value it doesn't need
+		case AO_FDECSTP:
+			_fp_pop();
+			break;
+		case AO_FWAIT:
+			break;
+		case AO_FADD:
+		case AO_FSUB:
+		case AO_FSUBR:
+		case AO_FMUL:
+		case AO_FDIV:
+		case AO_FDIVR: {
+			asm_oprnd_t res = _st(0);
+			asm_oprnd_t arg = left;
+			if (left == AOT_NONE) {
+				res = _st(1);
+				arg = _st(0);
+			} else if (left == AOT_REG && right == AOT_REG) {
+				res = _st(st_index(left, 0));
+				arg = _st(st_index(right, 0));
+			} else if (left == AOT_REG)
+				arg = _st(st_index(left, 0));
+			if (cmd == AO_FSUBR || cmd == AO_FDIVR) {
+				_emit(dst, AO_MOVSD, fp_scratch, arg);
+				_emit(dst, sse_op(cmd.op), fp_scratch, res);
+				_emit(dst, AO_MOVSD, res, fp_scratch);
+			} else
+				_emit(dst, sse_op(cmd.op), res, arg);
+			if (left == AOT_NONE)
+				_fp_pop();
+			break;
+		}
+		case AO_FCOMPP:
+		case AO_FSTSW:
+			throw TargetError("Can't lower " + asm_op_names[cmd.op] + " to x86-64 code");
+		default:
+			return false;
+	}
+	return true;
+}
+
+void asm_x64_gen_t::_lower_cmd(asm_cmd_list_t* src, asm_cmd_list_t* dst, const asm_cmd_t& cmd) {
+	// The stack cleanup after a call only has to drop what wasn't passed in registers
+	if (released_stack) {
+		int released = released_stack;
+		released_stack = 0;
+		if (cmd == AO_ADD && cmd.left == AR_ESP && cmd.right == AOT_IMM && cmd.right.imm >= released) {
+			if (cmd.right.imm > released)
+				_emit(dst, AO_ADD, asm_oprnd_t::make_reg(AR_RSP), asm_oprnd_t::make_imm(cmd.right.imm - released));
+			return;
+		}
+		_emit(dst, AO_SUB, asm_oprnd_t::make_reg(AR_RSP), asm_oprnd_t::make_imm(released));
+	}
+	// A label that can't be fallen into has the floating point stack it is jumped to with
+	if (cmd == ACT_LABEL) {
+		if (!reachable)
+			fp_depth = label_depths.count(cmd.left.label) ? label_depths[cmd.left.label] : 0;
+		reachable = true;
+		dst->_push_cmd(ACT_LABEL, AO_NOP, cmd.left, asm_oprnd_t());
+		return;
+	}
+	// Raw text is MASM syntax, it has no GAS meaning
+	if (cmd == ACT_STR)
+		throw TargetError("Unexpected assembly text " + src->idents[cmd.left.sym] + " in x86-64 code");
+	if (cmd == AO_CALL && cmd.left == AOT_IDENT && src->idents[cmd.left.sym].find('@') != string::npos) {
+		string name = src->idents[cmd.left.sym];
+		if (name.compare(0, EXTERN_PREFIX.size(), EXTERN_PREFIX) == 0)
+			_call_extern(dst, name);
+		else
+			_call_internal(dst, name);
+		return;
+	}
+	if (cmd == AO_RET) {
+		_ret(dst);
+		return;
+	}
+	if (cmd.left == AOT_LABEL) {
+		label_depths[cmd.left.label] = fp_depth;
+		if (cmd == AO_JMP)
+			reachable = false;
+	}
+
+	asm_oprnd_t left = _oprnd(src, dst, cmd.left);
+	asm_oprnd_t right = _oprnd(src, dst, cmd.right);
+	if (_lower_fp(dst, cmd, left, right))
+		return;
+	if (left == AOT_IDENT && right == AOT_REG && cmd != AO_SHL && cmd != AO_SHR)
+		left.mtype = asm_gen_t::mtype_by_size(asm_gen_t::size_of(right.reg));
+	if (right == AOT_IDENT && left == AOT_REG)
+		right.mtype = asm_gen_t::mtype_by_size(asm_gen_t::size_of(left.reg));
+	asm_oprnd_t scratch = asm_oprnd_t::make_reg(SCRATCH_REG);
+	if (right == AOT_ADDR && cmd != AO_MOV) {
+		right.type = AOT_IDENT;
+		_emit(dst, AO_LEA, scratch, right);
+		right = scratch;
+		left = wide(left);
+	}
+
+	switch (cmd.op) {
+		case AO_MOV:
+			if (right == AOT_ADDR) {
+				right.type = AOT_IDENT;
+				if (is_mem(left)) {
+					_emit(dst, AO_LEA, scratch, right);
+					left.mtype = AMT_QWORD;
+					_emit(dst, AO_MOV, left, scratch);
+				} else
+					_emit(dst, AO_LEA, wide(left), right);
+			} else if (is_gp32(left) && is_mem(right))
+				_emit(dst, AO_MOVSXD, wide(left), right);
+			else if (is_mem(left))
+				_emit(dst, AO_MOV, left, right);
+			else
+				_emit(dst, AO_MOV, wide(left), wide(right));
+			break;
+		case AO_PUSH:
+			if (left == AOT_ADDR) {
+				left.type = AOT_IDENT;
+				_emit(dst, AO_LEA, scratch, left);
+				left = scratch;
+			} else if (is_mem(left) && left.mtype != AMT_QWORD) {
+				_emit(dst, AO_MOVSXD, scratch, left);
+				left = scratch;
+			}
+			_emit(dst, AO_PUSH, wide(left));
+			break;
+		case AO_POP:
+			if (is_mem(left) && left.mtype != AMT_QWORD) {
+				_emit(dst, AO_POP, scratch);
+				_emit(dst, AO_MOV, left, asm_oprnd_t::make_reg(SCRATCH_REG, left.get_size()));
+			} else
+				_emit(dst, AO_POP, wide(left));
+			break;
+		case AO_LEA:
+		case AO_NOT:
+		case AO_CALL:
+			_emit(dst, cmd.op, wide(left), right);
+			break;
+		case AO_XCHG:
+			if (is_mem(left) || is_mem(right)) {
+				_emit(dst, AO_XCHG, left, right);
+				if (is_gp32(left) || is_gp32(right))
+					_emit(dst, AO_MOVSXD, wide(is_gp32(left) ? left : right), is_gp32(left) ? left : right);
+			} else
+				_emit(dst, AO_XCHG, wide(left), wide(right));
+			break;
+		case AO_AND:
+		case AO_OR:
+		case AO_XOR:
+		case AO_CMP:
+		case AO_TEST:
+			if (is_gp32(left) && is_mem(right)) {
+				if (cmd == AO_CMP || cmd == AO_TEST)
+					_emit(dst, cmd.op, left, right);
+				else
+					_emit_sext(dst, cmd.op, left, right);
+			} else if (left == AOT_REG)
+				_emit(dst, cmd.op, wide(left), wide(right));
+			else
+				_emit(dst, cmd.op, left, right);
+			break;
+		case AO_ADD:
+		case AO_SUB:
+		case AO_IMUL:
+		case AO_NEG:
+		case AO_INC:
+		case AO_DEC:
+		case AO_SHL:
+		case AO_SHR:
+			if (is_frame_reg(left))
+				_emit(dst, cmd.op, wide(left), wide(right));
+			else if (cmd == AO_IMUL && right == AOT_NONE) {
+				_emit(dst, AO_IMUL, left);
+				_emit(dst, AO_MOVSXD, asm_oprnd_t::make_reg(AR_RAX), asm_oprnd_t::make_reg(AR_EAX));
+				_emit(dst, AO_MOVSXD, asm_oprnd_t::make_reg(AR_RDX), asm_oprnd_t::make_reg(AR_EDX));
+			} else if (is_gp32(left))
+				_emit_sext(dst, cmd.op, left, right);
+			else if (left == AOT_REG && asm_gen_t::size_of(left.reg) == asm_gen_t::size_of(AMT_QWORD))
+				_emit(dst, cmd.op, left, wide(right));
+			else
+				_emit(dst, cmd.op, left, right);
+			break;
+		case AO_DIV:
+			_emit(dst, AO_DIV, left);
+			_emit(dst, AO_MOVSXD, asm_oprnd_t::make_reg(AR_RAX), asm_oprnd_t::make_reg(AR_EAX));
+			_emit(dst, AO_MOVSXD, asm_oprnd_t::make_reg(AR_RDX), asm_oprnd_t::make_reg(AR_EDX));
+			break;
+		default:
+			_emit(dst, cmd.op, left, right);
+	}
+}
+
+void asm_x64_gen_t::_lower(asm_cmd_list_ptr src, asm_cmd_list_t* dst) {
+	dst->labels_count = max(dst->labels_count, src->labels_count);
+	for (asm_cmd_iter_t it = src->_begin(); it != src->_end(); ++it)
+		_lower_cmd(src.get(), dst, *it);
+}
+
+void asm_x64_gen_t::_begin_function(const string& sig, bool frame) {
+	signature = sig;
+	args_size = (sig.size() - 1) * asm_gen_t::size_of(AMT_QWORD);
+	has_frame = frame;
+	promoted.clear();
+	fp_depth = 0;
+	spill_slots = 0;
+	label_depths.clear();
+	reachable = true;
+	released_stack = 0;
+}
+
+// Integer arguments stay in callee-saved registers when the body only ever accesses their slots directly,
+// the slots then keep the caller's values of those registers
+void asm_x64_gen_t::_promote_args(asm_cmd_list_ptr src, const vector<ASM_REGISTER>& regs) {
+	int slot = asm_gen_t::size_of(AMT_QWORD);
+	set<int> candidates;
+	for (int i = 0; i < regs.size(); i++)
+		if (regs[i] != AR_NONE && !is_xmm(regs[i]))
+			candidates.insert(slot + i * slot);
+	for (asm_cmd_iter_t it = src->_begin(); it != src->_end(); ++it) {
+		const asm_cmd_t& cmd = *it;
+		if (cmd == ACT_STR)
+			return;
+		for each (auto op in { cmd.left, cmd.right }) {
+			bool frame_reg = op == AOT_REG && asm_gen_t::parent_of(op.reg) == AR_EBP;
+			if (frame_reg && cmd != AO_PUSH && cmd != AO_POP && !(cmd == AO_MOV && (cmd.left == AR_ESP || cmd.right == AR_ESP)))
+				return;
+			if (op != AOT_DEREF || asm_gen_t::parent_of(op.reg) != AR_EBP)
+				continue;
+			if (op.offset_reg != AR_NONE) {
+				if (op.offset >= 0)
+					return;
+				continue;
+			}
+			for (auto arg = candidates.begin(); arg != candidates.end();)
+				if (op.offset < *arg + slot && *arg < op.offset + max(1, op.get_size()) && (cmd == AO_LEA || op.offset != *arg))
+					arg = candidates.erase(arg);
+				else
+					++arg;
+		}
+	}
+	for each (int offset in candidates)
+		if (promoted.size() < sizeof(saved_regs) / sizeof(saved_regs[0]))
+			promoted[offset] = saved_regs[promoted.size()];
+}
+
+// Arguments arrive in System V registers and stack slots, the prologue stores them where the body
+// addresses them, right above the return address. Spill slots and the callee-saved registers
+// the IR clobbers follow, and ret pops that whole area again.
+void asm_x64_gen_t::_lower_function(const string& sig, asm_cmd_list_ptr src, asm_cmd_list_t* dst) {
+	_begin_function(sig, true);
+	vector<ASM_REGISTER> regs = arg_regs(sig);
+	_promote_args(src, regs);
+	_lower(src, dst);
+	_ret(dst);
+
+	int slot = asm_gen_t::size_of(AMT_QWORD);
+	map<int, ASM_REGISTER> saved = promoted;
+	saved[slot + args_size + spill_slots * slot] = AR_RBX;
+	saved[2 * slot + args_size + spill_slots * slot] = AR_RBP;
+	int frame_size = args_size + (spill_slots + 2) * slot;
+	for (asm_cmd_iter_t it = dst->_begin(); it != dst->_end(); ++it) {
+		for each (auto op in { &it->left, &it->right })
+			if (*op == AOT_DEREF && op->reg == AR_RBP && op->offset_reg == AR_NONE && promoted.count(op->offset))
+				*op = asm_oprnd_t::make_reg(asm_gen_t::reg_by_mtype(promoted[op->offset], op->mtype));
+		if (*it == AO_RET) {
+			dst->_set_insert_pos(it);
+			for each (auto& reg in saved)
+				_emit(dst, AO_MOV, asm_oprnd_t::make_reg(reg.second), asm_oprnd_t::make_deref(AMT_QWORD, AR_RSP, reg.first));
+			it->left = asm_oprnd_t::make_imm(frame_size);
+		}
+	}
+
+	asm_oprnd_t scratch = asm_oprnd_t::make_reg(SCRATCH_REG);
+	asm_oprnd_t rax = asm_oprnd_t::make_reg(AR_RAX);
+	dst->_set_insert_pos(dst->_begin());
+	_emit(dst, AO_POP, scratch);
+	_emit(dst, AO_SUB, asm_oprnd_t::make_reg(AR_RSP), asm_oprnd_t::make_imm(frame_size));
+	int stack_arg = 0;
+	for (int i = 0; i < regs.size(); i++) {
+		asm_oprnd_t home = asm_oprnd_t::make_deref(AMT_QWORD, AR_RSP, i * slot);
+		if (regs[i] == AR_NONE) {
+			_emit(dst, AO_MOV, rax, asm_oprnd_t::make_deref(AMT_QWORD, AR_RSP, frame_size + stack_arg++ * slot));
+			_emit(dst, AO_MOV, home, rax);
+		} else if (!promoted.count(slot + i * slot))
+			_emit(dst, is_xmm(regs[i]) ? AO_MOVSD : AO_MOV, home, asm_oprnd_t::make_reg(regs[i]));
+	}
+	for each (auto& reg in saved)
+		_emit(dst, AO_MOV, asm_oprnd_t::make_deref(AMT_QWORD, AR_RSP, reg.first - slot), asm_oprnd_t::make_reg(reg.second));
+	for (int i = 0; i < regs.size(); i++)
+		if (promoted.count(slot + i * slot))
+			_emit(dst, AO_MOV, asm_oprnd_t::make_reg(promoted[slot + i * slot]), asm_oprnd_t::make_reg(regs[i]));
+	_emit(dst, AO_PUSH, scratch);
+	dst->_set_insert_pos(dst->_end());
+}
+
+void asm_x64_gen_t::_print_oprnd(out_buffer_t& os, asm_cmd_list_t* list, const asm_cmd_t& cmd, const asm_oprnd_t& op) {
+	switch (op.type) {
+		case AOT_REG: os << asm_reg_names[op.reg]; break;
+		case AOT_IMM: os << op.imm; break;
+		case AOT_LABEL: os << "LABEL_" << op.label; break;
+		case AOT_IDENT:
+		case AOT_ADDR:
+			if (cmd == AO_CALL)
+				os << list->idents[op.sym] << (is_extern(list->idents[op.sym]) ? "@PLT" : "");
+			else if (cmd == AO_LEA)
+				os << "[rip + " << list->idents[op.sym] << ']';
+			else
+				os << asm_mt_names[op.mtype] << " PTR " << list->idents[op.sym] << "[rip]";
+			break;
+		case AOT_DEREF:
+			os << asm_mt_names[op.mtype] << " PTR [" << asm_reg_names[op.reg];
+			if (op.offset_reg != AR_NONE)
+				os << " + " << asm_reg_names[op.offset_reg];
+			if (op.scale)
+				os << " * " << op.scale;
+			if (op.offset)
+				os << (op.offset < 0 ? " - " : " + ") << abs(op.offset);
+			os << ']';
+			break;
+	}
+}
+
+void asm_x64_gen_t::_print_cmd(out_buffer_t& os, asm_cmd_list_t* list, const asm_cmd_t& cmd) {
+	switch (cmd.type) {
+		case ACT_LABEL:
+			_print_oprnd(os, list, cmd, cmd.left);
+			os << ':';
+			break;
+		case ACT_STR:
+			os << list->idents[cmd.left.sym];
+			break;
+		case ACT_OPERATOR:
+			os << asm_op_names[cmd.op];
+			if (cmd.left != AOT_NONE) {
+				os << ' ';
+				_print_oprnd(os, list, cmd, cmd.left);
+			}
+			if (cmd.right != AOT_NONE) {
+				os << ", ";
+				_print_oprnd(os, list, cmd, cmd.right);
+			}
+			break;
+	}
+}
+
+void asm_x64_gen_t::print(ostream& out) {
+	out_buffer_t os(out);
+	os << ".intel_syntax noprefix\n";
+	os << ".text\n";
+	for each (auto& func in functions) {
+		if (func.name == "main")
+			os << ".globl main\n";
+		os << func.name << ":\n";
+		for (asm_cmd_iter_t it = func.cmd_list->_begin(); it != func.cmd_list->_end(); ++it) {
+			_print_cmd(os, func.cmd_list.get(), *it);
+			os << '\n';
+		}
+	}
+	os << ".bss\n";
+	for each (auto& var in data)
+		os << ".align " << var.align << '\n' << var.name << ":\n.zero " << var.size << '\n';
+	os << ".section .rodata\n";
+	for each (auto& literal in literals) {
+		if (auto fp = dynamic_pointer_cast<var_t<double>>(literal.value)) {
+			double val = fp->get_val();
+			uint64_t bits;
+			memcpy(&bits, &val, sizeof(bits));
+			os << ".align 8\n" << literal.name << ":\n.quad " << bits << '\n';
+		} else
+			os << literal.name << ":\n.asciz \"" << static_pointer_cast<var_t<string>>(literal.value)->get_val() << "\"\n";
+	}
+	os << ".section .note.GNU-stack,\"\",@progbits\n";
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "asm_generator.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <ostream>
+
+using namespace std;
+
+struct asm_x64_func_t {
+	string name;
+	asm_cmd_list_ptr cmd_list;
+};
+
+struct asm_x64_data_t {
+	string name;
+	int size;
+	int align;
+};
+
+struct asm_x64_literal_t {
+	string name;
+	var_ptr value;
+};
+
+class asm_x64_gen_t {
+	vector<asm_x64_func_t> functions;
+	vector<asm_x64_data_t> data;
+	vector<asm_x64_literal_t> literals;
+	map<string, string> literal_names;
+	map<string, ASM_MEM_TYPE> symbols;
+	set<string> code_symbols;
+	set<string> externs;
+
+	string signature;
+	int args_size;
+	bool has_frame;
+	map<int, ASM_REGISTER> promoted;
+	int fp_depth;
+	int spill_slots;
+	map<int, int> label_depths;
+	bool reachable;
+	int released_stack;
+
+	asm_oprnd_t _literal(asm_cmd_list_t* dst, var_ptr var);
+	asm_oprnd_t _oprnd(asm_cmd_list_t* src, asm_cmd_list_t* dst, const asm_oprnd_t& op);
+	void _emit(asm_cmd_list_t* dst, ASM_OPERATOR op, asm_oprnd_t left = asm_oprnd_t(), asm_oprnd_t right = asm_oprnd_t());
+	void _emit_sext(asm_cmd_list_t* dst, ASM_OPERATOR op, asm_oprnd_t left, asm_oprnd_t right);
+	asm_oprnd_t _st(int i);
+	asm_oprnd_t _fp_push();
+	void _fp_pop();
+	asm_oprnd_t _spill_slot(int i);
+	void _spill(asm_cmd_list_t* dst);
+	void _reload(asm_cmd_list_t* dst);
+	void _call_extern(asm_cmd_list_t* dst, string name);
+	void _call_internal(asm_cmd_list_t* dst, string name);
+	void _ret(asm_cmd_list_t* dst);
+	bool _lower_fp(asm_cmd_list_t* dst, const asm_cmd_t& cmd, const asm_oprnd_t& left, const asm_oprnd_t& right);
+	void _lower_cmd(asm_cmd_list_t* src, asm_cmd_list_t* dst, const asm_cmd_t& cmd);
+	void _lower(asm_cmd_list_ptr src, asm_cmd_list_t* dst);
+	void _begin_function(const string& sig, bool frame);
+	void _promote_args(asm_cmd_list_ptr src, const vector<ASM_REGISTER>& regs);
+	void _lower_function(const string& sig, asm_cmd_list_ptr src, asm_cmd_list_t* dst);
+	void _print_oprnd(out_buffer_t& os, asm_cmd_list_t* list, const asm_cmd_t& cmd, const asm_oprnd_t& op);
+	void _print_cmd(out_buffer_t& os, asm_cmd_list_t* list, const asm_cmd_t& cmd);
+public:
+	asm_x64_gen_t(asm_gen_ptr gen);
+	const vector<asm_x64_func_t>& get_functions();
+	const vector<asm_x64_data_t>& get_data();
+	const vector<asm_x64_literal_t>& get_literals();
+	bool is_extern(const string& name);
+	void print(ostream& os);
+};
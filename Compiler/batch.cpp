@@ -0,0 +1,93 @@
+#include "batch.h"
+#include "thread_pool.h"
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <iomanip>
+#include <exception>
+
+struct batch_status_t {
+	bool ok;
+	string error;
+	double time;
+};
+
+static string default_output(const string& input, COMPILE_MODE mode) {
+	size_t dot = input.find_last_of('.');
+	size_t slash = input.find_last_of("/\\");
+	string base = dot == string::npos || slash != string::npos && dot < slash ? input : input.substr(0, dot);
+	return base + (mode == CM_ASM ? ".asm" : mode == CM_OBJECT ? ".o" : mode == CM_LEXEMES_BIN ? ".tok" : mode == CM_AST ? ".ast" : ".txt");
+}
+
+bool batch_add_input(vector<batch_item_t>& items, const string& arg, COMPILE_MODE mode) {
+	if (arg[0] != '@') {
+		batch_item_t item = { arg, default_output(arg, mode) };
+		items.push_back(item);
+		return true;
+	}
+	ifstream fin(arg.substr(1));
+	if (!fin)
+		return false;
+	string line;
+	while (getline(fin, line)) {
+		istringstream ls(line);
+		batch_item_t item;
+		if (!(ls >> item.input) || item.input[0] == '#')
+			continue;
+		if (!(ls >> item.output))
+			item.output = default_output(item.input, mode);
+		items.push_back(item);
+	}
+	return true;
+}
+
+static batch_status_t compile_item(const compiler_context_t& context, const batch_item_t& item, const compile_options_t& options) {
+	batch_status_t res = { false, "", 0 };
+	auto start = chrono::steady_clock::now();
+	string source;
+	if (!read_source(item.input, source)) {
+		res.error = "Can't open file";
+		return res;
+	}
+	compile_result_t cres;
+	try {
+		cres = context.compile(source, options);
+	} catch (exception& e) {
+		res.error = string("Internal error: ") + e.what();
+		return res;
+	}
+	ofstream fout(item.output, options.binary_output() ? ios::binary : ios::out);
+	fout << cres.output << cres.error;
+	res.ok = cres.ok && fout;
+	res.error = fout ? cres.error.substr(0, cres.error.find('\n')) : "Can't write " + item.output;
+	res.time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	return res;
+}
+
+int compile_batch(const compiler_context_t& context, const vector<batch_item_t>& items, const compile_options_t& options, int jobs, ostream& log) {
+	vector<batch_status_t> statuses(items.size());
+	auto start = chrono::steady_clock::now();
+	parallel_for(context.get_pool(), items.size(), jobs, [&](int i) {
+		statuses[i] = compile_item(context, items[i], options);
+	});
+	double wall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	int failed = 0;
+	double total = 0;
+	log << fixed << setprecision(3);
+	for (int i = 0; i < items.size(); i++) {
+		if (statuses[i].ok)
+			log << "ok     ";
+		else {
+			log << "FAILED ";
+			failed++;
+		}
+		log << items[i].input << " (" << statuses[i].time * 1000 << " ms)";
+		if (!statuses[i].ok)
+			log << ": " << statuses[i].error;
+		log << endl;
+		total += statuses[i].time;
+	}
+	log << items.size() << " files, " << items.size() - failed << " ok, " << failed << " failed; "
+		<< "wall " << wall * 1000 << " ms, compile " << total * 1000 << " ms, " << jobs << " jobs" << endl;
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "compiler.h"
+#include <string>
+#include <vector>
+#include <ostream>
+
+using namespace std;
+
+struct batch_item_t {
+	string input;
+	string output;
+};
+
+bool batch_add_input(vector<batch_item_t>& items, const string& arg, COMPILE_MODE mode);
+int compile_batch(const compiler_context_t& context, const vector<batch_item_t>& items, const compile_options_t& options, int jobs, ostream& log);
@@ -0,0 +1,179 @@
+#include "bench.h"
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+static const char* expr_ops[] = { "+", "-", "*", "&", "|", "^" };
+
+static void gen_operand(ostream& os, int i) {
+	if (i % 3 == 0)
+		os << i % 97 + 1;
+	else
+		os << (char)('a' + i % 4);
+}
+
+static string gen_expr(int size) {
+	ostringstream os;
+	os << "int main() {\n\tint a = 1;\n\tint b = 2;\n\tint c = 3;\n\tint d = 4;\n";
+	for (int term = 0; term < size;) {
+		int terms = min(128, size - term);
+		int depth = min(terms - 1, 32);
+		os << '\t' << (char)('a' + term / 128 % 4) << " = ";
+		for (int i = 0; i < terms; i++, term++) {
+			gen_operand(os, term);
+			if (i < terms - 1)
+				os << ' ' << expr_ops[term % 6] << (i < depth ? " (" : " ");
+		}
+		os << string(depth, ')') << ";\n";
+	}
+	os << "\treturn a;\n}\n";
+	return os.str();
+}
+
+static string gen_funcs(int size) {
+	ostringstream os;
+	os << "int f0(int x, int y) {\n\treturn x + y;\n}\n";
+	for (int i = 1; i < size; i++)
+		os << "int f" << i << "(int x, int y) {\n\tint t;\n\tt = x * " << i % 13 + 1 << " + y;\n"
+			<< "\tif (t > " << i << ") {\n\t\tt = f" << i - 1 << "(t - y, y);\n\t}\n\treturn t;\n}\n";
+	os << "int main() {\n\treturn f" << size - 1 << "(1, 2);\n}\n";
+	return os.str();
+}
+
+static string gen_structs(int size) {
+	ostringstream os;
+	os << "struct s {\n";
+	for (int i = 0; i < size; i++)
+		os << (i % 3 == 1 ? "\tdouble f" : "\tint f") << i << (i % 3 == 2 ? "[4];\n" : ";\n");
+	os << "};\nstruct s g[16];\nint main() {\n\tstruct s v;\n";
+	for (int i = 0; i < size; i++) {
+		string field = "f" + to_string(i) + (i % 3 == 2 ? "[" + to_string(i % 4) + "]" : "");
+		os << "\tv." << field << (i % 3 == 1 ? " = 1.5;\n" : " = " + to_string(i) + ";\n");
+		os << "\tg[" << i % 16 << "]." << field << " = v." << field << " + 1;\n";
+	}
+	os << "\treturn 0;\n}\n";
+	return os.str();
+}
+
+static string gen_straight(int size) {
+	ostringstream os;
+	os << "int main() {\n\tint a = 1;\n\tint b = 2;\n\tint c = 3;\n\tdouble d = 0.5;\n";
+	for (int i = 0; i < size; i++)
+		switch (i % 4) {
+			case 0: os << "\ta = b + c * " << i << ";\n"; break;
+			case 1: os << "\tb = a - " << i << ";\n"; break;
+			case 2: os << "\tc = (a ^ b) + " << i << ";\n"; break;
+			case 3: os << "\td = d * 2.0 + a;\n"; break;
+		}
+	os << "\treturn a;\n}\n";
+	return os.str();
+}
+
+static string gen_nested(int size) {
+	ostringstream os;
+	os << "int main() {\n\tint i = 0;\n\tint s = 0;\n";
+	for (int block = 0; block < size;) {
+		int depth = min(16, size - block);
+		for (int i = 0; i < depth; i++, block++) {
+			string indent(i + 1, '\t');
+			switch (block % 4) {
+				case 0: os << indent << "if (s < " << block << ") {\n"; break;
+				case 1: os << indent << "while (i < " << block << ") {\n" << indent << "\ti = i + 1;\n"; break;
+				case 2: os << indent << "for (i = 0; i < " << block << "; i = i + 1) {\n"; break;
+				case 3: os << indent << "{\n"; break;
+			}
+			os << indent << "\ts = s + " << block << ";\n";
+		}
+		for (int i = depth - 1; i >= 0; i--)
+			os << string(i + 1, '\t') << "}\n";
+	}
+	os << "\treturn s;\n}\n";
+	return os.str();
+}
+
+const vector<bench_shape_t>& bench_shapes() {
+	static const vector<bench_shape_t> shapes = {
+		{ "expr", 2000, gen_expr },
+		{ "funcs", 100, gen_funcs },
+		{ "structs", 100, gen_structs },
+		{ "straight", 1000, gen_straight },
+		{ "nested", 200, gen_nested },
+	};
+	return shapes;
+}
+
+bool bench_generate(const string& shape, int size, string& source) {
+	for each (auto& s in bench_shapes())
+		if (s.name == shape) {
+			source = s.generate(size);
+			return true;
+		}
+	return false;
+}
+
+static double phase_time(const compile_result_t& res, const string& name) {
+	for each (auto& p in res.phases)
+		if (p.name == name)
+			return p.time;
+	return 0;
+}
+
+static long long counter(const compile_result_t& res, const string& name) {
+	for each (auto& c in res.counters)
+		if (c.first == name)
+			return c.second;
+	return 0;
+}
+
+int run_benchmarks(const compiler_context_t& context, const vector<string>& shapes, int steps, int repeats, const compile_options_t& options, ostream& os) {
+	compile_options_t bench_options = options;
+	bench_options.mode = CM_ASM;
+	bench_options.time_report = true;
+	os << std::left << setw(10) << "shape" << std::right << setw(8) << "size" << setw(8) << "lines" << setw(9) << "tokens"
+		<< setw(10) << "lex ms" << setw(10) << "parse ms" << setw(11) << "codegen ms" << setw(10) << "print ms" << setw(10) << "total ms"
+		<< setw(10) << "Ktok/s" << setw(10) << "Klines/s" << setw(10) << "peak KB" << setw(8) << "growth" << endl;
+	for each (auto& name in shapes) {
+		const bench_shape_t* shape = nullptr;
+		for each (auto& s in bench_shapes())
+			if (s.name == name)
+				shape = &s;
+		if (!shape) {
+			os << "Unknown shape: " << name << endl;
+			return 1;
+		}
+		double prev_total = 0;
+		int prev_size = 0;
+		for (int step = 0; step < steps; step++) {
+			int size = shape->base_size << step;
+			string source = shape->generate(size);
+			compile_result_t best;
+			long long peak = 0;
+			for (int i = 0; i < repeats; i++) {
+				reset_peak_memory();
+				long long base = peak_memory();
+				compile_result_t res = context.compile(source, bench_options);
+				if (!res.ok) {
+					os << name << ' ' << size << ": " << res.error.substr(0, res.error.find('\n')) << endl;
+					return 1;
+				}
+				peak = max(peak, peak_memory() - base);
+				if (!i || phase_time(res, "compile") < phase_time(best, "compile"))
+					best = res;
+			}
+			long long lines = count(source.begin(), source.end(), '\n');
+			long long tokens = counter(best, "tokens");
+			double total = phase_time(best, "compile");
+			os << std::left << setw(10) << name << std::right << setw(8) << size << setw(8) << lines << setw(9) << tokens << fixed << setprecision(2)
+				<< setw(10) << phase_time(best, "lexing") * 1000 << setw(10) << phase_time(best, "parse") * 1000
+				<< setw(11) << phase_time(best, "codegen") * 1000 << setw(10) << phase_time(best, "print") * 1000 << setw(10) << total * 1000
+				<< setw(10) << tokens / total / 1000 << setw(10) << lines / total / 1000 << setw(10) << peak / 1024 << setw(8);
+			if (prev_size)
+				os << total / prev_total * prev_size / size << endl;
+			else
+				os << "-" << endl;
+			prev_total = total;
+			prev_size = size;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "compiler.h"
+#include <string>
+#include <vector>
+#include <ostream>
+
+using namespace std;
+
+struct bench_shape_t {
+	string name;
+	int base_size;
+	string (*generate)(int size);
+};
+
+const vector<bench_shape_t>& bench_shapes();
+bool bench_generate(const string& shape, int size, string& source);
+int run_benchmarks(const compiler_context_t& context, const vector<string>& shapes, int steps, int repeats, const compile_options_t& options, ostream& os);
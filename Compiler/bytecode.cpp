@@ -0,0 +1,307 @@
+#include "bytecode.h"
+#include "parser.h"
+#include "exceptions.h"
+#include <algorithm>
+#include <cstring>
+
+static const map<string, BC_OPCODE> bc_builtins = {
+#define reg_res_func(incode_name, name, asm_name, ...) { #asm_name, BC_##incode_name },
+#include "register_reserved_function.h"
+#undef reg_res_func
+};
+
+static int align_up(int size, int align) {
+	return (size + align - 1) / align * align;
+}
+
+static int var_align(type_ptr type) {
+	return type == ST_DOUBLE ? 8 : type->get_size() >= 4 ? 4 : 1;
+}
+
+int bc_program_t::func_by_ip(int ip) const {
+	int res = -1;
+	for (int i = 0; i < funcs.size(); i++)
+		if (funcs[i].entry >= 0 && funcs[i].entry <= ip && (res < 0 || funcs[i].entry > funcs[res].entry))
+			res = i;
+	return res;
+}
+
+bc_builder_t::bc_builder_t(bc_program_t& program) : program(program), func_id(-1), regs_top(0), regs_max(0), frame_top(0), frame_max(0) {
+	program.entry = -1;
+}
+
+uint32_t bc_builder_t::_alloc_data(int size, int align) {
+	int offset = align_up(program.data.size(), align);
+	program.data.resize(offset + max(size, 1));
+	return BC_DATA_BASE + offset;
+}
+
+int bc_builder_t::_func_id(const string& name) {
+	auto it = func_ids.find(name);
+	if (it != func_ids.end())
+		return it->second;
+	bc_func_t func = { name, -1, 0, 0 };
+	program.funcs.push_back(func);
+	return func_ids[name] = program.funcs.size() - 1;
+}
+
+void bc_builder_t::_begin_function(const string& name) {
+	func_id = _func_id(name);
+	program.funcs[func_id].entry = program.code.size();
+	regs_top = regs_max = frame_top = frame_max = 0;
+	labels.clear();
+	jumps.clear();
+	locals.clear();
+}
+
+void bc_builder_t::_end_function() {
+	for each (auto& jump in jumps)
+		program.code[jump.first].c = labels[jump.second];
+	bc_func_t& func = program.funcs[func_id];
+	func.regs = regs_max;
+	func.frame_size = align_up(frame_max, 8);
+}
+
+void bc_builder_t::_init_var(sym_var_t* var, bool clear) {
+	auto& init_list = var->get_init_list();
+	if (init_list.empty())
+		return;
+	type_ptr type = var->get_type();
+	int addr = get_var_addr(var);
+	if (type == ST_ARRAY) {
+		auto arr = static_pointer_cast<sym_type_array_t>(type->get_base_type());
+		int elem_size = arr->get_elem_size();
+		for (int i = 0; i < init_list.size(); i++) {
+			int val = init_list[i]->bc_gen_code(*this, true);
+			store(addr, val, arr->get_element_type(), i * elem_size);
+			free_regs(val);
+		}
+		int rest = type->get_size() - init_list.size() * elem_size;
+		if (clear && rest > 0) {
+			emit(BC_ADDI, addr, addr, init_list.size() * elem_size);
+			emit(BC_CLEAR, addr, rest);
+		}
+	} else {
+		int val = init_list[0]->bc_gen_code(*this, true);
+		store(addr, val, type);
+	}
+	free_regs(addr);
+}
+
+void bc_builder_t::add_global(shared_ptr<sym_global_var_t> var) {
+	globals[var.get()] = _alloc_data(var->get_type_size(), var_align(var->get_type()));
+	global_vars.push_back(var);
+}
+
+void bc_builder_t::add_function(shared_ptr<sym_func_t> func) {
+	if (!func->defined())
+		return;
+	_begin_function(func->asm_get_name());
+	vector<sym_var_t*> args;
+	for each (auto sym in *func->get_sym_table())
+		if (sym == ST_VAR) {
+			auto var = dynamic_pointer_cast<sym_local_var_t>(sym);
+			frame_top = align_up(frame_top, var_align(var->get_type()));
+			locals[var.get()] = frame_top;
+			frame_top += var->get_type_size();
+			args.push_back(var.get());
+			new_reg();
+		}
+	frame_max = frame_top;
+	for (int i = 0; i < args.size(); i++) {
+		int addr = get_var_addr(args[i]);
+		store(addr, i, args[i]->get_type());
+		free_regs(addr);
+	}
+	func->get_block()->bc_gen_code(*this);
+	int res = new_reg();
+	emit(BC_MOVI, res, 0);
+	emit(BC_RET, res);
+	_end_function();
+}
+
+void bc_builder_t::finish() {
+	_begin_function("start");
+	program.entry = program.code.size();
+	for each (auto var in global_vars)
+		_init_var(var.get(), false);
+	auto main = func_ids.find("_main");
+	if (main == func_ids.end() || program.funcs[main->second].entry < 0)
+		throw MainFuncNotFound();
+	int res = new_reg();
+	emit(BC_CALL, res, main->second);
+	emit(BC_HALT, res);
+	_end_function();
+	for each (auto func in called_funcs)
+		if (!func->defined())
+			throw FuncNotDefined(func);
+}
+
+int bc_builder_t::new_reg() {
+	regs_max = max(regs_max, regs_top + 1);
+	return regs_top++;
+}
+
+void bc_builder_t::free_regs(int reg) {
+	regs_top = reg;
+}
+
+void bc_builder_t::emit(BC_OPCODE op, int a, int b, int c) {
+	bc_insn_t insn = { op, a, b, c };
+	program.code.push_back(insn);
+}
+
+int bc_builder_t::new_label() {
+	labels.push_back(-1);
+	return labels.size() - 1;
+}
+
+void bc_builder_t::insert_label(int label) {
+	labels[label] = program.code.size();
+}
+
+void bc_builder_t::jump(BC_OPCODE op, int label, int reg) {
+	jumps.push_back(make_pair((int)program.code.size(), label));
+	emit(op, reg, 0, -1);
+}
+
+int bc_builder_t::const_double(double val) {
+	uint64_t key;
+	memcpy(&key, &val, sizeof(val));
+	auto it = const_ids.find(key);
+	if (it != const_ids.end())
+		return it->second;
+	program.consts.push_back(val);
+	return const_ids[key] = program.consts.size() - 1;
+}
+
+uint32_t bc_builder_t::literal(const string& str) {
+	auto it = literals.find(str);
+	if (it != literals.end())
+		return it->second;
+	uint32_t addr = _alloc_data(str.size() + 1, 1);
+	memcpy(&program.data[addr - BC_DATA_BASE], str.c_str(), str.size() + 1);
+	return literals[str] = addr;
+}
+
+void bc_builder_t::call(shared_ptr<sym_func_t> func, int base) {
+	called_funcs.push_back(func);
+	emit(BC_CALL, base, _func_id(func->asm_get_name()));
+}
+
+void bc_builder_t::call_builtin(const string& name, int base, int argc) {
+	emit(bc_builtins.at(name), base, argc);
+}
+
+void bc_builder_t::enter_block(sym_table_ptr sym_table) {
+	vector<sym_var_t*> vars;
+	for each (auto sym in *sym_table)
+		if (sym == ST_VAR) {
+			auto var = dynamic_pointer_cast<sym_local_var_t>(sym);
+			if (!var)
+				continue;
+			frame_top = align_up(frame_top, var_align(var->get_type()));
+			locals[var.get()] = frame_top;
+			frame_top += var->get_type_size();
+			vars.push_back(var.get());
+		}
+	frame_max = max(frame_max, frame_top);
+	for each (auto var in vars)
+		_init_var(var, true);
+}
+
+void bc_builder_t::exit_block(int frame) {
+	frame_top = frame;
+}
+
+int bc_builder_t::frame() {
+	return frame_top;
+}
+
+int bc_builder_t::get_var(sym_var_t* var) {
+	type_ptr type = var->get_type();
+	auto it = locals.find(var);
+	if (it == locals.end() || type == ST_STRUCT || type == ST_ARRAY) {
+		int res = get_var_addr(var);
+		load(res, res, type);
+		return res;
+	}
+	int res = new_reg();
+	emit(type == ST_DOUBLE ? BC_LDL8 : type->get_size() == 1 ? BC_LDL1 : BC_LDL4, res, it->second);
+	return res;
+}
+
+int bc_builder_t::get_var_addr(sym_var_t* var) {
+	int res = new_reg();
+	auto local = locals.find(var);
+	if (local != locals.end()) {
+		emit(BC_ADDRL, res, local->second);
+		return res;
+	}
+	auto global = globals.find(var);
+	if (global == globals.end())
+		throw VmError("Variable " + var->get_name() + " has no storage");
+	emit(BC_MOVI, res, global->second);
+	return res;
+}
+
+int bc_builder_t::member_offset(shared_ptr<sym_type_struct_t> structure, sym_var_t* member) {
+	auto it = members.find(member);
+	if (it != members.end())
+		return it->second;
+	int offset = 0;
+	for each (auto sym in *structure->get_sym_table())
+		if (sym == ST_VAR) {
+			auto var = dynamic_pointer_cast<sym_local_var_t>(sym);
+			if (!var)
+				continue;
+			if (var->get_type_size() >= 4)
+				offset = align_up(offset, 4);
+			members[var.get()] = offset;
+			offset += var->get_type_size();
+		}
+	return members.at(member);
+}
+
+void bc_builder_t::load(int dst, int addr, type_ptr type, int offset) {
+	if (type == ST_STRUCT || type == ST_ARRAY) {
+		if (offset || dst != addr)
+			emit(BC_ADDI, dst, addr, offset);
+	} else
+		emit(type == ST_DOUBLE ? BC_LD8 : type->get_size() == 1 ? BC_LD1 : BC_LD4, dst, addr, offset);
+}
+
+void bc_builder_t::store(int addr, int val, type_ptr type, int offset) {
+	if (type == ST_STRUCT || type == ST_ARRAY) {
+		int dst = addr;
+		if (offset) {
+			dst = new_reg();
+			emit(BC_ADDI, dst, addr, offset);
+		}
+		emit(BC_COPY, dst, val, type->get_size());
+		if (offset)
+			free_regs(dst);
+	} else
+		emit(type == ST_DOUBLE ? BC_ST8 : type->get_size() == 1 ? BC_ST1 : BC_ST4, addr, val, offset);
+}
+
+void bc_builder_t::convert(int reg, type_ptr from, type_ptr to) {
+	if (to == ST_DOUBLE) {
+		if (from != ST_DOUBLE)
+			emit(BC_I2D, reg, reg);
+	} else if (from == ST_DOUBLE) {
+		emit(BC_D2I, reg, reg);
+		if (to == ST_CHAR)
+			emit(BC_I2C, reg, reg);
+	} else if (to == ST_CHAR && from != ST_CHAR)
+		emit(BC_I2C, reg, reg);
+}
+
+int bc_builder_t::gen_cond(expr_t* expr, bool normalize) {
+	int res = expr->bc_gen_code(*this, true);
+	if (expr->get_type() == ST_DOUBLE)
+		emit(BC_FBOOL, res, res);
+	else if (normalize)
+		emit(BC_BOOL, res, res);
+	return res;
+}
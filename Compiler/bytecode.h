@@ -0,0 +1,165 @@
+#pragma once
+#include "parser_symbol_node.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+using namespace std;
+
+class expr_t;
+
+#define BC_DATA_BASE 0x10000u
+
+// a - destination register unless noted, b and c - source registers or immediates
+#define BC_OPS(reg_bc_op)\
+	reg_bc_op(MOVI)		/* a = b */\
+	reg_bc_op(MOVD)		/* a = consts[b] */\
+	reg_bc_op(MOV)		/* a = b */\
+	reg_bc_op(ADDRL)	/* a = fp + b */\
+	reg_bc_op(LDL1)		/* a = frame[b] */\
+	reg_bc_op(LDL4)\
+	reg_bc_op(LDL8)\
+	reg_bc_op(STL1)		/* frame[a] = b */\
+	reg_bc_op(STL4)\
+	reg_bc_op(STL8)\
+	reg_bc_op(LD1)		/* a = mem[b + c] */\
+	reg_bc_op(LD4)\
+	reg_bc_op(LD8)\
+	reg_bc_op(ST1)		/* mem[a + c] = b */\
+	reg_bc_op(ST4)\
+	reg_bc_op(ST8)\
+	reg_bc_op(COPY)		/* mem[a .. a + c) = mem[b .. b + c) */\
+	reg_bc_op(CLEAR)	/* mem[a .. a + b) = 0 */\
+	reg_bc_op(ADD)\
+	reg_bc_op(SUB)\
+	reg_bc_op(MUL)\
+	reg_bc_op(DIV)\
+	reg_bc_op(MOD)\
+	reg_bc_op(AND)\
+	reg_bc_op(OR)\
+	reg_bc_op(XOR)\
+	reg_bc_op(SHL)\
+	reg_bc_op(SHR)\
+	reg_bc_op(ADDI)		/* a = b + imm c */\
+	reg_bc_op(MULI)		/* a = b * imm c */\
+	reg_bc_op(NEG)\
+	reg_bc_op(NOT)\
+	reg_bc_op(LNOT)\
+	reg_bc_op(BOOL)\
+	reg_bc_op(EQ)\
+	reg_bc_op(NE)\
+	reg_bc_op(LT)\
+	reg_bc_op(LE)\
+	reg_bc_op(GT)\
+	reg_bc_op(GE)\
+	reg_bc_op(FADD)\
+	reg_bc_op(FSUB)\
+	reg_bc_op(FMUL)\
+	reg_bc_op(FDIV)\
+	reg_bc_op(FNEG)\
+	reg_bc_op(FBOOL)\
+	reg_bc_op(FEQ)\
+	reg_bc_op(FNE)\
+	reg_bc_op(FLT)\
+	reg_bc_op(FLE)\
+	reg_bc_op(FGT)\
+	reg_bc_op(FGE)\
+	reg_bc_op(I2D)\
+	reg_bc_op(D2I)\
+	reg_bc_op(I2C)\
+	reg_bc_op(JMP)		/* ip = c */\
+	reg_bc_op(JZ)		/* if (!a) ip = c */\
+	reg_bc_op(JNZ)\
+	reg_bc_op(CALL)		/* callee registers start at a, b - function */\
+	reg_bc_op(RET)		/* callee register 0 = a */\
+	reg_bc_op(HALT)\
+	reg_bc_op(PRINTF)	/* arguments in a .. a + b, result in a */\
+	reg_bc_op(SCANF)\
+	reg_bc_op(MALLOC)\
+	reg_bc_op(FREE)
+
+enum BC_OPCODE {
+#define reg_bc_op(name) BC_##name,
+	BC_OPS(reg_bc_op)
+#undef reg_bc_op
+	BC_COUNT
+};
+
+struct bc_insn_t {
+	int32_t op;
+	int32_t a;
+	int32_t b;
+	int32_t c;
+};
+
+struct bc_func_t {
+	string name;
+	int entry;
+	int regs;
+	int frame_size;
+};
+
+struct bc_program_t {
+	vector<bc_insn_t> code;
+	vector<bc_func_t> funcs;
+	vector<double> consts;
+	vector<uint8_t> data;
+	int entry;
+	int func_by_ip(int ip) const;
+};
+
+typedef shared_ptr<bc_program_t> bc_program_ptr;
+
+class bc_builder_t {
+	bc_program_t& program;
+	map<string, int> func_ids;
+	map<string, uint32_t> literals;
+	map<uint64_t, int> const_ids;
+	map<sym_var_t*, uint32_t> globals;
+	map<sym_var_t*, int> locals;
+	map<sym_var_t*, int> members;
+	vector<shared_ptr<sym_global_var_t>> global_vars;
+	vector<shared_ptr<sym_func_t>> called_funcs;
+	vector<int> labels;
+	vector<pair<int, int>> jumps;
+	int func_id;
+	int regs_top;
+	int regs_max;
+	int frame_top;
+	int frame_max;
+
+	uint32_t _alloc_data(int size, int align);
+	int _func_id(const string& name);
+	void _begin_function(const string& name);
+	void _end_function();
+	void _init_var(sym_var_t* var, bool clear);
+public:
+	bc_builder_t(bc_program_t& program);
+	void add_global(shared_ptr<sym_global_var_t> var);
+	void add_function(shared_ptr<sym_func_t> func);
+	void finish();
+
+	int new_reg();
+	void free_regs(int reg);
+	void emit(BC_OPCODE op, int a = 0, int b = 0, int c = 0);
+	int new_label();
+	void insert_label(int label);
+	void jump(BC_OPCODE op, int label, int reg = 0);
+	int const_double(double val);
+	uint32_t literal(const string& str);
+	void call(shared_ptr<sym_func_t> func, int base);
+	void call_builtin(const string& name, int base, int argc);
+
+	void enter_block(sym_table_ptr sym_table);
+	void exit_block(int frame);
+	int frame();
+	int get_var(sym_var_t* var);
+	int get_var_addr(sym_var_t* var);
+	int member_offset(shared_ptr<sym_type_struct_t> structure, sym_var_t* member);
+	void load(int dst, int addr, type_ptr type, int offset = 0);
+	void store(int addr, int val, type_ptr type, int offset = 0);
+	void convert(int reg, type_ptr from, type_ptr to);
+	int gen_cond(expr_t* expr, bool normalize);
+};
@@ -0,0 +1,422 @@
+#include "bytecode_vm.h"
+#include "exceptions.h"
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <climits>
+#include <cmath>
+
+#define BC_MEMORY_SIZE (16u << 20)
+#define BC_STACK_SIZE (1u << 20)
+
+template <typename T>
+static string format_arg(const string& spec, T val) {
+	int len = snprintf(nullptr, 0, spec.c_str(), val);
+	if (len <= 0)
+		return "";
+	vector<char> buf(len + 1);
+	snprintf(buf.data(), buf.size(), spec.c_str(), val);
+	return string(buf.data(), len);
+}
+
+static const char* const bc_op_names[] = {
+#define reg_bc_op(name) #name,
+	BC_OPS(reg_bc_op)
+#undef reg_bc_op
+};
+
+bc_vm_t::bc_vm_t(bc_program_ptr program) :
+	program(program), memory(BC_MEMORY_SIZE), exit_code(0), max_steps(100000000), in(nullptr), out(nullptr), stats()
+{
+	if (BC_DATA_BASE + program->data.size() > BC_MEMORY_SIZE - BC_STACK_SIZE)
+		throw VmError("Data segment does not fit in VM memory");
+	if (!program->data.empty())
+		memcpy(&memory[BC_DATA_BASE], &program->data[0], program->data.size());
+	heap_end = BC_DATA_BASE + program->data.size();
+	stack_limit = BC_MEMORY_SIZE - BC_STACK_SIZE;
+}
+
+void bc_vm_t::set_max_steps(long long steps) {
+	max_steps = steps;
+}
+
+void bc_vm_t::set_input(istream& is) {
+	in = &is;
+}
+
+uint8_t* bc_vm_t::_mem(uint32_t addr, int size) {
+	if (addr < BC_DATA_BASE || addr > memory.size() - size) {
+		ostringstream os;
+		os << "Access violation at address 0x" << hex << setw(8) << setfill('0') << addr;
+		throw VmError(os.str());
+	}
+	return &memory[addr];
+}
+
+string bc_vm_t::_string(uint32_t addr) {
+	string res;
+	for (char c; (c = *_mem(addr, 1)) != 0; addr++)
+		res += c;
+	return res;
+}
+
+string bc_vm_t::_format(const bc_reg_t* args, int count) {
+	string res;
+	int arg = 1;
+	uint32_t fmt = args[0].u;
+	for (char c; (c = *_mem(fmt, 1)) != 0; fmt++) {
+		if (c != '%') {
+			res += c;
+			continue;
+		}
+		string spec = "%";
+		for (c = *_mem(++fmt, 1); c && strchr("-+ #0123456789.*lhL", c); c = *_mem(++fmt, 1))
+			if (c == '*')
+				spec += to_string(arg < count ? args[arg++].i : 0);
+			else if (!strchr("lhL", c))
+				spec += c;
+		if (!c)
+			break;
+		spec += c;
+		if (c != '%' && arg >= count)
+			throw VmError("Too few arguments for printf format");
+		switch (c) {
+			case 'd':
+			case 'i':
+			case 'c':
+				res += format_arg(spec, args[arg++].i);
+				break;
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X':
+				res += format_arg(spec, args[arg++].u);
+				break;
+			case 'p':
+				res += format_arg("%08X", args[arg++].u);
+				break;
+			case 's':
+				res += format_arg(spec, _string(args[arg++].u).c_str());
+				break;
+			case 'f':
+			case 'F':
+			case 'e':
+			case 'E':
+			case 'g':
+			case 'G':
+				res += format_arg(spec, args[arg++].d);
+				break;
+			case '%':
+				res += '%';
+				break;
+			default:
+				res += spec;
+		}
+	}
+	return res;
+}
+
+int bc_vm_t::_scan(const bc_reg_t* args, int count) {
+	if (!in)
+		return -1;
+	int res = 0;
+	int arg = 1;
+	uint32_t fmt = args[0].u;
+	for (char c; (c = *_mem(fmt, 1)) != 0; fmt++) {
+		if (isspace((unsigned char)c)) {
+			*in >> ws;
+			continue;
+		}
+		if (c != '%') {
+			if (in->peek() != c)
+				break;
+			in->get();
+			continue;
+		}
+		bool is_long = false;
+		for (c = *_mem(++fmt, 1); c && strchr("lhL0123456789", c); c = *_mem(++fmt, 1))
+			is_long |= c == 'l' || c == 'L';
+		if (c == '%') {
+			if (in->get() != '%')
+				break;
+			continue;
+		}
+		if (arg >= count)
+			break;
+		uint32_t dst = args[arg++].u;
+		bool ok = true;
+		switch (c) {
+			case 'd':
+			case 'i':
+			case 'u':
+			case 'x': {
+				long long val;
+				ok = !!(*in >> (c == 'x' ? hex : dec) >> val);
+				*in >> dec;
+				if (ok) {
+					int32_t val32 = (int32_t)val;
+					memcpy(_mem(dst, 4), &val32, 4);
+				}
+				break;
+			}
+			case 'c': {
+				char val;
+				ok = !!in->get(val);
+				if (ok)
+					*_mem(dst, 1) = val;
+				break;
+			}
+			case 's': {
+				string val;
+				ok = !!(*in >> val);
+				if (ok) {
+					val += '\0';
+					memcpy(_mem(dst, val.size()), val.data(), val.size());
+				}
+				break;
+			}
+			case 'f':
+			case 'e':
+			case 'g': {
+				double val;
+				ok = !!(*in >> val);
+				if (ok) {
+					if (is_long)
+						memcpy(_mem(dst, 8), &val, 8);
+					else {
+						float val32 = (float)val;
+						memcpy(_mem(dst, 4), &val32, 4);
+					}
+				}
+				break;
+			}
+			default:
+				ok = false;
+		}
+		if (!ok)
+			return res || !in->eof() ? res : -1;
+		res++;
+	}
+	return res;
+}
+
+// Each handler ends with BC_NEXT, which with BC_THREADED jumps straight to the handler of the
+// following instruction instead of returning to a central switch
+#ifdef BC_THREADED
+#define BC_CASE(name) op_##name:
+#define BC_DISPATCH() goto *dispatch[(insn = &code[ip])->op]
+#else
+#define BC_CASE(name) case BC_##name:
+#define BC_DISPATCH() continue
+#endif
+#define BC_NEXT() { ip++; steps++; BC_DISPATCH(); }
+#define BC_JUMP(target) { if (++steps > max_steps) goto step_limit; ip = target; BC_DISPATCH(); }
+#define R(x) r[insn->x]
+#define LOCAL(x) (&memory[fp + (x)])
+#define MEM(addr, size) (addr >= BC_DATA_BASE && addr <= BC_MEMORY_SIZE - size ? &memory[addr] : _mem(addr, size))
+
+int bc_vm_t::_exec() {
+#ifdef BC_THREADED
+	static void* const dispatch[] = {
+#define reg_bc_op(name) &&op_##name,
+		BC_OPS(reg_bc_op)
+#undef reg_bc_op
+	};
+#endif
+	const bc_insn_t* code = &program->code[0];
+	const double* consts = program->consts.empty() ? nullptr : &program->consts[0];
+	const bc_insn_t* insn;
+	int ip = program->entry;
+	int base = 0;
+	uint32_t fp = BC_MEMORY_SIZE;
+	long long steps = 0;
+	regs.assign(program->funcs[program->func_by_ip(ip)].regs, bc_reg_t());
+	bc_reg_t* r = &regs[0];
+	uint32_t addr;
+	try {
+#ifdef BC_THREADED
+		BC_DISPATCH();
+#else
+		for (;;) {
+			insn = &code[ip];
+			switch (insn->op) {
+#endif
+		BC_CASE(MOVI) R(a).i = insn->b; BC_NEXT();
+		BC_CASE(MOVD) R(a).d = consts[insn->b]; BC_NEXT();
+		BC_CASE(MOV) R(a) = R(b); BC_NEXT();
+		BC_CASE(ADDRL) R(a).u = fp + insn->b; BC_NEXT();
+		BC_CASE(LDL1) R(a).i = *LOCAL(insn->b); BC_NEXT();
+		BC_CASE(LDL4) memcpy(&R(a).i, LOCAL(insn->b), 4); BC_NEXT();
+		BC_CASE(LDL8) memcpy(&R(a).d, LOCAL(insn->b), 8); BC_NEXT();
+		BC_CASE(STL1) *LOCAL(insn->a) = (uint8_t)R(b).i; BC_NEXT();
+		BC_CASE(STL4) memcpy(LOCAL(insn->a), &R(b).i, 4); BC_NEXT();
+		BC_CASE(STL8) memcpy(LOCAL(insn->a), &R(b).d, 8); BC_NEXT();
+		BC_CASE(LD1) addr = R(b).u + insn->c; R(a).i = *MEM(addr, 1); BC_NEXT();
+		BC_CASE(LD4) addr = R(b).u + insn->c; memcpy(&R(a).i, MEM(addr, 4), 4); BC_NEXT();
+		BC_CASE(LD8) addr = R(b).u + insn->c; memcpy(&R(a).d, MEM(addr, 8), 8); BC_NEXT();
+		BC_CASE(ST1) addr = R(a).u + insn->c; *MEM(addr, 1) = (uint8_t)R(b).i; BC_NEXT();
+		BC_CASE(ST4) addr = R(a).u + insn->c; memcpy(MEM(addr, 4), &R(b).i, 4); BC_NEXT();
+		BC_CASE(ST8) addr = R(a).u + insn->c; memcpy(MEM(addr, 8), &R(b).d, 8); BC_NEXT();
+		BC_CASE(COPY) memmove(_mem(R(a).u, insn->c), _mem(R(b).u, insn->c), insn->c); BC_NEXT();
+		BC_CASE(CLEAR) memset(_mem(R(a).u, insn->b), 0, insn->b); BC_NEXT();
+		BC_CASE(ADD) R(a).u = R(b).u + R(c).u; BC_NEXT();
+		BC_CASE(SUB) R(a).u = R(b).u - R(c).u; BC_NEXT();
+		BC_CASE(MUL) R(a).u = R(b).u * R(c).u; BC_NEXT();
+		BC_CASE(DIV)
+			if (!R(c).i)
+				throw VmError("Integer division by zero");
+			if (R(b).i == INT_MIN && R(c).i == -1)
+				throw VmError("Integer overflow in division");
+			R(a).i = R(b).i / R(c).i;
+			BC_NEXT();
+		BC_CASE(MOD)
+			if (!R(c).i)
+				throw VmError("Integer division by zero");
+			if (R(b).i == INT_MIN && R(c).i == -1)
+				throw VmError("Integer overflow in division");
+			R(a).i = R(b).i % R(c).i;
+			BC_NEXT();
+		BC_CASE(AND) R(a).u = R(b).u & R(c).u; BC_NEXT();
+		BC_CASE(OR) R(a).u = R(b).u | R(c).u; BC_NEXT();
+		BC_CASE(XOR) R(a).u = R(b).u ^ R(c).u; BC_NEXT();
+		BC_CASE(SHL) R(a).u = R(b).u << (R(c).u & 31); BC_NEXT();
+		BC_CASE(SHR) R(a).i = R(b).i >> (R(c).u & 31); BC_NEXT();
+		BC_CASE(ADDI) R(a).u = R(b).u + insn->c; BC_NEXT();
+		BC_CASE(MULI) R(a).u = R(b).u * insn->c; BC_NEXT();
+		BC_CASE(NEG) R(a).u = 0u - R(b).u; BC_NEXT();
+		BC_CASE(NOT) R(a).u = ~R(b).u; BC_NEXT();
+		BC_CASE(LNOT) R(a).i = !R(b).i; BC_NEXT();
+		BC_CASE(BOOL) R(a).i = R(b).i != 0; BC_NEXT();
+		BC_CASE(EQ) R(a).i = R(b).i == R(c).i; BC_NEXT();
+		BC_CASE(NE) R(a).i = R(b).i != R(c).i; BC_NEXT();
+		BC_CASE(LT) R(a).i = R(b).i < R(c).i; BC_NEXT();
+		BC_CASE(LE) R(a).i = R(b).i <= R(c).i; BC_NEXT();
+		BC_CASE(GT) R(a).i = R(b).i > R(c).i; BC_NEXT();
+		BC_CASE(GE) R(a).i = R(b).i >= R(c).i; BC_NEXT();
+		BC_CASE(FADD) R(a).d = R(b).d + R(c).d; BC_NEXT();
+		BC_CASE(FSUB) R(a).d = R(b).d - R(c).d; BC_NEXT();
+		BC_CASE(FMUL) R(a).d = R(b).d * R(c).d; BC_NEXT();
+		BC_CASE(FDIV) R(a).d = R(b).d / R(c).d; BC_NEXT();
+		BC_CASE(FNEG) R(a).d = -R(b).d; BC_NEXT();
+		BC_CASE(FBOOL) R(a).i = R(b).d != 0; BC_NEXT();
+		BC_CASE(FEQ) R(a).i = R(b).d == R(c).d; BC_NEXT();
+		BC_CASE(FNE) R(a).i = R(b).d != R(c).d; BC_NEXT();
+		BC_CASE(FLT) R(a).i = R(b).d < R(c).d; BC_NEXT();
+		BC_CASE(FLE) R(a).i = R(b).d <= R(c).d; BC_NEXT();
+		BC_CASE(FGT) R(a).i = R(b).d > R(c).d; BC_NEXT();
+		BC_CASE(FGE) R(a).i = R(b).d >= R(c).d; BC_NEXT();
+		BC_CASE(I2D) R(a).d = R(b).i; BC_NEXT();
+		BC_CASE(D2I) R(a).i = R(b).d > INT_MIN - 1.0 && R(b).d < INT_MAX + 1.0 ? (int32_t)R(b).d : INT_MIN; BC_NEXT();
+		BC_CASE(I2C) R(a).i = R(b).i & 0xFF; BC_NEXT();
+		BC_CASE(JMP) stats.branches++; stats.taken_branches++; BC_JUMP(insn->c);
+		BC_CASE(JZ)
+			stats.branches++;
+			if (R(a).i)
+				BC_NEXT();
+			stats.taken_branches++;
+			BC_JUMP(insn->c);
+		BC_CASE(JNZ)
+			stats.branches++;
+			if (!R(a).i)
+				BC_NEXT();
+			stats.taken_branches++;
+			BC_JUMP(insn->c);
+		BC_CASE(CALL) {
+			const bc_func_t& func = program->funcs[insn->b];
+			if (fp - stack_limit < (uint32_t)func.frame_size)
+				throw VmError("Stack overflow");
+			bc_frame_t frame = { ip + 1, base, fp };
+			frames.push_back(frame);
+			base += insn->a;
+			fp -= func.frame_size;
+			stats.stack_bytes = max(stats.stack_bytes, BC_MEMORY_SIZE - fp);
+			if (regs.size() < base + func.regs)
+				regs.resize(base + func.regs);
+			r = &regs[base];
+			stats.calls++;
+			BC_JUMP(func.entry);
+		}
+		BC_CASE(RET) {
+			bc_reg_t res = R(a);
+			bc_frame_t frame = frames.back();
+			frames.pop_back();
+			r[0] = res;
+			ip = frame.ret_ip;
+			base = frame.base;
+			fp = frame.fp;
+			r = &regs[base];
+			steps++;
+			BC_DISPATCH();
+		}
+		BC_CASE(HALT)
+			stats.instructions = steps + 1;
+			return R(a).i;
+		BC_CASE(PRINTF) {
+			string res = _format(&R(a), insn->b);
+			*out << res;
+			R(a).i = res.size();
+			stats.extern_calls++;
+			BC_NEXT();
+		}
+		BC_CASE(SCANF) R(a).i = _scan(&R(a), insn->b); stats.extern_calls++; BC_NEXT();
+		BC_CASE(MALLOC) {
+			uint32_t size = R(a).u;
+			uint32_t res = (heap_end + 7) / 8 * 8;
+			if (size > stack_limit - res)
+				R(a).u = 0;
+			else {
+				heap_end = res + max(size, 1u);
+				stats.heap_bytes += size;
+				R(a).u = res;
+			}
+			stats.extern_calls++;
+			BC_NEXT();
+		}
+		BC_CASE(FREE) stats.extern_calls++; BC_NEXT();
+#ifndef BC_THREADED
+				default:
+					throw VmError("Invalid instruction");
+			}
+		}
+#endif
+	step_limit:
+		throw VmError("Step limit of " + to_string(max_steps) + " instructions exceeded");
+	} catch (VmError& e) {
+		stats.instructions = steps;
+		ostringstream es;
+		es << e;
+		int func = program->func_by_ip(ip);
+		if (func >= 0)
+			es << " in " << program->funcs[func].name << ": " << bc_op_names[code[ip].op];
+		throw VmError(es.str());
+	}
+}
+
+int bc_vm_t::run(ostream& os) {
+	out = &os;
+	frames.clear();
+	exit_code = _exec();
+	out->flush();
+	return exit_code;
+}
+
+const bc_vm_stats_t& bc_vm_t::get_stats() {
+	return stats;
+}
+
+void bc_vm_t::print_stats(ostream& os) {
+	os << std::left << setw(24) << "exit code" << std::right << setw(14) << exit_code << endl;
+	pair<const char*, long long> rows[] = {
+		{ "instructions", stats.instructions },
+		{ "branches", stats.branches },
+		{ "taken branches", stats.taken_branches },
+		{ "calls", stats.calls },
+		{ "extern calls", stats.extern_calls },
+		{ "heap bytes", stats.heap_bytes },
+		{ "stack bytes", stats.stack_bytes },
+	};
+	for each (auto& row in rows)
+		os << std::left << setw(24) << row.first << std::right << setw(14) << row.second << endl;
+}
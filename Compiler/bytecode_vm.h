@@ -0,0 +1,59 @@
+#pragma once
+#include "bytecode.h"
+#include <istream>
+#include <ostream>
+
+using namespace std;
+
+#if defined(__GNUC__)
+#define BC_THREADED
+#endif
+
+union bc_reg_t {
+	int32_t i;
+	uint32_t u;
+	double d;
+};
+
+struct bc_frame_t {
+	int ret_ip;
+	int base;
+	uint32_t fp;
+};
+
+struct bc_vm_stats_t {
+	long long instructions;
+	long long branches;
+	long long taken_branches;
+	long long calls;
+	long long extern_calls;
+	long long heap_bytes;
+	uint32_t stack_bytes;
+};
+
+class bc_vm_t {
+	bc_program_ptr program;
+	vector<uint8_t> memory;
+	vector<bc_reg_t> regs;
+	vector<bc_frame_t> frames;
+	uint32_t heap_end;
+	uint32_t stack_limit;
+	int exit_code;
+	long long max_steps;
+	istream* in;
+	ostream* out;
+	bc_vm_stats_t stats;
+
+	uint8_t* _mem(uint32_t addr, int size);
+	string _string(uint32_t addr);
+	string _format(const bc_reg_t* args, int count);
+	int _scan(const bc_reg_t* args, int count);
+	int _exec();
+public:
+	bc_vm_t(bc_program_ptr program);
+	void set_max_steps(long long steps);
+	void set_input(istream& is);
+	int run(ostream& os);
+	const bc_vm_stats_t& get_stats();
+	void print_stats(ostream& os);
+};
@@ -0,0 +1,125 @@
+#include "compile_cache.h"
+#include "sha256.h"
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#if defined(_MSC_VER) && _MSC_VER < 1914
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#else
+#include <filesystem>
+namespace fs = std::filesystem;
+#endif
+
+compile_cache_t::compile_cache_t(string dir, uintmax_t max_size) : dir(dir), max_size(max_size), size(0), scanned(false) {
+	error_code ec;
+	fs::create_directories(dir, ec);
+}
+
+string compile_cache_t::options_key(const compile_options_t& options) {
+	ostringstream os;
+	os << COMPILER_VERSION << '\n' << options.mode << ' ' << options.opt_level << ' ' << options.target;
+	for each (auto& p in options.passes)
+		os << ' ' << (p.second ? "+" : "-") << p.first;
+	os << '\n';
+	return os.str();
+}
+
+string compile_cache_t::make_key(const string& source, const compile_options_t& options) {
+	ostringstream os;
+	os << options_key(options) << source.size() << '\n' << source;
+	return sha256_hex(os.str());
+}
+
+string compile_cache_t::_path(const string& key) {
+	return (fs::path(dir) / key).string();
+}
+
+bool compile_cache_t::load(const string& key, string& data) {
+	ifstream fin(_path(key), ios::binary);
+	if (!fin)
+		return false;
+	stringstream ss;
+	ss << fin.rdbuf();
+	fin.close();
+	data = ss.str();
+	error_code ec;
+	fs::last_write_time(_path(key), fs::file_time_type::clock::now(), ec);
+	return true;
+}
+
+bool compile_cache_t::load(const string& key, compile_result_t& res) {
+	string data;
+	if (!load(key, data))
+		return false;
+	istringstream is(data);
+	size_t out_size, err_size;
+	if (!(is >> res.ok >> out_size >> err_size) || is.get() != '\n')
+		return false;
+	res.output.resize(out_size);
+	res.error.resize(err_size);
+	return is.read(&res.output[0], out_size) && is.read(&res.error[0], err_size);
+}
+
+void compile_cache_t::store(const string& key, const compile_result_t& res) {
+	ostringstream os;
+	os << res.ok << ' ' << res.output.size() << ' ' << res.error.size() << '\n' << res.output << res.error;
+	store(key, os.str());
+}
+
+// Several processes can share one cache directory and thread ids repeat between them, so the temporary name carries both
+void compile_cache_t::store(const string& key, const string& data) {
+	ostringstream id;
+	id << getpid() << '.' << this_thread::get_id();
+	string tmp = _path(key) + ".tmp" + id.str();
+	{
+		ofstream fout(tmp, ios::binary);
+		fout << data;
+		if (!fout)
+			return;
+	}
+	error_code ec;
+	uintmax_t entry_size = fs::file_size(tmp, ec);
+	fs::rename(tmp, _path(key), ec);
+	if (ec) {
+		fs::remove(tmp, ec);
+		return;
+	}
+	lock_guard<mutex> lock(size_mutex);
+	if (!scanned)
+		_scan();
+	else
+		size += entry_size;
+	if (size > max_size)
+		_evict();
+}
+
+void compile_cache_t::_scan() {
+	error_code ec;
+	size = 0;
+	for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+		size += fs::file_size(it->path(), ec);
+	scanned = true;
+}
+
+void compile_cache_t::_evict() {
+	error_code ec;
+	vector<pair<fs::file_time_type, fs::path>> entries;
+	for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+		entries.push_back(make_pair(fs::last_write_time(it->path(), ec), it->path()));
+	sort(entries.begin(), entries.end());
+	_scan();
+	for (int i = 0; i < entries.size() && size > max_size / 10 * 9; i++) {
+		uintmax_t entry_size = fs::file_size(entries[i].second, ec);
+		if (fs::remove(entries[i].second, ec))
+			size -= entry_size;
+	}
+}
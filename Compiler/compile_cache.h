@@ -0,0 +1,26 @@
+#pragma once
+#include "compiler.h"
+#include <string>
+#include <mutex>
+#include <stdint.h>
+
+using namespace std;
+
+class compile_cache_t {
+	string dir;
+	uintmax_t max_size;
+	uintmax_t size;
+	bool scanned;
+	mutex size_mutex;
+	string _path(const string& key);
+	void _scan();
+	void _evict();
+public:
+	compile_cache_t(string dir, uintmax_t max_size);
+	bool load(const string& key, string& data);
+	void store(const string& key, const string& data);
+	bool load(const string& key, compile_result_t& res);
+	void store(const string& key, const compile_result_t& res);
+	static string options_key(const compile_options_t& options);
+	static string make_key(const string& source, const compile_options_t& options);
+};
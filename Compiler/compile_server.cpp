@@ -0,0 +1,194 @@
+#include "compile_server.h"
+#include "thread_pool.h"
+#include <sstream>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET socket_t;
+#define close_socket closesocket
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+typedef int socket_t;
+#define INVALID_SOCKET -1
+#define close_socket close
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static bool sockets_init() {
+#ifdef _WIN32
+	WSADATA data;
+	return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+	return true;
+#endif
+}
+
+static bool make_address(const string& path, sockaddr_un& addr) {
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path))
+		return false;
+	strcpy(addr.sun_path, path.c_str());
+	return true;
+}
+
+static bool send_all(socket_t s, const string& data) {
+	for (size_t sent = 0; sent < data.size();) {
+		int n = send(s, data.data() + sent, (int)(data.size() - sent), MSG_NOSIGNAL);
+		if (n <= 0)
+			return false;
+		sent += n;
+	}
+	return true;
+}
+
+static bool recv_exact(socket_t s, size_t size, string& res) {
+	res.resize(size);
+	for (size_t got = 0; got < size;) {
+		int n = recv(s, &res[got], (int)(size - got), 0);
+		if (n <= 0)
+			return false;
+		got += n;
+	}
+	return true;
+}
+
+static bool recv_line(socket_t s, string& res) {
+	res.clear();
+	char c;
+	while (recv(s, &c, 1, 0) == 1) {
+		if (c == '\n')
+			return true;
+		if (res.size() >= SERVER_MAX_LINE_SIZE)
+			return false;
+		res += c;
+	}
+	return false;
+}
+
+static bool recv_sizes(socket_t s, vector<size_t>& sizes) {
+	string line;
+	if (!recv_line(s, line))
+		return false;
+	istringstream is(line);
+	for (int i = 0; i < sizes.size(); i++)
+		if (!(is >> sizes[i]))
+			return false;
+	return true;
+}
+
+static string response(const compile_result_t& res) {
+	ostringstream os;
+	os << (res.ok ? "ok " : "error ") << res.output.size() << ' ' << res.error.size() << ' ' << res.report.size() << '\n';
+	os << res.output << res.error << res.report;
+	return os.str();
+}
+
+static void serve_requests(const compiler_context_t& context, socket_t client) {
+	string header;
+	while (recv_line(client, header)) {
+		istringstream hs(header);
+		string mode, opt;
+		compile_options_t options;
+		compile_result_t res = { false };
+		hs >> mode;
+		options.mode = compile_options_t::mode_by_char(mode.empty() ? 0 : mode[0]);
+		while (hs >> opt)
+			if (!options.parse_option(opt))
+				res.error = "Unknown option: " + opt + "\n";
+		options.jobs = max(1, min(options.jobs, hardware_jobs()));
+		options.max_steps = min(options.max_steps, SERVER_MAX_STEPS);
+		if (options.time_report && !memory_tracking_enabled())
+			res.error = "The server was not started with -ftime-report\n";
+		vector<size_t> sizes(1);
+		string source;
+		if (!recv_sizes(client, sizes))
+			break;
+		if (sizes[0] > SERVER_MAX_SOURCE_SIZE) {
+			res.ok = false;
+			res.error = "Source is too large\n";
+			send_all(client, response(res));
+			break;
+		}
+		if (!recv_exact(client, sizes[0], source))
+			break;
+		if (res.error.empty()) {
+			try {
+				res = context.compile(source, options);
+			} catch (exception& e) {
+				res.ok = false;
+				res.error = string("Internal error: ") + e.what() + "\n";
+			}
+		}
+		if (!send_all(client, response(res)))
+			break;
+	}
+}
+
+// Runs on a detached thread, nothing may escape from here or the whole server goes down
+static void serve_client(const compiler_context_t& context, socket_t client) {
+	try {
+		serve_requests(context, client);
+	} catch (...) {}
+	close_socket(client);
+}
+
+int run_compile_server(const compiler_context_t& context, const string& path, ostream& log) {
+	sockaddr_un addr;
+	if (!sockets_init() || !make_address(path, addr)) {
+		log << "Bad socket path: " << path << endl;
+		return 1;
+	}
+	socket_t server = socket(AF_UNIX, SOCK_STREAM, 0);
+	remove(path.c_str());
+	if (server == INVALID_SOCKET || ::bind(server, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(server, SOMAXCONN) != 0) {
+		log << "Can't listen on " << path << endl;
+		return 1;
+	}
+	log << "Listening on " << path << endl;
+	for (;;) {
+		socket_t client = accept(server, nullptr, nullptr);
+		if (client == INVALID_SOCKET)
+			continue;
+		thread(serve_client, ref(context), client).detach();
+	}
+}
+
+bool compile_remote(const string& path, const string& mode, const vector<string>& options, const string& source, compile_result_t& res) {
+	sockaddr_un addr;
+	if (!sockets_init() || !make_address(path, addr))
+		return false;
+	socket_t s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s == INVALID_SOCKET)
+		return false;
+	if (connect(s, (sockaddr*)&addr, sizeof(addr)) != 0) {
+		close_socket(s);
+		return false;
+	}
+	ostringstream request;
+	request << mode;
+	for each (auto& opt in options)
+		request << ' ' << opt;
+	request << '\n' << source.size() << '\n' << source;
+	string status;
+	vector<size_t> sizes(3);
+	bool ok = send_all(s, request.str()) && recv_line(s, status);
+	if (ok) {
+		istringstream is(status);
+		is >> status;
+		res.ok = status == "ok";
+		ok = (is >> sizes[0] >> sizes[1] >> sizes[2]) &&
+			recv_exact(s, sizes[0], res.output) && recv_exact(s, sizes[1], res.error) && recv_exact(s, sizes[2], res.report);
+	}
+	close_socket(s);
+	return ok;
+}
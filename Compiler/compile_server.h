@@ -0,0 +1,16 @@
+#pragma once
+#include "compiler.h"
+#include <string>
+#include <vector>
+#include <ostream>
+
+using namespace std;
+
+// Requests are read into memory whole, so a client can't ask for more than this
+#define SERVER_MAX_SOURCE_SIZE (256 << 20)
+#define SERVER_MAX_LINE_SIZE (1 << 16)
+// A single request can't take more threads than the machine has or run longer than this in r/v modes
+#define SERVER_MAX_STEPS 100000000LL
+
+int run_compile_server(const compiler_context_t& context, const string& path, ostream& log);
+bool compile_remote(const string& path, const string& mode, const vector<string>& options, const string& source, compile_result_t& res);
@@ -0,0 +1,255 @@
+#include "compiler.h"
+#include "compile_cache.h"
+#include "lexeme_analyzer.h"
+#include "parser.h"
+#include "thread_pool.h"
+#include "asm_code_simulator.h"
+#include "asm_jit.h"
+#include "bytecode_vm.h"
+#include "serializer.h"
+#include "type_table.h"
+#include <sstream>
+#include <fstream>
+#include <mutex>
+#include <cstdlib>
+
+static once_flag init_flag;
+static phase_t init_phase = { "init", 1, 0, 0, 0 };
+
+static void compiler_init() {
+	auto start = chrono::steady_clock::now();
+	long long allocs = allocations_count();
+	long long bytes = allocated_bytes();
+	tokens_init();
+	lexeme_analyzer_init();
+	parser_init();
+	asm_generator_init();
+	init_phase.time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	init_phase.allocs = allocations_count() - allocs;
+	init_phase.bytes = allocated_bytes() - bytes;
+}
+
+compile_options_t::compile_options_t() : mode(CM_ASM), opt_level(OL_2), time_passes(false), time_report(false), report_json(false), lexer_thread(false), jobs(1), max_steps(100000000), target(AT_X86) {}
+
+bool compile_options_t::parse_option(const string& opt) {
+	if (opt == "-O0")
+		opt_level = OL_0;
+	else if (opt == "-O1")
+		opt_level = OL_1;
+	else if (opt == "-O2")
+		opt_level = OL_2;
+	else if (opt == "-Os")
+		opt_level = OL_S;
+	else if (opt == "-ftime-passes")
+		time_passes = true;
+	else if (opt == "-ftime-report")
+		time_report = true;
+	else if (opt == "-ftime-report=json")
+		time_report = report_json = true;
+	else if (opt == "-lexer-thread")
+		lexer_thread = true;
+	else if (opt.compare(0, 2, "-j") == 0 && opt.size() > 2)
+		jobs = atoi(opt.c_str() + 2);
+	else if (opt.compare(0, 11, "-max-steps=") == 0)
+		max_steps = atoll(opt.c_str() + 11);
+	else if (opt == "-target=i386-win32")
+		target = AT_X86;
+	else if (opt == "-target=x86_64-linux")
+		target = AT_X64;
+	else if (opt.compare(0, 2, "-f") == 0) {
+		bool enabled = opt.compare(0, 5, "-fno-") != 0;
+		string name = opt.substr(enabled ? 2 : 5);
+		if (!asm_optimizer_t().set_pass_enabled(name, enabled))
+			return false;
+		passes.push_back(make_pair(name, enabled));
+	} else
+		return false;
+	return true;
+}
+
+COMPILE_MODE compile_options_t::mode_by_char(char c) {
+	switch (c) {
+		case 'l': return CM_LEXEMES;
+		case 'e': return CM_EXPR;
+		case 't': return CM_TYPE;
+		case 'd':
+		case 's': return CM_STATEMENTS;
+		case 'a': return CM_ASM;
+		case 'r': return CM_RUN;
+		case 'o': return CM_OBJECT;
+		case 'v': return CM_VM;
+		case 'L': return CM_LEXEMES_BIN;
+		case 'S': return CM_AST;
+	}
+	return CM_NONE;
+}
+
+bool compile_options_t::binary_output() const {
+	return mode == CM_OBJECT || mode == CM_LEXEMES_BIN || mode == CM_AST;
+}
+
+bool read_source(const string& path, string& source) {
+	char magic[SERIALIZED_MAGIC_SIZE];
+	ifstream probe(path, ios::binary);
+	if (!probe)
+		return false;
+	probe.read(magic, sizeof(magic));
+	bool binary = serialized_format(string(magic, (size_t)probe.gcount())) != SF_NONE;
+	probe.close();
+	ifstream fin(path, binary ? ios::in | ios::binary : ios::in);
+	if (!fin)
+		return false;
+	stringstream ss;
+	ss << fin.rdbuf();
+	source = ss.str();
+	return true;
+}
+
+// The calling thread of every parallel loop works as well, so the pool needs one thread less than the machine
+compiler_context_t::compiler_context_t() : pool(new thread_pool_t(max(1, hardware_jobs() - 1))) {
+	call_once(init_flag, compiler_init);
+}
+
+thread_pool_t* compiler_context_t::get_pool() const {
+	return pool.get();
+}
+
+void compiler_context_t::set_cache(string dir, uintmax_t max_size) {
+	cache = shared_ptr<compile_cache_t>(new compile_cache_t(dir, max_size));
+}
+
+compile_result_t compiler_context_t::compile(const string& source, const compile_options_t& options) const {
+	if (!cache || options.time_passes || options.time_report || options.mode == CM_RUN || options.mode == CM_JIT || options.mode == CM_VM)
+		return _compile(source, options);
+	compile_result_t res;
+	string key = compile_cache_t::make_key(source, options);
+	if (cache->load(key, res))
+		return res;
+	res = _compile(source, options);
+	cache->store(key, res);
+	return res;
+}
+
+// Streams bypass the cache: the key would need the whole source text, which is never held in memory
+compile_result_t compiler_context_t::compile_stream(istream& is, const compile_options_t& options, ostream& os) const {
+	return _compile(string(), options, &is, &os);
+}
+
+compile_result_t compiler_context_t::_compile(const string& source, const compile_options_t& options, istream* input, ostream* output) const {
+	compile_result_t res;
+	phase_report_t phase_report;
+	phase_report_t* report = options.time_report ? &phase_report : nullptr;
+	asm_gen_t::set_target(options.mode == CM_OBJECT || options.mode == CM_JIT ? AT_X64 : options.mode == CM_VM ? AT_X86 : options.target);
+	{
+		phase_timer_t compile_timer(report, "compile", 0);
+		if (report)
+			report->set(report->add(init_phase.name, init_phase.depth), init_phase.time, init_phase.allocs, init_phase.bytes);
+		asm_optimizer_t optimizer(options.opt_level);
+		for each (auto& p in options.passes)
+			optimizer.set_pass_enabled(p.first, p.second);
+		optimizer.set_time_passes(options.time_passes);
+		SERIALIZED_FORMAT format = input ? SF_NONE : serialized_format(source);
+		bool parallel_lex = format == SF_NONE && !input && options.jobs > 1 && source.size() >= 2 * PARALLEL_LEX_CHUNK;
+		istringstream is(format == SF_NONE && !parallel_lex ? source : string());
+		source_manager_t sources(format == SF_NONE && !input ? &source : nullptr);
+		source_manager_t::set_current(&sources);
+		type_table_t types;
+		type_table_t::set_current(&types);
+		ostringstream buffered;
+		ostream& os = output ? *output : buffered;
+		res.ok = true;
+		try {
+			lexeme_analyzer_t la(input ? *input : is, input ? &sources : nullptr);
+			parser_t parser(&la);
+			parser.set_jobs(options.jobs, pool.get());
+			parser.set_report(report);
+			if (cache && !options.time_passes && !options.time_report)
+				parser.set_cache(cache, compile_cache_t::options_key(options));
+			if (format == SF_TOKENS)
+				la.replay(deserialize_tokens(source));
+			else if (format == SF_AST)
+				parser.load_ast(source);
+			else if (parallel_lex) {
+				exception_ptr error;
+				vector<token_ptr> tokens;
+				{
+					phase_timer_t timer(report, "lex", 1);
+					tokens = lexeme_analyzer_t::lex_parallel(source, pool.get(), options.jobs, error);
+				}
+				la.replay(move(tokens), error);
+			}
+			else if (options.lexer_thread && !input)
+				la.start_pipeline();
+			switch (options.mode) {
+				case CM_LEXEMES:
+					while (!la.eof())
+						os << la.next() << '\n';
+					break;
+				case CM_LEXEMES_BIN: os << serialize_tokens(la); break;
+				case CM_AST: parser.print_ast(os); break;
+				case CM_EXPR: parser.print_expr(os); break;
+				case CM_TYPE: parser.print_type(os); break;
+				case CM_STATEMENTS: parser.print_statements(os); break;
+				case CM_ASM: parser.print_asm_code(os, optimizer); break;
+				case CM_OBJECT: parser.print_object_code(os, optimizer); break;
+				case CM_RUN:
+					if (asm_gen_ptr gen = parser.generate_asm_code(optimizer)) {
+						phase_timer_t timer(report, "run", 1);
+						asm_machine_t machine(gen);
+						machine.set_max_steps(options.max_steps);
+						machine.run(os);
+						ostringstream ss;
+						machine.print_stats(ss);
+						res.report += ss.str();
+					}
+					break;
+				case CM_JIT:
+					if (asm_gen_ptr gen = parser.generate_asm_code(optimizer)) {
+						asm_jit_t jit;
+						{
+							phase_timer_t timer(report, "encode", 1);
+							jit.load(gen);
+						}
+						phase_timer_t timer(report, "run", 1);
+						jit.run();
+					}
+					break;
+				case CM_VM:
+					if (bc_program_ptr program = parser.generate_bytecode()) {
+						phase_timer_t timer(report, "run", 1);
+						bc_vm_t vm(program);
+						vm.set_max_steps(options.max_steps);
+						vm.run(os);
+						ostringstream ss;
+						vm.print_stats(ss);
+						res.report += ss.str();
+					}
+					break;
+			}
+		} catch (CompileError& e) {
+			ostringstream es;
+			es << e;
+			res.ok = false;
+			res.error = es.str();
+		}
+		res.output = buffered.str();
+		if (options.time_passes) {
+			ostringstream ts;
+			optimizer.print_pass_times(ts);
+			res.report += ts.str();
+		}
+	}
+	if (report) {
+		if (!output)
+			report->count("output bytes", res.output.size());
+		res.phases = report->get_phases();
+		res.counters = report->get_counters();
+		ostringstream rs;
+		if (options.report_json)
+			report->print_json(rs);
+		else
+			report->print(rs);
+		res.report += rs.str();
+	}
+	return res;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "asm_code_optimnizer.h"
+#include "phase_report.h"
+#include <string>
+#include <istream>
+#include <ostream>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+using namespace std;
+
+#define COMPILER_VERSION "1.4"
+
+class compile_cache_t;
+class thread_pool_t;
+
+enum COMPILE_MODE {
+	CM_NONE,
+	CM_LEXEMES,
+	CM_EXPR,
+	CM_TYPE,
+	CM_STATEMENTS,
+	CM_ASM,
+	CM_RUN,
+	CM_OBJECT,
+	CM_JIT,
+	CM_VM,
+	CM_LEXEMES_BIN,
+	CM_AST
+};
+
+struct compile_options_t {
+	COMPILE_MODE mode;
+	OPT_LEVEL opt_level;
+	vector<pair<string, bool>> passes;
+	bool time_passes;
+	bool time_report;
+	bool report_json;
+	bool lexer_thread;
+	int jobs;
+	long long max_steps;
+	ASM_TARGET target;
+	compile_options_t();
+	bool parse_option(const string& opt);
+	bool binary_output() const;
+	static COMPILE_MODE mode_by_char(char c);
+};
+
+struct compile_result_t {
+	bool ok;
+	string output;
+	string error;
+	string report;
+	vector<phase_t> phases;
+	vector<pair<string, long long>> counters;
+};
+
+bool read_source(const string& path, string& source);
+
+class compiler_context_t {
+	shared_ptr<compile_cache_t> cache;
+	shared_ptr<thread_pool_t> pool;
+	compile_result_t _compile(const string& source, const compile_options_t& options, istream* input = nullptr, ostream* output = nullptr) const;
+public:
+	compiler_context_t();
+	void set_cache(string dir, uintmax_t max_size);
+	thread_pool_t* get_pool() const;
+	compile_result_t compile(const string& source, const compile_options_t& options) const;
+	compile_result_t compile_stream(istream& is, const compile_options_t& options, ostream& os) const;
+};
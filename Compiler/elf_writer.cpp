@@ -0,0 +1,274 @@
+#include "elf_writer.h"
+#include "exceptions.h"
+#include <algorithm>
+
+#define EHDR_SIZE 64
+#define SHDR_SIZE 64
+#define SYM_SIZE 24
+#define RELA_SIZE 24
+
+enum ELF_SECTION_TYPE {
+	SHT_NULL = 0,
+	SHT_PROGBITS = 1,
+	SHT_SYMTAB = 2,
+	SHT_STRTAB = 3,
+	SHT_RELA = 4,
+	SHT_NOBITS = 8
+};
+
+enum ELF_SECTION_FLAGS {
+	SHF_WRITE = 0x1,
+	SHF_ALLOC = 0x2,
+	SHF_EXECINSTR = 0x4,
+	SHF_INFO_LINK = 0x40
+};
+
+enum ELF_SYMBOL_INFO {
+	STT_NOTYPE = 0,
+	STT_OBJECT = 1,
+	STT_FUNC = 2,
+	STT_SECTION = 3,
+	STB_LOCAL = 0,
+	STB_GLOBAL = 1
+};
+
+struct elf_shdr_t {
+	uint32_t name;
+	uint32_t type;
+	uint64_t flags;
+	string data;
+	uint64_t offset;
+	uint64_t size;
+	uint32_t link;
+	uint32_t info;
+	uint64_t align;
+	uint64_t entsize;
+};
+
+static const char* section_names[ES_COUNT] = { ".text", ".data", ".bss", ".rodata" };
+static const uint64_t section_flags[ES_COUNT] = { SHF_ALLOC | SHF_EXECINSTR, SHF_ALLOC | SHF_WRITE, SHF_ALLOC | SHF_WRITE, SHF_ALLOC };
+
+static void put(string& buf, uint64_t val, int size) {
+	for (int i = 0; i < size; i++)
+		buf.push_back((char)(val >> i * 8 & 0xFF));
+}
+
+static uint32_t add_str(string& table, const string& str) {
+	uint32_t pos = table.size();
+	table += str;
+	table.push_back('\0');
+	return pos;
+}
+
+static void put_sym(string& buf, uint32_t name, int bind, int type, int section, uint64_t value, uint64_t size) {
+	put(buf, name, 4);
+	put(buf, bind << 4 | type, 1);
+	put(buf, 0, 1);
+	put(buf, section, 2);
+	put(buf, value, 8);
+	put(buf, size, 8);
+}
+
+static bool is_local_label(const string& name) {
+	return name.compare(0, 2, ".L") == 0;
+}
+
+elf_writer_t::elf_writer_t() {
+	for (int i = 0; i < ES_COUNT; i++) {
+		sections[i].size = 0;
+		sections[i].align = 1;
+	}
+}
+
+uint64_t elf_writer_t::_align(ELF_SECTION section, uint64_t align) {
+	elf_section_t& s = sections[section];
+	s.align = max(s.align, align);
+	s.size = (s.size + align - 1) / align * align;
+	if (section != ES_BSS)
+		s.data.resize(s.size);
+	return s.size;
+}
+
+uint64_t elf_writer_t::append(ELF_SECTION section, const vector<uint8_t>& data, uint64_t align) {
+	uint64_t offset = _align(section, align);
+	sections[section].data.insert(sections[section].data.end(), data.begin(), data.end());
+	sections[section].size += data.size();
+	return offset;
+}
+
+uint64_t elf_writer_t::reserve(ELF_SECTION section, uint64_t size, uint64_t align) {
+	uint64_t offset = _align(section, align);
+	sections[section].size += size;
+	if (section != ES_BSS)
+		sections[section].data.resize(sections[section].size);
+	return offset;
+}
+
+void elf_writer_t::add_symbol(string name, ELF_SECTION section, uint64_t value, uint64_t size, bool global, bool func) {
+	if (symbol_ids.count(name))
+		throw EncodeError("Symbol " + name + " is already defined");
+	elf_symbol_t sym = { name, section, value, size, global, func };
+	symbol_ids[name] = symbols.size();
+	symbols.push_back(sym);
+}
+
+void elf_writer_t::add_reloc(ELF_SECTION section, uint64_t offset, string symbol, ELF_RELOC_TYPE type, int64_t addend) {
+	elf_reloc_t reloc = { offset, symbol, type, addend };
+	sections[section].relocs.push_back(reloc);
+}
+
+const elf_section_t& elf_writer_t::get_section(ELF_SECTION section) {
+	return sections[section];
+}
+
+const vector<elf_symbol_t>& elf_writer_t::get_symbols() {
+	return symbols;
+}
+
+void elf_writer_t::write(ostream& os) {
+	string shstrtab(1, '\0'), strtab(1, '\0'), symtab;
+	vector<elf_shdr_t> headers(1, elf_shdr_t());
+	int section_ids[ES_COUNT];
+	for (int i = 0; i < ES_COUNT; i++) {
+		elf_shdr_t header = elf_shdr_t();
+		header.name = add_str(shstrtab, section_names[i]);
+		header.type = i == ES_BSS ? SHT_NOBITS : SHT_PROGBITS;
+		header.flags = section_flags[i];
+		header.data.assign(sections[i].data.begin(), sections[i].data.end());
+		header.size = sections[i].size;
+		header.align = sections[i].align;
+		section_ids[i] = headers.size();
+		headers.push_back(header);
+	}
+
+	map<string, int> sym_ids;
+	int section_syms[ES_COUNT];
+	put_sym(symtab, 0, STB_LOCAL, STT_NOTYPE, 0, 0, 0);
+	int sym_count = 1;
+	for (int i = 0; i < ES_COUNT; i++) {
+		put_sym(symtab, 0, STB_LOCAL, STT_SECTION, section_ids[i], 0, 0);
+		section_syms[i] = sym_count++;
+	}
+	for (int pass = 0; pass < 2; pass++)
+		for each (auto& sym in symbols)
+			if (sym.global == (pass == 1) && !is_local_label(sym.name)) {
+				put_sym(symtab, add_str(strtab, sym.name), sym.global ? STB_GLOBAL : STB_LOCAL, sym.func ? STT_FUNC : STT_OBJECT,
+					section_ids[sym.section], sym.value, sym.size);
+				sym_ids[sym.name] = sym_count++;
+			}
+	int first_global = sym_count - count_if(symbols.begin(), symbols.end(), [](const elf_symbol_t& sym) { return sym.global; });
+	for (int i = 0; i < ES_COUNT; i++)
+		for each (auto& reloc in sections[i].relocs)
+			if (!symbol_ids.count(reloc.symbol) && !sym_ids.count(reloc.symbol)) {
+				put_sym(symtab, add_str(strtab, reloc.symbol), STB_GLOBAL, STT_NOTYPE, 0, 0, 0);
+				sym_ids[reloc.symbol] = sym_count++;
+			}
+
+	vector<int> rela_headers;
+	for (int i = 0; i < ES_COUNT; i++) {
+		if (sections[i].relocs.empty())
+			continue;
+		elf_shdr_t header = elf_shdr_t();
+		header.name = add_str(shstrtab, string(".rela") + section_names[i]);
+		header.type = SHT_RELA;
+		header.flags = SHF_INFO_LINK;
+		header.info = section_ids[i];
+		header.align = 8;
+		header.entsize = RELA_SIZE;
+		for each (auto& reloc in sections[i].relocs) {
+			int sym;
+			int64_t addend = reloc.addend;
+			auto it = symbol_ids.find(reloc.symbol);
+			if (it != symbol_ids.end() && !symbols[it->second].global) {
+				const elf_symbol_t& target = symbols[it->second];
+				sym = section_syms[target.section];
+				addend += target.value;
+			} else
+				sym = sym_ids[reloc.symbol];
+			put(header.data, reloc.offset, 8);
+			put(header.data, (uint64_t)sym << 32 | reloc.type, 8);
+			put(header.data, addend, 8);
+		}
+		header.size = header.data.size();
+		rela_headers.push_back(headers.size());
+		headers.push_back(header);
+	}
+
+	elf_shdr_t symtab_header = elf_shdr_t();
+	symtab_header.name = add_str(shstrtab, ".symtab");
+	symtab_header.type = SHT_SYMTAB;
+	symtab_header.data = symtab;
+	symtab_header.size = symtab.size();
+	symtab_header.link = headers.size() + 1;
+	symtab_header.info = first_global;
+	symtab_header.align = 8;
+	symtab_header.entsize = SYM_SIZE;
+	for each (int i in rela_headers)
+		headers[i].link = headers.size();
+	headers.push_back(symtab_header);
+
+	elf_shdr_t strtab_header = elf_shdr_t();
+	strtab_header.name = add_str(shstrtab, ".strtab");
+	strtab_header.type = SHT_STRTAB;
+	strtab_header.data = strtab;
+	strtab_header.size = strtab.size();
+	strtab_header.align = 1;
+	headers.push_back(strtab_header);
+
+	elf_shdr_t stack_header = elf_shdr_t();
+	stack_header.name = add_str(shstrtab, ".note.GNU-stack");
+	stack_header.type = SHT_PROGBITS;
+	stack_header.align = 1;
+	headers.push_back(stack_header);
+
+	elf_shdr_t shstrtab_header = elf_shdr_t();
+	shstrtab_header.name = add_str(shstrtab, ".shstrtab");
+	shstrtab_header.type = SHT_STRTAB;
+	shstrtab_header.data = shstrtab;
+	shstrtab_header.size = shstrtab.size();
+	shstrtab_header.align = 1;
+	headers.push_back(shstrtab_header);
+
+	string body;
+	for (int i = 1; i < headers.size(); i++) {
+		elf_shdr_t& header = headers[i];
+		uint64_t align = max<uint64_t>(header.align, 1);
+		body.resize((EHDR_SIZE + body.size() + align - 1) / align * align - EHDR_SIZE);
+		header.offset = EHDR_SIZE + body.size();
+		body += header.data;
+	}
+	body.resize((EHDR_SIZE + body.size() + 7) / 8 * 8 - EHDR_SIZE);
+
+	string file("\x7f" "ELF", 4);
+	put(file, 2, 1);
+	put(file, 1, 1);
+	put(file, 1, 1);
+	file.resize(16);
+	put(file, 1, 2);
+	put(file, 62, 2);
+	put(file, 1, 4);
+	put(file, 0, 8);
+	put(file, 0, 8);
+	put(file, EHDR_SIZE + body.size(), 8);
+	put(file, 0, 4);
+	put(file, EHDR_SIZE, 2);
+	put(file, 0, 2);
+	put(file, 0, 2);
+	put(file, SHDR_SIZE, 2);
+	put(file, headers.size(), 2);
+	put(file, headers.size() - 1, 2);
+	file += body;
+	for each (auto& header in headers) {
+		put(file, header.name, 4);
+		put(file, header.type, 4);
+		put(file, header.flags, 8);
+		put(file, 0, 8);
+		put(file, header.offset, 8);
+		put(file, header.size, 8);
+		put(file, header.link, 4);
+		put(file, header.info, 4);
+		put(file, header.align, 8);
+		put(file, header.entsize, 8);
+	}
+	os.write(file.data(), file.size());
+}
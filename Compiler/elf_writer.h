@@ -0,0 +1,63 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdint.h>
+
+using namespace std;
+
+enum ELF_SECTION {
+	ES_TEXT,
+	ES_DATA,
+	ES_BSS,
+	ES_RODATA,
+	ES_COUNT,
+	ES_UNDEF = -1
+};
+
+enum ELF_RELOC_TYPE {
+	ERT_64 = 1,
+	ERT_PC32 = 2,
+	ERT_PLT32 = 4
+};
+
+struct elf_symbol_t {
+	string name;
+	ELF_SECTION section;
+	uint64_t value;
+	uint64_t size;
+	bool global;
+	bool func;
+};
+
+struct elf_reloc_t {
+	uint64_t offset;
+	string symbol;
+	ELF_RELOC_TYPE type;
+	int64_t addend;
+};
+
+struct elf_section_t {
+	vector<uint8_t> data;
+	uint64_t size;
+	uint64_t align;
+	vector<elf_reloc_t> relocs;
+};
+
+class elf_writer_t {
+	elf_section_t sections[ES_COUNT];
+	vector<elf_symbol_t> symbols;
+	map<string, int> symbol_ids;
+
+	uint64_t _align(ELF_SECTION section, uint64_t align);
+public:
+	elf_writer_t();
+	uint64_t append(ELF_SECTION section, const vector<uint8_t>& data, uint64_t align = 1);
+	uint64_t reserve(ELF_SECTION section, uint64_t size, uint64_t align = 1);
+	void add_symbol(string name, ELF_SECTION section, uint64_t value, uint64_t size = 0, bool global = false, bool func = false);
+	void add_reloc(ELF_SECTION section, uint64_t offset, string symbol, ELF_RELOC_TYPE type, int64_t addend = 0);
+	const elf_section_t& get_section(ELF_SECTION section);
+	const vector<elf_symbol_t>& get_symbols();
+	void write(ostream& os);
+};
@@ -39,6 +39,11 @@ public:
 	BadEOF(pos_t pos) : LexemeAnalyzeError("BadEOF", pos) {}
 };
 
+class StreamBacktrack : public LexemeAnalyzeError {
+public:
+	StreamBacktrack(pos_t pos) : LexemeAnalyzeError("Backtrack past the input buffer", pos) {}
+};
+
 class BadChar : public LexemeAnalyzeError {
 public:
 	BadChar(pos_t pos) : LexemeAnalyzeError("BadChar", pos) {}
@@ -190,7 +195,7 @@ public:
 		orig_symbol->short_print(err);
 		err << ", first defenition was here: ";
 		pos_t pos = orig_symbol->get_token()->get_pos();
-		err << pos.line << ':' << pos.column;
+		err << pos.get_line() << ':' << pos.get_column();
 	}
 };
 
@@ -324,6 +329,36 @@ public:
 	CantGetSize(pos_t pos) : SemanticError("Can't get size of symbol", pos) {}
 };
 
+class SimulationError : public CompileError {
+public:
+	using CompileError::CompileError;
+};
+
+class EncodeError : public CompileError {
+public:
+	using CompileError::CompileError;
+};
+
+class TargetError : public CompileError {
+public:
+	using CompileError::CompileError;
+};
+
+class JitError : public CompileError {
+public:
+	using CompileError::CompileError;
+};
+
+class VmError : public CompileError {
+public:
+	using CompileError::CompileError;
+};
+
+class SerializeError : public CompileError {
+public:
+	using CompileError::CompileError;
+};
+
 class MainFuncNotFound : public CompileError {
 public:
 	MainFuncNotFound() : CompileError("Main function not found") {};
@@ -1,6 +1,13 @@
 #include "lexeme_analyzer.h"
+#include "phase_report.h"
+#include "source_manager.h"
+#include "thread_pool.h"
 #include <map>
 #include <set>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <algorithm>
 
 #define is_char(a) ((a) >= 'a' && (a) <= 'z' || (a) >= 'A' && (a) <= 'Z' || (a) == '_')
 #define is_digit(a) ((a) >= '0' && (a) <= '9')
@@ -27,56 +34,52 @@ map<AUTOMATON_STATE, TOKEN> state_to_token;
 #include "token_register.h"
 #undef TOKEN_FUNC
 
-map<AUTOMATON_STATE, token_ptr(*)(string, AUTOMATON_STATE, int, int)> token_getters;
+map<AUTOMATON_STATE, token_ptr(*)(string, AUTOMATON_STATE, int)> token_getters;
 
-lexeme_analyzer_t::lexeme_analyzer_t(istream& is_) {
-	is = &is_;
+lexeme_analyzer_t::lexeme_analyzer_t(istream& is_, source_manager_t* sources, int offset) : in(is_, sources), curr_offset(offset - 1), producer_stop(false) {
 	state = AS_START;
-	curr_pos.line = 1;
 
 	next_char();
 	skip_spaces();
 }
 
+lexeme_analyzer_t::~lexeme_analyzer_t() {
+	if (producer.joinable()) {
+		producer_stop = true;
+		producer.join();
+	}
+}
+
 void lexeme_analyzer_t::add_char() {
 	curr_str += cc;
 }
 
 void lexeme_analyzer_t::next_char() {
-	if (cc == '\t') {
-		curr_pos.column = curr_pos.column == 0 ? 1 : curr_pos.column;
-		int n = ceil(curr_pos.column / 4.0);
-		curr_pos.column = 4 * n;
-	}
-	if (cc == '\n') {
-		curr_pos.column = 0;
-		curr_pos.line++;
-	}
-	cc = is->get();
-	curr_pos.column++;
+	cc = in.get();
+	curr_offset++;
 	
 	if (cc == 255)
 		cc = eof_code;
 	if (cc < 0 || cc > 128)
-		throw BadCC(curr_pos);
+		throw BadCC(pos_t(curr_offset));
 }
 
 bool lexeme_analyzer_t::eof() {
-	return is->eof();
+	return peek(1) == T_EMPTY;
 }
 
 void lexeme_analyzer_t::throw_exception(AUTOMATON_STATE state) {
 	switch (state) {
-		case AS_ERR_BAD_CC: throw BadCC(curr_pos); break;
-		case AS_ERR_BAD_CHAR: throw BadChar(curr_pos); break;
-		case AS_ERR_BAD_EOF: throw BadEOF(curr_pos); break;
-		case AS_ERR_BAD_NL: throw BadNewLine(curr_pos); break;
-		case AS_ERR_CHAR_TL: throw BadChar(curr_pos); break;
-		case AS_ERR_CHAR_TS: throw BadChar(curr_pos); break;
-		case AS_ERR_NO_CC: throw NoCC(curr_pos); break;
-		case AS_ERR_NO_EXP: throw NoExp(curr_pos); break;
-		case AS_ERR_NO_FRACT: throw NoFract(curr_pos); break;
-		case AS_ERR_NO_HEX: throw NoHex(curr_pos); break;
+		case AS_ERR_BAD_CC: throw BadCC(pos_t(curr_offset)); break;
+		case AS_ERR_BAD_CHAR: throw BadChar(pos_t(curr_offset)); break;
+		case AS_ERR_BAD_EOF: throw BadEOF(pos_t(curr_offset)); break;
+		case AS_ERR_BAD_NL: throw BadNewLine(pos_t(curr_offset)); break;
+		case AS_ERR_CHAR_TL: throw BadChar(pos_t(curr_offset)); break;
+		case AS_ERR_CHAR_TS: throw BadChar(pos_t(curr_offset)); break;
+		case AS_ERR_NO_CC: throw NoCC(pos_t(curr_offset)); break;
+		case AS_ERR_NO_EXP: throw NoExp(pos_t(curr_offset)); break;
+		case AS_ERR_NO_FRACT: throw NoFract(pos_t(curr_offset)); break;
+		case AS_ERR_NO_HEX: throw NoHex(pos_t(curr_offset)); break;
 	}
 }
 
@@ -87,30 +90,72 @@ void lexeme_analyzer_t::skip_spaces() {
 }
 
 token_ptr lexeme_analyzer_t::next() {
-	if (eof())
-		return curr_token = token_ptr(new token_t);
+	if (ahead.empty())
+		curr_token = _fetch();
+	else {
+		curr_token = ahead.front();
+		ahead.pop_front();
+	}
+	if (recording)
+		record_token();
+	return curr_token;
+}
+
+// peek(0) is the current token, peek(n) the n-th one after it
+token_ptr lexeme_analyzer_t::peek(size_t n) {
+	if (!n)
+		return curr_token;
+	while (ahead.size() < n)
+		ahead.push_back(_fetch());
+	return ahead[n - 1];
+}
+
+token_ptr lexeme_analyzer_t::_fetch() {
+	if (replaying)
+		return _replay_next();
+	if (ring)
+		return _pop();
+	return _lex();
+}
+
+token_ptr lexeme_analyzer_t::_lex() {
+	if (!timing)
+		return _next();
+	auto start = chrono::steady_clock::now();
+	long long allocs = allocations_count();
+	long long bytes = allocated_bytes();
+	token_ptr res = _next();
+	stats.time += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	stats.allocs += allocations_count() - allocs;
+	stats.bytes += allocated_bytes() - bytes;
+	return res;
+}
+
+token_ptr lexeme_analyzer_t::_next() {
+	if (in.eof())
+		return token_ptr(new token_t);
 	state = AS_START;
 	curr_str.clear();
-	pos_t start_pos;
+	int start_offset = curr_offset;
 	while (state < AS_END_REACHED) {
 		if (state == AS_START)
-			start_pos = curr_pos;
+			start_offset = curr_offset;
 		AUTOMATON_CARRET_COMMAND carret_command = commands[cc][state].carret_command;
 		state = commands[cc][state].state;
 		switch (carret_command) {
 			case ACC_NEXT: add_char(); next_char(); break;
-			case ACC_PREV: is->seekg((int)is->tellg() - 1); curr_str.pop_back(); break;
-			case ACC_REMEMBER: add_char(); rem_carr_pos = is->tellg(); rem_pos = curr_pos; next_char(); break;
+			case ACC_PREV: in.seek(in.tell() - 1); curr_str.pop_back(); break;
+			case ACC_REMEMBER: add_char(); rem_carr_pos = in.tell(); rem_offset = curr_offset; next_char(); break;
 			case ACC_RETURN_TO_REM: {
-				int p = (int)is->tellg() - rem_carr_pos - 1;
+				int p = in.tell() - rem_carr_pos - 1;
 				if (cc == '\n')		// 
 					p--;
 				curr_str.erase(curr_str.end() - p - 1, curr_str.end());
-				is->seekg(rem_carr_pos - 1);
+				in.seek(rem_carr_pos - 1);
 
-				cc = is->get();
+				cc = in.get();
 
-				curr_pos = rem_pos;
+				curr_offset = rem_offset;
 			} break;
 			case ACC_SKIP: next_char(); break;
 			case ACC_SKIP_AND_ERASE: next_char(); curr_str.clear(); break;
@@ -120,9 +165,200 @@ token_ptr lexeme_analyzer_t::next() {
 	throw_exception(state);
 	if (state == AS_END_REACHED)
 		return token_ptr(new token_t());
-	curr_token = token_getters[state](curr_str, state, start_pos.line, start_pos.column);
+	token_ptr token = token_getters[state](curr_str, state, start_offset);
+	stats.tokens++;
 	skip_spaces();
-	return curr_token;
+	return token;
+}
+
+// Records are keyed by a canonical spelling of the token value: replayed tokens have no source text,
+// and a pipelined lexer has moved past the token by the time the parser records it
+static string token_spelling(token_ptr token) {
+	switch (token->get_token_id()) {
+		case T_INTEGER: return to_string(static_pointer_cast<token_with_value_t<int>>(token)->get_value());
+		case T_DOUBLE: {
+			char buf[32];
+			snprintf(buf, sizeof(buf), "%.17g", static_pointer_cast<token_with_value_t<double>>(token)->get_value());
+			return buf;
+		}
+		case T_CHAR: return string(1, static_pointer_cast<token_with_value_t<char>>(token)->get_value());
+		case T_IDENTIFIER:
+		case T_STRING: return static_pointer_cast<token_with_value_t<string>>(token)->get_value();
+	}
+	return token->get_name();
+}
+
+token_ptr lexeme_analyzer_t::_replay_next() {
+	if (replay_pos == replay_tokens.size()) {
+		if (replay_error)
+			rethrow_exception(replay_error);
+		return token_ptr(new token_t);
+	}
+	stats.tokens++;
+	return replay_tokens[replay_pos++];
+}
+
+void lexeme_analyzer_t::replay(vector<token_ptr> tokens, exception_ptr error) {
+	replay_tokens.swap(tokens);
+	replay_error = error;
+	replay_pos = 0;
+	replaying = true;
+}
+
+// Offsets just past the newlines where a single lexer would be between tokens. Only comments, string
+// and char literals can be open there; their rules mirror the automaton, "**/" not closing a comment included
+static vector<int> chunk_starts(const string& source, int chunk_size) {
+	enum { PS_CODE, PS_LINE_COMMENT, PS_COMMENT, PS_COMMENT_STAR, PS_STRING } state = PS_CODE;
+	vector<int> starts(1, 0);
+	int size = source.size();
+	int next = chunk_size;
+	for (int i = 0; i < size; i++) {
+		char c = source[i];
+		switch (state) {
+			case PS_CODE:
+				if (c == '/' && i + 1 < size && source[i + 1] == '/') {
+					state = PS_LINE_COMMENT;
+					i++;
+				} else if (c == '/' && i + 1 < size && source[i + 1] == '*') {
+					state = PS_COMMENT;
+					i++;
+				} else if (c == '\"')
+					state = PS_STRING;
+				else if (c == '\'' && i + 2 < size && source[i + 2] == '\'' && !is_new_line(source[i + 1]))
+					i += 2;
+				break;
+			case PS_LINE_COMMENT:
+				if (c == '\n')
+					state = PS_CODE;
+				break;
+			case PS_COMMENT: state = c == '*' ? PS_COMMENT_STAR : PS_COMMENT; break;
+			case PS_COMMENT_STAR: state = c == '/' ? PS_CODE : PS_COMMENT; break;
+			case PS_STRING:
+				if (c == '\"' || is_new_line(c))
+					state = PS_CODE;
+				break;
+		}
+		if (c == '\n' && state == PS_CODE && i + 1 >= next && i + 1 < size) {
+			starts.push_back(i + 1);
+			next = i + 1 + chunk_size;
+		}
+	}
+	return starts;
+}
+
+// The pieces are lexed independently and cut where a single lexer would have stopped: at the first error,
+// or at a character it reads as end of input. A single lexer reports a bad character among the spaces leading
+// a piece while skipping the spaces after the previous token, so that token is dropped as well when only spaces follow it
+vector<token_ptr> lexeme_analyzer_t::lex_parallel(const string& source, thread_pool_t* pool, int jobs, exception_ptr& error) {
+	vector<int> starts = chunk_starts(source, max(PARALLEL_LEX_CHUNK, (int)source.size() / (jobs * 4)));
+	int count = starts.size();
+	vector<vector<token_ptr>> tokens(count);
+	vector<exception_ptr> errors(count);
+	vector<char> leading_error(count, false);
+	vector<char> stopped(count, false);
+	vector<char> spaces_tail(count, false);
+	source_manager_t* sources = source_manager_t::current();
+	parallel_for(pool, count, jobs, [&](int i) {
+		source_manager_t::set_current(sources);
+		int end = i + 1 < count ? starts[i + 1] : source.size();
+		istringstream is(source.substr(starts[i], end - starts[i]));
+		unique_ptr<lexeme_analyzer_t> la;
+		try {
+			la = unique_ptr<lexeme_analyzer_t>(new lexeme_analyzer_t(is, nullptr, starts[i]));
+		} catch (...) {
+			errors[i] = current_exception();
+			leading_error[i] = true;
+			return;
+		}
+		try {
+			while (true) {
+				spaces_tail[i] = la->in.eof();
+				token_ptr token = la->_next();
+				if (*token == T_EMPTY)
+					break;
+				tokens[i].push_back(token);
+			}
+			stopped[i] = !la->in.eof();
+		} catch (...) {
+			errors[i] = current_exception();
+		}
+	});
+	vector<token_ptr> res;
+	bool only_spaces = false;
+	for (int i = 0; i < count; i++) {
+		if (leading_error[i] && only_spaces && !res.empty())
+			res.pop_back();
+		res.insert(res.end(), tokens[i].begin(), tokens[i].end());
+		only_spaces = spaces_tail[i] && (only_spaces || !tokens[i].empty());
+		if (errors[i]) {
+			error = errors[i];
+			break;
+		}
+		if (stopped[i])
+			break;
+	}
+	return res;
+}
+
+// Lexing moves to its own thread; the parser takes the tokens from the ring as they are published
+void lexeme_analyzer_t::start_pipeline() {
+	if (replaying || ring)
+		return;
+	ring = unique_ptr<spsc_ring_t<token_ptr>>(new spsc_ring_t<token_ptr>(TOKEN_RING_SIZE, TOKEN_RING_BATCH));
+	producer = thread(&lexeme_analyzer_t::_produce, this, source_manager_t::current());
+}
+
+void lexeme_analyzer_t::_produce(source_manager_t* sources) {
+	source_manager_t::set_current(sources);
+	try {
+		bool end = false;
+		while (!end) {
+			token_ptr token = _lex();
+			end = *token == T_EMPTY;
+			if (!ring->push(move(token), producer_stop))
+				break;
+		}
+	} catch (...) {
+		producer_error = current_exception();
+	}
+	ring->close();
+}
+
+token_ptr lexeme_analyzer_t::_pop() {
+	token_ptr token;
+	if (ring->pop(token))
+		return token;
+	if (producer_error)
+		rethrow_exception(producer_error);
+	return token_ptr(new token_t);
+}
+
+void lexeme_analyzer_t::record_token() {
+	string spelling = token_spelling(curr_token);
+	record_end = record.size();
+	record += to_string(curr_token->get_token_id()) + ':' + to_string(spelling.size()) + ':' + spelling;
+}
+
+void lexeme_analyzer_t::start_record() {
+	recording = true;
+	record.clear();
+	record_token();
+}
+
+string lexeme_analyzer_t::get_record() {
+	return record.substr(0, record_end);
+}
+
+void lexeme_analyzer_t::stop_record() {
+	recording = false;
+}
+
+void lexeme_analyzer_t::set_timing(bool timing_) {
+	timing = timing_;
+}
+
+const lexeme_stats_t& lexeme_analyzer_t::get_stats() {
+	return stats;
 }
 
 token_ptr lexeme_analyzer_t::get() {
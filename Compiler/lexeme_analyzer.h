@@ -3,7 +3,21 @@
 #include <iostream>
 #include "tokens.h"
 #include <set>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <exception>
 #include "exceptions.h"
+#include "source_stream.h"
+#include "spsc_ring.h"
+
+class thread_pool_t;
+
+#define TOKEN_RING_SIZE (1 << 14)
+#define TOKEN_RING_BATCH 256
+#define PARALLEL_LEX_CHUNK (1 << 18)
 
 using namespace std;
 
@@ -97,17 +111,38 @@ struct automaton_commands_t {
 	automaton_commands_t() : state(AS_ERR_BAD_CHAR), carret_command(ACC_STOP) {};
 };
 
+struct lexeme_stats_t {
+	int tokens;
+	double time;
+	long long allocs;
+	long long bytes;
+};
+
 class lexeme_analyzer_t {
 protected:
-	istream* is;
+	source_stream_t in;
 	unsigned char cc = 0;
-	pos_t curr_pos;
-	pos_t rem_pos;
+	int curr_offset = -1;
+	int rem_offset = -1;
 	int rem_carr_pos = -1;
 	string curr_str;
 	token_ptr prev_token;
 	token_ptr curr_token;
 	bool eof_reached = false;
+	bool recording = false;
+	string record;
+	size_t record_end = 0;
+	bool timing = false;
+	lexeme_stats_t stats = {};
+	vector<token_ptr> replay_tokens;
+	size_t replay_pos = 0;
+	bool replaying = false;
+	exception_ptr replay_error;
+	deque<token_ptr> ahead;
+	unique_ptr<spsc_ring_t<token_ptr>> ring;
+	thread producer;
+	atomic<bool> producer_stop;
+	exception_ptr producer_error;
 
 	AUTOMATON_STATE state;
 
@@ -115,12 +150,29 @@ protected:
 	void add_char();
 	void next_char();
 	void skip_spaces();
+	void record_token();
+	token_ptr _next();
+	token_ptr _lex();
+	token_ptr _fetch();
+	token_ptr _replay_next();
+	token_ptr _pop();
+	void _produce(source_manager_t* sources);
 public:
-	lexeme_analyzer_t(istream& is_);
+	lexeme_analyzer_t(istream& is_, source_manager_t* sources = nullptr, int offset = 0);
+	~lexeme_analyzer_t();
 	token_ptr next();
 	token_ptr get();
+	token_ptr peek(size_t n);
 	token_ptr require(TOKEN first, ...);
 	token_ptr require(token_ptr op, TOKEN first, ...);
 	token_ptr require(set<TOKEN>&);
 	bool eof();
+	void start_record();
+	string get_record();
+	void stop_record();
+	void set_timing(bool timing_);
+	void replay(vector<token_ptr> tokens, exception_ptr error = nullptr);
+	static vector<token_ptr> lex_parallel(const string& source, thread_pool_t* pool, int jobs, exception_ptr& error);
+	void start_pipeline();
+	const lexeme_stats_t& get_stats();
 };
\ No newline at end of file
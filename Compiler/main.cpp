@@ -1,54 +1,193 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <regex>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <cstring>
 #include "lexeme_analyzer.h"
 #include "parser.h"
 #include "asm_generator.h"
+#include "asm_code_optimnizer.h"
+#include "compiler.h"
+#include "batch.h"
+#include "bench.h"
+#include "compile_server.h"
+#include "thread_pool.h"
 #include "var.h"
+#include "source_manager.h"
+#include "type_table.h"
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 using namespace std;
 
 int main(int argc, char** argv) {
-	tokens_init();
-	lexeme_analyzer_init();
-	parser_init();
-	asm_generator_init();
-	if (argc == 4) {
-		ifstream fin(argv[2]);
-		if (!fin) {
+	// Allocation accounting is decided once, before anything is allocated: the benchmark always reports memory,
+	// the server only when started with -ftime-report
+	for (int i = 1; i < argc; i++)
+		if (strncmp(argv[i], "-ftime-report", 13) == 0 || i == 1 && strcmp(argv[i], "bench") == 0)
+			enable_memory_tracking();
+	compiler_context_t context;
+	string cache_dir;
+	uintmax_t cache_size = 256;
+	int args_count = 1;
+	for (int i = 1; i < argc; i++) {
+		string arg(argv[i]);
+		if (arg.compare(0, 7, "-cache=") == 0)
+			cache_dir = arg.substr(7);
+		else if (arg.compare(0, 12, "-cache-size=") == 0)
+			cache_size = atoi(arg.c_str() + 12);
+		else
+			argv[args_count++] = argv[i];
+	}
+	argc = args_count;
+	if (!cache_dir.empty())
+		context.set_cache(cache_dir, cache_size << 20);
+	if ((argc == 3 || argc == 4 && strncmp(argv[3], "-ftime-report", 13) == 0) && string(argv[1]) == "server")
+		return run_compile_server(context, argv[2], cerr);
+	if (argc >= 6 && string(argv[1]) == "client") {
+		string source;
+		if (!read_source(argv[4], source)) {
+			cerr << "Can't open file" << endl;
+			return 1;
+		}
+		compile_result_t res;
+		if (!compile_remote(argv[2], argv[3], vector<string>(argv + 6, argv + argc), source, res)) {
+			cerr << "Can't connect to " << argv[2] << endl;
+			return 1;
+		}
+		compile_options_t options;
+		options.mode = compile_options_t::mode_by_char(argv[3][0]);
+		ofstream fout(argv[5], options.binary_output() ? ios::binary : ios::out);
+		fout << res.output << res.error;
+		cerr << res.report;
+		return 0;
+	}
+	if (argc >= 2 && string(argv[1]) == "bench") {
+		compile_options_t options;
+		options.jobs = hardware_jobs();
+		vector<string> shapes;
+		int steps = 4;
+		int repeats = 3;
+		for (int i = 2; i < argc; i++) {
+			string arg(argv[i]);
+			if (arg.compare(0, 7, "-steps=") == 0)
+				steps = atoi(arg.c_str() + 7);
+			else if (arg.compare(0, 8, "-repeat=") == 0)
+				repeats = max(1, atoi(arg.c_str() + 8));
+			else if (arg[0] != '-')
+				shapes.push_back(arg);
+			else if (!options.parse_option(arg)) {
+				cerr << "Unknown option: " << arg << endl;
+				return 1;
+			}
+		}
+		if (shapes.empty())
+			for each (auto& s in bench_shapes())
+				shapes.push_back(s.name);
+		return run_benchmarks(context, shapes, steps, repeats, options, cout);
+	}
+	if (argc == 5 && string(argv[1]) == "gen") {
+		string source;
+		if (!bench_generate(argv[2], atoi(argv[3]), source)) {
+			cerr << "Unknown shape: " << argv[2] << endl;
+			return 1;
+		}
+		ofstream fout(argv[4]);
+		fout << source;
+		return 0;
+	}
+	if (argc >= 3 && string(argv[1]) == "run") {
+		compile_options_t options;
+		options.mode = CM_JIT;
+		options.jobs = hardware_jobs();
+		for (int i = 3; i < argc; i++)
+			if (!options.parse_option(argv[i])) {
+				cerr << "Unknown option: " << argv[i] << endl;
+				return 1;
+			}
+		string source;
+		if (!read_source(argv[2], source)) {
 			cerr << "Can't open file" << endl;
 			return 1;
 		}
-		ofstream fout(argv[3]);
-		lexeme_analyzer_t la(fin);
-		parser_t parser(&la);
-		try {
-			if (argv[1][0] == 'l') {
-				while (!la.eof())
-					fout << la.next() << endl;
-			} else if (argv[1][0] == 'e') {
-				parser.print_expr(fout);
-			} else if (argv[1][0] == 't') {
-				parser.print_type(fout);
-			} else if (argv[1][0] == 'd') {
-				parser.print_statements(fout);
-			} else if (argv[1][0] == 's') {
-				parser.print_statements(fout);
-			} else if (argv[1][0] == 'a') {
-				parser.print_asm_code(fout);
+		compile_result_t res = context.compile(source, options);
+		if (!res.ok)
+			cerr << res.error << endl;
+		cerr << res.report;
+		return res.ok ? 0 : 1;
+	}
+	if (argc >= 4 && string(argv[1]) == "b") {
+		compile_options_t options;
+		options.mode = compile_options_t::mode_by_char(argv[2][0]);
+		options.jobs = hardware_jobs();
+		vector<batch_item_t> items;
+		for (int i = 3; i < argc; i++) {
+			if (argv[i][0] == '-') {
+				if (!options.parse_option(argv[i])) {
+					cerr << "Unknown option: " << argv[i] << endl;
+					return 1;
+				}
+			} else if (!batch_add_input(items, argv[i], options.mode)) {
+				cerr << "Can't open file" << endl;
+				return 1;
 			}
-		} catch (CompileError& e) {
-			fout << e;
 		}
+		int jobs = options.jobs;
+		options.jobs = 1;
+		return compile_batch(context, items, options, jobs, cout);
+	}
+	if (argc >= 4) {
+		compile_options_t options;
+		options.mode = compile_options_t::mode_by_char(argv[1][0]);
+		options.jobs = hardware_jobs();
+		for (int i = 4; i < argc; i++)
+			if (!options.parse_option(argv[i])) {
+				cerr << "Unknown option: " << argv[i] << endl;
+				return 1;
+			}
+		// "-" reads the source from stdin and writes the output to stdout, so the compiler fits in a pipeline
+		bool from_stdin = string(argv[2]) == "-";
+		bool to_stdout = string(argv[3]) == "-";
+		string source;
+		if (!from_stdin && !read_source(argv[2], source)) {
+			cerr << "Can't open file" << endl;
+			return 1;
+		}
+#ifdef _WIN32
+		if (to_stdout && options.binary_output())
+			_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		ofstream fout;
+		if (!to_stdout)
+			fout.open(argv[3], options.binary_output() ? ios::binary : ios::out);
+		ostream& out = to_stdout ? cout : fout;
+		compile_result_t res;
+		if (from_stdin)
+			res = context.compile_stream(cin, options, out);
+		else
+			res = context.compile(source, options);
+		out << res.output << res.error;
+		out.flush();
+		cerr << res.report;
 		return 0;
 	}
-	ifstream fin("data.txt");
+	string source;
+	read_source("data.txt", source);
+	istringstream fin(source);
+	source_manager_t sources(&source);
+	source_manager_t::set_current(&sources);
+	type_table_t types;
+	type_table_t::set_current(&types);
 	lexeme_analyzer_t la(fin);
 	parser_t parser(&la);
+	asm_optimizer_t optimizer;
 	try {
-		parser.print_asm_code(cout);
+		parser.print_asm_code(cout, optimizer);
 	} catch (LexemeAnalyzeError& e) {
 		cerr << "Lexeme analyzer error: " << e << endl;
 	} catch (SyntaxError& e) {
@@ -0,0 +1,124 @@
+#include "out_buffer.h"
+#include <cstring>
+
+static thread_local vector<vector<char>> free_buffers;
+
+static const char digit_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+out_buffer_t::out_buffer_t(ostream& os) : os(os), pos(0) {
+	if (free_buffers.empty())
+		buf.resize(OUT_BUFFER_SIZE);
+	else {
+		buf.swap(free_buffers.back());
+		free_buffers.pop_back();
+	}
+}
+
+out_buffer_t::~out_buffer_t() {
+	flush();
+	free_buffers.push_back(vector<char>());
+	free_buffers.back().swap(buf);
+}
+
+void out_buffer_t::_reserve(size_t size) {
+	if (pos + size > buf.size())
+		flush();
+}
+
+void out_buffer_t::flush() {
+	if (pos)
+		os.write(&buf[0], pos);
+	pos = 0;
+}
+
+void out_buffer_t::write(const char* str, size_t size) {
+	if (size > buf.size()) {
+		flush();
+		os.write(str, size);
+		return;
+	}
+	_reserve(size);
+	memcpy(&buf[pos], str, size);
+	pos += size;
+}
+
+void out_buffer_t::_uint(unsigned long long val) {
+	char tmp[24];
+	char* end = tmp + sizeof(tmp);
+	char* p = end;
+	while (val >= 100) {
+		p -= 2;
+		memcpy(p, digit_pairs + val % 100 * 2, 2);
+		val /= 100;
+	}
+	if (val >= 10) {
+		p -= 2;
+		memcpy(p, digit_pairs + val * 2, 2);
+	} else
+		*--p = (char)('0' + val);
+	write(p, end - p);
+}
+
+void out_buffer_t::_int(long long val) {
+	if (val < 0) {
+		*this << '-';
+		_uint(0ull - (unsigned long long)val);
+	} else
+		_uint(val);
+}
+
+out_buffer_t& out_buffer_t::operator<<(char c) {
+	_reserve(1);
+	buf[pos++] = c;
+	return *this;
+}
+
+out_buffer_t& out_buffer_t::operator<<(const char* str) {
+	write(str, strlen(str));
+	return *this;
+}
+
+out_buffer_t& out_buffer_t::operator<<(const string& str) {
+	write(str.data(), str.size());
+	return *this;
+}
+
+out_buffer_t& out_buffer_t::operator<<(int val) {
+	_int(val);
+	return *this;
+}
+
+out_buffer_t& out_buffer_t::operator<<(unsigned val) {
+	_uint(val);
+	return *this;
+}
+
+out_buffer_t& out_buffer_t::operator<<(long val) {
+	_int(val);
+	return *this;
+}
+
+out_buffer_t& out_buffer_t::operator<<(unsigned long val) {
+	_uint(val);
+	return *this;
+}
+
+out_buffer_t& out_buffer_t::operator<<(long long val) {
+	_int(val);
+	return *this;
+}
+
+out_buffer_t& out_buffer_t::operator<<(unsigned long long val) {
+	_uint(val);
+	return *this;
+}
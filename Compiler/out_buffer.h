@@ -0,0 +1,33 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define OUT_BUFFER_SIZE (1 << 16)
+
+// Collects formatted text in a reusable buffer and hands it to the stream in large blocks
+class out_buffer_t {
+	ostream& os;
+	vector<char> buf;
+	size_t pos;
+
+	void _reserve(size_t size);
+	void _int(long long val);
+	void _uint(unsigned long long val);
+public:
+	out_buffer_t(ostream& os);
+	~out_buffer_t();
+	void write(const char* str, size_t size);
+	void flush();
+	out_buffer_t& operator<<(char c);
+	out_buffer_t& operator<<(const char* str);
+	out_buffer_t& operator<<(const string& str);
+	out_buffer_t& operator<<(int val);
+	out_buffer_t& operator<<(unsigned val);
+	out_buffer_t& operator<<(long val);
+	out_buffer_t& operator<<(unsigned long val);
+	out_buffer_t& operator<<(long long val);
+	out_buffer_t& operator<<(unsigned long long val);
+};
@@ -2,6 +2,17 @@
 #include <map>
 #include <set>
 #include <assert.h>
+#include <algorithm>
+#include <exception>
+#include "thread_pool.h"
+#include "asm_code_optimnizer.h"
+#include "compile_cache.h"
+#include "sha256.h"
+#include "asm_x64.h"
+#include "asm_encoder.h"
+#include "phase_report.h"
+#include "serializer.h"
+#include "type_table.h"
 
 sym_table_ptr parser_t::prelude_sym_table;
 
@@ -48,18 +59,15 @@ res_funcs_makers[T_KWRD_##incode_name] = make_res_func<expr_##name##_op_t>;
 
 	init_parser_symbol_node();
 	parser_expression_node_init();
-}
-
-parser_t::parser_t(lexeme_analyzer_t* la_): la(la_) {
-	if (!prelude_sym_table) {
-		prelude_sym_table = sym_table_ptr(new sym_table_t);
 
-		prelude_sym_table->insert(sym_ptr(new sym_type_int_t));
-		prelude_sym_table->insert(sym_ptr(new sym_type_char_t));
-		prelude_sym_table->insert(sym_ptr(new sym_type_double_t));
-		prelude_sym_table->insert(sym_ptr(new sym_type_void_t));
-	}
+	parser_t::prelude_sym_table = sym_table_ptr(new sym_table_t);
+	parser_t::prelude_sym_table->insert(sym_ptr(new sym_type_int_t));
+	parser_t::prelude_sym_table->insert(sym_ptr(new sym_type_char_t));
+	parser_t::prelude_sym_table->insert(sym_ptr(new sym_type_double_t));
+	parser_t::prelude_sym_table->insert(sym_ptr(new sym_type_void_t));
+}
 
+parser_t::parser_t(lexeme_analyzer_t* la_): la(la_), jobs(1), pool(nullptr), loaded(false), report(nullptr) {
 	sym_table = top_sym_table = sym_table_ptr(new sym_table_t(prelude_sym_table));
 }
 
@@ -274,8 +282,14 @@ sym_ptr parser_t::parse_declaration(decl_raw_t decl, sym_table_ptr sym_table, bo
 	return res;
 }
 
+// Types are shared through the symbol table by name. An array without a length is left out,
+// its initializer decides the length later
 void parser_t::optimize_type(type_ptr type) {
 	type_base_ptr base_type = type->get_base_type();
+	if (base_type == ST_ARRAY && !base_type->completed()) {
+		optimize_type(static_pointer_cast<sym_type_array_t>(base_type)->get_element_type());
+		return;
+	}
 	type_base_ptr finded_type = dynamic_pointer_cast<type_base_t>(sym_table->find_global(base_type));
 	if (finded_type) {
 		shared_ptr<sym_type_alias_t> alias = dynamic_pointer_cast<sym_type_alias_t>(finded_type);
@@ -602,6 +616,9 @@ void parser_t::parse_struct_decl_list(sym_table_ptr sym_table) {
 }
 
 void parser_t::parse_decl_stmt() {
+	bool record = cache && sym_table == top_sym_table;
+	if (record)
+		la->start_record();
 	shared_ptr<sym_func_t> sym_func = dynamic_pointer_cast<sym_func_t>(sym_table == top_sym_table ? parse_global_declaration() : parse_declaration());
 	if (sym_func) {
 		sym_ptr finded_global_sym = sym_table->find_global(sym_func);
@@ -618,7 +635,13 @@ void parser_t::parse_decl_stmt() {
 				sym_table->insert(sym_func);
 			sym_table = sym_func->get_sym_table();
 			func_stack.push(sym_func);
+			if (record)
+				env_record += la->get_record();
 			sym_func->set_block(parse_block_stmt());
+			if (record) {
+				sym_func->set_source(la->get_record());
+				la->stop_record();
+			}
 			func_stack.pop();
 			exit_namespace();
 			return;
@@ -629,6 +652,10 @@ void parser_t::parse_decl_stmt() {
 		}
 	}
 	la->require(T_SEMICOLON, 0);
+	if (record) {
+		env_record += la->get_record();
+		la->stop_record();
+	}
 }
 
 stmt_ptr parser_t::parse_expr_stmt() {
@@ -742,7 +769,7 @@ void parser_t::print_eval_expr(ostream& os) {
 		return;
 	expr_t* expr = parse_expr();
 	expr->eval()->print(os);
-	os << endl;
+	os << '\n';
 }
 
 void parser_t::print_type(ostream& os) {
@@ -768,7 +795,7 @@ void parser_t::print_type(ostream& os) {
 			os << "}";
 		}
 	}
-	os << endl;
+	os << '\n';
 }
 
 void parser_t::print_decl(ostream& os) {
@@ -790,31 +817,156 @@ void parser_t::print_statement(ostream& os) {
 }
 
 void parser_t::print_statements(ostream& os) {
-	if (la->next() != T_EMPTY) {
-		parse_top_level_stmt();
-		sym_table->print(os);
+	if (_has_program()) {
+		if (!loaded)
+			parse_top_level_stmt();
+		top_sym_table->print(os);
 	}
 }
 
-void parser_t::print_asm_code(ostream& os) {
-	if (la->next() != T_EMPTY) {
+void parser_t::print_asm_code(ostream& os, asm_optimizer_t& optimizer) {
+	asm_gen_ptr gen = generate_asm_code(optimizer);
+	if (!gen)
+		return;
+	phase_timer_t timer(report, "print", 1);
+	if (asm_gen_t::get_target() == AT_X64)
+		asm_x64_gen_t(gen).print(os);
+	else
+		gen->print(os);
+}
+
+void parser_t::print_object_code(ostream& os, asm_optimizer_t& optimizer) {
+	asm_gen_ptr gen = generate_asm_code(optimizer);
+	if (!gen)
+		return;
+	phase_timer_t timer(report, "encode", 1);
+	asm_x64_gen_t x64_gen(gen);
+	asm_encoder_t(x64_gen).write_object(os);
+}
+
+void parser_t::print_ast(ostream& os) {
+	if (!_has_program())
+		return;
+	parse_program();
+	phase_timer_t timer(report, "serialize", 1);
+	os << serialize_ast(top_sym_table, env_record);
+}
+
+void parser_t::load_ast(const string& data) {
+	phase_timer_t timer(report, "load", 1);
+	ast_reader_t reader(data);
+	sym_table = top_sym_table = reader.read_program(env_record);
+	loaded = true;
+}
+
+bool parser_t::_has_program() {
+	return loaded || la->next() != T_EMPTY;
+}
+
+void parser_t::parse_program() {
+	if (loaded) {
+		top_sym_table->asm_set_offset_for_local_vars(0, AR_NONE);
+		return;
+	}
+	long long nodes = node_t::created_count();
+	long long symbols = sym_table_t::inserted_count();
+	phase_timer_t timer(report, "parse", 1);
+	int lexing = report ? report->add("lexing", 2) : -1;
+	parse_top_level_stmt();
+	top_sym_table->asm_set_offset_for_local_vars(0, AR_NONE);
+	if (report) {
+		auto& stats = la->get_stats();
+		report->set(lexing, stats.time, stats.allocs, stats.bytes);
+		report->count("tokens", stats.tokens);
+		report->count("AST nodes", node_t::created_count() - nodes);
+		report->count("symbols", sym_table_t::inserted_count() - symbols);
+	}
+}
+
+asm_gen_ptr parser_t::generate_asm_code(asm_optimizer_t& optimizer) {
+	if (_has_program()) {
 		asm_gen_ptr gen(new asm_gen_t);
 		stmt_ptr main_block;
-		parse_top_level_stmt();
-		top_sym_table->asm_set_offset_for_local_vars(0, AR_NONE);
+		parse_program();
+		vector<shared_ptr<sym_func_t>> funcs;
+		for each (auto sym in *top_sym_table)
+			if (sym == ST_FUNC)
+				funcs.push_back(dynamic_pointer_cast<sym_func_t>(sym));
+		vector<asm_cmd_list_ptr> cmd_lists(funcs.size());
+		vector<exception_ptr> errors(funcs.size());
+		string env_key = cache ? sha256_hex(cache_salt + env_record) : "";
+		{
+			phase_timer_t timer(report, "codegen", 1);
+			int generate = -1, optimize = -1;
+			vector<int> generate_rows(funcs.size(), -1), optimize_rows(funcs.size(), -1);
+			if (report) {
+				report->count("functions", funcs.size());
+				generate = report->add("generate", 2);
+				for (int i = 0; i < funcs.size(); i++)
+					generate_rows[i] = report->add(funcs[i]->get_name(), 3);
+				optimize = report->add("optimize", 2);
+				for (int i = 0; i < funcs.size(); i++)
+					optimize_rows[i] = report->add(funcs[i]->get_name(), 3);
+			}
+			ASM_TARGET target = asm_gen_t::get_target();
+			source_manager_t* sources = source_manager_t::current();
+			type_table_t* types = type_table_t::current();
+			parallel_for(pool, funcs.size(), jobs, [&](int i) {
+				asm_gen_t::set_target(target);
+				source_manager_t::set_current(sources);
+				type_table_t::set_current(types);
+				try {
+					asm_cmd_list_ptr cmd_list(new asm_cmd_list_t);
+					bool cached = cache && funcs[i]->defined() && !funcs[i]->get_source().empty();
+					string key = cached ? sha256_hex(env_key + funcs[i]->get_source()) : "";
+					string data;
+					if (!cached || !cache->load(key, data) || !cmd_list->deserialize(data)) {
+						cmd_list = asm_cmd_list_ptr(new asm_cmd_list_t);
+						{
+							phase_timer_t group_timer(report, generate, true);
+							phase_timer_t func_timer(report, generate_rows[i]);
+							funcs[i]->asm_set_offset();
+							funcs[i]->asm_generate_code(cmd_list);
+						}
+						if (report)
+							report->count("generated instructions", cmd_list->_size());
+						{
+							phase_timer_t group_timer(report, optimize, true);
+							phase_timer_t func_timer(report, optimize_rows[i]);
+							optimizer.optimize(cmd_list);
+						}
+						if (cached) {
+							data = cmd_list->serialize();
+							if (!data.empty())
+								cache->store(key, data);
+						}
+					} else if (report)
+						report->count("cached functions", 1);
+					if (report)
+						report->count("emitted instructions", cmd_list->_size());
+					cmd_lists[i] = cmd_list;
+				} catch (...) {
+					errors[i] = current_exception();
+				}
+			});
+		}
+		int func_id = 0;
+		int labels_base = 0;
 		for each (auto sym in *top_sym_table) {
 			if (sym == ST_FUNC) {
-				auto sym_func = dynamic_pointer_cast<sym_func_t>(sym);
-				asm_cmd_list_ptr cmd_list(new asm_cmd_list_t);
-				sym_func->asm_set_offset();
-				sym_func->asm_generate_code(cmd_list);
+				if (errors[func_id])
+					rethrow_exception(errors[func_id]);
+				auto sym_func = funcs[func_id];
+				asm_cmd_list_ptr cmd_list = cmd_lists[func_id++];
+				cmd_list->_shift_labels(labels_base);
+				labels_base += cmd_list->_labels_count();
 				if (sym_func->get_name() == "main") {
 					if (!sym_func->defined())
 						throw MainFuncNotFound();
 					main_block = sym_func->get_block();
 					gen->set_main_cmd_list(cmd_list);
 				} else
-					gen->add_function(sym_func->asm_get_name(), cmd_list);
+					gen->add_function(sym_func->asm_get_name(), cmd_list, sym_func->get_func_type()->asm_signature());
 			} else if (sym == ST_VAR) {
 				auto sym_global_var = dynamic_pointer_cast<sym_global_var_t>(sym);
 				sym_global_var->asm_register(gen);
@@ -822,9 +974,43 @@ void parser_t::print_asm_code(ostream& os) {
 		}
 		if (!main_block)
 			throw MainFuncNotFound();
-		gen->optimize();
-		gen->print(os);
+		return gen;
 	}
+	return nullptr;
+}
+
+bc_program_ptr parser_t::generate_bytecode() {
+	if (!_has_program())
+		return nullptr;
+	parse_program();
+	phase_timer_t timer(report, "codegen", 1);
+	bc_program_ptr program(new bc_program_t);
+	bc_builder_t builder(*program);
+	for each (auto sym in *top_sym_table)
+		if (sym == ST_VAR)
+			builder.add_global(dynamic_pointer_cast<sym_global_var_t>(sym));
+	for each (auto sym in *top_sym_table)
+		if (sym == ST_FUNC)
+			builder.add_function(dynamic_pointer_cast<sym_func_t>(sym));
+	builder.finish();
+	if (report)
+		report->count("bytecode instructions", program->code.size());
+	return program;
+}
+
+void parser_t::set_jobs(int jobs_, thread_pool_t* pool_) {
+	jobs = max(1, jobs_);
+	pool = pool_;
+}
+
+void parser_t::set_cache(shared_ptr<compile_cache_t> cache_, string cache_salt_) {
+	cache = cache_;
+	cache_salt = cache_salt_;
+}
+
+void parser_t::set_report(phase_report_t* report_) {
+	report = report_;
+	la->set_timing(report != nullptr);
 }
 
 sym_table_ptr parser_t::get_prelude_sym_table() {
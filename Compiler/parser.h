@@ -15,6 +15,11 @@
 
 using namespace std;
 
+class compile_cache_t;
+class asm_optimizer_t;
+class phase_report_t;
+class thread_pool_t;
+
 void parser_init();
 
 struct type_chain_t {
@@ -46,7 +51,15 @@ struct decl_raw_t {
 };
 
 class parser_t {
+	friend void parser_init();
 	lexeme_analyzer_t* la;
+	int jobs;
+	thread_pool_t* pool;
+	shared_ptr<compile_cache_t> cache;
+	string cache_salt;
+	string env_record;
+	bool loaded;
+	phase_report_t* report;
 
 	sym_table_ptr sym_table;
 	sym_table_ptr top_sym_table;
@@ -94,15 +107,25 @@ class parser_t {
 	stmt_ptr parse_for_stmt();
 	stmt_ptr parse_break_continue_stmt();
 	stmt_ptr parse_return_stmt();
+	void parse_program();
+	bool _has_program();
 public:
 	parser_t(lexeme_analyzer_t* la_);
+	void set_jobs(int jobs_, thread_pool_t* pool_);
+	void set_cache(shared_ptr<compile_cache_t> cache_, string cache_salt_);
+	void set_report(phase_report_t* report_);
 	void print_expr(ostream&);
 	void print_eval_expr(ostream&);
 	void print_type(ostream&);
 	void print_decl(ostream&);
 	void print_statement(ostream&);
 	void print_statements(ostream&);
-	void print_asm_code(ostream&);
+	void print_asm_code(ostream&, asm_optimizer_t&);
+	void print_object_code(ostream&, asm_optimizer_t&);
+	void print_ast(ostream&);
+	void load_ast(const string& data);
+	asm_gen_ptr generate_asm_code(asm_optimizer_t&);
+	bc_program_ptr generate_bytecode();
 	static sym_table_ptr get_prelude_sym_table();
 	static type_base_ptr get_base_type(SYM_TYPE sym_type);
 	static type_ptr get_type(SYM_TYPE sym_type, bool is_const = false);
@@ -1,5 +1,15 @@
 #include "parser_base_node.h"
 
+static thread_local long long nodes_created = 0;
+
+node_t::node_t() {
+	nodes_created++;
+}
+
+long long node_t::created_count() {
+	return nodes_created;
+}
+
 void node_t::print(ostream& os) {
 	print_l(os, 0);
 }
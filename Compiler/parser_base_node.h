@@ -6,6 +6,8 @@ using namespace std;
 
 class node_t {
 public:
+	node_t();
+	static long long created_count();
 	void print(ostream& os);
 	void short_print(ostream& os);
 	virtual void print_l(ostream& os, int level) = 0;
@@ -19,17 +21,15 @@ typedef shared_ptr<statement_t> stmt_ptr;
 class sym_table_t;
 typedef shared_ptr<sym_table_t> sym_table_ptr;
 class expr_t;
+class ast_writer_t;
+class ast_reader_t;
 
-class asm_cmd_t;
+struct asm_cmd_t;
 class asm_cmd_list_t;
-class asm_operand_t;
 class asm_gen_t;
 class asm_local_vars_t;
-class asm_label_oprnd_t;
 
-class asm_oprnd_ptr;
 typedef shared_ptr<asm_gen_t> asm_gen_ptr;
 typedef shared_ptr<asm_local_vars_t> asm_local_vars_ptr;
-typedef shared_ptr<asm_label_oprnd_t> asm_label_ptr;
 
 void print_level(ostream& os, int level);
\ No newline at end of file
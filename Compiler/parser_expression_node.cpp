@@ -1,6 +1,7 @@
 #include "parser.h"
 #include "exceptions.h"
 #include "type_conversion.h"
+#include "bytecode.h"
 #include <map>
 
 using namespace std;
@@ -8,6 +9,8 @@ using namespace std;
 map<TOKEN, ASM_OPERATOR> token_to_int_op_map;
 map<TOKEN, ASM_OPERATOR> token_to_fp_op_map;
 map<TOKEN, ASM_OPERATOR> token_to_fp_rev_op_map;
+map<TOKEN, BC_OPCODE> token_to_bc_int_op_map;
+map<TOKEN, BC_OPCODE> token_to_bc_fp_op_map;
 
 void parser_expression_node_init() {
 	token_to_int_op_map[T_OP_INC] = AO_INC;
@@ -63,6 +66,48 @@ void parser_expression_node_init() {
 	token_to_fp_rev_op_map[T_OP_MUL_ASSIGN] = AO_FMUL;
 	token_to_fp_rev_op_map[T_OP_DIV] = AO_FDIVR;
 	token_to_fp_rev_op_map[T_OP_DIV_ASSIGN] = AO_FDIVR;
+
+	token_to_bc_int_op_map[T_OP_ADD] = BC_ADD;
+	token_to_bc_int_op_map[T_OP_ADD_ASSIGN] = BC_ADD;
+	token_to_bc_int_op_map[T_OP_SUB] = BC_SUB;
+	token_to_bc_int_op_map[T_OP_SUB_ASSIGN] = BC_SUB;
+	token_to_bc_int_op_map[T_OP_MUL] = BC_MUL;
+	token_to_bc_int_op_map[T_OP_MUL_ASSIGN] = BC_MUL;
+	token_to_bc_int_op_map[T_OP_DIV] = BC_DIV;
+	token_to_bc_int_op_map[T_OP_DIV_ASSIGN] = BC_DIV;
+	token_to_bc_int_op_map[T_OP_MOD] = BC_MOD;
+	token_to_bc_int_op_map[T_OP_MOD_ASSIGN] = BC_MOD;
+	token_to_bc_int_op_map[T_OP_BIT_OR] = BC_OR;
+	token_to_bc_int_op_map[T_OP_BIT_OR_ASSIGN] = BC_OR;
+	token_to_bc_int_op_map[T_OP_BIT_AND] = BC_AND;
+	token_to_bc_int_op_map[T_OP_BIT_AND_ASSIGN] = BC_AND;
+	token_to_bc_int_op_map[T_OP_XOR] = BC_XOR;
+	token_to_bc_int_op_map[T_OP_XOR_ASSIGN] = BC_XOR;
+	token_to_bc_int_op_map[T_OP_LEFT] = BC_SHL;
+	token_to_bc_int_op_map[T_OP_LEFT_ASSIGN] = BC_SHL;
+	token_to_bc_int_op_map[T_OP_RIGHT] = BC_SHR;
+	token_to_bc_int_op_map[T_OP_RIGHT_ASSIGN] = BC_SHR;
+	token_to_bc_int_op_map[T_OP_EQ] = BC_EQ;
+	token_to_bc_int_op_map[T_OP_NEQ] = BC_NE;
+	token_to_bc_int_op_map[T_OP_L] = BC_LT;
+	token_to_bc_int_op_map[T_OP_LE] = BC_LE;
+	token_to_bc_int_op_map[T_OP_G] = BC_GT;
+	token_to_bc_int_op_map[T_OP_GE] = BC_GE;
+
+	token_to_bc_fp_op_map[T_OP_ADD] = BC_FADD;
+	token_to_bc_fp_op_map[T_OP_ADD_ASSIGN] = BC_FADD;
+	token_to_bc_fp_op_map[T_OP_SUB] = BC_FSUB;
+	token_to_bc_fp_op_map[T_OP_SUB_ASSIGN] = BC_FSUB;
+	token_to_bc_fp_op_map[T_OP_MUL] = BC_FMUL;
+	token_to_bc_fp_op_map[T_OP_MUL_ASSIGN] = BC_FMUL;
+	token_to_bc_fp_op_map[T_OP_DIV] = BC_FDIV;
+	token_to_bc_fp_op_map[T_OP_DIV_ASSIGN] = BC_FDIV;
+	token_to_bc_fp_op_map[T_OP_EQ] = BC_FEQ;
+	token_to_bc_fp_op_map[T_OP_NEQ] = BC_FNE;
+	token_to_bc_fp_op_map[T_OP_L] = BC_FLT;
+	token_to_bc_fp_op_map[T_OP_LE] = BC_FLE;
+	token_to_bc_fp_op_map[T_OP_G] = BC_FGT;
+	token_to_bc_fp_op_map[T_OP_GE] = BC_FGE;
 }
 
 //-----------------------------------EXPRESSIONS-----------------------------------
@@ -81,6 +126,16 @@ void expr_t::asm_get_addr(asm_cmd_list_ptr cmd_list) {
 	assert(false);
 }
 
+int expr_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	assert(false);
+	return 0;
+}
+
+int expr_t::bc_get_addr(bc_builder_t& bc) {
+	assert(false);
+	return 0;
+}
+
 var_ptr expr_t::eval() {
 	throw ExprMustBeEval(get_pos());
 	return var_ptr();
@@ -102,6 +157,10 @@ ASM_OPERATOR expr_t::token_to_int_op(token_ptr token) {
 	return token_to_int_op_map.at(token->get_token_id());
 }
 
+BC_OPCODE expr_t::token_to_bc_op(token_ptr token, bool fp) {
+	return (fp ? token_to_bc_fp_op_map : token_to_bc_int_op_map).at(token->get_token_id());
+}
+
 //-----------------------------------VARIABLE-----------------------------------
 
 expr_var_t::expr_var_t() : expr_t(true) {}
@@ -109,7 +168,7 @@ expr_var_t::expr_var_t() : expr_t(true) {}
 void expr_var_t::print_l(ostream& os, int level) {
 	print_level(os, level);
 	variable->short_print(os);
-	os << endl;
+	os << '\n';
 }
 
 void expr_var_t::short_print_l(ostream& os, int level) {
@@ -152,6 +211,18 @@ void expr_var_t::asm_get_addr(asm_cmd_list_ptr cmd_list) {
 	dynamic_pointer_cast<sym_var_t>(variable)->asm_get_addr(cmd_list);
 }
 
+int expr_var_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	if (variable->is(ST_FUNC))
+		throw VmError("Function pointers are not supported by the bytecode VM", get_pos());
+	return bc.get_var(static_cast<sym_var_t*>(variable.get()));
+}
+
+int expr_var_t::bc_get_addr(bc_builder_t& bc) {
+	if (variable->is(ST_FUNC))
+		throw VmError("Function pointers are not supported by the bytecode VM", get_pos());
+	return bc.get_var_addr(static_cast<sym_var_t*>(variable.get()));
+}
+
 var_ptr expr_var_t::eval() {
 	if (variable->get_type() == ST_FUNC_TYPE ||
 		variable->get_type() == ST_ARRAY)
@@ -173,7 +244,7 @@ expr_const_t::expr_const_t(token_ptr constant_) : constant(constant_) {}
 void expr_const_t::print_l(ostream& os, int level) {
 	print_level(os, level);
 	constant->short_print(os);
-	os << endl;
+	os << '\n';
 }
 
 void expr_const_t::short_print_l(ostream& os, int level) {
@@ -218,6 +289,23 @@ void expr_const_t::asm_get_addr(asm_cmd_list_ptr cmd_list) {
 	asm_gen_code(cmd_list, true);
 }
 
+int expr_const_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	int res = bc.new_reg();
+	auto var = static_pointer_cast<token_base_with_value_t>(constant)->get_var();
+	if (constant == T_STRING)
+		bc.emit(BC_MOVI, res, bc.literal(unescape(static_pointer_cast<var_t<string>>(var)->get_val())));
+	else if (get_type() == ST_DOUBLE)
+		bc.emit(BC_MOVD, res, bc.const_double(var_pointer_cast<double>(var)->get_val()));
+	else
+		bc.emit(BC_MOVI, res, var_pointer_cast<int>(var)->get_val() & (get_type() == ST_CHAR ? 0xFF : -1));
+	return res;
+}
+
+int expr_const_t::bc_get_addr(bc_builder_t& bc) {
+	assert(constant == T_STRING);
+	return bc_gen_code(bc, true);
+}
+
 var_ptr expr_const_t::eval() {
 	return static_pointer_cast<token_base_with_value_t>(constant)->get_var();
 }
@@ -229,7 +317,7 @@ expr_un_op_t::expr_un_op_t(token_ptr op, bool lvalue) : op(op), expr_t(lvalue) {
 void expr_un_op_t::print_l(ostream& os, int level) {
 	print_level(os, level);
 	op->short_print(os);
-	os << endl;
+	os << '\n';
 	expr->print_l(os, level + 1);
 }
 
@@ -243,6 +331,10 @@ void expr_un_op_t::asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) {
 	expr->asm_gen_code(cmd_list, keep_val);
 }
 
+int expr_un_op_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	return expr->bc_gen_code(bc, keep_val);
+}
+
 expr_t* expr_un_op_t::get_expr() {
 	return expr;
 }
@@ -330,7 +422,7 @@ void expr_prefix_un_op_t::print_l(ostream& os, int level) {
 	print_level(os, level);
 	os << "prefix ";
 	op->short_print(os);
-	os << endl;
+	os << '\n';
 	expr->print_l(os, level + 1);
 }
 
@@ -378,6 +470,10 @@ void expr_get_addr_un_op_t::asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_va
 		expr->asm_get_addr(cmd_list);
 }
 
+int expr_get_addr_un_op_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	return expr->bc_get_addr(bc);
+}
+
 type_ptr expr_get_addr_un_op_t::get_type() {
 	return sym_type_ptr_t::make_ptr(expr->get_type());
 }
@@ -406,6 +502,16 @@ void expr_dereference_op_t::asm_get_addr(asm_cmd_list_ptr cmd_list) {
 	expr->asm_gen_code(cmd_list, true);
 }
 
+int expr_dereference_op_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	int res = expr->bc_gen_code(bc, true);
+	bc.load(res, res, get_type());
+	return res;
+}
+
+int expr_dereference_op_t::bc_get_addr(bc_builder_t& bc) {
+	return expr->bc_gen_code(bc, true);
+}
+
 type_ptr expr_dereference_op_t::get_type() {
 	return sym_type_ptr_t::dereference(expr->get_type());
 }
@@ -427,7 +533,7 @@ inline int get_ptr_elem_size(type_ptr type) {
 void expr_prefix_inc_dec_op_t::asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) {
 	expr->asm_get_addr(cmd_list);
 	if (get_type() == ST_PTR)
-		cmd_list->_add_op_lderef(op == T_OP_INC ? AO_ADD : AO_SUB, AR_EAX, new_var<int>(get_ptr_elem_size(get_type())), AMT_DWORD);
+		cmd_list->_add_op_lderef(op == T_OP_INC ? AO_ADD : AO_SUB, AR_EAX, new_var<int>(get_ptr_elem_size(get_type())), get_type_size());
 	else if (get_type()->is_integer())
 		cmd_list->_add_op_deref(token_to_int_op(op), AR_EAX, get_type_size());
 	else {
@@ -441,6 +547,32 @@ void expr_prefix_inc_dec_op_t::asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep
 		cmd_list->mov_rderef(AR_EAX, AR_EAX, get_type_size());
 }
 
+static void bc_inc_dec(bc_builder_t& bc, int dst, int src, type_ptr type, bool inc) {
+	if (type == ST_DOUBLE) {
+		int one = bc.new_reg();
+		bc.emit(BC_MOVD, one, bc.const_double(1));
+		bc.emit(inc ? BC_FADD : BC_FSUB, dst, src, one);
+		bc.free_regs(one);
+		return;
+	}
+	int step = type == ST_PTR ? get_ptr_elem_size(type) : 1;
+	bc.emit(BC_ADDI, dst, src, inc ? step : -step);
+	if (type == ST_CHAR)
+		bc.emit(BC_I2C, dst, dst);
+}
+
+int expr_prefix_inc_dec_op_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	int addr = expr->bc_get_addr(bc);
+	int val = bc.new_reg();
+	bc.load(val, addr, get_type());
+	bc_inc_dec(bc, val, val, get_type(), op == T_OP_INC);
+	bc.store(addr, val, get_type());
+	if (keep_val)
+		bc.emit(BC_MOV, addr, val);
+	bc.free_regs(addr + 1);
+	return addr;
+}
+
 //-----------------------------------PREFIX_ADD_SUB-----------------------------------
 
 expr_prefix_add_sub_un_op_t::expr_prefix_add_sub_un_op_t(token_ptr op) : expr_prefix_un_op_t(op) {
@@ -460,6 +592,13 @@ void expr_prefix_add_sub_un_op_t::asm_gen_code(asm_cmd_list_ptr cmd_list, bool k
 	}
 }
 
+int expr_prefix_add_sub_un_op_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	int res = expr->bc_gen_code(bc, true);
+	if (op == T_OP_SUB)
+		bc.emit(get_type() == ST_DOUBLE ? BC_FNEG : BC_NEG, res, res);
+	return res;
+}
+
 //-----------------------------------PREFIX_LOGICAL_NOT-----------------------------------
 
 expr_prefix_not_un_op_t::expr_prefix_not_un_op_t(token_ptr op) : expr_prefix_un_op_t(op) {
@@ -472,6 +611,12 @@ type_ptr expr_prefix_not_un_op_t::get_type() {
 	return parser_t::get_type(ST_INTEGER);
 }
 
+int expr_prefix_not_un_op_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	int res = bc.gen_cond(expr, false);
+	bc.emit(BC_LNOT, res, res);
+	return res;
+}
+
 //-----------------------------------PREFIX_BIT_NOT-----------------------------------
 
 expr_prefix_bit_not_un_op_t::expr_prefix_bit_not_un_op_t(token_ptr op) : expr_prefix_un_op_t(op) {
@@ -486,13 +631,19 @@ void expr_prefix_bit_not_un_op_t::asm_gen_code(asm_cmd_list_ptr cmd_list, bool k
 	}
 }
 
+int expr_prefix_bit_not_un_op_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	int res = expr->bc_gen_code(bc, true);
+	bc.emit(BC_NOT, res, res);
+	return res;
+}
+
 //-----------------------------------POSTFIX_UNARY_OPERATOR-----------------------------------
 
 void expr_postfix_un_op_t::print_l(ostream& os, int level) {
 	print_level(os, level);
 	os << "postfix ";
 	op->short_print(os);
-	os << endl;
+	os << '\n';
 	expr->print_l(os, level + 1);
 }
 
@@ -523,7 +674,7 @@ void expr_postfix_inc_dec_op_t::asm_gen_code(asm_cmd_list_ptr cmd_list, bool kee
 		if (keep_val)
 			cmd_list->mov_rderef(AR_EBX, AR_EAX, get_type_size());
 		if (get_type() == ST_PTR) 
-			cmd_list->_add_op_lderef(op == T_OP_INC ? AO_ADD : AO_SUB, AR_EAX, new_var<int>(get_ptr_elem_size(get_type())), AMT_DWORD);
+			cmd_list->_add_op_lderef(op == T_OP_INC ? AO_ADD : AO_SUB, AR_EAX, new_var<int>(get_ptr_elem_size(get_type())), get_type_size());
 		else if (get_type()->is_integer())
 			cmd_list->_add_op_deref(token_to_int_op(op), AR_EAX, get_type_size());
 		if (keep_val)
@@ -538,6 +689,19 @@ void expr_postfix_inc_dec_op_t::asm_gen_code(asm_cmd_list_ptr cmd_list, bool kee
 	}
 }
 
+int expr_postfix_inc_dec_op_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	int addr = expr->bc_get_addr(bc);
+	int val = bc.new_reg();
+	int res = bc.new_reg();
+	bc.load(val, addr, get_type());
+	bc_inc_dec(bc, res, val, get_type(), op == T_OP_INC);
+	bc.store(addr, res, get_type());
+	if (keep_val)
+		bc.emit(BC_MOV, addr, val);
+	bc.free_regs(addr + 1);
+	return addr;
+}
+
 //-----------------------------------BINARY_OPERATORS-----------------------------------
 
 expr_bin_op_t::expr_bin_op_t(token_ptr op) : left(0), right(0), op(op) {}
@@ -546,7 +710,7 @@ void expr_bin_op_t::print_l(ostream& os, int level) {
 	left->print_l(os, level + 1);
 	print_level(os, level);
 	op->short_print(os);
-	os << endl;
+	os << '\n';
 	right->print_l(os, level + 1);
 }
 
@@ -651,6 +815,18 @@ void expr_bin_op_t::asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) {
 	}
 }
 
+void expr_bin_op_t::_bc_gen_code_op(bc_builder_t& bc, int left_reg, int right_reg) {
+	bc.emit(token_to_bc_op(op, left->get_type() == ST_DOUBLE), left_reg, left_reg, right_reg);
+}
+
+int expr_bin_op_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	int res = left->bc_gen_code(bc, true);
+	int right_reg = right->bc_gen_code(bc, true);
+	_bc_gen_code_op(bc, res, right_reg);
+	bc.free_regs(res + 1);
+	return res;
+}
+
 var_ptr expr_bin_op_t::eval() {
 	var_ptr lv = left->eval();
 	var_ptr rv = right->eval();
@@ -832,6 +1008,30 @@ void expr_base_assign_bin_op_t::asm_gen_code(asm_cmd_list_ptr cmd_list, bool kee
 	}
 }
 
+int expr_base_assign_bin_op_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	type_ptr type = get_type();
+	bool fp = type == ST_DOUBLE || right->get_type() == ST_DOUBLE;
+	int res = right->bc_gen_code(bc, true);
+	int addr = left->bc_get_addr(bc);
+	int val = bc.new_reg();
+	bc.load(val, addr, type);
+	if (fp) {
+		type_ptr double_type = parser_t::get_type(ST_DOUBLE);
+		bc.convert(val, type, double_type);
+		bc.convert(res, right->get_type(), double_type);
+		bc.emit(token_to_bc_op(op, true), res, val, res);
+		bc.convert(res, double_type, type);
+	} else {
+		if (type == ST_PTR && get_ptr_elem_size(type) > 1)
+			bc.emit(BC_MULI, res, res, get_ptr_elem_size(type));
+		bc.emit(token_to_bc_op(op, false), res, val, res);
+		bc.convert(res, parser_t::get_type(ST_INTEGER), type);
+	}
+	bc.store(addr, res, type);
+	bc.free_regs(res + 1);
+	return res;
+}
+
 //-----------------------------------ASSIGN---------------------------------------------
 
 expr_assign_bin_op_t::expr_assign_bin_op_t(token_ptr op) : expr_base_assign_bin_op_t(op) {
@@ -842,6 +1042,14 @@ void expr_assign_bin_op_t::_asm_gen_code_int(asm_cmd_list_ptr cmd_list, bool kee
 	cmd_list->mov_lderef(AR_EBX, AR_EAX, get_type_size());
 }
 
+int expr_assign_bin_op_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	int res = right->bc_gen_code(bc, true);
+	int addr = left->bc_get_addr(bc);
+	bc.store(addr, res, get_type());
+	bc.free_regs(res + 1);
+	return res;
+}
+
 void expr_assign_bin_op_t::_asm_assign_fp_to_fp(asm_cmd_list_ptr cmd_list, bool keep_val) {
 	if (keep_val)
 		cmd_list->fst_deref(AR_EAX, AMT_QWORD);
@@ -985,7 +1193,15 @@ void expr_add_bin_op_t::_asm_gen_code_int(asm_cmd_list_ptr cmd_list, bool keep_v
 		mul_reg_to_elem_size(cmd_list, AR_EBX, get_ptr_elem_size(get_type()));
 	else if (right->get_type() == ST_PTR)
 		mul_reg_to_elem_size(cmd_list, AR_EAX, get_ptr_elem_size(get_type()));
-	cmd_list->add(AR_EAX, AR_EBX);
+	cmd_list->add(AR_EAX, AR_EBX, get_type() == ST_PTR ? get_type_size() : 0);
+}
+
+void expr_add_bin_op_t::_bc_gen_code_op(bc_builder_t& bc, int left_reg, int right_reg) {
+	if (get_type() == ST_PTR && get_ptr_elem_size(get_type()) > 1) {
+		int index = left->get_type() == ST_PTR ? right_reg : left_reg;
+		bc.emit(BC_MULI, index, index, get_ptr_elem_size(get_type()));
+	}
+	bc.emit(get_type() == ST_DOUBLE ? BC_FADD : BC_ADD, left_reg, left_reg, right_reg);
 }
 
 expr_add_assign_bin_op_t::expr_add_assign_bin_op_t(token_ptr op) : expr_arithmetic_assign_bin_op_t(op) {
@@ -1014,7 +1230,18 @@ void expr_sub_bin_op_t::_asm_gen_code_int(asm_cmd_list_ptr cmd_list, bool keep_v
 	if (left->get_type() == ST_PTR) {
 		mul_reg_to_elem_size(cmd_list, AR_EBX, get_ptr_elem_size(get_type()));
 	}
-	cmd_list->sub(AR_EAX, AR_EBX);
+	cmd_list->sub(AR_EAX, AR_EBX, left->get_type() == ST_PTR ? left->get_type_size() : 0);
+}
+
+void expr_sub_bin_op_t::_bc_gen_code_op(bc_builder_t& bc, int left_reg, int right_reg) {
+	int elem_size = left->get_type() == ST_PTR ? get_ptr_elem_size(left->get_type()) : 1;
+	if (elem_size > 1 && right->get_type() != ST_PTR)
+		bc.emit(BC_MULI, right_reg, right_reg, elem_size);
+	bc.emit(get_type() == ST_DOUBLE ? BC_FSUB : BC_SUB, left_reg, left_reg, right_reg);
+	if (elem_size > 1 && right->get_type() == ST_PTR) {
+		bc.emit(BC_MOVI, right_reg, elem_size);
+		bc.emit(BC_DIV, left_reg, left_reg, right_reg);
+	}
 }
 
 expr_sub_assign_bin_op_t::expr_sub_assign_bin_op_t(token_ptr op) : expr_arithmetic_assign_bin_op_t(op) {
@@ -1109,6 +1336,18 @@ expr_logical_bin_op_t::expr_logical_bin_op_t(token_ptr op) : expr_bin_op_t(op) {
 	type_convertions.push_back(tc_bo_ptr_to_arithmetic);
 }
 
+int expr_logical_bin_op_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	int res = bc.gen_cond(left, true);
+	int exit_label = bc.new_label();
+	bc.jump(op == T_OP_AND ? BC_JZ : BC_JNZ, exit_label, res);
+	int right_reg = bc.gen_cond(right, true);
+	bc.emit(BC_MOV, res, right_reg);
+	bc.insert_label(exit_label);
+	bc.free_regs(res + 1);
+	bc.convert(res, parser_t::get_type(ST_INTEGER), get_type());
+	return res;
+}
+
 //--------------------------------------SHIFT_OPERATORS----------------------------------------------
 
 expr_shift_bin_op_t::expr_shift_bin_op_t(token_ptr op) : expr_bin_op_t(op) {
@@ -1143,10 +1382,10 @@ expr_tern_op_t::expr_tern_op_t(token_ptr qm, token_ptr c) : question_mark(qm), c
 void expr_tern_op_t::print_l(ostream& os, int level) {
 	condition->print_l(os, level + 1);
 	print_level(os, level);
-	os << "?" << endl;
+	os << "?\n";
 	left->print_l(os, level + 1);
 	print_level(os, level);
-	os << ":" << endl;
+	os << ":\n";
 	right->print_l(os, level + 1);
 }
 
@@ -1215,6 +1454,21 @@ var_ptr expr_tern_op_t::eval() {
 	return condition->eval() ? left->eval() : right->eval();
 }
 
+int expr_tern_op_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	int res = bc.gen_cond(condition, false);
+	int else_label = bc.new_label();
+	int exit_label = bc.new_label();
+	bc.free_regs(res);
+	bc.jump(BC_JZ, else_label, res);
+	left->bc_gen_code(bc, keep_val);
+	bc.jump(BC_JMP, exit_label);
+	bc.insert_label(else_label);
+	bc.free_regs(res);
+	right->bc_gen_code(bc, keep_val);
+	bc.insert_label(exit_label);
+	return res;
+}
+
 //-----------------------------------ARRAY_INDEX-----------------------------------
 
 expr_arr_index_t::expr_arr_index_t(token_ptr sqr_bracket) : expr_t(true), sqr_bracket(sqr_bracket) {}
@@ -1222,7 +1476,7 @@ expr_arr_index_t::expr_arr_index_t(token_ptr sqr_bracket) : expr_t(true), sqr_br
 void expr_arr_index_t::print_l(ostream& os, int level) {
 	arr->print_l(os, level + 1);
 	print_level(os, level);
-	os << "[]" << endl;
+	os << "[]\n";
 	index->print_l(os, level + 1);
 }
 
@@ -1268,7 +1522,7 @@ void expr_arr_index_t::asm_get_addr(asm_cmd_list_ptr cmd_list) {
 	}
 	cmd_list->pop(AR_EBX);
 	mul_reg_to_elem_size(cmd_list, AR_EAX, static_pointer_cast<sym_type_array_t>(arr->get_type()->get_base_type())->get_elem_size());
-	cmd_list->add(AR_EAX, AR_EBX);
+	cmd_list->add(AR_EAX, AR_EBX, asm_gen_t::ptr_size());
 	//cmd_list->lea_rderef(AR_EAX, AR_EBX, AMT_DWORD, 0, AR_EAX, static_pointer_cast<sym_type_array_t>(arr->get_type()->get_base_type())->get_elem_size());
 }
 
@@ -1280,6 +1534,27 @@ void expr_arr_index_t::asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) {
 	}
 }
 
+int expr_arr_index_t::bc_get_addr(bc_builder_t& bc) {
+	int res = arr->bc_gen_code(bc, true);
+	int elem_size = get_ptr_elem_size(arr->get_type());
+	if (typeid(*index) == typeid(expr_const_t)) {
+		bc.emit(BC_ADDI, res, res, var_pointer_cast<int>(index->eval())->get_val() * elem_size);
+		return res;
+	}
+	int index_reg = index->bc_gen_code(bc, true);
+	if (elem_size > 1)
+		bc.emit(BC_MULI, index_reg, index_reg, elem_size);
+	bc.emit(BC_ADD, res, res, index_reg);
+	bc.free_regs(res + 1);
+	return res;
+}
+
+int expr_arr_index_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	int res = bc_get_addr(bc);
+	bc.load(res, res, get_type());
+	return res;
+}
+
 type_ptr expr_arr_index_t::get_type() {
 	return sym_type_ptr_t::dereference(arr->get_type());
 }
@@ -1296,10 +1571,10 @@ void expr_struct_access_t::print_l(ostream& os, int level) {
 	struct_expr->print_l(os, level + 1);
 	print_level(os, level);
 	op->short_print(os);
-	os << endl;
+	os << '\n';
 	print_level(os, level + 1);
 	member->get_token()->short_print(os);
-	os << endl;
+	os << '\n';
 }
 
 void expr_struct_access_t::short_print_l(ostream& os, int level) {
@@ -1351,6 +1626,20 @@ void expr_struct_access_t::asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val
 	member->asm_get_val(cmd_list);
 }
 
+int expr_struct_access_t::bc_get_addr(bc_builder_t& bc) {
+	int res = struct_expr->bc_gen_code(bc, true);
+	int offset = bc.member_offset(structure, member.get());
+	if (offset)
+		bc.emit(BC_ADDI, res, res, offset);
+	return res;
+}
+
+int expr_struct_access_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	int res = struct_expr->bc_gen_code(bc, true);
+	bc.load(res, res, get_type(), bc.member_offset(structure, member.get()));
+	return res;
+}
+
 type_ptr expr_struct_access_t::get_type() {
 	return member->get_type();
 }
@@ -1366,7 +1655,7 @@ expr_func_t::expr_func_t(token_ptr op) : brace(op) {}
 void expr_func_t::print_l(ostream &os, int level) {
 	func->print_l(os, level + 1);
 	print_level(os, level);
-	os << "()" << endl;
+	os << "()\n";
 	for (int i = 0; i < args.size(); i++)
 		args[i]->print_l(os, level + 1);
 }
@@ -1429,20 +1718,41 @@ void expr_func_t::asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) {
 		}
 			
 	}
-	cmd_list->call(asm_func_name);
+	_asm_call(cmd_list);
 	cmd_list->_free_in_stack(args_size);
 	cmd_list->pop(AR_EBP);
 	if (!keep_val && get_type() == ST_DOUBLE)
 		cmd_list->fdecstp();
 }
 
+int expr_func_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	int base = bc.new_reg();
+	bc.free_regs(base);
+	for each (auto arg in args)
+		arg->bc_gen_code(bc, true);
+	_bc_call(bc, base);
+	bc.free_regs(base + 1);
+	return base;
+}
+
 int expr_func_t::get_args_size() {
 	int res = 0;
 	for each (auto var in args)
-		res += asm_gen_t::alignment(var->get_type_size());
+		res += asm_gen_t::stack_alignment(var->get_type_size());
 	return res;
 }
 
+void expr_func_t::_asm_call(asm_cmd_list_ptr cmd_list) {
+	if (asm_gen_t::get_target() == AT_X64)
+		cmd_list->call(asm_func_name + '@' + _get_func_type()->asm_signature());
+	else
+		cmd_list->call(asm_func_name);
+}
+
+void expr_func_t::_bc_call(bc_builder_t& bc, int base) {
+	bc.call(dynamic_pointer_cast<sym_func_t>(dynamic_cast<expr_var_t*>(func)->get_var()), base);
+}
+
 pos_t expr_func_t::get_pos() {
 	return brace->get_pos();
 }
@@ -1453,6 +1763,23 @@ expr_reserved_func_t::expr_reserved_func_t(token_ptr op, char* asm_name) : expr_
 	asm_func_name = asm_name;
 }
 
+void expr_reserved_func_t::_asm_call(asm_cmd_list_ptr cmd_list) {
+	if (asm_gen_t::get_target() != AT_X64) {
+		expr_func_t::_asm_call(cmd_list);
+		return;
+	}
+	// Libc calls on x86-64 are marshalled from the stack slots into registers
+	// when lowering, so the call carries the result and argument classes.
+	string sig(1, get_type() == ST_VOID ? 'v' : get_type() == ST_PTR ? 'p' : 'i');
+	for each (auto arg in args)
+		sig += arg->get_type() == ST_DOUBLE ? 'd' : 'i';
+	cmd_list->call(asm_func_name + '@' + sig);
+}
+
+void expr_reserved_func_t::_bc_call(bc_builder_t& bc, int base) {
+	bc.call_builtin(asm_func_name, base, args.size());
+}
+
 #define CHECK_ARGS_FUNC_LIST
 #include "register_reserved_function.h"
 #undef CHECK_ARGS_FUNC_LIST
@@ -1479,7 +1806,7 @@ void expr_cast_t::print_l(ostream& os, int level) {
 	print_level(os, level);
 	os << "cast to (";
 	type->print(os);
-	os << ")(" << endl;
+	os << ")(\n";
 	expr->print_l(os, level + 1);
 	os << ')';
 }
@@ -1541,6 +1868,14 @@ void expr_cast_t::asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) {
 		expr->asm_gen_code(cmd_list, false);
 }
 
+int expr_cast_t::bc_gen_code(bc_builder_t& bc, bool keep_val) {
+	if (expr->get_type() == ST_ARRAY)
+		return expr->bc_get_addr(bc);
+	int res = expr->bc_gen_code(bc, keep_val);
+	bc.convert(res, expr->get_type(), type);
+	return res;
+}
+
 var_ptr expr_cast_t::eval() {
 	return
 		type == ST_CHAR ? var_cast<char>(expr->eval()) :
@@ -6,10 +6,13 @@
 #include <vector>
 #include "asm_generator.h"
 #include "var.h"
+#include "bytecode.h"
 
 void parser_expression_node_init();
 
 class expr_t : public node_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	bool lvalue;
 public:
@@ -19,15 +22,20 @@ public:
 	virtual type_ptr get_type() = 0;
 	virtual void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val);
 	virtual void asm_get_addr(asm_cmd_list_ptr cmd_list);
+	virtual int bc_gen_code(bc_builder_t& bc, bool keep_val);
+	virtual int bc_get_addr(bc_builder_t& bc);
 	virtual var_ptr eval(); //           
 	virtual int get_type_size();
 	static ASM_OPERATOR token_to_fp_op(token_ptr token);
 	static ASM_OPERATOR token_to_int_op(token_ptr token);
+	static BC_OPCODE token_to_bc_op(token_ptr token, bool fp);
 };
 
 //-------------CONSTANT------------
 
 class expr_const_t : public expr_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 	token_ptr constant;
 public:
 	expr_const_t(token_ptr constant_);
@@ -39,12 +47,16 @@ public:
 	bool is_null();
 	void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) override;
 	void asm_get_addr(asm_cmd_list_ptr cmd_list) override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
+	int bc_get_addr(bc_builder_t& bc) override;
 	var_ptr eval() override;
 };
 
 //------------VARIABLE_OR_FUNCTION----------
 
 class expr_var_t : public expr_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 	shared_ptr<sym_with_type_t> variable;
 	token_ptr var_token;
 public:
@@ -58,12 +70,16 @@ public:
 	pos_t get_pos();
 	void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) override;
 	void asm_get_addr(asm_cmd_list_ptr cmd_list) override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
+	int bc_get_addr(bc_builder_t& bc) override;
 	var_ptr eval() override;
 };
 
 //-----------------UNARY_OPERATORS-----------------
 
 class expr_un_op_t : public expr_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	expr_t* expr;
 	token_ptr op;
@@ -76,6 +92,7 @@ public:
 	void print_l(ostream& os, int level) override;
 	void short_print_l(ostream& os, int level) override;
 	void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 	expr_t* get_expr();
 	void set_operand(expr_t* operand);
 	token_ptr get_op();
@@ -96,6 +113,7 @@ class expr_get_addr_un_op_t : public expr_prefix_un_op_t {
 public:
 	expr_get_addr_un_op_t(token_ptr op);
 	void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 	type_ptr get_type() override;
 };
 
@@ -104,18 +122,22 @@ public:
 	expr_dereference_op_t(token_ptr op);
 	void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) override;
 	void asm_get_addr(asm_cmd_list_ptr cmd_list) override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
+	int bc_get_addr(bc_builder_t& bc) override;
 	type_ptr get_type();
 };
 
 class expr_prefix_inc_dec_op_t : public expr_prefix_un_op_t {
 public:
 	void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 	expr_prefix_inc_dec_op_t(token_ptr op);
 };
 
 class expr_prefix_add_sub_un_op_t : public expr_prefix_un_op_t {
 public:
 	void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 	expr_prefix_add_sub_un_op_t(token_ptr op);
 };
 
@@ -123,11 +145,13 @@ class expr_prefix_not_un_op_t : public expr_prefix_un_op_t {
 public:
 	expr_prefix_not_un_op_t(token_ptr op);
 	type_ptr get_type() override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 };
 
 class expr_prefix_bit_not_un_op_t : public expr_prefix_un_op_t {
 public:
 	void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 	expr_prefix_bit_not_un_op_t(token_ptr op);
 };
 
@@ -142,12 +166,15 @@ public:
 class expr_postfix_inc_dec_op_t : public expr_postfix_un_op_t {
 public:
 	void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 	expr_postfix_inc_dec_op_t(token_ptr op);
 };
 
 //---------------BINARY_OPERATORS-------------------
 
 class expr_bin_op_t : public expr_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	expr_t* left;
 	expr_t* right;
@@ -158,6 +185,7 @@ protected:
 	vector<bool(*)(expr_t** left, expr_t** right)> pre_check_type_convertions;
 	virtual void _asm_gen_code_int(asm_cmd_list_ptr cmd_list, bool keep_val);
 	virtual void _asm_gen_code_fp(asm_cmd_list_ptr cmd_list, bool keep_val);
+	virtual void _bc_gen_code_op(bc_builder_t& bc, int left_reg, int right_reg);
 public:
 	expr_bin_op_t(token_ptr op);
 	void print_l(ostream& os, int level) override;
@@ -170,6 +198,7 @@ public:
 	type_ptr get_type() override;
 	static expr_bin_op_t* make_bin_op(token_ptr op);
 	void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 	var_ptr eval() override;
 };
 
@@ -180,6 +209,7 @@ protected:
 	virtual void _asm_assign_fp_to_int(asm_cmd_list_ptr cmd_list, bool keep_val);
 public:
 	void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 	expr_base_assign_bin_op_t(token_ptr op);
 };
 
@@ -189,6 +219,7 @@ class expr_assign_bin_op_t : public expr_base_assign_bin_op_t {
 	void _asm_assign_fp_to_int(asm_cmd_list_ptr cmd_list, bool keep_val) override;
 public:
 	expr_assign_bin_op_t(token_ptr op);
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 };
 
 class expr_integer_bin_op_t : public expr_bin_op_t {
@@ -217,6 +248,7 @@ public:
 
 class expr_add_bin_op_t : public expr_arithmetic_bin_op_t {
 	void _asm_gen_code_int(asm_cmd_list_ptr cmd_list, bool keep_val) override;
+	void _bc_gen_code_op(bc_builder_t& bc, int left_reg, int right_reg) override;
 public:
 	expr_add_bin_op_t(token_ptr op);
 };
@@ -229,6 +261,7 @@ public:
 
 class expr_sub_bin_op_t : public expr_arithmetic_bin_op_t {
 	void _asm_gen_code_int(asm_cmd_list_ptr cmd_list, bool keep_val) override;
+	void _bc_gen_code_op(bc_builder_t& bc, int left_reg, int right_reg) override;
 public:
 	expr_sub_bin_op_t(token_ptr op);
 };
@@ -267,6 +300,7 @@ public:
 class expr_logical_bin_op_t : public expr_bin_op_t {
 public:
 	expr_logical_bin_op_t(token_ptr op);
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 };
 
 class expr_shift_bin_op_t : public expr_bin_op_t {
@@ -284,6 +318,8 @@ public:
 //---------------TERNARY_OPERATOR-------------------
 
 class expr_tern_op_t : public expr_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 	expr_t* condition;
 	expr_t* left;
 	expr_t* right;
@@ -300,6 +336,7 @@ public:
 	token_ptr get_colon_token();
 	void set_operands(expr_t* condition, expr_t* left, expr_t* right);
 	type_ptr get_type() override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 	pos_t get_pos() override;
 	var_ptr eval() override;
 };
@@ -307,6 +344,8 @@ public:
 //----------------ARRAY_INDEX----------------------
 
 class expr_arr_index_t : public expr_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 	expr_t* arr;
 	expr_t* index;
 	token_ptr sqr_bracket;
@@ -320,6 +359,8 @@ public:
 	void set_operands(expr_t* arr, expr_t* index);
 	void asm_get_addr(asm_cmd_list_ptr cmd_list) override;
 	void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) override;
+	int bc_get_addr(bc_builder_t& bc) override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 	type_ptr get_type() override;
 	pos_t get_pos();
 };
@@ -327,12 +368,16 @@ public:
 //----------------FUNCTION_CALL---------------
 
 class expr_func_t : public expr_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 	expr_t* func;
 	token_ptr brace;
 	shared_ptr<sym_type_func_t> _get_func_type();
 protected:
 	vector<expr_t*> args;
 	string asm_func_name;
+	virtual void _asm_call(asm_cmd_list_ptr cmd_list);
+	virtual void _bc_call(bc_builder_t& bc, int base);
 public:
 	expr_func_t(token_ptr op);
 	void print_l(ostream& os, int level) override;
@@ -340,6 +385,7 @@ public:
 	void set_operands(expr_t* f, vector<expr_t*> args_);
 	type_ptr get_type() override;
 	void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 	int get_args_size();
 	pos_t get_pos() override;
 };
@@ -347,6 +393,9 @@ public:
 //----------------RESERVED_FUNCTIONS---------------
 
 class expr_reserved_func_t : public expr_func_t {
+protected:
+	void _asm_call(asm_cmd_list_ptr cmd_list) override;
+	void _bc_call(bc_builder_t& bc, int base) override;
 public:
 	expr_reserved_func_t(token_ptr op, char* asm_name); //, void (*check_args_func)(vector<expr_t*> args), SYM_TYPE res_type
 	virtual void set_operands(vector<expr_t*> args) = 0;
@@ -365,6 +414,8 @@ type_ptr get_type() override;\
 //----------------STRUCT_ACCESS-------------------
 
 class expr_struct_access_t : public expr_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 	expr_t* struct_expr;
 	token_ptr op;
 	shared_ptr<sym_type_struct_t> structure;
@@ -379,6 +430,8 @@ public:
 	token_ptr get_member();
 	void asm_get_addr(asm_cmd_list_ptr cmd_list) override;
 	void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) override;
+	int bc_get_addr(bc_builder_t& bc) override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 	type_ptr get_type() override;
 	pos_t get_pos() override;
 };
@@ -386,6 +439,8 @@ public:
 //----------------CAST-------------------
 
 class expr_cast_t : public expr_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 	expr_t* expr;
 	type_ptr type;
 public: 
@@ -394,6 +449,7 @@ public:
 	void short_print_l(ostream& os, int level) override;
 	void set_operand(expr_t* expr, type_ptr type);
 	void asm_gen_code(asm_cmd_list_ptr cmd_list, bool keep_val) override;
+	int bc_gen_code(bc_builder_t& bc, bool keep_val) override;
 	type_ptr get_type() override;
 	pos_t get_pos() override;
 	var_ptr eval() override;
@@ -28,17 +28,21 @@ void statement_t::asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset) {
 
 void statement_t::asm_gen_exit_code(asm_cmd_list_ptr cmd_list) {}
 
+void statement_t::bc_gen_code(bc_builder_t& bc) {
+	assert(false);
+}
+
 void stmt_block_t::print_l(ostream& os, int level) {
-	os << '{' << endl;
+	os << '{' << '\n';
 	if (!sym_table->empty()) {
 		sym_table->print_l(os, level + 1);
 		if (!statements.empty())
-			os << endl;
+			os << '\n';
 	}
 	for each (auto var in statements) {
 		print_level(os, level + 1);
 		var->print_l(os, level + 1);
-		os << endl;
+		os << '\n';
 	}
 	print_level(os, level);
 	os << '}';
@@ -69,6 +73,14 @@ void stmt_block_t::asm_gen_exit_code(asm_cmd_list_ptr cmd_list) {
 	cmd_list->_free_in_stack(vars_size);
 }
 
+void stmt_block_t::bc_gen_code(bc_builder_t& bc) {
+	int frame = bc.frame();
+	bc.enter_block(sym_table);
+	for each (auto stmt in statements)
+		stmt->bc_gen_code(bc);
+	bc.exit_block(frame);
+}
+
 void stmt_block_t::add_statement(stmt_ptr stmt) {
 	statements.push_back(stmt);
 }
@@ -87,6 +99,10 @@ void stmt_expr_t::asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset) {
 	expression->asm_gen_code(cmd_list, false);
 }
 
+void stmt_expr_t::bc_gen_code(bc_builder_t& bc) {
+	bc.free_regs(expression->bc_gen_code(bc, false));
+}
+
 void stmt_decl_t::print_l(ostream& os, int level) {
 	os << "declaration: ";
 	symbol->short_print_l(os, level);
@@ -100,8 +116,8 @@ void stmt_if_t::asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset) {
 	} else
 		condition->asm_gen_code(cmd_list, true);
 	cmd_list->test(AR_EAX, AR_EAX);
-	asm_label_ptr else_label = cmd_list->_new_label();
-	asm_label_ptr exit_label = cmd_list->_new_label();
+	asm_label_t else_label = cmd_list->_new_label();
+	asm_label_t exit_label = cmd_list->_new_label();
 	if (then_stmt) {
 		cmd_list->jz(else_stmt ? else_label : exit_label);
 		then_stmt->asm_generate_code(cmd_list);
@@ -116,6 +132,21 @@ void stmt_if_t::asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset) {
 	cmd_list->_insert_label(exit_label);
 }
 
+void stmt_if_t::bc_gen_code(bc_builder_t& bc) {
+	int cond = bc.gen_cond(condition, false);
+	bc.free_regs(cond);
+	int else_label = bc.new_label();
+	int exit_label = bc.new_label();
+	bc.jump(BC_JZ, else_label, cond);
+	if (then_stmt)
+		then_stmt->bc_gen_code(bc);
+	bc.jump(BC_JMP, exit_label);
+	bc.insert_label(else_label);
+	if (else_stmt)
+		else_stmt->bc_gen_code(bc);
+	bc.insert_label(exit_label);
+}
+
 void stmt_if_t::print_l(ostream& os, int level) {
 	short_print_l(os, level);
 	os << " (";
@@ -123,7 +154,7 @@ void stmt_if_t::print_l(ostream& os, int level) {
 	os << ") ";
 	if (then_stmt) {
 		if (typeid(*then_stmt.get()) != typeid(stmt_block_t)) {
-			os << endl;
+			os << '\n';
 			print_level(os, level + 1);
 			then_stmt->print_l(os, level + 1);
 		} else
@@ -132,13 +163,13 @@ void stmt_if_t::print_l(ostream& os, int level) {
 		os << ';';
 	if (else_stmt) {
 		if (typeid(*then_stmt.get()) != typeid(stmt_block_t)) {
-			os << endl;
+			os << '\n';
 			print_level(os, level);
 		} else
 			os << ' ';
 		os << "else ";
 		if (typeid(*else_stmt.get()) != typeid(stmt_block_t)) {
-			os << endl;
+			os << '\n';
 			print_level(os, level + 1);
 			else_stmt->print_l(os, level + 1);
 		} else 
@@ -168,19 +199,27 @@ void stmt_loop_t::asm_gen_jmp_to_exit_loop(asm_cmd_list_ptr cmd_list) {
 	cmd_list->jmp(exit_loop_label);
 }
 
+void stmt_loop_t::bc_gen_jmp_to_loop(bc_builder_t& bc) {
+	bc.jump(BC_JMP, bc_loop_label);
+}
+
+void stmt_loop_t::bc_gen_jmp_to_exit_loop(bc_builder_t& bc) {
+	bc.jump(BC_JMP, bc_exit_loop_label);
+}
+
 void stmt_while_t::print_l(ostream& os, int level) {
 	os << " (";
 	condition->short_print(os);
 	os << ") ";
 	if (stmt) {
 		if (typeid(*stmt.get()) != typeid(stmt_block_t)) {
-			os << endl;
+			os << '\n';
 			print_level(os, level + 1);
 			stmt->print_l(os, level + 1);
 		} else
 			stmt->print_l(os, level);
 	} else
-		os << ';' << endl;
+		os << ';' << '\n';
 }
 
 void stmt_while_t::asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset) {
@@ -198,6 +237,19 @@ void stmt_while_t::asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset)
 	cmd_list->_insert_label(exit_loop_label);
 }
 
+void stmt_while_t::bc_gen_code(bc_builder_t& bc) {
+	bc_loop_label = bc.new_label();
+	bc_exit_loop_label = bc.new_label();
+	bc.insert_label(bc_loop_label);
+	int cond = bc.gen_cond(condition, false);
+	bc.free_regs(cond);
+	bc.jump(BC_JZ, bc_exit_loop_label, cond);
+	if (stmt)
+		stmt->bc_gen_code(bc);
+	bc.jump(BC_JMP, bc_loop_label);
+	bc.insert_label(bc_exit_loop_label);
+}
+
 stmt_do_while_t::stmt_do_while_t() : stmt_while_t(0) {}
 
 void stmt_do_while_t::set_condition(expr_t* condition_) {
@@ -217,6 +269,20 @@ void stmt_do_while_t::asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offse
 	exit_loop_label = cmd_list->_insert_new_label();
 }
 
+void stmt_do_while_t::bc_gen_code(bc_builder_t& bc) {
+	int body_label = bc.new_label();
+	bc_loop_label = bc.new_label();
+	bc_exit_loop_label = bc.new_label();
+	bc.insert_label(body_label);
+	if (stmt)
+		stmt->bc_gen_code(bc);
+	bc.insert_label(bc_loop_label);
+	int cond = bc.gen_cond(condition, false);
+	bc.free_regs(cond);
+	bc.jump(BC_JNZ, body_label, cond);
+	bc.insert_label(bc_exit_loop_label);
+}
+
 void stmt_for_t::print_l(ostream& os, int level) {
 	short_print_l(os, level);
 	os << " (";
@@ -231,13 +297,13 @@ void stmt_for_t::print_l(ostream& os, int level) {
 	os << ") ";
 	if (stmt) {
 		if (typeid(*stmt.get()) != typeid(stmt_block_t)) {
-			os << endl;
+			os << '\n';
 			print_level(os, level + 1);
 			stmt->print_l(os, level + 1);
 		} else
 			stmt->print_l(os, level);
 	} else
-		os << ';' << endl;
+		os << ';' << '\n';
 }
 
 void stmt_for_t::asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset) {
@@ -253,14 +319,43 @@ void stmt_for_t::asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset) {
 	cmd_list->_insert_label(exit_loop_label);
 }
 
+void stmt_for_t::bc_gen_code(bc_builder_t& bc) {
+	int cond_label = bc.new_label();
+	bc_loop_label = bc.new_label();
+	bc_exit_loop_label = bc.new_label();
+	if (init_expr)
+		bc.free_regs(init_expr->bc_gen_code(bc, false));
+	bc.insert_label(cond_label);
+	if (condition) {
+		int cond = bc.gen_cond(condition, false);
+		bc.free_regs(cond);
+		bc.jump(BC_JZ, bc_exit_loop_label, cond);
+	}
+	if (stmt)
+		stmt->bc_gen_code(bc);
+	bc.insert_label(bc_loop_label);
+	if (expr)
+		bc.free_regs(expr->bc_gen_code(bc, false));
+	bc.jump(BC_JMP, cond_label);
+	bc.insert_label(bc_exit_loop_label);
+}
+
 void stmt_break_t::asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset) {
 	parent->asm_gen_jmp_to_exit_loop(cmd_list);
 }
 
+void stmt_break_t::bc_gen_code(bc_builder_t& bc) {
+	parent->bc_gen_jmp_to_exit_loop(bc);
+}
+
 void stmt_continue_t::asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset) {
 	parent->asm_gen_jmp_to_loop(cmd_list);
 }
 
+void stmt_continue_t::bc_gen_code(bc_builder_t& bc) {
+	parent->bc_gen_jmp_to_loop(bc);
+}
+
 void stmt_return_t::set_ret_expr(expr_t* expr_) {
 	auto func_type = parent->get_func_type();
 	expr = auto_convert(expr_, func_type->get_element_type());
@@ -271,3 +366,9 @@ void stmt_return_t::asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset)
 	cmd_list->mov(AR_ESP, AR_EBP);
 	cmd_list->ret();
 }
+
+void stmt_return_t::bc_gen_code(bc_builder_t& bc) {
+	int res = expr->bc_gen_code(bc, true);
+	bc.emit(BC_RET, res);
+	bc.free_regs(res);
+}
\ No newline at end of file
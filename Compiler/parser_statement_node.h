@@ -30,9 +30,12 @@ public:
 	virtual void asm_gen_entry_code(asm_cmd_list_ptr cmd_list, int offset = 0);
 	virtual void asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset = 0);
 	virtual void asm_gen_exit_code(asm_cmd_list_ptr cmd_list);
+	virtual void bc_gen_code(bc_builder_t& bc);
 };
 
 class stmt_block_t : public statement_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 	vector<stmt_ptr> statements;
 	sym_table_ptr sym_table;
 	int vars_size;
@@ -46,17 +49,23 @@ public:
 	void asm_gen_entry_code(asm_cmd_list_ptr cmd_list, int offset = 0);
 	void asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset = 0);
 	void asm_gen_exit_code(asm_cmd_list_ptr cmd_list);
+	void bc_gen_code(bc_builder_t& bc) override;
 };
 
 class stmt_expr_t : public statement_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 	expr_t* expression;
 public:
 	stmt_expr_t(expr_t* expression);
 	void print_l(ostream& os, int level) override;
 	void asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset = 0) override;
+	void bc_gen_code(bc_builder_t& bc) override;
 };
 
 class stmt_decl_t : public statement_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 	sym_ptr symbol;
 public:
 	stmt_decl_t(sym_ptr symbol);
@@ -75,6 +84,8 @@ inline void stmt_named_t<T>::short_print_l(ostream& os, int level) {
 }
 
 class stmt_if_t : public stmt_named_t<T_KWRD_IF> {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 	expr_t* condition;
 	stmt_ptr then_stmt;
 	stmt_ptr else_stmt;
@@ -82,14 +93,19 @@ public:
 	stmt_if_t(expr_t* condition, stmt_ptr then_stmt);
 	stmt_if_t(expr_t* condition, stmt_ptr then_stmt, stmt_ptr else_stmt);
 	void asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset = 0) override;
+	void bc_gen_code(bc_builder_t& bc) override;
 	void print_l(ostream& os, int level) override;
 };
 
 class stmt_loop_t : public virtual statement_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	stmt_ptr stmt;
-	asm_label_ptr loop_label;
-	asm_label_ptr exit_loop_label;
+	asm_label_t loop_label;
+	asm_label_t exit_loop_label;
+	int bc_loop_label;
+	int bc_exit_loop_label;
 public:
 	stmt_loop_t(stmt_ptr stmt);
 	stmt_loop_t();
@@ -98,9 +114,13 @@ public:
 	void asm_gen_exit_code(asm_cmd_list_ptr cmd_list) override;
 	void asm_gen_jmp_to_loop(asm_cmd_list_ptr cmd_list);
 	void asm_gen_jmp_to_exit_loop(asm_cmd_list_ptr cmd_list);
+	void bc_gen_jmp_to_loop(bc_builder_t& bc);
+	void bc_gen_jmp_to_exit_loop(bc_builder_t& bc);
 };
 
 class stmt_while_t : public stmt_loop_t, public stmt_named_t<T_KWRD_WHILE> {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	expr_t* condition;
 public:
@@ -108,6 +128,7 @@ public:
 	stmt_while_t(expr_t* condition);
 	void print_l(ostream& os, int level) override;
 	void asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset = 0) override;
+	void bc_gen_code(bc_builder_t& bc) override;
 };
 
 class stmt_do_while_t : public stmt_while_t {
@@ -115,9 +136,12 @@ public:
 	stmt_do_while_t();
 	void set_condition(expr_t* condition);
 	void asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset = 0) override;
+	void bc_gen_code(bc_builder_t& bc) override;
 };
 
 class stmt_for_t : public stmt_loop_t, public stmt_named_t<T_KWRD_FOR> {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 	expr_t* init_expr;
 	expr_t* condition;
 	expr_t* expr;
@@ -126,10 +150,13 @@ public:
 	stmt_for_t(expr_t* init_expr, expr_t* condition, expr_t* expr);
 	void print_l(ostream& os, int level) override;
 	void asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset = 0) override;
+	void bc_gen_code(bc_builder_t& bc) override;
 };
 
 template<TOKEN T, typename pT> 
 class stmt_jump_t : public stmt_named_t<T> {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	pT parent;
 public:
@@ -151,18 +178,23 @@ class stmt_break_t : public stmt_jump_t<T_KWRD_BREAK, shared_ptr<stmt_loop_t>> {
 public:
 	using stmt_jump_t<T_KWRD_BREAK, shared_ptr<stmt_loop_t>>::stmt_jump_t;
 	void asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset);
+	void bc_gen_code(bc_builder_t& bc);
 };
 
 class stmt_continue_t : public stmt_jump_t<T_KWRD_CONTINUE, shared_ptr<stmt_loop_t>> {
 public:
 	using stmt_jump_t<T_KWRD_CONTINUE, shared_ptr<stmt_loop_t>>::stmt_jump_t;
 	void asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset);
+	void bc_gen_code(bc_builder_t& bc);
 };
 
 class stmt_return_t : public stmt_jump_t<T_KWRD_RETURN, shared_ptr<sym_func_t>> {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 	expr_t* expr;
 public:
 	using stmt_jump_t<T_KWRD_RETURN, shared_ptr<sym_func_t>>::stmt_jump_t;
 	void set_ret_expr(expr_t* expr);
 	void asm_gen_internal_code(asm_cmd_list_ptr cmd_list, int offset = 0) override;
+	void bc_gen_code(bc_builder_t& bc) override;
 };
@@ -3,6 +3,7 @@
 #include "parser.h"
 #include "type_conversion.h"
 #include "asm_generator.h"
+#include "type_table.h"
 #include <vector>
 #include <map>
 
@@ -63,7 +64,9 @@ symbol_t::symbol_t(SYM_TYPE symbol_type) : symbol_type(symbol_type) {}
 symbol_t::symbol_t(SYM_TYPE symbol_type, token_ptr token) : symbol_type(symbol_type), token(token) {}
 
 void symbol_t::update_name() {
-	name = _get_name();
+	string new_name = _get_name();
+	if (new_name != name)
+		name = new_name;
 }
 
 const string& symbol_t::get_name() const {
@@ -99,7 +102,8 @@ token_ptr symbol_t::get_token() {
 }
 
 void symbol_t::set_token(token_ptr token_) {
-	token = token_;
+	if (token.get() != token_.get())
+		token = token_;
 }
 
 void symbol_t::short_print_l(ostream& os, int level) {
@@ -116,7 +120,11 @@ TOKEN symbol_t::sym_type_to_token(SYM_TYPE st) {
 
 //--------------------------------BASE_TYPE-------------------------------
 
-type_base_t::type_base_t() : symbol_t(ST_VOID) {}
+type_base_t::type_base_t() : symbol_t(ST_VOID), canon(nullptr) {}
+
+type_base_t* type_base_t::canonical() {
+	return type_table_t::canonical(this);
+}
 
 bool type_base_t::completed() {
 	return true;
@@ -156,11 +164,11 @@ string type_t::_get_name() const {
 	return type->get_name();
 }
 
-type_t::type_t(type_base_ptr type_) : symbol_t(ST_QL) {
+type_t::type_t(type_base_ptr type_) : symbol_t(ST_QL), size(-1) {
 	set_base_type(type_);
 }
 
-type_t::type_t(type_base_ptr type_, bool is_const) : symbol_t(ST_QL) {
+type_t::type_t(type_base_ptr type_, bool is_const) : symbol_t(ST_QL), size(-1) {
 	set_base_type(type_);
 	_is_const = is_const;
 }
@@ -190,6 +198,8 @@ void type_t::set_base_type(type_base_ptr type_) {
 	type = type_;
 	set_token(type->get_token());
 	name = type->get_name();
+	canon = nullptr;
+	size = -1;
 }
 
 bool type_t::completed() {
@@ -204,8 +214,19 @@ bool type_t::is(type_ptr type_) const {
 	return type_base_t::is(type);
 }
 
+// The size lives on the canonical node, so every copy of a type shares one computation.
+// Incomplete types are not cached, arrays and structs can still be completed later
 int type_t::get_size() {
-	return type->get_size();
+	type_t* res = static_cast<type_t*>(canonical());
+	if (res != this)
+		return res->get_size();
+	int cached = size.load(memory_order_relaxed);
+	if (cached >= 0)
+		return cached;
+	cached = type->get_size();
+	if (completed())
+		size.store(cached, memory_order_relaxed);
+	return cached;
 }
 
 bool type_t::is_const() {
@@ -222,6 +243,7 @@ bool type_t::is_arithmetic() {
 
 void type_t::set_is_const(bool is_const) {
 	_is_const = is_const;
+	canon = nullptr;
 }
 
 token_ptr type_t::get_token() {
@@ -256,6 +278,7 @@ updatable_base_type_t::updatable_base_type_t() : symbol_t(ST_VOID) {}
 
 void updatable_base_type_t::set_element_type(type_ptr type) {
 	elem_type = type;
+	canon = nullptr;
 }
 
 type_ptr updatable_base_type_t::get_element_type() {
@@ -428,7 +451,7 @@ void sym_global_var_t::asm_register(asm_gen_ptr gen) {
 		cmd_list->mov(asm_get_name(), asm_gen_t::reg_by_size(AR_EAX, get_type_size()));
 	} else if (type == ST_STRUCT || type == ST_ARRAY)
 		dup = asm_gen_t::alignment(type->get_size() / asm_gen_t::size_of(AMT_DWORD));
-	gen->add_global_var(asm_get_name(), type == ST_DOUBLE ? AMT_QWORD : AMT_DWORD, cmd_list, dup);
+	gen->add_global_var(asm_get_name(), type == ST_DOUBLE || type == ST_PTR ? asm_gen_t::mtype_by_size(get_type_size()) : AMT_DWORD, cmd_list, dup);
 }
 
 void sym_global_var_t::asm_get_addr(asm_cmd_list_ptr cmd_list) {
@@ -444,7 +467,7 @@ void sym_global_var_t::asm_get_val(asm_cmd_list_ptr cmd_list) {
 	} else if (type == ST_DOUBLE)
 		cmd_list->fld(asm_get_name());
 	else
-		cmd_list->mov(AR_EAX, asm_get_name());
+		cmd_list->mov(AR_EAX, asm_get_name(), type == ST_PTR ? get_type_size() : 0);
 }
 
 //--------------------------------SYMBOL_LOCAL_VAR--------------------------------
@@ -517,7 +540,7 @@ sym_type_ptr_t::sym_type_ptr_t() : symbol_t(ST_PTR) {
 }
 
 int sym_type_ptr_t::get_size() {
-	return sizeof(void*);
+	return asm_gen_t::ptr_size();
 }
 
 string sym_type_ptr_t::_get_name() const {
@@ -547,7 +570,7 @@ type_ptr sym_type_ptr_t::make_ptr(type_ptr type, bool is_const) {
 
 //--------------------------------SYMBOL_TYPE_ARRAY-------------------------------
 
-sym_type_array_t::sym_type_array_t(expr_t* size_expr) : symbol_t(ST_ARRAY), size_expr(size_expr) {
+sym_type_array_t::sym_type_array_t(expr_t* size_expr) : symbol_t(ST_ARRAY), size_expr(size_expr), len(0) {
 	if (size_expr)
 		if (!size_expr->get_type()->is_integer())
 			throw SemanticError("Size of array has non-integer type", size_expr->get_pos());
@@ -569,7 +592,10 @@ int sym_type_array_t::get_len() {
 
 string sym_type_array_t::_get_name() const {
 	elem_type->update_name();
-	return token_t::get_name_by_id(T_SQR_BRACKET_OPEN) + token_t::get_name_by_id(T_SQR_BRACKET_CLOSE) + elem_type->get_name();
+	string res = token_t::get_name_by_id(T_SQR_BRACKET_OPEN);
+	if (len)
+		res += to_string(len);
+	return res + token_t::get_name_by_id(T_SQR_BRACKET_CLOSE) + elem_type->get_name();
 }
 
 void sym_type_array_t::print_l(ostream& os, int level) {
@@ -586,6 +612,7 @@ bool sym_type_array_t::completed() {
 
 void sym_type_array_t::set_len(size_t len_) {
 	len = len_;
+	canon = nullptr;
 }
 
 type_ptr sym_type_array_t::get_element_type() {
@@ -605,6 +632,7 @@ void sym_type_array_t::set_element_type(type_ptr type) {
 		throw SemanticError("Array type has incomplete element type", type->get_token()->get_pos());
 
 	elem_type = type;
+	canon = nullptr;
 }
 
 //--------------------------------SYMBOL_TYPE_FUNC-------------------------------
@@ -633,6 +661,7 @@ string sym_type_func_t::_get_name() const {
 
 void sym_type_func_t::set_arg_types(const vector<type_ptr> &at) {
 	arg_types = at;
+	canon = nullptr;
 }
 
 vector<type_ptr> sym_type_func_t::get_arg_types() {
@@ -642,7 +671,20 @@ vector<type_ptr> sym_type_func_t::get_arg_types() {
 int sym_type_func_t::get_args_size() {
 	int res = 0;
 	for each (auto arg in arg_types)
-		res += asm_gen_t::alignment(arg->get_size());
+		res += asm_gen_t::stack_alignment(arg->get_size());
+	return res;
+}
+
+// Result class followed by a class per argument: 'v'oid, 'i'nteger, 'p'ointer, 'd'ouble,
+// and an 'm' for every stack slot of a structure, which is always passed in memory
+string sym_type_func_t::asm_signature() {
+	string res(1, elem_type == ST_VOID ? 'v' : elem_type == ST_DOUBLE ? 'd' : elem_type == ST_PTR || elem_type == ST_STRUCT ? 'p' : 'i');
+	for each (auto arg in arg_types) {
+		if (arg == ST_STRUCT)
+			res += string(asm_gen_t::stack_alignment(arg->get_size()) / asm_gen_t::ptr_size(), 'm');
+		else
+			res += arg == ST_DOUBLE ? 'd' : arg == ST_PTR ? 'p' : 'i';
+	}
 	return res;
 }
 
@@ -655,6 +697,7 @@ void sym_type_func_t::set_element_type(type_ptr type) {
 		throw SemanticError("Function can't return function", type->get_token()->get_pos());
 
 	elem_type = type;
+	canon = nullptr;
 }
 
 void sym_type_func_t::print_l(ostream& os, int level) {
@@ -686,6 +729,14 @@ stmt_ptr sym_func_t::get_block() {
 	return block;
 }
 
+void sym_func_t::set_source(string source_) {
+	source = source_;
+}
+
+const string& sym_func_t::get_source() {
+	return source;
+}
+
 void sym_func_t::set_sym_table(sym_table_ptr sym_table_) {
 	sym_table = sym_table_;
 }
@@ -726,12 +777,12 @@ void sym_func_t::asm_generate_code(asm_cmd_list_ptr cmd_list) {
 void sym_func_t::asm_set_offset() {
 	if (!sym_table)
 		throw FuncNotDefined(sym_ptr(this));
-	int offset = 4;
+	int offset = asm_gen_t::ptr_size();
 	for each (auto var in *sym_table) {
 		if (var == ST_VAR) {
 			auto local_var = dynamic_pointer_cast<sym_local_var_t>(var);
 			local_var->asm_set_offset(offset, AR_EBP);
-			offset += max(4, asm_gen_t::alignment(local_var->get_type_size()));
+			offset += max(asm_gen_t::ptr_size(), asm_gen_t::stack_alignment(local_var->get_type_size()));
 		}
 	}
 }
@@ -784,11 +835,11 @@ bool type_ptr::operator!=(SYM_TYPE sym_type) const {
 }
 
 bool type_ptr::operator==(type_ptr type) const {
-	return (*this)->equal(type);
+	return get() == type.get() || get() && type && get()->canonical() == type->canonical();
 }
 
 bool type_ptr::operator!=(type_ptr type) const {
-	return (*this)->unequal(type);
+	return !(*this == type);
 }
 
 bool type_base_ptr::operator==(SYM_TYPE sym_type) const {
@@ -800,11 +851,19 @@ bool type_base_ptr::operator!=(SYM_TYPE sym_type) const {
 }
 
 bool type_base_ptr::operator==(type_ptr type) const {
-	return (*this)->equal(type);
+	return get() && type && get()->canonical() == type->canonical();
 }
 
 bool type_base_ptr::operator!=(type_ptr type) const {
-	return (*this)->unequal(type);
+	return !(*this == type);
+}
+
+bool type_base_ptr::operator==(type_base_ptr type) const {
+	return get() == type.get() || get() && type && get()->canonical() == type->canonical();
+}
+
+bool type_base_ptr::operator!=(type_base_ptr type) const {
+	return !(*this == type);
 }
 
 //--------------------------------SYMBOL_STRUCT-------------------------------
@@ -851,7 +910,7 @@ void sym_type_struct_t::print_l(ostream& os, int level) {
 	if (sym_table) {
 		os << " {";
 		if (!sym_table->empty()) {
-			os << endl;
+			os << '\n';
 			sym_table->short_print_l(os, level + 1);
 			print_level(os, level);
 		}
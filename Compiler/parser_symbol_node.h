@@ -2,6 +2,7 @@
 #include "tokens.h"
 #include "parser_base_node.h"
 #include <vector>
+#include <atomic>
 #include "asm_generator.h"
 
 enum SYM_TYPE {
@@ -53,9 +54,13 @@ public:
 	bool operator!=(SYM_TYPE sym_type) const;
 	bool operator==(type_ptr type) const;
 	bool operator!=(type_ptr type) const;
+	bool operator==(type_base_ptr type) const;
+	bool operator!=(type_base_ptr type) const;
 };
 
 class symbol_t : public node_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	virtual string _get_name() const = 0;
 	string name;
@@ -86,8 +91,12 @@ template<> struct less<sym_ptr> {
 };
 
 class type_base_t : public virtual symbol_t {
+	friend class type_table_t;
+protected:
+	atomic<type_base_t*> canon;
 public:
 	type_base_t();
+	type_base_t* canonical();
 	virtual bool completed();
 	static type_base_ptr make_type(SYM_TYPE s);
 	virtual int get_size();
@@ -99,6 +108,8 @@ public:
 };
 
 class updatable_base_type_t : public type_base_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	type_ptr elem_type;
 public:
@@ -109,10 +120,13 @@ public:
 };
 
 class type_t : public type_base_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	type_base_ptr type;
 	virtual string _get_name() const override;
 	bool _is_const = false;
+	atomic<int> size;
 public:
 	type_t(type_base_ptr type);
 	type_t(type_base_ptr type, bool is_const);
@@ -137,6 +151,8 @@ public:
 };
 
 class sym_with_type_t : public virtual symbol_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	type_ptr type;
 	string _get_name() const override;
@@ -149,6 +165,8 @@ public:
 };
 
 class sym_var_t : public sym_with_type_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	vector<expr_t*> init_list;
 public:
@@ -189,6 +207,8 @@ public:
 };
 
 class sym_type_str_literal_t : public sym_built_in_type {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	token_ptr str;
 public:
@@ -234,6 +254,8 @@ public:
 };
 
 class sym_type_array_t : public updatable_base_type_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	expr_t* size_expr;
 	size_t len;
@@ -252,6 +274,8 @@ public:
 };
 
 class sym_type_struct_t : public type_base_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	sym_table_ptr sym_table;
 	token_ptr identifier;
@@ -269,6 +293,8 @@ public:
 };
 
 class sym_type_func_t : public updatable_base_type_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	vector<type_ptr> arg_types;
 	string _get_name() const override;
@@ -278,19 +304,25 @@ public:
 	void set_arg_types(const vector<type_ptr> &at);
 	vector<type_ptr> get_arg_types();
 	int get_args_size();
+	string asm_signature();
 	void set_element_type(type_ptr type) override;
 	void print_l(ostream& os, int level) override;
 };
 
 class sym_func_t : public sym_with_type_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	stmt_ptr block;
 	sym_table_ptr sym_table;
+	string source;
 public:
 	sym_func_t(token_ptr ident, shared_ptr<sym_type_func_t> func_type, sym_table_ptr sym_table);
 	shared_ptr<sym_type_func_t> get_func_type();
 	void set_block(stmt_ptr b);
 	stmt_ptr get_block();
+	void set_source(string source_);
+	const string& get_source();
 	void set_sym_table(sym_table_ptr sym_table);
 	sym_table_ptr get_sym_table();
 	void clear_sym_table();
@@ -0,0 +1,196 @@
+#include "phase_report.h"
+#include <iomanip>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <malloc.h>
+
+#ifdef _WIN32
+#define block_size _msize
+#else
+#define block_size malloc_usable_size
+#endif
+
+static thread_local long long thread_allocs = 0;
+static thread_local long long thread_bytes = 0;
+static thread_local int timers_depth = 0;
+static atomic<long long> live_bytes(0);
+static atomic<long long> peak_bytes(0);
+static atomic<bool> tracking(false);
+
+// Accounting costs every allocation of the compiler, so it stays off unless a report asks for it.
+// It can only be switched on at process start: a block allocated before would be subtracted on free
+// without ever having been added
+void* operator new(size_t size) {
+	if (!tracking.load(memory_order_relaxed)) {
+		void* p = malloc(size ? size : 1);
+		if (!p)
+			throw bad_alloc();
+		return p;
+	}
+	thread_allocs++;
+	thread_bytes += size;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw bad_alloc();
+	long long live = live_bytes += block_size(p);
+	long long peak = peak_bytes;
+	while (live > peak && !peak_bytes.compare_exchange_weak(peak, live));
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	if (!p)
+		return;
+	if (tracking.load(memory_order_relaxed))
+		live_bytes -= block_size(p);
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	operator delete(p);
+}
+
+void enable_memory_tracking() {
+	tracking.store(true, memory_order_relaxed);
+}
+
+bool memory_tracking_enabled() {
+	return tracking.load(memory_order_relaxed);
+}
+
+long long allocations_count() {
+	return thread_allocs;
+}
+
+long long allocated_bytes() {
+	return thread_bytes;
+}
+
+long long peak_memory() {
+	return peak_bytes;
+}
+
+void reset_peak_memory() {
+	peak_bytes = live_bytes.load();
+}
+
+phase_report_t::phase_report_t() : owner(this_thread::get_id()), worker_allocs(0), worker_bytes(0) {}
+
+long long phase_report_t::allocs() {
+	lock_guard<mutex> lock(report_mutex);
+	return allocations_count() + worker_allocs;
+}
+
+long long phase_report_t::bytes() {
+	lock_guard<mutex> lock(report_mutex);
+	return allocated_bytes() + worker_bytes;
+}
+
+void phase_report_t::add_worker(long long allocs, long long bytes) {
+	lock_guard<mutex> lock(report_mutex);
+	worker_allocs += allocs;
+	worker_bytes += bytes;
+}
+
+int phase_report_t::add(string name, int depth) {
+	lock_guard<mutex> lock(report_mutex);
+	phase_t phase = { name, depth, 0, 0, 0 };
+	phases.push_back(phase);
+	return phases.size() - 1;
+}
+
+void phase_report_t::set(int id, double time, long long allocs, long long bytes) {
+	lock_guard<mutex> lock(report_mutex);
+	phases[id].time = time;
+	phases[id].allocs = allocs;
+	phases[id].bytes = bytes;
+}
+
+void phase_report_t::add_to(int id, double time, long long allocs, long long bytes) {
+	lock_guard<mutex> lock(report_mutex);
+	phases[id].time += time;
+	phases[id].allocs += allocs;
+	phases[id].bytes += bytes;
+}
+
+void phase_report_t::count(string name, long long value) {
+	lock_guard<mutex> lock(report_mutex);
+	for each (auto& c in counters)
+		if (c.first == name) {
+			c.second += value;
+			return;
+		}
+	counters.push_back(make_pair(name, value));
+}
+
+const vector<phase_t>& phase_report_t::get_phases() {
+	return phases;
+}
+
+const vector<pair<string, long long>>& phase_report_t::get_counters() {
+	return counters;
+}
+
+void phase_report_t::print(ostream& os) {
+	lock_guard<mutex> lock(report_mutex);
+	os << std::left << setw(32) << "phase" << std::right << setw(12) << "time (ms)" << setw(12) << "allocs" << setw(12) << "KB" << endl;
+	for each (auto& p in phases)
+		os << std::left << setw(32) << string(p.depth * 2, ' ') + p.name << std::right << fixed << setprecision(3)
+			<< setw(12) << p.time * 1000 << setw(12) << p.allocs << setw(12) << p.bytes / 1024 << endl;
+	for each (auto& c in counters)
+		os << std::left << setw(32) << c.first << std::right << setw(12) << c.second << endl;
+}
+
+static string json_str(const string& s) {
+	string res = "\"";
+	for each (char c in s) {
+		if (c == '"' || c == '\\')
+			res += '\\';
+		res += c;
+	}
+	return res + '"';
+}
+
+void phase_report_t::print_json(ostream& os) {
+	lock_guard<mutex> lock(report_mutex);
+	os << "{\"phases\": [";
+	for (int i = 0; i < phases.size(); i++)
+		os << (i ? ", " : "") << "{\"name\": " << json_str(phases[i].name) << ", \"depth\": " << phases[i].depth << ", \"time_ms\": "
+			<< fixed << setprecision(3) << phases[i].time * 1000 << ", \"allocs\": " << phases[i].allocs << ", \"bytes\": " << phases[i].bytes << "}";
+	os << "], \"counters\": {";
+	for (int i = 0; i < counters.size(); i++)
+		os << (i ? ", " : "") << json_str(counters[i].first) << ": " << counters[i].second;
+	os << "}}" << endl;
+}
+
+// named phases run on the report's thread and include the allocations of worker threads,
+// timers of pre-added rows measure a single task on the current thread
+phase_timer_t::phase_timer_t(phase_report_t* report, string name, int depth) :
+	report(report), id(report ? report->add(name, depth) : -1), accumulate(false), wall(true), start(chrono::steady_clock::now()),
+	allocs(report ? report->allocs() : 0), bytes(report ? report->bytes() : 0)
+{
+	timers_depth++;
+}
+
+phase_timer_t::phase_timer_t(phase_report_t* report, int id, bool accumulate) :
+	report(report), id(id), accumulate(accumulate), wall(false), start(chrono::steady_clock::now()),
+	allocs(allocations_count()), bytes(allocated_bytes())
+{
+	timers_depth++;
+}
+
+phase_timer_t::~phase_timer_t() {
+	timers_depth--;
+	if (!report)
+		return;
+	double time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	long long phase_allocs = (wall ? report->allocs() : allocations_count()) - allocs;
+	long long phase_bytes = (wall ? report->bytes() : allocated_bytes()) - bytes;
+	if (accumulate)
+		report->add_to(id, time, phase_allocs, phase_bytes);
+	else
+		report->set(id, time, phase_allocs, phase_bytes);
+	if (!timers_depth && this_thread::get_id() != report->owner)
+		report->add_worker(phase_allocs, phase_bytes);
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <ostream>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+void enable_memory_tracking();
+bool memory_tracking_enabled();
+long long allocations_count();
+long long allocated_bytes();
+long long peak_memory();
+void reset_peak_memory();
+
+struct phase_t {
+	string name;
+	int depth;
+	double time;
+	long long allocs;
+	long long bytes;
+};
+
+class phase_report_t {
+	friend class phase_timer_t;
+	vector<phase_t> phases;
+	vector<pair<string, long long>> counters;
+	mutex report_mutex;
+	thread::id owner;
+	long long worker_allocs;
+	long long worker_bytes;
+public:
+	phase_report_t();
+	long long allocs();
+	long long bytes();
+	void add_worker(long long allocs, long long bytes);
+	int add(string name, int depth);
+	void set(int id, double time, long long allocs, long long bytes);
+	void add_to(int id, double time, long long allocs, long long bytes);
+	void count(string name, long long value);
+	const vector<phase_t>& get_phases();
+	const vector<pair<string, long long>>& get_counters();
+	void print(ostream& os);
+	void print_json(ostream& os);
+};
+
+class phase_timer_t {
+	phase_report_t* report;
+	int id;
+	bool accumulate;
+	bool wall;
+	chrono::steady_clock::time_point start;
+	long long allocs;
+	long long bytes;
+public:
+	phase_timer_t(phase_report_t* report, string name, int depth);
+	phase_timer_t(phase_report_t* report, int id, bool accumulate = false);
+	~phase_timer_t();
+};
@@ -0,0 +1,803 @@
+#include "serializer.h"
+#include "parser.h"
+#include "exceptions.h"
+#include <cstring>
+#include <map>
+
+extern map<TOKEN, string> token_names;
+extern map<TOKEN, expr_reserved_func_t* (*)(token_ptr op)> res_funcs_makers;
+
+enum AST_TAG {
+	AST_NULL,
+	AST_REF,
+	AST_NEW,
+	AST_PRELUDE,
+
+	AST_BUILT_IN_TYPE,
+	AST_STR_LITERAL_TYPE,
+	AST_TYPE,
+	AST_PTR_TYPE,
+	AST_ARRAY_TYPE,
+	AST_STRUCT_TYPE,
+	AST_FUNC_TYPE,
+	AST_ALIAS,
+	AST_FUNC,
+	AST_GLOBAL_VAR,
+	AST_LOCAL_VAR,
+
+	AST_BLOCK,
+	AST_EXPR_STMT,
+	AST_DECL,
+	AST_IF,
+	AST_WHILE,
+	AST_DO_WHILE,
+	AST_FOR,
+	AST_BREAK,
+	AST_CONTINUE,
+	AST_RETURN,
+
+	AST_CONST,
+	AST_VAR,
+	AST_PREFIX_OP,
+	AST_POSTFIX_OP,
+	AST_BIN_OP,
+	AST_TERN_OP,
+	AST_ARR_INDEX,
+	AST_CALL,
+	AST_RESERVED_CALL,
+	AST_STRUCT_ACCESS,
+	AST_CAST
+};
+
+SERIALIZED_FORMAT serialized_format(const string& data) {
+	if (data.compare(0, SERIALIZED_MAGIC_SIZE, TOKENS_MAGIC) == 0)
+		return SF_TOKENS;
+	if (data.compare(0, SERIALIZED_MAGIC_SIZE, AST_MAGIC) == 0)
+		return SF_AST;
+	return SF_NONE;
+}
+
+//--------------------------------BINARY_STREAM-------------------------------
+
+bin_writer_t::bin_writer_t(const char* magic) : data(magic), offset(0) {}
+
+void bin_writer_t::u(unsigned long long val) {
+	while (val >= 0x80) {
+		data += (char)(val & 0x7f | 0x80);
+		val >>= 7;
+	}
+	data += (char)val;
+}
+
+void bin_writer_t::i(long long val) {
+	u((unsigned long long)val << 1 ^ (unsigned long long)(val >> 63));
+}
+
+void bin_writer_t::f(double val) {
+	char bytes[sizeof(double)];
+	memcpy(bytes, &val, sizeof(val));
+	data.append(bytes, sizeof(bytes));
+}
+
+void bin_writer_t::str(const string& val) {
+	u(val.size());
+	data += val;
+}
+
+void bin_writer_t::token(token_ptr token) {
+	u(token->get_token_id());
+	i(token->get_offset() - offset);
+	offset = token->get_offset();
+	switch (token->get_token_id()) {
+		case T_INTEGER: i(static_pointer_cast<token_with_value_t<int>>(token)->get_value()); break;
+		case T_DOUBLE: f(static_pointer_cast<token_with_value_t<double>>(token)->get_value()); break;
+		case T_CHAR: u((unsigned char)static_pointer_cast<token_with_value_t<char>>(token)->get_value()); break;
+		case T_IDENTIFIER:
+		case T_STRING: str(static_pointer_cast<token_with_value_t<string>>(token)->get_value()); break;
+	}
+}
+
+void bin_writer_t::_offsets(const vector<int>& offsets) {
+	u(offsets.size());
+	int prev = 0;
+	for each (int val in offsets) {
+		u(val - prev);
+		prev = val;
+	}
+}
+
+void bin_writer_t::index() {
+	source_manager_t* sources = source_manager_t::current();
+	_offsets(sources ? sources->get_line_starts() : vector<int>());
+	_offsets(sources ? sources->get_tabs() : vector<int>());
+}
+
+const string& bin_writer_t::get_data() {
+	return data;
+}
+
+bin_reader_t::bin_reader_t(const string& data, const char* magic) : data(data), pos(SERIALIZED_MAGIC_SIZE), offset(0) {
+	if (data.compare(0, SERIALIZED_MAGIC_SIZE, magic) != 0)
+		throw SerializeError("Unknown serialized data format");
+}
+
+void bin_reader_t::_need(size_t size) {
+	if (data.size() - pos < size)
+		throw SerializeError("Corrupted serialized data");
+}
+
+bool bin_reader_t::at_end() {
+	return pos == data.size();
+}
+
+unsigned long long bin_reader_t::u() {
+	unsigned long long res = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		_need(1);
+		unsigned char c = data[pos++];
+		res |= (unsigned long long)(c & 0x7f) << shift;
+		if (!(c & 0x80))
+			return res;
+	}
+	throw SerializeError("Corrupted serialized data");
+}
+
+long long bin_reader_t::i() {
+	unsigned long long val = u();
+	return (long long)(val >> 1) ^ -(long long)(val & 1);
+}
+
+double bin_reader_t::f() {
+	double res;
+	_need(sizeof(res));
+	memcpy(&res, &data[pos], sizeof(res));
+	pos += sizeof(res);
+	return res;
+}
+
+string bin_reader_t::str() {
+	size_t size = u();
+	_need(size);
+	string res = data.substr(pos, size);
+	pos += size;
+	return res;
+}
+
+token_ptr bin_reader_t::token() {
+	TOKEN id = (TOKEN)u();
+	if (id != T_EMPTY && token_names.find(id) == token_names.end())
+		throw SerializeError("Corrupted serialized data");
+	offset += (int)i();
+	switch (id) {
+		case T_INTEGER: return token_ptr(new token_with_value_t<int>(offset, id, (int)i()));
+		case T_DOUBLE: return token_ptr(new token_with_value_t<double>(offset, id, f()));
+		case T_CHAR: return token_ptr(new token_with_value_t<char>(offset, id, (char)u()));
+		case T_IDENTIFIER:
+		case T_STRING: return token_ptr(new token_with_value_t<string>(offset, id, str()));
+	}
+	return token_ptr(new token_t(offset, id));
+}
+
+vector<int> bin_reader_t::_offsets() {
+	size_t size = u();
+	_need(size);
+	vector<int> res(size);
+	int prev = 0;
+	for (size_t i = 0; i < size; i++)
+		prev = res[i] = prev + (int)u();
+	return res;
+}
+
+void bin_reader_t::index() {
+	vector<int> line_starts = _offsets();
+	vector<int> tabs = _offsets();
+	if (source_manager_t* sources = source_manager_t::current())
+		sources->set_index(line_starts, tabs);
+}
+
+string serialize_tokens(lexeme_analyzer_t& la) {
+	bin_writer_t writer(TOKENS_MAGIC);
+	writer.index();
+	while (!la.eof())
+		writer.token(la.next());
+	return writer.get_data();
+}
+
+vector<token_ptr> deserialize_tokens(const string& data) {
+	bin_reader_t reader(data, TOKENS_MAGIC);
+	reader.index();
+	vector<token_ptr> res;
+	while (!reader.at_end())
+		res.push_back(reader.token());
+	return res;
+}
+
+//--------------------------------AST_WRITER-------------------------------
+
+ast_writer_t::ast_writer_t() : bin_writer_t(AST_MAGIC), prelude(parser_t::get_prelude_sym_table()) {}
+
+bool ast_writer_t::_ref(unordered_map<const void*, unsigned>& ids, const void* obj) {
+	if (!obj) {
+		u(AST_NULL);
+		return true;
+	}
+	auto it = ids.find(obj);
+	if (it == ids.end()) {
+		unsigned id = ids.size();
+		ids[obj] = id;
+		return false;
+	}
+	u(AST_REF);
+	u(it->second);
+	return true;
+}
+
+void ast_writer_t::token(token_ptr token) {
+	if (_ref(tokens, token.get()))
+		return;
+	u(AST_NEW);
+	bin_writer_t::token(token);
+}
+
+void ast_writer_t::name(const string& name) {
+	auto it = names.find(name);
+	if (it != names.end()) {
+		u(AST_REF);
+		u(it->second);
+		return;
+	}
+	unsigned id = names.size();
+	names[name] = id;
+	u(AST_NEW);
+	str(name);
+}
+
+void ast_writer_t::sym(sym_ptr s) {
+	if (_ref(syms, s.get()))
+		return;
+	symbol_t* p = s.get();
+	if (prelude->find_local(p->name).get() == p) {
+		u(AST_PRELUDE);
+		name(p->name);
+		return;
+	}
+	if (auto alias = dynamic_cast<sym_type_alias_t*>(p)) {
+		u(AST_ALIAS);
+		token(p->token);
+		name(p->name);
+		sym(alias->type);
+	} else if (auto func = dynamic_cast<sym_func_t*>(p)) {
+		u(AST_FUNC);
+		token(p->token);
+		name(p->name);
+		sym(func->type);
+		table(func->sym_table);
+		stmt(func->block);
+		str(func->source);
+	} else if (auto var = dynamic_cast<sym_var_t*>(p)) {
+		u(dynamic_cast<sym_global_var_t*>(p) ? AST_GLOBAL_VAR : AST_LOCAL_VAR);
+		token(p->token);
+		name(p->name);
+		sym(var->type);
+		expr_list(var->init_list);
+	} else if (auto type = dynamic_cast<type_t*>(p)) {
+		u(AST_TYPE);
+		token(p->token);
+		name(p->name);
+		sym(type->type);
+		u(type->_is_const);
+	} else if (auto literal = dynamic_cast<sym_type_str_literal_t*>(p)) {
+		u(AST_STR_LITERAL_TYPE);
+		token(p->token);
+		token(literal->str);
+		name(p->name);
+	} else if (dynamic_cast<sym_built_in_type*>(p)) {
+		u(AST_BUILT_IN_TYPE);
+		token(p->token);
+		u(p->symbol_type);
+		name(p->name);
+	} else if (auto ptr = dynamic_cast<sym_type_ptr_t*>(p)) {
+		u(AST_PTR_TYPE);
+		token(p->token);
+		name(p->name);
+		sym(ptr->elem_type);
+	} else if (auto arr = dynamic_cast<sym_type_array_t*>(p)) {
+		u(AST_ARRAY_TYPE);
+		token(p->token);
+		name(p->name);
+		sym(arr->elem_type);
+		expr(arr->size_expr);
+		u(arr->len);
+	} else if (auto structure = dynamic_cast<sym_type_struct_t*>(p)) {
+		u(AST_STRUCT_TYPE);
+		token(p->token);
+		token(structure->identifier);
+		name(p->name);
+		table(structure->sym_table);
+	} else if (auto func_type = dynamic_cast<sym_type_func_t*>(p)) {
+		u(AST_FUNC_TYPE);
+		token(p->token);
+		name(p->name);
+		u(func_type->arg_types.size());
+		for each (auto& arg in func_type->arg_types)
+			sym(arg);
+		sym(func_type->elem_type);
+	} else
+		throw SerializeError("Can't serialize symbol " + p->name);
+}
+
+void ast_writer_t::table(sym_table_ptr table) {
+	if (_ref(tables, table.get()))
+		return;
+	if (table == prelude) {
+		u(AST_PRELUDE);
+		return;
+	}
+	u(AST_NEW);
+	this->table(table->parent);
+	u(table->size());
+	map<string, sym_ptr> rebuilt;
+	for each (auto s in *table) {
+		sym(s);
+		rebuilt[s->name] = s;
+	}
+	vector<pair<string, sym_ptr>> changed;
+	vector<string> erased;
+	for each (auto& entry in table->map_st) {
+		auto it = rebuilt.find(entry.first);
+		if (it == rebuilt.end() || it->second.get() != entry.second.get())
+			changed.push_back(entry);
+	}
+	for each (auto& entry in rebuilt)
+		if (table->map_st.find(entry.first) == table->map_st.end())
+			erased.push_back(entry.first);
+	u(changed.size());
+	for each (auto& entry in changed) {
+		name(entry.first);
+		sym(entry.second);
+	}
+	u(erased.size());
+	for each (auto& key in erased)
+		name(key);
+}
+
+void ast_writer_t::stmt(stmt_ptr node) {
+	if (_ref(stmts, node.get()))
+		return;
+	statement_t* p = node.get();
+	if (auto block = dynamic_cast<stmt_block_t*>(p)) {
+		u(AST_BLOCK);
+		table(block->sym_table);
+		u(block->statements.size());
+		for each (auto& s in block->statements)
+			stmt(s);
+	} else if (auto e = dynamic_cast<stmt_expr_t*>(p)) {
+		u(AST_EXPR_STMT);
+		expr(e->expression);
+	} else if (auto decl = dynamic_cast<stmt_decl_t*>(p)) {
+		u(AST_DECL);
+		sym(decl->symbol);
+	} else if (auto if_stmt = dynamic_cast<stmt_if_t*>(p)) {
+		u(AST_IF);
+		expr(if_stmt->condition);
+		stmt(if_stmt->then_stmt);
+		stmt(if_stmt->else_stmt);
+	} else if (auto while_stmt = dynamic_cast<stmt_while_t*>(p)) {
+		u(dynamic_cast<stmt_do_while_t*>(p) ? AST_DO_WHILE : AST_WHILE);
+		expr(while_stmt->condition);
+		stmt(static_cast<stmt_loop_t*>(while_stmt)->stmt);
+	} else if (auto for_stmt = dynamic_cast<stmt_for_t*>(p)) {
+		u(AST_FOR);
+		expr(for_stmt->init_expr);
+		expr(for_stmt->condition);
+		expr(for_stmt->expr);
+		stmt(static_cast<stmt_loop_t*>(for_stmt)->stmt);
+	} else if (auto break_stmt = dynamic_cast<stmt_break_t*>(p)) {
+		u(AST_BREAK);
+		stmt(break_stmt->parent);
+	} else if (auto continue_stmt = dynamic_cast<stmt_continue_t*>(p)) {
+		u(AST_CONTINUE);
+		stmt(continue_stmt->parent);
+	} else if (auto ret = dynamic_cast<stmt_return_t*>(p)) {
+		u(AST_RETURN);
+		sym(ret->parent);
+		expr(ret->expr);
+	} else
+		throw SerializeError("Can't serialize statement");
+}
+
+void ast_writer_t::expr(expr_t* node) {
+	if (_ref(exprs, node))
+		return;
+	if (auto c = dynamic_cast<expr_const_t*>(node)) {
+		u(AST_CONST);
+		token(c->constant);
+	} else if (auto var = dynamic_cast<expr_var_t*>(node)) {
+		u(AST_VAR);
+		sym(var->variable);
+		token(var->var_token);
+	} else if (auto un = dynamic_cast<expr_un_op_t*>(node)) {
+		u(dynamic_cast<expr_prefix_un_op_t*>(node) ? AST_PREFIX_OP : AST_POSTFIX_OP);
+		token(un->op);
+		expr(un->expr);
+	} else if (auto bin = dynamic_cast<expr_bin_op_t*>(node)) {
+		u(AST_BIN_OP);
+		token(bin->op);
+		expr(bin->left);
+		expr(bin->right);
+	} else if (auto tern = dynamic_cast<expr_tern_op_t*>(node)) {
+		u(AST_TERN_OP);
+		token(tern->question_mark);
+		token(tern->colon);
+		expr(tern->condition);
+		expr(tern->left);
+		expr(tern->right);
+	} else if (auto arr = dynamic_cast<expr_arr_index_t*>(node)) {
+		u(AST_ARR_INDEX);
+		token(arr->sqr_bracket);
+		expr(arr->arr);
+		expr(arr->index);
+	} else if (auto call = dynamic_cast<expr_func_t*>(node)) {
+		bool reserved = dynamic_cast<expr_reserved_func_t*>(node) != nullptr;
+		u(reserved ? AST_RESERVED_CALL : AST_CALL);
+		token(call->brace);
+		if (!reserved) {
+			expr(call->func);
+			name(call->asm_func_name);
+		}
+		expr_list(call->args);
+	} else if (auto access = dynamic_cast<expr_struct_access_t*>(node)) {
+		u(AST_STRUCT_ACCESS);
+		token(access->op);
+		expr(access->struct_expr);
+		sym(access->structure);
+		sym(access->member);
+	} else if (auto cast = dynamic_cast<expr_cast_t*>(node)) {
+		u(AST_CAST);
+		expr(cast->expr);
+		sym(cast->type);
+	} else
+		throw SerializeError("Can't serialize expression");
+	u(node->lvalue);
+}
+
+void ast_writer_t::expr_list(const vector<expr_t*>& list) {
+	u(list.size());
+	for each (auto e in list)
+		expr(e);
+}
+
+void ast_writer_t::write_program(sym_table_ptr top, const string& env_record) {
+	index();
+	table(top);
+	str(env_record);
+}
+
+string serialize_ast(sym_table_ptr top, const string& env_record) {
+	ast_writer_t writer;
+	writer.write_program(top, env_record);
+	return writer.get_data();
+}
+
+//--------------------------------AST_READER-------------------------------
+
+ast_reader_t::ast_reader_t(const string& data) : bin_reader_t(data, AST_MAGIC), prelude(parser_t::get_prelude_sym_table()), placeholder(parser_t::get_base_type(ST_VOID)) {}
+
+unsigned ast_reader_t::_tag() {
+	return (unsigned)u();
+}
+
+unsigned ast_reader_t::_id(size_t count) {
+	unsigned long long id = u();
+	if (id >= count)
+		throw SerializeError("Corrupted serialized data");
+	return (unsigned)id;
+}
+
+template<typename T>
+shared_ptr<T> ast_reader_t::_sym() {
+	sym_ptr s = sym();
+	if (!s)
+		return nullptr;
+	auto res = dynamic_pointer_cast<T>(s);
+	if (!res)
+		throw SerializeError("Corrupted serialized data");
+	return res;
+}
+
+token_ptr ast_reader_t::token() {
+	switch (_tag()) {
+		case AST_NULL: return nullptr;
+		case AST_REF: return tokens[_id(tokens.size())];
+		case AST_NEW: tokens.push_back(bin_reader_t::token()); return tokens.back();
+	}
+	throw SerializeError("Corrupted serialized data");
+}
+
+string ast_reader_t::name() {
+	switch (_tag()) {
+		case AST_REF: return names[_id(names.size())];
+		case AST_NEW: names.push_back(str()); return names.back();
+	}
+	throw SerializeError("Corrupted serialized data");
+}
+
+sym_ptr ast_reader_t::sym() {
+	unsigned tag = _tag();
+	switch (tag) {
+		case AST_NULL: return nullptr;
+		case AST_REF: return syms[_id(syms.size())];
+		case AST_PRELUDE: {
+			sym_ptr s = prelude->find_local(name());
+			if (!s)
+				throw SerializeError("Corrupted serialized data");
+			syms.push_back(s);
+			return s;
+		}
+	}
+	token_ptr tok = token();
+	symbol_t* p;
+	switch (tag) {
+		case AST_ALIAS: p = new sym_type_alias_t(tok, type_t::make_type(placeholder)); break;
+		case AST_FUNC: p = new sym_func_t(tok, shared_ptr<sym_type_func_t>(new sym_type_func_t(vector<type_ptr>())), nullptr); break;
+		case AST_GLOBAL_VAR: p = new sym_global_var_t(tok); break;
+		case AST_LOCAL_VAR: p = new sym_local_var_t(tok); break;
+		case AST_TYPE: p = new type_t(placeholder); break;
+		case AST_STR_LITERAL_TYPE: p = new sym_type_str_literal_t(token()); break;
+		case AST_BUILT_IN_TYPE:
+			switch (u()) {
+				case ST_INTEGER: p = new sym_type_int_t; break;
+				case ST_CHAR: p = new sym_type_char_t; break;
+				case ST_DOUBLE: p = new sym_type_double_t; break;
+				case ST_VOID: p = new sym_type_void_t; break;
+				default: throw SerializeError("Corrupted serialized data");
+			}
+			break;
+		case AST_PTR_TYPE: p = new sym_type_ptr_t; break;
+		case AST_ARRAY_TYPE: p = new sym_type_array_t(nullptr); break;
+		case AST_STRUCT_TYPE: p = new sym_type_struct_t(token()); break;
+		case AST_FUNC_TYPE: p = new sym_type_func_t(vector<type_ptr>()); break;
+		default: throw SerializeError("Corrupted serialized data");
+	}
+	sym_ptr s(p);
+	syms.push_back(s);
+	p->token = tok;
+	p->name = name();
+	switch (tag) {
+		case AST_ALIAS: dynamic_cast<sym_type_alias_t*>(p)->type = _sym<type_t>(); break;
+		case AST_FUNC: {
+			auto func = dynamic_cast<sym_func_t*>(p);
+			func->type = _sym<type_t>();
+			func->sym_table = table();
+			func->block = stmt();
+			func->source = str();
+		} break;
+		case AST_GLOBAL_VAR:
+		case AST_LOCAL_VAR: {
+			auto var = dynamic_cast<sym_var_t*>(p);
+			var->type = _sym<type_t>();
+			var->init_list = expr_list();
+		} break;
+		case AST_TYPE: {
+			auto type = dynamic_cast<type_t*>(p);
+			type->type = _sym<type_base_t>();
+			type->_is_const = u() != 0;
+			if (!type->type)
+				throw SerializeError("Corrupted serialized data");
+		} break;
+		case AST_PTR_TYPE: dynamic_cast<sym_type_ptr_t*>(p)->elem_type = _sym<type_t>(); break;
+		case AST_ARRAY_TYPE: {
+			auto arr = dynamic_cast<sym_type_array_t*>(p);
+			arr->elem_type = _sym<type_t>();
+			arr->size_expr = expr();
+			arr->len = u();
+		} break;
+		case AST_STRUCT_TYPE: dynamic_cast<sym_type_struct_t*>(p)->sym_table = table(); break;
+		case AST_FUNC_TYPE: {
+			auto func_type = dynamic_cast<sym_type_func_t*>(p);
+			size_t count = u();
+			for (size_t i = 0; i < count; i++)
+				func_type->arg_types.push_back(_sym<type_t>());
+			func_type->elem_type = _sym<type_t>();
+		} break;
+	}
+	return s;
+}
+
+sym_table_ptr ast_reader_t::table() {
+	switch (_tag()) {
+		case AST_NULL: return nullptr;
+		case AST_REF: return tables[_id(tables.size())];
+		case AST_PRELUDE: tables.push_back(prelude); return prelude;
+		case AST_NEW: break;
+		default: throw SerializeError("Corrupted serialized data");
+	}
+	sym_table_ptr res(new sym_table_t);
+	tables.push_back(res);
+	res->parent = table();
+	size_t count = u();
+	for (size_t i = 0; i < count; i++)
+		res->push_back(sym());
+	for each (auto s in *res)
+		res->map_st[s->name] = s;
+	count = u();
+	for (size_t i = 0; i < count; i++) {
+		string key = name();
+		res->map_st[key] = sym();
+	}
+	count = u();
+	for (size_t i = 0; i < count; i++)
+		res->map_st.erase(name());
+	return res;
+}
+
+stmt_ptr ast_reader_t::stmt() {
+	unsigned tag = _tag();
+	switch (tag) {
+		case AST_NULL: return nullptr;
+		case AST_REF: return stmts[_id(stmts.size())];
+	}
+	statement_t* p;
+	switch (tag) {
+		case AST_BLOCK: p = new stmt_block_t; break;
+		case AST_EXPR_STMT: p = new stmt_expr_t(nullptr); break;
+		case AST_DECL: p = new stmt_decl_t(nullptr); break;
+		case AST_IF: p = new stmt_if_t(nullptr, nullptr, nullptr); break;
+		case AST_WHILE: p = new stmt_while_t(nullptr); break;
+		case AST_DO_WHILE: p = new stmt_do_while_t; break;
+		case AST_FOR: p = new stmt_for_t(nullptr, nullptr, nullptr); break;
+		case AST_BREAK: p = new stmt_break_t(nullptr); break;
+		case AST_CONTINUE: p = new stmt_continue_t(nullptr); break;
+		case AST_RETURN: p = new stmt_return_t(nullptr); break;
+		default: throw SerializeError("Corrupted serialized data");
+	}
+	stmt_ptr res(p);
+	stmts.push_back(res);
+	switch (tag) {
+		case AST_BLOCK: {
+			auto block = dynamic_cast<stmt_block_t*>(p);
+			block->sym_table = table();
+			size_t count = u();
+			for (size_t i = 0; i < count; i++)
+				block->statements.push_back(stmt());
+		} break;
+		case AST_EXPR_STMT: dynamic_cast<stmt_expr_t*>(p)->expression = expr(); break;
+		case AST_DECL: dynamic_cast<stmt_decl_t*>(p)->symbol = sym(); break;
+		case AST_IF: {
+			auto if_stmt = dynamic_cast<stmt_if_t*>(p);
+			if_stmt->condition = expr();
+			if_stmt->then_stmt = stmt();
+			if_stmt->else_stmt = stmt();
+		} break;
+		case AST_WHILE:
+		case AST_DO_WHILE: {
+			auto loop = dynamic_cast<stmt_while_t*>(p);
+			loop->condition = expr();
+			static_cast<stmt_loop_t*>(loop)->stmt = stmt();
+		} break;
+		case AST_FOR: {
+			auto loop = dynamic_cast<stmt_for_t*>(p);
+			loop->init_expr = expr();
+			loop->condition = expr();
+			loop->expr = expr();
+			static_cast<stmt_loop_t*>(loop)->stmt = stmt();
+		} break;
+		case AST_BREAK:
+		case AST_CONTINUE: {
+			auto loop = dynamic_pointer_cast<stmt_loop_t>(stmt());
+			if (!loop)
+				throw SerializeError("Corrupted serialized data");
+			if (tag == AST_BREAK)
+				dynamic_cast<stmt_break_t*>(p)->parent = loop;
+			else
+				dynamic_cast<stmt_continue_t*>(p)->parent = loop;
+		} break;
+		case AST_RETURN: {
+			auto ret = dynamic_cast<stmt_return_t*>(p);
+			ret->parent = _sym<sym_func_t>();
+			ret->expr = expr();
+		} break;
+	}
+	return res;
+}
+
+expr_t* ast_reader_t::expr() {
+	unsigned tag = _tag();
+	switch (tag) {
+		case AST_NULL: return nullptr;
+		case AST_REF: return exprs[_id(exprs.size())];
+	}
+	expr_t* res;
+	switch (tag) {
+		case AST_CONST: {
+			auto c = new expr_const_t(token());
+			exprs.push_back(res = c);
+		} break;
+		case AST_VAR: {
+			auto var = new expr_var_t;
+			exprs.push_back(res = var);
+			var->variable = _sym<sym_with_type_t>();
+			var->var_token = token();
+		} break;
+		case AST_PREFIX_OP:
+		case AST_POSTFIX_OP: {
+			token_ptr op = token();
+			auto un = tag == AST_PREFIX_OP ? expr_prefix_un_op_t::make_prefix_un_op(op) : expr_postfix_un_op_t::make_postfix_un_op(op);
+			if (!un)
+				throw SerializeError("Corrupted serialized data");
+			exprs.push_back(res = un);
+			un->expr = expr();
+		} break;
+		case AST_BIN_OP: {
+			auto bin = expr_bin_op_t::make_bin_op(token());
+			if (!bin)
+				throw SerializeError("Corrupted serialized data");
+			exprs.push_back(res = bin);
+			bin->left = expr();
+			bin->right = expr();
+		} break;
+		case AST_TERN_OP: {
+			token_ptr qm = token();
+			auto tern = new expr_tern_op_t(qm, token());
+			exprs.push_back(res = tern);
+			tern->condition = expr();
+			tern->left = expr();
+			tern->right = expr();
+		} break;
+		case AST_ARR_INDEX: {
+			auto arr = new expr_arr_index_t(token());
+			exprs.push_back(res = arr);
+			arr->arr = expr();
+			arr->index = expr();
+		} break;
+		case AST_CALL: {
+			auto call = new expr_func_t(token());
+			exprs.push_back(res = call);
+			call->func = expr();
+			call->asm_func_name = name();
+			call->args = expr_list();
+		} break;
+		case AST_RESERVED_CALL: {
+			token_ptr brace = token();
+			auto maker = res_funcs_makers.find(brace ? brace->get_token_id() : T_EMPTY);
+			if (maker == res_funcs_makers.end())
+				throw SerializeError("Corrupted serialized data");
+			expr_func_t* call = maker->second(brace);
+			exprs.push_back(res = call);
+			call->args = expr_list();
+		} break;
+		case AST_STRUCT_ACCESS: {
+			auto access = new expr_struct_access_t(token());
+			exprs.push_back(res = access);
+			access->struct_expr = expr();
+			access->structure = _sym<sym_type_struct_t>();
+			access->member = _sym<sym_var_t>();
+		} break;
+		case AST_CAST: {
+			auto cast = new expr_cast_t;
+			exprs.push_back(res = cast);
+			cast->expr = expr();
+			cast->type = _sym<type_t>();
+		} break;
+		default: throw SerializeError("Corrupted serialized data");
+	}
+	res->lvalue = u() != 0;
+	return res;
+}
+
+vector<expr_t*> ast_reader_t::expr_list() {
+	vector<expr_t*> res;
+	size_t count = u();
+	for (size_t i = 0; i < count; i++)
+		res.push_back(expr());
+	return res;
+}
+
+sym_table_ptr ast_reader_t::read_program(string& env_record) {
+	index();
+	sym_table_ptr top = table();
+	env_record = str();
+	if (!top || !at_end())
+		throw SerializeError("Corrupted serialized data");
+	return top;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "lexeme_analyzer.h"
+#include "symbol_table.h"
+#include "source_manager.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+using namespace std;
+
+#define TOKENS_MAGIC "CTK2"
+#define AST_MAGIC "CAS2"
+#define SERIALIZED_MAGIC_SIZE 4
+
+enum SERIALIZED_FORMAT {
+	SF_NONE,
+	SF_TOKENS,
+	SF_AST
+};
+
+SERIALIZED_FORMAT serialized_format(const string& data);
+
+// Varint-encoded stream; token offsets are stored as deltas from the previous token,
+// the line and tab index of the active source manager goes in front so positions can still be resolved after loading
+class bin_writer_t {
+protected:
+	string data;
+	int offset;
+
+	void _offsets(const vector<int>& offsets);
+public:
+	bin_writer_t(const char* magic);
+	void u(unsigned long long val);
+	void i(long long val);
+	void f(double val);
+	void str(const string& val);
+	void token(token_ptr token);
+	void index();
+	const string& get_data();
+};
+
+class bin_reader_t {
+protected:
+	const string& data;
+	size_t pos;
+	int offset;
+	void _need(size_t size);
+	vector<int> _offsets();
+public:
+	bin_reader_t(const string& data, const char* magic);
+	bool at_end();
+	unsigned long long u();
+	long long i();
+	double f();
+	string str();
+	token_ptr token();
+	void index();
+};
+
+string serialize_tokens(lexeme_analyzer_t& la);
+vector<token_ptr> deserialize_tokens(const string& data);
+
+// Symbols, statements and expressions are written once and referred to by index afterwards,
+// so shared types and back references (loops, functions, recursive structs) survive the round trip
+class ast_writer_t : public bin_writer_t {
+	sym_table_ptr prelude;
+	unordered_map<const void*, unsigned> tokens, syms, tables, stmts, exprs;
+	unordered_map<string, unsigned> names;
+
+	bool _ref(unordered_map<const void*, unsigned>& ids, const void* obj);
+public:
+	ast_writer_t();
+	void token(token_ptr token);
+	void name(const string& name);
+	void sym(sym_ptr s);
+	void table(sym_table_ptr table);
+	void stmt(stmt_ptr stmt);
+	void expr(expr_t* expr);
+	void expr_list(const vector<expr_t*>& list);
+	void write_program(sym_table_ptr top, const string& env_record);
+};
+
+class ast_reader_t : public bin_reader_t {
+	sym_table_ptr prelude;
+	type_base_ptr placeholder;
+	vector<token_ptr> tokens;
+	vector<string> names;
+	vector<sym_ptr> syms;
+	vector<sym_table_ptr> tables;
+	vector<stmt_ptr> stmts;
+	vector<expr_t*> exprs;
+
+	unsigned _tag();
+	unsigned _id(size_t count);
+	template<typename T> shared_ptr<T> _sym();
+public:
+	ast_reader_t(const string& data);
+	token_ptr token();
+	string name();
+	sym_ptr sym();
+	sym_table_ptr table();
+	stmt_ptr stmt();
+	expr_t* expr();
+	vector<expr_t*> expr_list();
+	sym_table_ptr read_program(string& env_record);
+};
+
+string serialize_ast(sym_table_ptr top, const string& env_record);
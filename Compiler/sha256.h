@@ -0,0 +1,6 @@
+#pragma once
+#include <string>
+
+using namespace std;
+
+string sha256_hex(const string& data);
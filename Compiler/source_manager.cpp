@@ -0,0 +1,70 @@
+#include "source_manager.h"
+#include <algorithm>
+
+static thread_local source_manager_t* current_sources = nullptr;
+
+source_manager_t::source_manager_t(const string* text) : text(text), appended(0) {}
+
+source_manager_t::~source_manager_t() {
+	if (current_sources == this)
+		current_sources = nullptr;
+}
+
+void source_manager_t::_index() {
+	line_starts.push_back(0);
+	if (text)
+		_scan(text->data(), text->size(), 0);
+}
+
+void source_manager_t::_scan(const char* data, int size, int offset) {
+	for (int i = 0; i < size; i++)
+		if (data[i] == '\n')
+			line_starts.push_back(offset + i + 1);
+		else if (data[i] == '\t')
+			tabs.push_back(offset + i);
+}
+
+// A tab moves the column up to the next multiple of 4, the first character of a line is column 1
+void source_manager_t::locate(int offset, int& line, int& column) {
+	call_once(indexed, [this] { _index(); });
+	line = upper_bound(line_starts.begin(), line_starts.end(), offset) - line_starts.begin();
+	int start = line ? line_starts[line - 1] : 0;
+	int col = 0;
+	for (auto it = lower_bound(tabs.begin(), tabs.end(), start); it != tabs.end() && *it < offset; ++it) {
+		col = (col + *it - start + 4) / 4 * 4;
+		start = *it + 1;
+	}
+	column = col + offset - start + 1;
+}
+
+const vector<int>& source_manager_t::get_line_starts() {
+	call_once(indexed, [this] { _index(); });
+	return line_starts;
+}
+
+const vector<int>& source_manager_t::get_tabs() {
+	call_once(indexed, [this] { _index(); });
+	return tabs;
+}
+
+void source_manager_t::set_index(const vector<int>& line_starts_, const vector<int>& tabs_) {
+	call_once(indexed, [&] {
+		line_starts = line_starts_;
+		tabs = tabs_;
+	});
+}
+
+// Streamed input has no text to index later, so the index grows as the chunks are read
+void source_manager_t::append(const char* data, int size) {
+	call_once(indexed, [this] { _index(); });
+	_scan(data, size, appended);
+	appended += size;
+}
+
+source_manager_t* source_manager_t::current() {
+	return current_sources;
+}
+
+void source_manager_t::set_current(source_manager_t* sources) {
+	current_sources = sources;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+
+using namespace std;
+
+// Tokens only carry byte offsets; line and column are recovered here when a diagnostic or a dump asks for them.
+// The index of line starts and tabs is built on the first lookup
+class source_manager_t {
+	const string* text;
+	vector<int> line_starts;
+	vector<int> tabs;
+	int appended;
+	once_flag indexed;
+
+	void _index();
+	void _scan(const char* data, int size, int offset);
+public:
+	source_manager_t(const string* text = nullptr);
+	~source_manager_t();
+	void locate(int offset, int& line, int& column);
+	const vector<int>& get_line_starts();
+	const vector<int>& get_tabs();
+	void set_index(const vector<int>& line_starts, const vector<int>& tabs);
+	void append(const char* data, int size);
+	static source_manager_t* current();
+	static void set_current(source_manager_t* sources);
+};
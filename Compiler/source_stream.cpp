@@ -0,0 +1,36 @@
+#include "source_stream.h"
+#include "source_manager.h"
+#include "exceptions.h"
+#include <algorithm>
+
+source_stream_t::source_stream_t(istream& is, source_manager_t* sources) : is(is), sources(sources), buf(SOURCE_STREAM_SIZE), pos(0), end(0), eof_reached(false), past_end(false) {}
+
+bool source_stream_t::_fill() {
+	if (eof_reached)
+		return false;
+	int at = end & (SOURCE_STREAM_SIZE - 1);
+	int size = min(SOURCE_STREAM_SIZE - at, SOURCE_STREAM_SIZE - SOURCE_STREAM_HISTORY);
+	is.read(&buf[at], size);
+	int count = (int)is.gcount();
+	if (count < size)
+		eof_reached = true;
+	if (sources)
+		sources->append(&buf[at], count);
+	end += count;
+	return count > 0;
+}
+
+int source_stream_t::tell() {
+	return pos;
+}
+
+void source_stream_t::seek(int offset) {
+	if (offset < 0 || offset > end || offset < end - SOURCE_STREAM_SIZE)
+		throw StreamBacktrack(pos_t(pos));
+	pos = offset;
+	past_end = false;
+}
+
+bool source_stream_t::eof() {
+	return past_end;
+}
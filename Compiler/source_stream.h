@@ -0,0 +1,39 @@
+#pragma once
+#include <istream>
+#include <cstdio>
+#include <vector>
+
+using namespace std;
+
+class source_manager_t;
+
+#define SOURCE_STREAM_SIZE (1 << 17)
+#define SOURCE_STREAM_HISTORY (1 << 12)
+
+// Fixed-size ring over the input, refilled with large reads. The last SOURCE_STREAM_HISTORY characters
+// before the read position are kept, so the lexer steps back inside the ring instead of seeking the stream
+class source_stream_t {
+	istream& is;
+	source_manager_t* sources;
+	vector<char> buf;
+	int pos;
+	int end;
+	bool eof_reached;
+	bool past_end;
+
+	bool _fill();
+public:
+	source_stream_t(istream& is, source_manager_t* sources = nullptr);
+	int get();
+	int tell();
+	void seek(int offset);
+	bool eof();
+};
+
+inline int source_stream_t::get() {
+	if (pos == end && !_fill()) {
+		past_end = true;
+		return EOF;
+	}
+	return (unsigned char)buf[pos++ & (SOURCE_STREAM_SIZE - 1)];
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <thread>
+
+using namespace std;
+
+// Lock-free single-producer/single-consumer queue. The producer publishes its writes in batches,
+// so the consumer only touches the shared tail once per batch
+template<typename T>
+class spsc_ring_t {
+	vector<T> slots;
+	size_t mask;
+	size_t batch;
+	atomic<size_t> head;
+	atomic<size_t> tail;
+	atomic<bool> closed;
+	size_t write_pos;
+	size_t read_limit;
+public:
+	spsc_ring_t(size_t size, size_t batch);
+	bool push(T&& val, const atomic<bool>& stop);
+	void publish();
+	void close();
+	bool pop(T& val);
+};
+
+template<typename T>
+spsc_ring_t<T>::spsc_ring_t(size_t size, size_t batch) : slots(size), mask(size - 1), batch(batch), head(0), tail(0), closed(false), write_pos(0), read_limit(0) {}
+
+template<typename T>
+bool spsc_ring_t<T>::push(T&& val, const atomic<bool>& stop) {
+	while (write_pos - head.load(memory_order_acquire) == slots.size()) {
+		publish();
+		if (stop.load(memory_order_relaxed))
+			return false;
+		this_thread::yield();
+	}
+	slots[write_pos++ & mask] = move(val);
+	if (write_pos - tail.load(memory_order_relaxed) >= batch)
+		publish();
+	return true;
+}
+
+template<typename T>
+void spsc_ring_t<T>::publish() {
+	tail.store(write_pos, memory_order_release);
+}
+
+template<typename T>
+void spsc_ring_t<T>::close() {
+	publish();
+	closed.store(true, memory_order_release);
+}
+
+template<typename T>
+bool spsc_ring_t<T>::pop(T& val) {
+	size_t pos = head.load(memory_order_relaxed);
+	while (pos == read_limit) {
+		bool last = closed.load(memory_order_acquire);
+		read_limit = tail.load(memory_order_acquire);
+		if (pos != read_limit)
+			break;
+		if (last)
+			return false;
+		this_thread::yield();
+	}
+	val = move(slots[pos & mask]);
+	head.store(pos + 1, memory_order_release);
+	return true;
+}
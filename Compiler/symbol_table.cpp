@@ -6,9 +6,16 @@ sym_table_t::sym_table_t() : parent(nullptr) {}
 
 sym_table_t::sym_table_t(sym_table_ptr  parent) : parent(parent) {}
 
+static thread_local long long symbols_inserted = 0;
+
 void sym_table_t::_insert(sym_ptr s) {
 	map_st[s->get_name()] = s;
 	push_back(s);
+	symbols_inserted++;
+}
+
+long long sym_table_t::inserted_count() {
+	return symbols_inserted;
 }
 
 void sym_table_t::insert(sym_ptr s) {
@@ -160,7 +167,7 @@ void sym_table_t::print_l(ostream& os, int level) {
 	for each (auto var in *this) {
 		print_level(os, level);
 		var->print_l(os, level);
-		os << endl;
+		os << '\n';
 	}
 }
 
@@ -168,6 +175,6 @@ void sym_table_t::short_print_l(ostream& os, int level) {
 	for each (auto var in *this) {
 		print_level(os, level);
 		var->short_print_l(os, level);
-		os << endl;
+		os << '\n';
 	}
 }
\ No newline at end of file
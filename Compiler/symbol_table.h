@@ -5,11 +5,14 @@
 #include <map>
 
 class sym_table_t : public vector<sym_ptr>, public node_t {
+	friend class ast_writer_t;
+	friend class ast_reader_t;
 protected:
 	map<string, sym_ptr> map_st;
 	sym_table_ptr  parent;
 	void _insert(sym_ptr symbol);
 public:
+	static long long inserted_count();
 	sym_table_t();
 	sym_table_t(sym_table_ptr  parent);
 	void insert(sym_ptr s);
@@ -0,0 +1,92 @@
+#include "thread_pool.h"
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <algorithm>
+
+struct parallel_loop_t {
+	const function<void(int)>* body;
+	int count;
+	atomic<int> next;
+	int done;
+	vector<exception_ptr> errors;
+	mutex lock;
+	condition_variable finished;
+};
+
+thread_pool_t::thread_pool_t(int max_workers) : stopping(false), max_workers(max_workers) {}
+
+thread_pool_t::~thread_pool_t() {
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	ready.notify_all();
+	for each (auto& t in workers)
+		t.join();
+}
+
+void thread_pool_t::_work() {
+	for (;;) {
+		function<void()> task;
+		{
+			unique_lock<mutex> guard(lock);
+			ready.wait(guard, [this]() { return stopping || !tasks.empty(); });
+			if (tasks.empty())
+				return;
+			task = move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+void thread_pool_t::submit(function<void()> task, int workers_needed) {
+	{
+		lock_guard<mutex> guard(lock);
+		tasks.push_back(move(task));
+		while ((int)workers.size() < min(workers_needed, max_workers))
+			workers.push_back(thread(&thread_pool_t::_work, this));
+	}
+	ready.notify_one();
+}
+
+int hardware_jobs() {
+	return max(1, (int)thread::hardware_concurrency());
+}
+
+// A helper that gets to run after the loop is over finds no index left, so it never touches the caller's body
+static void run_loop(shared_ptr<parallel_loop_t> loop) {
+	for (int i = loop->next++; i < loop->count; i = loop->next++) {
+		try {
+			(*loop->body)(i);
+		} catch (...) {
+			loop->errors[i] = current_exception();
+		}
+		lock_guard<mutex> guard(loop->lock);
+		if (++loop->done == loop->count)
+			loop->finished.notify_all();
+	}
+}
+
+void parallel_for(thread_pool_t* pool, int count, int jobs, const function<void(int)>& body) {
+	if (count <= 0)
+		return;
+	shared_ptr<parallel_loop_t> loop(new parallel_loop_t);
+	loop->body = &body;
+	loop->count = count;
+	loop->next = 0;
+	loop->done = 0;
+	loop->errors.resize(count);
+	int helpers = pool ? min(jobs, count) - 1 : 0;
+	for (int i = 0; i < helpers; i++)
+		pool->submit(bind(run_loop, loop), helpers);
+	run_loop(loop);
+	{
+		unique_lock<mutex> guard(loop->lock);
+		loop->finished.wait(guard, [&]() { return loop->done == loop->count; });
+	}
+	for each (auto& e in loop->errors)
+		if (e)
+			rethrow_exception(e);
+}
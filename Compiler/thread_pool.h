@@ -0,0 +1,32 @@
+#pragma once
+#include <functional>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+// Worker threads are started on first use and live as long as the pool, so compiles share them
+// instead of starting threads of their own. The caller of a loop runs iterations too and only waits
+// for the ones already running, so loops may nest and run concurrently without adding threads
+class thread_pool_t {
+	vector<thread> workers;
+	deque<function<void()>> tasks;
+	mutex lock;
+	condition_variable ready;
+	bool stopping;
+	int max_workers;
+
+	void _work();
+public:
+	thread_pool_t(int max_workers);
+	~thread_pool_t();
+	void submit(function<void()> task, int workers_needed);
+};
+
+int hardware_jobs();
+// Runs body for every index in [0, count) with up to jobs threads, the first exception is rethrown.
+// Without a pool the loop runs on the calling thread
+void parallel_for(thread_pool_t* pool, int count, int jobs, const function<void(int)>& body);
@@ -1,6 +1,6 @@
 #ifdef TOKEN_FUNC
-token_ptr token_double(string str, AUTOMATON_STATE state, int line, int column) {
-	return token_ptr(new token_with_value_t<double>(line, column, T_DOUBLE, atof(str.c_str())));
+token_ptr token_double(string str, AUTOMATON_STATE state, int offset) {
+	return token_ptr(new token_with_value_t<double>(offset, T_DOUBLE, atof(str.c_str())));
 }
 #endif
 
@@ -1,9 +1,9 @@
 #ifdef TOKEN_FUNC
-token_ptr token_ident(string str, AUTOMATON_STATE state, int line, int column) {
+token_ptr token_ident(string str, AUTOMATON_STATE state, int offset) {
 	if (keywords.find(str) != keywords.end())
-		return token_ptr(new token_t(line, column, keywords[str]));
+		return token_ptr(new token_t(offset, keywords[str]));
 	else {
-		return token_ptr(new token_with_value_t<string>(line, column, T_IDENTIFIER, str));
+		return token_ptr(new token_with_value_t<string>(offset, T_IDENTIFIER, str));
 	}
 }
 #endif
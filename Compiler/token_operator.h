@@ -1,6 +1,6 @@
 #ifdef TOKEN_FUNC
-token_ptr token_without_value(string str, AUTOMATON_STATE state, int line, int column) {
-	return token_ptr(new token_t(line, column, state_to_token[state]));
+token_ptr token_without_value(string str, AUTOMATON_STATE state, int offset) {
+	return token_ptr(new token_t(offset, state_to_token[state]));
 }
 #endif
 
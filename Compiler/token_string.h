@@ -1,9 +1,9 @@
 #ifdef TOKEN_FUNC
-token_ptr token_string(string str, AUTOMATON_STATE state, int line, int column) {
+token_ptr token_string(string str, AUTOMATON_STATE state, int offset) {
 	string t_str = str;
 	t_str.erase(t_str.begin());
 	t_str.pop_back();
-	return token_ptr(new token_with_value_t<string>(line, column, T_STRING, t_str));
+	return token_ptr(new token_with_value_t<string>(offset, T_STRING, t_str));
 }
 #endif
 
@@ -1,7 +1,9 @@
 #include "tokens.h"
+#include "source_manager.h"
 #include <sstream>
 #include <map>
 #include <stdarg.h>
+#include <cctype>
 
 map<TOKEN, string> token_names;
 
@@ -10,19 +12,36 @@ ostream& operator<<(ostream& os, const token_ptr& e) {
 	return os;
 }
 
-pos_t::pos_t() : line(0), column(0) {}
-pos_t::pos_t(int line, int column) : line(line), column(column) {}
+pos_t::pos_t() : offset(-1) {}
+pos_t::pos_t(int offset) : offset(offset) {}
+
+int pos_t::get_line() const {
+	int line = 0, column = 0;
+	if (source_manager_t* sources = source_manager_t::current())
+		sources->locate(offset, line, column);
+	return line;
+}
+
+int pos_t::get_column() const {
+	int line = 0, column = offset + 1;
+	if (source_manager_t* sources = source_manager_t::current())
+		sources->locate(offset, line, column);
+	return column;
+}
 
 pos_t::operator bool() {
-	return line || column;
+	return offset >= 0;
 }
 
 ostream& operator<<(ostream& os, const pos_t e) {
-	os << e.line << ':' << e.column << ": ";
+	int line = 0, column = e.offset + 1;
+	if (source_manager_t* sources = source_manager_t::current())
+		sources->locate(e.offset, line, column);
+	os << line << ':' << column << ": ";
 	return os;
 }
 
-token_t::token_t(int line, int column, TOKEN token) : pos(line, column), token(token) {}
+token_t::token_t(int offset, TOKEN token) : pos(offset), token(token) {}
 token_t::token_t() : token(T_EMPTY) {}
 
 bool token_t::operator==(const TOKEN& token_) const {
@@ -104,11 +123,15 @@ string token_t::get_name_by_id(TOKEN token_id) {
 }
 
 int token_t::get_line() {
-	return pos.line;
+	return pos.get_line();
 }
 
 int token_t::get_column() {
-	return pos.column;
+	return pos.get_column();
+}
+
+int token_t::get_offset() {
+	return pos.offset;
 }
 
 pos_t token_t::get_pos() {
@@ -154,3 +177,39 @@ void tokens_init() {
 #undef TOKEN_LIST
 #undef register_token
 }
+
+string unescape(const string& str) {
+	string res;
+	for (int i = 0; i < str.size(); i++) {
+		if (str[i] != '\\' || i + 1 == str.size()) {
+			res += str[i];
+			continue;
+		}
+		char c = str[++i];
+		switch (c) {
+			case 'n': res += '\n'; break;
+			case 't': res += '\t'; break;
+			case 'r': res += '\r'; break;
+			case 'a': res += '\a'; break;
+			case 'b': res += '\b'; break;
+			case 'f': res += '\f'; break;
+			case 'v': res += '\v'; break;
+			case 'x': {
+				int val = 0;
+				while (i + 1 < str.size() && isxdigit((unsigned char)str[i + 1]))
+					val = val * 16 + (isdigit((unsigned char)str[++i]) ? str[i] - '0' : tolower(str[i]) - 'a' + 10);
+				res += (char)val;
+				break;
+			}
+			default:
+				if (c >= '0' && c <= '7') {
+					int val = c - '0';
+					for (int n = 1; n < 3 && i + 1 < str.size() && str[i + 1] >= '0' && str[i + 1] <= '7'; n++)
+						val = val * 8 + str[++i] - '0';
+					res += (char)val;
+				} else
+					res += c;
+		}
+	}
+	return res;
+}
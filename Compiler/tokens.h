@@ -26,12 +26,15 @@ enum TOKEN {
 #define is_op(x) ((x) >= T_OP_BRACKET_OPEN && (x) <= T_OP_BIT_NOT_ASSIGN)
 
 void tokens_init();
+string unescape(const string& str);
 
+// Byte offset into the source; line and column are resolved through the active source manager
 struct pos_t {
-	int line;
-	int column;
+	int offset;
 	pos_t();
-	pos_t(int line, int column);
+	pos_t(int offset);
+	int get_line() const;
+	int get_column() const;
 	operator bool();
 	friend ostream& operator<<(ostream& os, const pos_t e);
 };
@@ -41,7 +44,7 @@ protected:
 	TOKEN token;
 	pos_t pos;
 public:
-	token_t(int line_, int column_, TOKEN token_);
+	token_t(int offset_, TOKEN token_);
 	token_t();
 	bool operator==(const TOKEN&) const;
 	virtual bool operator==(const token_t&) const;
@@ -59,6 +62,7 @@ public:
 	static string get_name_by_id(TOKEN token_id);
 	int get_line();
 	int get_column();
+	int get_offset();
 	pos_t get_pos();
 	TOKEN get_token_id() const;
 };
@@ -85,7 +89,7 @@ class token_with_value_t : public token_base_with_value_t {
 protected:
 	shared_ptr<var_t<T>> var;
 public:
-	token_with_value_t(int line_, int column_, TOKEN token_, T value_);
+	token_with_value_t(int offset_, TOKEN token_, T value_);
 	bool operator==(const token_t&) const override;
 	void print_l(ostream& os, int level) override;
 	void short_print_l(ostream& os, int level) override;
@@ -132,6 +136,6 @@ inline const var_ptr token_with_value_t<T>::get_var() const {
 }
 
 template<typename T>
-token_with_value_t<T>::token_with_value_t(int line_, int column_, TOKEN token_, T value_) : token_base_with_value_t(line_, column_, token_) {
+token_with_value_t<T>::token_with_value_t(int offset_, TOKEN token_, T value_) : token_base_with_value_t(offset_, token_) {
 	var = new_var<T>(value_);
 }
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include "type_table.h"
+#include "parser.h"
+
+static thread_local type_table_t* current_types = nullptr;
+
+bool type_table_t::key_t::operator==(const key_t& key) const {
+	return kind == key.kind && is_const == key.is_const && len == key.len && parts == key.parts;
+}
+
+size_t type_table_t::key_hash_t::operator()(const key_t& key) const {
+	size_t res = hash<int>()(key.kind) * 31 + key.is_const;
+	res = res * 31 + hash<size_t>()(key.len);
+	for each (auto part in key.parts)
+		res = res * 31 + hash<type_base_t*>()(part);
+	return res;
+}
+
+type_table_t::~type_table_t() {
+	if (current_types == this)
+		current_types = nullptr;
+}
+
+type_base_t* type_table_t::_leaf(type_base_t* type) {
+	SYM_TYPE kind = type->get_sym_type();
+	type_base_t* res = kind == ST_INTEGER || kind == ST_CHAR || kind == ST_DOUBLE || kind == ST_VOID ? parser_t::get_base_type(kind).get() : type;
+	type->canon.store(res, memory_order_release);
+	return res;
+}
+
+// Canonical nodes only point at other canonical nodes and at leaves, all of them outlive the table's users,
+// so the references between them do not own anything
+type_base_ptr type_table_t::_make(const key_t& key) {
+	type_base_ptr res;
+	if (key.kind == ST_QL)
+		res = type_base_ptr(new type_t(type_base_ptr(type_base_ptr(), key.parts[0]), key.is_const));
+	else {
+		type_ptr elem(type_ptr(), static_cast<type_t*>(key.parts[0]));
+		if (key.kind == ST_PTR) {
+			auto ptr = new sym_type_ptr_t;
+			ptr->set_element_type(elem);
+			res = type_base_ptr(ptr);
+		} else if (key.kind == ST_ARRAY) {
+			auto arr = new sym_type_array_t;
+			arr->set_element_type(elem);
+			arr->set_len(key.len);
+			res = type_base_ptr(arr);
+		} else {
+			vector<type_ptr> arg_types;
+			for (int i = 1; i < key.parts.size(); i++)
+				arg_types.push_back(type_ptr(type_ptr(), static_cast<type_t*>(key.parts[i])));
+			auto func = new sym_type_func_t(arg_types);
+			func->set_element_type(elem);
+			res = type_base_ptr(func);
+		}
+	}
+	res->update_name();
+	res->canon = res.get();
+	return res;
+}
+
+type_base_t* type_table_t::_intern(type_base_t* type) {
+	if (!type)
+		return nullptr;
+	type_base_t* res = type->canon.load(memory_order_acquire);
+	if (res)
+		return res;
+	key_t key;
+	key.kind = type->get_sym_type();
+	key.is_const = false;
+	key.len = 0;
+	if (key.kind == ST_QL) {
+		type_t* ql = static_cast<type_t*>(type);
+		key.is_const = ql->is_const();
+		key.parts.push_back(_intern(ql->get_base_type().get()));
+	} else if (key.kind == ST_PTR || key.kind == ST_ARRAY || key.kind == ST_FUNC_TYPE) {
+		key.parts.push_back(_intern(static_cast<updatable_base_type_t*>(type)->get_element_type().get()));
+		if (key.kind == ST_ARRAY)
+			key.len = static_cast<sym_type_array_t*>(type)->get_len();
+		if (key.kind == ST_FUNC_TYPE)
+			for each (auto arg in static_cast<sym_type_func_t*>(type)->get_arg_types())
+				key.parts.push_back(_intern(arg.get()));
+	} else
+		return _leaf(type);
+	for each (auto part in key.parts)
+		if (!part)
+			return type;
+	auto it = types.find(key);
+	if (it == types.end())
+		it = types.emplace(key, _make(key)).first;
+	res = it->second.get();
+	if (type->completed())
+		type->canon.store(res, memory_order_release);
+	return res;
+}
+
+// Without an active table only the leaves are resolved, a derived type is then identical to itself alone
+type_base_t* type_table_t::canonical(type_base_t* type) {
+	type_base_t* res = type->canon.load(memory_order_acquire);
+	if (res)
+		return res;
+	SYM_TYPE kind = type->get_sym_type();
+	if (kind != ST_QL && kind != ST_PTR && kind != ST_ARRAY && kind != ST_FUNC_TYPE)
+		return _leaf(type);
+	type_table_t* types = current();
+	if (!types)
+		return type;
+	lock_guard<mutex> guard(types->lock);
+	return types->_intern(type);
+}
+
+type_table_t* type_table_t::current() {
+	return current_types;
+}
+
+void type_table_t::set_current(type_table_t* types) {
+	current_types = types;
+}
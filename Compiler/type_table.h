@@ -0,0 +1,34 @@
+#pragma once
+#include "parser_symbol_node.h"
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+
+using namespace std;
+
+// Derived types (qualified, pointer, array and function types) are hash-consed here for one compilation:
+// structurally equal types resolve to a single canonical node, so type identity is a pointer compare.
+// Built-in types resolve to the prelude, structs, aliases and string literals are their own canonical node
+class type_table_t {
+	struct key_t {
+		SYM_TYPE kind;
+		bool is_const;
+		size_t len;
+		vector<type_base_t*> parts;
+		bool operator==(const key_t& key) const;
+	};
+	struct key_hash_t {
+		size_t operator()(const key_t& key) const;
+	};
+	unordered_map<key_t, type_base_ptr, key_hash_t> types;
+	mutex lock;
+
+	type_base_t* _intern(type_base_t* type);
+	type_base_ptr _make(const key_t& key);
+	static type_base_t* _leaf(type_base_t* type);
+public:
+	~type_table_t();
+	static type_base_t* canonical(type_base_t* type);
+	static type_table_t* current();
+	static void set_current(type_table_t* types);
+};
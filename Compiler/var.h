@@ -4,6 +4,8 @@
 #include <memory>
 #include <assert.h>
 #include <string>
+#include <cstdio>
+#include "out_buffer.h"
 
 using namespace std;
 
@@ -33,6 +35,7 @@ public:
 	virtual operator bool() = 0;
 	virtual void print(ostream& os) = 0;
 	virtual void asm_print(ostream& os) = 0;
+	virtual void asm_print(out_buffer_t& os) = 0;
 	virtual void full_print(ostream& os) = 0;
 	virtual bool is_null() = 0;
 };
@@ -53,6 +56,7 @@ public:
 	void print(ostream& os) override;
 	void full_print(ostream& os) override;
 	void asm_print(ostream& os) override;
+	void asm_print(out_buffer_t& os) override;
 	bool is_null() override;
 };
 
@@ -76,6 +80,11 @@ inline void var_t<T>::asm_print(ostream & os) {
 	print(os);
 }
 
+template<typename T>
+inline void var_t<T>::asm_print(out_buffer_t& os) {
+	os << val;
+}
+
 template<typename T>
 inline bool var_t<T>::is_null() {
 	return val == 0;
@@ -90,16 +99,35 @@ inline void var_t<double>::asm_print(ostream& os) {
 	os << "R8(" << scientific << val << ')';
 }
 
+template<>
+inline void var_t<double>::asm_print(out_buffer_t& os) {
+	char buf[32];
+	int len = snprintf(buf, sizeof(buf), "%e", val);
+	os << "R8(";
+	os.write(buf, len);
+	os << ')';
+}
+
 template<>
 inline void var_t<char>::asm_print(ostream& os) {
 	os << (int)val;
 }
 
+template<>
+inline void var_t<char>::asm_print(out_buffer_t& os) {
+	os << (int)val;
+}
+
 template<>
 inline void var_t<string>::asm_print(ostream& os) {
 	os << "OFFSET STR_LITERAL(\"" << val << "\")";
 }
 
+template<>
+inline void var_t<string>::asm_print(out_buffer_t& os) {
+	os << "OFFSET STR_LITERAL(\"" << val << "\")";
+}
+
 template<>
 inline void var_t<char>::full_print(ostream& os) {
 	os << '\'' << val << '\'';
@@ -0,0 +1,48 @@
+double sq(double x) {
+	return x * x;
+}
+
+double mix(int a, double x, int b, double y) {
+	return a * x - b / y;
+}
+
+int many(int a, int b, int c, int d, int e, int f, int g, int h) {
+	return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g + 8 * h;
+}
+
+double fmany(double a, double b, double c, double d, double e, double f, double g, double h, double i, double j) {
+	return a + b * 2 + c * 3 + d * 4 + e * 5 + f * 6 + g * 7 + h * 8 + i * 9 + j * 10;
+}
+
+int fact(int n) {
+	if (n < 2)
+		return 1;
+	return n * fact(n - 1);
+}
+
+int bump(int x) {
+	x = x + 5;
+	x++;
+	return x * 2;
+}
+
+int addr(int x) {
+	int* p;
+	p = &x;
+	*p = *p + 1;
+	return x;
+}
+
+int main() {
+	double x;
+	double y;
+	x = 1.5;
+	y = 4.0;
+	printf("%f %f", sq(x), mix(3, x, 2, y));
+	printf(" %d %f ", many(1, 2, 3, 4, 5, 6, 7, 8), fmany(1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0));
+	printf("%d %d %d ", fact(6), bump(3), addr(41));
+	printf("%f %f", x + sq(y) * 2.0, -sq(x - y));
+	printf(" %f", sq(sq(x) + sq(y)));
+	sq(2.0);
+	return 0;
+}
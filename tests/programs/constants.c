@@ -0,0 +1,10 @@
+double half(double x) {
+	return x * 0.5 + 0.1;
+}
+int main() {
+	char* s = "hi";
+	int n;
+	n = half(9.0) * 10;
+	printf("%s %d", s, n);
+	return 0;
+}
@@ -0,0 +1,49 @@
+struct point {
+	int x;
+	int y;
+};
+
+int table[8];
+double scale;
+char tag = 'q';
+
+int sum(int* p, int n) {
+	int i;
+	int res = 0;
+	for (i = 0; i < n; i++)
+		res += p[i];
+	return res;
+}
+
+int dist(struct point* a, struct point* b) {
+	int dx = a->x - b->x;
+	int dy = a->y - b->y;
+	return dx * dx + dy * dy;
+}
+
+int main() {
+	struct point a;
+	struct point b;
+	int i = 0;
+	int k;
+	double d;
+	scale = 2.5;
+	a.x = 1;
+	a.y = 2;
+	b.x = 4;
+	b.y = 6;
+	while (i < 8) {
+		table[i] = i * i;
+		i++;
+	}
+	do {
+		i--;
+	} while (table[i] % 2 == 0 | i == 7);
+	if (i > 5)
+		k = i;
+	else
+		k = -i;
+	d = scale * k;
+	printf("%d %d %d %c %f %d", sum(table, 8), dist(&a, &b), k, tag, d, i);
+	return 0;
+}
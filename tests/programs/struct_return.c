@@ -0,0 +1,15 @@
+struct pair { int a; int b; };
+
+struct pair mk(int a, int b) {
+	struct pair p;
+	p.a = a;
+	p.b = b * 2;
+	return p;
+}
+
+int main() {
+	struct pair r;
+	r = mk(3, 4);
+	printf("%d %d", r.a, r.b);
+	return 0;
+}
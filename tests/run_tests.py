@@ -0,0 +1,280 @@
+#!/usr/bin/env python3
+# Regression tests: every programs/*.c is compiled by each backend at every optimization level,
+# run, and its output compared with programs/*.out.
+#
+# Usage: run_tests.py <path to compiler>
+
+import os
+import platform
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+OPT_LEVELS = ['-O0', '-O1', '-O2', '-Os']
+TIMEOUT = 60
+
+here = os.path.dirname(os.path.abspath(__file__))
+failures = []
+
+
+def run(args, **kwargs):
+	return subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.PIPE, timeout=TIMEOUT, **kwargs)
+
+
+def read(path):
+	with open(path, 'rb') as f:
+		return f.read()
+
+
+def check(name, expected, actual, details=b''):
+	if actual != expected:
+		failures.append(name)
+		print('FAIL %s\n  expected: %r\n  actual:   %r\n%s' % (name, expected, actual, details.decode(errors='replace')))
+
+
+def native_x64():
+	return platform.machine().lower() in ('x86_64', 'amd64')
+
+
+def gas_x64():
+	return native_x64() and sys.platform.startswith('linux') and shutil.which('gcc')
+
+
+# Each backend compiles src with opts in tmp and returns what the program printed
+def simulator(compiler, src, tmp, opts):
+	out = os.path.join(tmp, 'sim.txt')
+	res = run([compiler, 'r', src, out] + opts)
+	return read(out), res.stderr
+
+
+def vm(compiler, src, tmp, opts):
+	out = os.path.join(tmp, 'vm.txt')
+	res = run([compiler, 'v', src, out] + opts)
+	return read(out), res.stderr
+
+
+def jit(compiler, src, tmp, opts):
+	res = run([compiler, 'run', src] + opts)
+	return res.stdout, res.stderr
+
+
+def assembly_x64(compiler, src, tmp, opts):
+	asm = os.path.join(tmp, 'x64.s')
+	exe = os.path.join(tmp, 'x64_s')
+	res = run([compiler, 'a', src, asm, '-target=x86_64-linux'] + opts)
+	link = run(['gcc', asm, '-o', exe])
+	if link.returncode:
+		return None, res.stderr + link.stderr
+	return run([exe]).stdout, b''
+
+
+def object_x64(compiler, src, tmp, opts):
+	obj = os.path.join(tmp, 'x64.o')
+	exe = os.path.join(tmp, 'x64_o')
+	res = run([compiler, 'o', src, obj] + opts)
+	link = run(['gcc', obj, '-o', exe])
+	if link.returncode:
+		return None, res.stderr + link.stderr
+	return run([exe]).stdout, b''
+
+
+# The parser takes its tokens from a lexer thread instead of lexing on demand
+def lexer_thread(compiler, src, tmp, opts):
+	return simulator(compiler, src, tmp, opts + ['-lexer-thread'])
+
+
+def backends():
+	res = [('sim', simulator, OPT_LEVELS), ('sim-lexer-thread', lexer_thread, OPT_LEVELS), ('vm', vm, [''])]
+	if native_x64():
+		res.append(('jit', jit, OPT_LEVELS))
+	if gas_x64():
+		res.append(('x64-asm', assembly_x64, OPT_LEVELS))
+		res.append(('x64-obj', object_x64, OPT_LEVELS))
+	return res
+
+
+# Backends that are also run with the per-function cache, once filling it and once reading from it
+CACHED = ['sim', 'x64-asm', 'x64-obj']
+
+
+def programs():
+	path = os.path.join(here, 'programs')
+	for name in sorted(os.listdir(path)):
+		if name.endswith('.c'):
+			src = os.path.join(path, name)
+			yield name, src, read(src[:-2] + '.out')
+
+
+def test_programs(compiler, tmp):
+	for name, src, expected in programs():
+		for backend, compile_and_run, levels in backends():
+			for level in levels:
+				opts = [level] if level else []
+				actual, details = compile_and_run(compiler, src, tmp, opts)
+				check('%s %s %s' % (name, backend, level), expected, actual, details)
+
+
+def test_cache(compiler, tmp):
+	for backend, compile_and_run, levels in backends():
+		if backend not in CACHED:
+			continue
+		for level in levels:
+			cache = os.path.join(tmp, 'cache')
+			shutil.rmtree(cache, ignore_errors=True)
+			opts = ([level] if level else []) + ['-cache=' + cache]
+			for run_name in ('cold', 'warm'):
+				for name, src, expected in programs():
+					actual, details = compile_and_run(compiler, src, tmp, opts)
+					check('%s %s %s cache %s' % (name, backend, level, run_name), expected, actual, details)
+
+
+def server_request(path, data):
+	res = b''
+	try:
+		s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+		s.settimeout(TIMEOUT)
+		s.connect(path)
+		s.sendall(data)
+		while True:
+			chunk = s.recv(1 << 16)
+			if not chunk:
+				break
+			res += chunk
+			if b'\n' in res:
+				head = res.split(b'\n', 1)
+				if len(head[1]) >= sum(int(x) for x in head[0].split()[1:]):
+					break
+		s.close()
+	except OSError:
+		pass
+	return res
+
+
+# Token streams (L) and ASTs (S) are read back wherever a source is: compiling them must give the same result
+def test_serialized(compiler, tmp):
+	for name, src, expected in programs():
+		reference = {}
+		for mode in ('a', 'r'):
+			out = os.path.join(tmp, 'text.' + mode)
+			run([compiler, mode, src, out])
+			reference[mode] = read(out)
+		for fmt in ('L', 'S'):
+			binary = os.path.join(tmp, 'program.' + fmt)
+			res = run([compiler, fmt, src, binary])
+			for mode in ('a', 'r'):
+				out = os.path.join(tmp, 'binary.' + mode)
+				run([compiler, mode, binary, out])
+				check('%s %s -> %s' % (name, fmt, mode), reference[mode], read(out), res.stderr)
+
+
+# An error in the middle of a long file stops the parser while the lexer thread is still ahead of it:
+# the same error is reported as without the thread, and the thread is shut down
+def test_lexer_thread_errors(compiler, tmp):
+	body = b''.join(b'int f%d(int a) { return a * %d + 1; }\n' % (i, i) for i in range(20000))
+	half = body.count(b'\n') // 2
+	lines = body.split(b'\n')
+	for name, error in (('syntax error', b'int broken( { }'), ('lexical error', b'int broken = 1 $ 2;')):
+		src = os.path.join(tmp, 'error.c')
+		with open(src, 'wb') as f:
+			f.write(b'\n'.join(lines[:half] + [error] + lines[half:]))
+		outputs = []
+		for opts in ([], ['-lexer-thread']):
+			out = os.path.join(tmp, 'error.s')
+			res = run([compiler, 'a', src, out] + opts)
+			outputs.append((read(out), res.returncode))
+		check('lexer thread %s' % name, outputs[0], outputs[1])
+
+
+# Must match PARALLEL_LEX_CHUNK in lexeme_analyzer.h, sources of at least two chunks are lexed in parallel
+LEX_CHUNK = 1 << 18
+LEX_LINES = [
+	b'int a%d = 0x1F + 1.5e3 * (b >> 2);',
+	b'char* s%d = "not /* a comment // either";',
+	b"char c%d = '\"'; char d = '/'; e <<= 1; p->x++; f = a && b || !c;",
+	b'// a line comment with "quotes" and /* an opener',
+	b'/* a comment that spans lines',
+	b' with "an open string and \'a char',
+	b' and // inside it */ g%d >>= 3; h -= --i;',
+]
+
+
+# Plenty of comments spanning lines, so some of them cover every place where a chunk could start
+def big_source(errors):
+	lines = []
+	size = 0
+	while size < 5 * LEX_CHUNK:
+		line = LEX_LINES[len(lines) % len(LEX_LINES)]
+		line = line % len(lines) if b'%d' in line else line
+		if len(lines) in errors:
+			line += b' $ "unterminated'
+		lines.append(line)
+		size += len(line) + 1
+	return b'\n'.join(lines) + b'\n'
+
+
+# Chunk boundaries must be invisible: tokens, error messages and their positions are the same as with one thread
+def test_parallel_lex(compiler, tmp):
+	for name, errors in (('no errors', ()), ('late error', (20000,)), ('two errors', (9002, 24003))):
+		src = os.path.join(tmp, 'big.c')
+		with open(src, 'wb') as f:
+			f.write(big_source(errors))
+		outputs = []
+		for jobs in ('-j1', '-j8'):
+			out = os.path.join(tmp, 'big%s.txt' % jobs)
+			run([compiler, 'l', src, out, jobs])
+			outputs.append(read(out))
+		first, second = outputs[0].split(b'\n'), outputs[1].split(b'\n')
+		diff = [i for i in range(min(len(first), len(second))) if first[i] != second[i]]
+		line = diff[0] if diff else min(len(first), len(second))
+		check('parallel lex %s' % name, first[line:line + 1], second[line:line + 1], b'  at output line %d\n' % (line + 1))
+
+
+# A client must not be able to take the server down, the next client still gets an answer
+def test_server(compiler, tmp):
+	if not hasattr(socket, 'AF_UNIX') or sys.platform.startswith('win'):
+		return
+	path = os.path.join(tmp, 'server.sock')
+	server = subprocess.Popen([compiler, 'server', path], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+	try:
+		for _ in range(100):
+			if os.path.exists(path):
+				break
+			time.sleep(0.05)
+		check('server oversized header', True, server_request(path, b'r\n18446744073709551615\n').startswith(b'error'))
+		source = b'int main() { printf("%d", 6 * 7); return 0; }'
+		res = server_request(path, b'r\n%d\n%s' % (len(source), source))
+		check('server after oversized header', b'42', res.split(b'\n', 1)[-1][:2], res)
+		res = server_request(path, b'r -ftime-report\n%d\n%s' % (len(source), source))
+		check('server time report without tracking', True, res.startswith(b'error'), res)
+		source = b'int main() { while (1) {} return 0; }'
+		res = server_request(path, b'r -max-steps=1000000000000 -j100000\n%d\n%s' % (len(source), source))
+		check('server step limit', True, b'Step limit of 100000000 ' in res, res)
+	finally:
+		server.kill()
+		server.wait()
+
+
+def main():
+	if len(sys.argv) != 2:
+		print('Usage: run_tests.py <path to compiler>')
+		return 2
+	compiler = os.path.abspath(sys.argv[1])
+	tmp = tempfile.mkdtemp()
+	try:
+		test_programs(compiler, tmp)
+		test_cache(compiler, tmp)
+		test_serialized(compiler, tmp)
+		test_parallel_lex(compiler, tmp)
+		test_lexer_thread_errors(compiler, tmp)
+		test_server(compiler, tmp)
+	finally:
+		shutil.rmtree(tmp, ignore_errors=True)
+	print('%d failed' % len(failures) if failures else 'All tests passed')
+	return 1 if failures else 0
+
+
+if __name__ == '__main__':
+	sys.exit(main())